@@ -14,9 +14,59 @@ constexpr uint16_t CC6920BSO5A_ADC_TICKS_PER_AMP = 340;
 // value is correct.
 constexpr uint16_t TMCS1108A4B_ADC_TICKS_PER_AMP = 496;
 
-// How many time the pair of channels is sampled per second.
-// This time ticks are used as the data time base.
-constexpr uint32_t kTimeTicksPerSec = 40000;
+// A current sensor type.
+struct SensorProfile {
+  const char* name;
+  uint16_t adc_ticks_per_amp;
+};
+
+// The supported sensor types. The default profile of a device is
+// determined by its hardware config. Can be overridden at runtime, e.g.
+// for sensors that are assembled in a different hardware config. The
+// analyzer takes the ADC ticks per amp as a runtime parameter, so a
+// profile can be added or re-measured here alone.
+constexpr SensorProfile kSensorProfiles[] = {
+    {"CC6920BSO5A", CC6920BSO5A_ADC_TICKS_PER_AMP},
+    {"TMCS1108A4B", TMCS1108A4B_ADC_TICKS_PER_AMP},
+};
+
+constexpr uint8_t kNumSensorProfiles =
+    sizeof(kSensorProfiles) / sizeof(kSensorProfiles[0]);
+
+// The analyzer rejects a zero scale, see analyzer::setup().
+constexpr bool are_sensor_profiles_valid() {
+  for (const SensorProfile& profile : kSensorProfiles) {
+    if (!profile.adc_ticks_per_amp) {
+      return false;
+    }
+  }
+  return true;
+}
+static_assert(are_sensor_profiles_valid());
+
+// Per channel gain calibration, in fixed point with this number of
+// fraction bits. Compensates for the gain differences of the two
+// sensors of a motor, which skew the quadrant sector boundaries.
+constexpr int kGainFractionBits = 12;
+constexpr uint16_t kUnityGain = 1 << kGainFractionBits;
+// Allowed gain range, [0.5, 2.0].
+constexpr uint16_t kMinGain = kUnityGain / 2;
+constexpr uint16_t kMaxGain = kUnityGain * 2;
+
+// Number of monitored motors. Each motor has a pair of current
+// sensors, sampled by a pair of ADC1 channels. See adc_task.cpp
+// for the channel assignment. Set with a build flag, e.g.
+// -DANALYZER_NUM_MOTORS=3.
+#ifndef ANALYZER_NUM_MOTORS
+#define ANALYZER_NUM_MOTORS 1
+#endif
+constexpr uint8_t kNumMotors = ANALYZER_NUM_MOTORS;
+static_assert(kNumMotors >= 1 && kNumMotors <= 3, "Unsupported motors count");
+
+// How many time the pair of channels of each motor is sampled per
+// second. This time ticks are used as the data time base. The motors
+// share the ADC conversions rate.
+constexpr uint32_t kTimeTicksPerSec = 40000 / kNumMotors;
 
 // Number of histogram buckets, each bucket represents
 // a band of step speeds.
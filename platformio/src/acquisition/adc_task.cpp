@@ -4,9 +4,11 @@
 
 #include <stdio.h>
 
+#include "acq_consts.h"
 #include "analyzer_private.h"
 #include "esp_adc/adc_continuous.h"
 #include "esp_assert.h"
+#include "esp_attr.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
@@ -19,11 +21,25 @@ namespace adc_task {
 
 static constexpr auto TAG = "adc_task";
 
+using acq_consts::kNumMotors;
+
 constexpr uint32_t kBytesPerValue = sizeof(adc_digi_output_data_t);
-constexpr uint32_t kValuePairsPerBuffer = 50;
+// Pairs of values per buffer, of all motors together.
+constexpr uint32_t kValuePairsPerBuffer = 50 * kNumMotors;
 constexpr uint32_t kValuesPerBuffer = 2 * kValuePairsPerBuffer;
 constexpr uint32_t kBytesPerBuffer = kValuesPerBuffer * kBytesPerValue;
-constexpr uint32_t kNumBuffers = 2000 / kValuePairsPerBuffer;
+// 100ms of samples. The ADC ISR is IRAM safe and keeps filling the
+// buffers while a flash erase of the offline recording disables the
+// cache and stalls this task. A sector erase typically takes 45ms but
+// up to 400ms per the flash datasheets, and the 64KB of buffers that
+// would cover that don't fit the DRAM along with the BLE stack, so a
+// rare slow erase overflows the pool. The ISR then drops conversions,
+// which the analyzer sees as a signal gap, and counts them in
+// pool_overflows. See recorder::Status::max_erase_millis.
+constexpr uint32_t kNumBuffers = 4000 / kValuePairsPerBuffer;
+
+// The rate of the analyzer state snapshots.
+constexpr uint32_t kSnapshotsPerSec = 50;
 
 #if !CONFIG_IDF_TARGET_ESP32
 #error "Unexpected target CPU."
@@ -36,29 +52,32 @@ static adc_continuous_handle_cfg_t continious_config = {
 
 static adc_continuous_handle_t handle = nullptr;
 
-// TODO: Ok to have only two entries in this array instead
-// of SOC_ADC_PATT_LEN_MAX?
-static adc_digi_pattern_config_t adc_pattern[] = {
-    {
-        .atten = ADC_ATTEN_DB_11,
-        .channel = 6,
-        .unit = 0,  /// ADC_UNIT_1,
-        .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH,
-    },
-    {
-        .atten = ADC_ATTEN_DB_11,
-        .channel = 7,
-        .unit = 0,  // ADC_UNIT_1,
-        .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH,
-    },
+// The ADC1 channels of the (v1, v2) current sensors of each motor.
+// Motor 0 is the original single motor pair.
+static constexpr uint8_t kMotorChannels[3][2] = {{6, 7}, {4, 5}, {0, 3}};
+
+// Number of ADC1 channels.
+constexpr uint8_t kNumAdcChannels = 8;
+
+// Maps an ADC1 channel to its motor and coil. Motor is -1 for
+// unused channels. Coil is 0 for v1 and 1 for v2.
+struct ChannelMapping {
+  int8_t motor;
+  uint8_t coil;
 };
 
+static ChannelMapping channel_mappings[kNumAdcChannels];
+
+// TODO: Ok to have only 2 x kNumMotors entries in this array instead
+// of SOC_ADC_PATT_LEN_MAX?
+static adc_digi_pattern_config_t adc_pattern[2 * kNumMotors] = {};
+
 static const adc_continuous_config_t dig_cfg = {
 
-    .pattern_num = 2,
+    .pattern_num = 2 * kNumMotors,
     .adc_pattern = adc_pattern,
 
-    // 40k sample pairs per sec.
+    // 40k sample pairs per sec, shared by the motors.
     // ESP32 range is 611Hz ~ 83333Hz
     .sample_freq_hz = 80 * 1000,
     .conv_mode = ADC_CONV_SINGLE_UNIT_1,
@@ -68,49 +87,94 @@ static const adc_continuous_config_t dig_cfg = {
 static uint8_t buffer_bytes[kBytesPerBuffer] = {0};
 
 struct AdcTaskStats {
-  uint64_t good_67_pairs;
-  uint64_t good_76_pairs;
-  uint32_t bad_pairs;
+  // Pairs that arrived in v1, v2 order and in the swapped v2, v1 order.
+  uint64_t good_pairs;
+  uint64_t good_swapped_pairs;
+  uint32_t bad_values;
+  // Times the ISR found the pool full and dropped conversions.
+  uint32_t pool_overflows;
 };
 
 static SemaphoreHandle_t stats_mutex;
 static AdcTaskStats stats = {};
 
+// Updated by the ADC ISR, outside of the stats mutex. In DRAM, such that
+// it's accessible while the flash cache is disabled.
+static volatile uint32_t isr_pool_overflows = 0;
+
+// Called by the ADC ISR, also while the flash cache is disabled, thus
+// in IRAM.
+static bool IRAM_ATTR on_pool_ovf(adc_continuous_handle_t handle,
+    const adc_continuous_evt_data_t* edata, void* user_data) {
+  isr_pool_overflows = isr_pool_overflows + 1;
+  // No task was woken.
+  return false;
+}
+
 void dump_stats() {
   AdcTaskStats snapshot;
   xSemaphoreTake(stats_mutex, portMAX_DELAY);
   { snapshot = stats; }
   xSemaphoreGive(stats_mutex);
-  ESP_LOGI(TAG, "bad: %lu, good: %llu, good_swap: %llu", snapshot.bad_pairs,
-      stats.good_67_pairs, stats.good_76_pairs);
+  snapshot.pool_overflows = isr_pool_overflows;
+  ESP_LOGI(TAG, "bad: %lu, good: %llu, good_swap: %llu, pool_ovf: %lu",
+      snapshot.bad_values, snapshot.good_pairs, snapshot.good_swapped_pairs,
+      snapshot.pool_overflows);
 }
 
-// Accepts a pair of samples, sort them to v1 and v2 and return true,
-// or returns false, if can't.
-// Called within stats mutex.
-inline bool mutex_condition_sample_pair(const adc_digi_output_data_t& data1,
-    const adc_digi_output_data_t& data2, uint16_t* v1, uint16_t* v2) {
-  if (data1.type1.channel == 6 && data2.type1.channel == 7) {
-    *v1 = data1.type1.data;
-    *v2 = data2.type1.data;
-    stats.good_67_pairs++;
-    return true;
-  }
+// The value of each motor that waits for the other coil of its
+// conversion. The DMA may deliver the two coils of a motor in either
+// order, so whichever arrives first waits, also across buffers.
+struct PendingValue {
+  bool is_valid;
+  uint8_t coil;
+  uint16_t value;
+};
 
-  if (data1.type1.channel == 7 && data2.type1.channel == 6) {
-    *v1 = data2.type1.data;
-    *v2 = data1.type1.data;
-    stats.good_76_pairs++;
-    return true;
+static PendingValue pending_values[kNumMotors] = {};
+
+// Accepts the next ADC value. Processes a motor sample when the pair
+// of the motor is completed, in either coils order. A value whose
+// other coil was lost is dropped. Called within stats and analyzer
+// mutexes.
+static inline void mutex_condition_value(const adc_digi_output_data_t& data) {
+  const uint8_t channel = data.type1.channel;
+  const ChannelMapping mapping =
+      (channel < kNumAdcChannels) ? channel_mappings[channel]
+                                  : ChannelMapping{-1, 0};
+  if (mapping.motor < 0) {
+    stats.bad_values++;
+    return;
+  }
+  PendingValue& pending = pending_values[mapping.motor];
+  if (!pending.is_valid) {
+    pending = {true, mapping.coil, data.type1.data};
+    return;
+  }
+  if (pending.coil == mapping.coil) {
+    // The other coil of the pending value was lost. Wait with this one.
+    stats.bad_values++;
+    pending.value = data.type1.data;
+    return;
+  }
+  pending.is_valid = false;
+  if (mapping.coil == 1) {
+    stats.good_pairs++;
+    analyzer::isr_handle_one_sample(
+        mapping.motor, pending.value, data.type1.data);
+  } else {
+    stats.good_swapped_pairs++;
+    analyzer::isr_handle_one_sample(
+        mapping.motor, data.type1.data, pending.value);
   }
-
-  stats.bad_pairs++;
-  return false;
 }
 
 void adc_task(void* ignored) {
   uint32_t buffers_count = 0;
-  uint32_t samples_to_snapshot = 0;
+  // Per motor samples times the snapshot rate, since the last snapshot.
+  // Kept scaled since the per motor snapshot period is not an integer
+  // for some motors counts.
+  uint32_t scaled_samples_since_snapshot = 0;
 
   for (;;) {
     // TEST1 pin is high during processing and low during waiting for new
@@ -132,26 +196,22 @@ void adc_task(void* ignored) {
 
     buffers_count++;
 
-    // We expect the buffer to have the same order of pairs.
+    // We expect the buffer to have the pattern order of values.
     analyzer::enter_mutex();
     xSemaphoreTake(stats_mutex, portMAX_DELAY);
     {
-      for (int i = 0; i < kValuesPerBuffer; i += 2) {
-        uint16_t v1;
-        uint16_t v2;
-        if (!mutex_condition_sample_pair(
-                buffer_values[i], buffer_values[i + 1], &v1, &v2)) {
-          // Bad pair. Skip.
-          continue;
-        }
-        analyzer::isr_handle_one_sample(v1, v2);
+      for (int i = 0; i < kValuesPerBuffer; i++) {
+        mutex_condition_value(buffer_values[i]);
       }
     }
 
-    samples_to_snapshot += kValuePairsPerBuffer;
-    if (samples_to_snapshot >= 800) {
+    // Snapshot at 50Hz. Counting the samples of each motor, and
+    // carrying the remainder so the average rate is exact.
+    scaled_samples_since_snapshot +=
+        (kValuePairsPerBuffer / kNumMotors) * kSnapshotsPerSec;
+    if (scaled_samples_since_snapshot >= acq_consts::kTimeTicksPerSec) {
       analyzer::isr_snapshot_state();
-      samples_to_snapshot = 0;
+      scaled_samples_since_snapshot -= acq_consts::kTimeTicksPerSec;
     }
     xSemaphoreGive(stats_mutex);
     analyzer::exit_mutex();
@@ -162,8 +222,32 @@ void setup() {
   stats_mutex = xSemaphoreCreateMutex();
   assert(stats_mutex);
 
+  // Construct the ADC pattern and the reverse mapping from the motors
+  // channels.
+  for (uint8_t i = 0; i < kNumAdcChannels; i++) {
+    channel_mappings[i] = {-1, 0};
+  }
+  for (uint8_t motor = 0; motor < kNumMotors; motor++) {
+    for (uint8_t coil = 0; coil < 2; coil++) {
+      const uint8_t channel = kMotorChannels[motor][coil];
+      adc_pattern[2 * motor + coil] = {
+          .atten = ADC_ATTEN_DB_11,
+          .channel = channel,
+          .unit = 0,  // ADC_UNIT_1,
+          .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH,
+      };
+      channel_mappings[channel] = {(int8_t)motor, coil};
+    }
+  }
+
   ESP_ERROR_CHECK(adc_continuous_new_handle(&continious_config, &handle));
   ESP_ERROR_CHECK(adc_continuous_config(handle, &dig_cfg));
+  const adc_continuous_evt_cbs_t callbacks = {
+      .on_conv_done = nullptr,
+      .on_pool_ovf = on_pool_ovf,
+  };
+  ESP_ERROR_CHECK(
+      adc_continuous_register_event_callbacks(handle, &callbacks, nullptr));
   ESP_ERROR_CHECK(adc_continuous_start(handle));
 
   TaskHandle_t xHandle = NULL;
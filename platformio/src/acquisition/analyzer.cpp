@@ -12,6 +12,7 @@
 #include <stdlib.h>
 
 #include "analyzer_private.h"
+#include "current_magnitude.h"
 #include "esp_log.h"
 #include "filters.h"
 #include "freertos/FreeRTOS.h"
@@ -33,27 +34,82 @@ static SemaphoreHandle_t data_mutex;
 void enter_mutex() { ENTER_MUTEX }
 void exit_mutex() { EXIT_MUTEX }
 
-// Circular buffer of states. Used for state notifications.
-// With 20ms per sample, 10 entires provides 200ms buffering.
-static CircularBuffer<State, 10> state_circular_buffer;
+using acq_consts::kNumMotors;
 
-// We signal this one each time we insert an item to state_circular_buffer.
+// Circular buffers of states, one per motor. Used for state
+// notifications. With 20ms per sample, 10 entires provides 200ms
+// buffering.
+typedef CircularBuffer<State, 10> StateCircularBuffer;
+static StateCircularBuffer state_circular_buffers[kNumMotors];
+
+// Anomaly events of all motors, for notifications. Events are rare so a
+// small buffer suffices.
+typedef CircularBuffer<AnomalyEvent, 16> AnomalyCircularBuffer;
+static AnomalyCircularBuffer anomaly_circular_buffer;
+
+// The position stream items of the capture motor.
+typedef CircularBuffer<PositionStreamItem, kPositionStreamBufferSize>
+    PositionStreamCircularBuffer;
+static PositionStreamCircularBuffer position_stream_buffer;
+
+// Per motor latest retraction episodes. Read as a snapshot, never
+// popped.
+typedef CircularBuffer<RetractionEvent, kRetractionEventsSize>
+    RetractionEventsCircularBuffer;
+
+// Per motor records of invalid quadrant transitions. Read as a snapshot,
+// never popped.
+typedef CircularBuffer<QuadratureErrorRecord, kQuadratureErrorRecords>
+    QuadratureErrorCircularBuffer;
+
+// Per motor completed rollups of a tier. Read as a snapshot, never
+// popped.
+typedef CircularBuffer<Rollup, kRollupsPerTier> RollupsCircularBuffer;
+
+// We signal this one each time we insert an item to one of
+// state_circular_buffers.
 static SemaphoreHandle_t circular_state_semaphore;
 
 // static K_SEM_DEFINE(circular_state_semaphore, 0, 1);
 
 // Energized/non-energized histeresis limits in ADC
-// counts.
-//
-// TODO: specify here what the limits are as a percentage
-// of full current scale.
+// counts of the CC6920BSO5A sensor, about 0.15A and 0.44A.
+// The other sensors switch at the same currents, see
+// scale_threshold(). These are the initial limits, they are
+// adapted to the measured noise floor within the min/max
+// non energized limits, keeping the energized limit at
+// kEnergizedThresholdRatio times the non energized one.
 constexpr uint16_t kNonEnergizedThresholdCounts = 50;
 constexpr uint16_t kEnergizedThresholdCounts = 150;
+constexpr uint16_t kMinNonEnergizedThresholdCounts = 12;
+constexpr uint16_t kMaxNonEnergizedThresholdCounts = 100;
+constexpr uint16_t kEnergizedThresholdRatio = 3;
+constexpr uint16_t kThresholdsAdcTicksPerAmp =
+    acq_consts::CC6920BSO5A_ADC_TICKS_PER_AMP;
+
+// The adapted non energized limit is this multiple of the noise
+// floor, plus the residual zero offsets. See isr_update_thresholds().
+constexpr uint32_t kNoiseThresholdFactor = 4;
+
+// Scales a threshold from the CC6920BSO5A sensor to a sensor with the
+// given ADC ticks per amp.
+constexpr uint16_t scale_threshold(uint16_t counts, uint16_t ticks_per_amp) {
+  return (uint32_t)counts * ticks_per_amp / kThresholdsAdcTicksPerAmp;
+}
 
-// Controls the low pass filter. See filters.h for details.
-// Higher value -> more agressive filtering. In the range
-// (0, 1024).
-constexpr uint16_t kFilterFactor = 700;
+// The optional stages of the per sample pipeline. Each instance of
+// isr_process_sample() has a mask of the stages it includes, the other
+// stages are compiled out. The instance is switched as the stages are
+// enabled and disabled, see mutex_update_sample_handler().
+enum PipelineStageBits : uint8_t {
+  // The capture motor position stream. See set_position_stream_rate().
+  STAGE_POSITION_STREAM = 0x01,
+  // The capture motor resonance monitoring. See set_resonance_bands().
+  STAGE_RESONANCE = 0x02,
+  // Flagging the events of the event capture triggers. See
+  // set_capture_trigger().
+  STAGE_EVENT_TRIGGERS = 0x04,
+};
 
 // Allowed range for adc zero current offset setting.
 // This range is wider than needed and actual offsets
@@ -65,37 +121,232 @@ constexpr int kMaxOffset = 4095;  // 12 bits max
 constexpr uint16_t kStepsCaptureDivider =
     acq_consts::kTimeTicksPerSec / kStepsCaptursPerSec;
 
+// Zero offsets drift tracking. While a motor is non energized, its
+// readings are averaged over windows of kDriftWindowSamples and the
+// offsets are nudged by one count toward zero average. The first
+// kDriftSettleSamples after becoming non energized are ignored to skip
+// the current decay. Averages above kMaxDriftErrorCounts are assumed to
+// be an actual current, and the total correction since the last zero
+// calibration is limited to kMaxDriftCorrectionCounts.
+constexpr int32_t kDriftSettleSamples = acq_consts::kTimeTicksPerSec / 10;
+constexpr int32_t kDriftWindowSamples = 4096;
+constexpr int32_t kMaxDriftErrorCounts = 20;
+constexpr int16_t kMaxDriftCorrectionCounts = 50;
+
+// Steps longer than this are not considered part of a move, for the step
+// period jump detection, such that pauses and move starts are not
+// reported. Same as the histogram's 10 steps/sec.
+constexpr uint32_t kAnomalyMaxMoveStepTicks = acq_consts::kTimeTicksPerSec / 10;
+
+// Gains of the velocity and acceleration alpha-beta tracker, as right
+// shifts of the step rate residual, alpha = 1/4 and beta = 1/32. Close
+// to critical damping, with a response time of a few steps.
+constexpr uint8_t kMotionAlphaBits = 2;
+constexpr uint8_t kMotionBetaBits = 5;
+
+// The window of the reversals rate.
+constexpr uint32_t kReversalRateWindowTicks =
+    60 * acq_consts::kTimeTicksPerSec;
+
+// Resonance monitoring. The Goertzel blocks are one state interval of
+// decimated samples, such that the band amplitudes refresh at the state
+// rate.
+constexpr uint32_t kResonanceSampleRate =
+    acq_consts::kTimeTicksPerSec / kResonanceDecimation;
+constexpr uint16_t kResonanceBlockSize = kResonanceSampleRate / 50;
+constexpr uint8_t kResonanceCoeffBits = 14;
+
 enum AdcCaptureState {
-  // Blind filling half of the capture buffer. In this state we don't
-  // look for a trigger because we want to have at least half a buffer
-  // captured before the trigger.
-  ADC_CAPTURE_HALF_FILL,
+  // Blind filling the pre trigger part of the capture buffer. In this
+  // state we don't look for a trigger because we want to have the
+  // pre trigger items captured before the trigger.
+  ADC_CAPTURE_PRE_FILL,
   // Keep filling in a circular way until a trigger event
   // or wait for trigger timeout.
   ADC_CAPTURE_PRE_TRIGGER,
   // Keep filling the buffer until the capture buffer is full.
   // When we complete this state, we clear the buffer and go back
-  // to go back to ADC_CAPTURE_HALF_FILL.
+  // to go back to ADC_CAPTURE_PRE_FILL.
   ADC_CAPTURE_POST_TRIGER,
   // Not capturing. ISR is guaranteed not to update or access the
   // capture buffer.
 };
 
-// This data is accessed from interrupt and thus should
-// be access from main() with IRQ disabled.
-struct IsrData {
+// Analyzer events that can trigger a signal capture. The decoder
+// sets these bits as events happen and the capture logic consumes
+// them on the next captured sample.
+enum CaptureEventBits : uint8_t {
+  CAPTURE_EVENT_QUADRATURE_ERROR = 0x01,
+  CAPTURE_EVENT_DIRECTION_REVERSAL = 0x02,
+  CAPTURE_EVENT_ENERGIZED = 0x04,
+  CAPTURE_EVENT_NON_ENERGIZED = 0x08,
+  CAPTURE_EVENT_STEP_PERIOD = 0x10,
+};
+
+// Maps CaptureTriggerMode to the event bits it triggers on. Zero
+// for the level trigger.
+static constexpr uint8_t kCaptureTriggerEventMasks[TRIGGER_MODES_COUNT] = {
+    0,  // TRIGGER_LEVEL
+    CAPTURE_EVENT_QUADRATURE_ERROR,  // TRIGGER_QUADRATURE_ERROR
+    CAPTURE_EVENT_DIRECTION_REVERSAL,  // TRIGGER_DIRECTION_REVERSAL
+    CAPTURE_EVENT_ENERGIZED,  // TRIGGER_ENERGIZED
+    CAPTURE_EVENT_NON_ENERGIZED,  // TRIGGER_NON_ENERGIZED
+    CAPTURE_EVENT_STEP_PERIOD,  // TRIGGER_STEP_PERIOD
+};
+
+// The aggregates of a rollup period in progress. The mean squared
+// current is computed when the period completes.
+struct OpenRollup {
+  Rollup rollup;
+  // Ticks of the period so far, and the total squared currents of both
+  // coils over them.
+  uint32_t ticks;
+  uint64_t sq_currents;
+};
+
+// The data of the motors. Part of IsrData. Each field is an array
+// indexed by the motor, such that the pipeline code indexes a field
+// with the motor rather than following a per motor base pointer, and
+// the same field of all motors is contiguous.
+struct MotorsData {
   // The acquisition state visible to users.
-  State state;
+  State state[kNumMotors];
 
   // The histogram buffer. Visible to users.
-  Histogram histogram;
+  Histogram histogram[kNumMotors];
 
   // Offset settings. See analyzer::Settings.
-  int16_t offset1;
-  int16_t offset2;
+  int16_t offset1[kNumMotors];
+  int16_t offset2[kNumMotors];
+
+  // Gain settings. See acq_consts::kUnityGain.
+  uint16_t gain1[kNumMotors];
+  uint16_t gain2[kNumMotors];
+
+  // We use these filters to reduce internal and external noise. The
+  // filter kernel is selected with set_signal_filter(), FILTER_BYPASS
+  // if free CPU time is insufficient.
+  filters::AdcFilterState signal1_filter[kNumMotors];
+  filters::AdcFilterState signal2_filter[kNumMotors];
+
+  // CaptureEventBits of events that happened since the last captured
+  // sample. Consumed only for the capture motor.
+  uint8_t capture_events[kNumMotors];
+
+  // Members for capturing step counter at fixed intervals for notification
+  // to the BLE client.
+  //
+  // The steps capture circula buffer.
+  StepsCaptureBuffer steps_capture_buffer[kNumMotors];
+  // Adc tick counter counter/divider. Use to sample the steps
+  // count only every kStepsCaptureDivider adc ticks.
+  uint16_t steps_capture_divider_counter[kNumMotors];
+
+  // Zero offsets drift tracking. See kDriftWindowSamples.
+  int32_t drift_sum1[kNumMotors];
+  int32_t drift_sum2[kNumMotors];
+  // Samples in the current window. Negative while settling.
+  int32_t drift_count[kNumMotors];
+  // Total corrections since the last zero calibration.
+  int16_t drift_correction1[kNumMotors];
+  int16_t drift_correction2[kNumMotors];
+  // Set when the offsets were corrected. See take_offsets_drifted().
+  bool offsets_drifted[kNumMotors];
+  // Channel averages of the last drift window. The centers of the
+  // noise deviations.
+  int16_t drift_mean1[kNumMotors];
+  int16_t drift_mean2[kNumMotors];
+
+  // Noise floor tracking. Sum of the absolute deviations in the
+  // current drift window, and the smoothed mean absolute deviation
+  // of |v1| + |v2| in counts with 4 fraction bits. Zero if not
+  // measured yet.
+  uint32_t noise_sum[kNumMotors];
+  uint16_t noise_floor[kNumMotors];
+
+  // Energized detection hysteresis limits in ADC counts. Adapted to
+  // the noise floor.
+  uint16_t non_energized_threshold[kNumMotors];
+  uint16_t energized_threshold[kNumMotors];
+
+  // Squared coil currents of the samples of the current step, in ADC
+  // counts squared. Added to the histogram and to the energy totals
+  // when the step ends.
+  uint64_t step_sq_currents1[kNumMotors];
+  uint64_t step_sq_currents2[kNumMotors];
+  // Squared coil currents of the completed steps since the last data
+  // reset. See EnergyStats.
+  uint64_t total_sq_currents1[kNumMotors];
+  uint64_t total_sq_currents2[kNumMotors];
+  // Tick count of the last data reset.
+  uint64_t energy_start_tick[kNumMotors];
+
+  // Missed step detection. Period of the last step if it was entered
+  // and exited in the same direction, otherwise zero.
+  uint32_t anomaly_last_step_ticks[kNumMotors];
+  // A bit per each of the last 8 steps, set if it reversed the
+  // direction, and the number of set bits.
+  uint8_t anomaly_reversal_bits[kNumMotors];
+  uint8_t anomaly_reversals[kNumMotors];
+  // Highest step peak current of the move so far, zero if not in a
+  // move. See ANOMALY_CURRENT_LAG.
+  uint32_t anomaly_move_peak_current[kNumMotors];
+  // Anomalies since the last data reset.
+  uint32_t anomaly_count[kNumMotors];
+
+  // Invalid quadrant transitions since the last data reset, by
+  // QuadratureErrorClass, and the newest of them.
+  uint32_t quadrature_error_counts[kNumMotors][QUADRATURE_ERROR_CLASSES_COUNT];
+  QuadratureErrorCircularBuffer quadrature_error_records[kNumMotors];
+
+  // The open retraction episode. Its deepest retraction in full steps,
+  // zero if no episode is open, and the tick counts of its first
+  // retraction step, of its deepest step and of its first unretraction
+  // step, zero if the unretraction didn't start.
+  int retraction_peak_steps[kNumMotors];
+  uint64_t retraction_start_tick[kNumMotors];
+  uint64_t retraction_peak_tick[kNumMotors];
+  uint64_t unretraction_start_tick[kNumMotors];
+  // Completed retraction episodes since the last data reset.
+  RetractionBucket retraction_buckets[kNumMotors][kNumRetractionBuckets];
+  RetractionEventsCircularBuffer retraction_events[kNumMotors];
+
+  // Direction reversals since the last data reset. See ReversalStats.
+  uint32_t forward_reversals[kNumMotors];
+  uint32_t backward_reversals[kNumMotors];
+  uint32_t reversal_dwell_buckets[kNumMotors][kNumReversalDwellBuckets];
+  // Reversals rate tracking. The start of the current window, and the
+  // reversals of the current and the previous windows. Windows are
+  // advanced lazily, on reversals.
+  uint64_t reversal_window_start_tick[kNumMotors];
+  uint32_t reversal_window_count[kNumMotors];
+  uint32_t reversal_last_window_count[kNumMotors];
+
+  // Total ticks in moves since the last data reset, by acceleration.
+  // See MotionStats.
+  uint64_t acceleration_ticks[kNumMotors][kNumAccelerationBuckets];
+
+  // Rollups. The cumulative values at the last state snapshot, and the
+  // periods in progress and the completed periods of each tier.
+  uint64_t rollup_last_tick[kNumMotors];
+  int rollup_last_full_steps[kNumMotors];
+  uint32_t rollup_last_quadrature_errors[kNumMotors];
+  uint64_t rollup_last_sq_currents[kNumMotors];
+  OpenRollup open_rollups[kNumMotors][ROLLUP_TIERS_COUNT];
+  RollupsCircularBuffer rollups[kNumMotors][ROLLUP_TIERS_COUNT];
+};
+
+// This data is accessed from interrupt and thus should
+// be access from main() with IRQ disabled.
+struct IsrData {
+  MotorsData motors;
 
   // Signal capturing.
   //
+  // The motor whose signals are captured by the signal and long
+  // record captures.
+  uint8_t capture_motor;
+  //
   // Capturing state.
   AdcCaptureState adc_capture_state;
   // Time out for waiting for trigger in divided ADC ticks.
@@ -105,6 +356,44 @@ struct IsrData {
   uint8_t adc_capture_divider;
   // Up counter for capturing only every n'th samples.
   uint8_t adc_capture_divider_counter;
+  // How the captured samples are reduced by adc_capture_divider.
+  CaptureDecimation adc_capture_decimation;
+  // Per channel decimator accumulators, used with boxcar and CIC
+  // decimation.
+  filters::CicDecimator adc_capture_decimator1;
+  filters::CicDecimator adc_capture_decimator2;
+  // Number of decimated outputs to drop while the decimators settle.
+  uint8_t adc_capture_decimator_skip;
+  // Number of active zoom out lanes.
+  uint8_t adc_capture_zoom_lanes;
+  // Cascaded zoom lanes decimation. A lane counter advances only when
+  // the previous lane outputs an item, so most captured items cost a
+  // single counter update.
+  uint8_t adc_capture_zoom_counters[kAdcCaptureMaxZoomLanes];
+  int32_t adc_capture_zoom_sums1[kAdcCaptureMaxZoomLanes];
+  int32_t adc_capture_zoom_sums2[kAdcCaptureMaxZoomLanes];
+  // The capture trigger settings.
+  CaptureTriggerSettings adc_capture_trigger;
+  // Event bits of adc_capture_trigger.mode. Zero for level trigger.
+  uint8_t adc_capture_trigger_event_mask;
+  // Level trigger values, precomputed from adc_capture_trigger such
+  // that the per sample check is a couple of integer ops. Falling
+  // slope is handled by negating the channel value.
+  bool adc_capture_trigger_negate;
+  int32_t adc_capture_trigger_arm_level;
+  int32_t adc_capture_trigger_fire_level;
+  // True if the level trigger saw the channel beyond the hysteresis
+  // band and is ready to fire.
+  bool adc_capture_trigger_armed;
+  // Number of items to keep before the trigger. In [1, buffer size].
+  uint16_t adc_capture_pre_trigger_items;
+  // The coil current metric of the histograms and the magnitude
+  // trigger.
+  CurrentMetric current_metric;
+  // The bounds of the adapted non energized limits, scaled to the
+  // sensor. See isr_update_thresholds().
+  uint16_t min_non_energized_threshold;
+  uint16_t max_non_energized_threshold;
   // The ADC capture buffer. Updated by ISR when state != CAPTURE_IDLE
   // and accessible by the UI (ready only) when state = CAPTURE_IDLE.
   AdcCaptureBuffer adc_capture_buffer;
@@ -112,22 +401,123 @@ struct IsrData {
   // it in this buffer, and start from scratch.
   AdcCaptureBuffer adc_capture_buffer_snapshot;
 
-  // Members for capturing step counter at fixed intervals for notification
-  // to the BLE client.
-  //
-  // The steps capture circula buffer.
-  StepsCaptureBuffer steps_capture_buffer;
-  // Adc tick counter counter/divider. Use to sample the steps
-  // count only every kStepsCaptureDivider adc ticks.
-  uint16_t steps_capture_divider_counter;
+  // Long record capture. The ring is updated by the ISR only while
+  // armed and not frozen.
+  LongCaptureStatus long_capture_status;
+  // Up counter for capturing only every n'th samples.
+  uint8_t long_capture_divider_counter;
+  // Number of items to keep before the trigger.
+  uint16_t long_capture_pre_trigger_items;
+
+  // Resonance monitoring of the capture motor. See
+  // set_resonance_bands().
+  uint8_t resonance_num_bands;
+  uint16_t resonance_frequencies[kMaxResonanceBands];
+  // Goertzel coefficients 2*cos(w) with kResonanceCoeffBits fraction
+  // bits.
+  int32_t resonance_coeffs[kMaxResonanceBands];
+  // Boxcar decimation. The sums are the Goertzel input.
+  uint8_t resonance_decimation_counter;
+  int32_t resonance_sum1;
+  int32_t resonance_sum2;
+  // Number of decimated samples in the current block.
+  uint16_t resonance_block_count;
+  // Goertzel states of each band and coil.
+  int32_t resonance_s1[kMaxResonanceBands][2];
+  int32_t resonance_s2[kMaxResonanceBands][2];
+  // Powers of the last completed block, of both coils together.
+  uint64_t resonance_powers[kMaxResonanceBands];
+  uint16_t resonance_seq_number;
+
+  // Position stream of the capture motor. Samples divider, zero if
+  // disabled, and the samples since the last streamed item.
+  uint16_t position_stream_divider;
+  uint16_t position_stream_counter;
 };
 
 static IsrData isr_data = {};
 
+// Switches the pipeline instance after a change of the signal filter or
+// the enabled optional stages. Defined with the
+// pipeline below. Called within the mutex.
+static void mutex_update_sample_handler();
+
+// ADC linearity correction table, indexed by the raw 12 bit ADC code.
+// Identity unless a table is set. Protected by the mutex.
+static uint16_t adc_linearity_table[kAdcLinearityTableSize];
+
+// Restarts the drift tracking window of a motor, after a settling
+// period.
+static inline void isr_restart_offset_drift(const uint8_t motor) {
+  MotorsData& m = isr_data.motors;
+  m.drift_count[motor] = -kDriftSettleSamples;
+  m.drift_sum1[motor] = 0;
+  m.drift_sum2[motor] = 0;
+  m.noise_sum[motor] = 0;
+}
+
+// Restarts the resonance monitoring block. Keeps the powers of the last
+// completed block.
+static void isr_restart_resonance() {
+  isr_data.resonance_decimation_counter = 0;
+  isr_data.resonance_sum1 = 0;
+  isr_data.resonance_sum2 = 0;
+  isr_data.resonance_block_count = 0;
+  memset(isr_data.resonance_s1, 0, sizeof(isr_data.resonance_s1));
+  memset(isr_data.resonance_s2, 0, sizeof(isr_data.resonance_s2));
+}
+
+// Resets the noise floor tracking of all motors and their energized
+// limits to the defaults of the sensor.
+static void isr_reset_thresholds(uint16_t ticks_per_amp) {
+  isr_data.min_non_energized_threshold =
+      scale_threshold(kMinNonEnergizedThresholdCounts, ticks_per_amp);
+  isr_data.max_non_energized_threshold =
+      scale_threshold(kMaxNonEnergizedThresholdCounts, ticks_per_amp);
+  for (uint8_t motor = 0; motor < kNumMotors; motor++) {
+    MotorsData& m = isr_data.motors;
+    m.noise_floor[motor] = 0;
+    m.non_energized_threshold[motor] =
+        scale_threshold(kNonEnergizedThresholdCounts, ticks_per_amp);
+    m.energized_threshold[motor] =
+        scale_threshold(kEnergizedThresholdCounts, ticks_per_amp);
+  }
+}
+
+// The long record capture ring. Kept out of IsrData to make the
+// reservation explicit. Has a single dummy item if disabled.
+typedef CircularBuffer<AdcCaptureItem,
+    kLongCaptureBufferSize ? kLongCaptureBufferSize : 1>
+    LongCaptureItems;
+static LongCaptureItems long_capture_items;
+
+const CaptureTriggerSettings kDefaultCaptureTriggerSettings = {
+    .mode = TRIGGER_LEVEL,
+    .min_step_ticks = 0,
+    .max_step_ticks = UINT32_MAX,
+    .level = 0,
+    .hysteresis = 10,
+    .channel = TRIGGER_CHANNEL_V1,
+    .slope = TRIGGER_SLOPE_RISING,
+    .pre_trigger_percent = 50};
+
+// Copies a capture buffer, skipping the inactive zoom lanes.
+static void copy_adc_capture_buffer(
+    const AdcCaptureBuffer& src, AdcCaptureBuffer* dst) {
+  dst->seq_number = src.seq_number;
+  dst->divider = src.divider;
+  dst->decimation = src.decimation;
+  dst->zoom_lanes = src.zoom_lanes;
+  dst->items = src.items;
+  for (uint8_t i = 0; i < src.zoom_lanes; i++) {
+    dst->zoom_items[i] = src.zoom_items[i];
+  }
+}
+
 void get_last_capture_snapshot(AdcCaptureBuffer* buffer) {
   ENTER_MUTEX {
     // We copy the last completed snapsho.
-    *buffer = isr_data.adc_capture_buffer_snapshot;
+    copy_adc_capture_buffer(isr_data.adc_capture_buffer_snapshot, buffer);
   }
   EXIT_MUTEX
 }
@@ -136,56 +526,211 @@ void get_last_capture_snapshot(AdcCaptureBuffer* buffer) {
 void isr_reset_adc_capture_buffer() {
   isr_data.adc_capture_buffer.items.clear();
   isr_data.adc_capture_buffer.divider = isr_data.adc_capture_divider;
+  isr_data.adc_capture_buffer.decimation = isr_data.adc_capture_decimation;
+  isr_data.adc_capture_buffer.zoom_lanes = isr_data.adc_capture_zoom_lanes;
+  for (uint8_t i = 0; i < isr_data.adc_capture_zoom_lanes; i++) {
+    isr_data.adc_capture_buffer.zoom_items[i].clear();
+    isr_data.adc_capture_zoom_counters[i] = 0;
+    isr_data.adc_capture_zoom_sums1[i] = 0;
+    isr_data.adc_capture_zoom_sums2[i] = 0;
+  }
+  isr_data.adc_capture_decimator1.reset();
+  isr_data.adc_capture_decimator2.reset();
+  isr_data.adc_capture_decimator_skip =
+      (isr_data.adc_capture_decimation == DECIMATION_CIC2) ? 1 : 0;
 
-  isr_data.adc_capture_state = ADC_CAPTURE_HALF_FILL;
+  isr_data.adc_capture_state = ADC_CAPTURE_PRE_FILL;
+  isr_data.adc_capture_trigger_armed = false;
   isr_data.adc_capture_pre_trigger_items_left = kAdcCaptureMaxWaitToTrigger;
   isr_data.adc_capture_divider_counter = 0;
+  isr_data.motors.capture_events[isr_data.capture_motor] = 0;
 }
 
 // Should be called from ISR from when interrupts are not enabled.
 void isr_restart_adc_capture_cycle() {
   // Snapshot the last sample, if any.
-  isr_data.adc_capture_buffer_snapshot = isr_data.adc_capture_buffer;
+  copy_adc_capture_buffer(
+      isr_data.adc_capture_buffer, &isr_data.adc_capture_buffer_snapshot);
 
   // Initialize the new capture buffer.
   isr_data.adc_capture_buffer.seq_number++;
   isr_reset_adc_capture_buffer();
 }
 
-void sample_histogram(Histogram* histogram) {
-  ENTER_MUTEX { *histogram = isr_data.histogram; }
+void sample_histogram(uint8_t motor, Histogram* histogram) {
+  assert(motor < kNumMotors);
+  ENTER_MUTEX { *histogram = isr_data.motors.histogram[motor]; }
   EXIT_MUTEX
 }
 
 static StepsCaptureBuffer steps_capture_sample_buffer;
-const StepsCaptureBuffer* sample_steps_capture() {
+const StepsCaptureBuffer* sample_steps_capture(uint8_t motor) {
+  assert(motor < kNumMotors);
+  StepsCaptureBuffer& buffer = isr_data.motors.steps_capture_buffer[motor];
   steps_capture_sample_buffer.clear();
   ENTER_MUTEX {
     // NOTE: steps_capture_buffer is managed as a circular buffer
     // such it can be empty only when the device starts.
-    if (!isr_data.steps_capture_buffer.is_empty()) {
-      steps_capture_sample_buffer = isr_data.steps_capture_buffer;
-      isr_data.steps_capture_buffer.clear();
+    if (!buffer.is_empty()) {
+      steps_capture_sample_buffer = buffer;
+      buffer.clear();
     }
   }
   EXIT_MUTEX
   return &steps_capture_sample_buffer;
 }
 
-void sample_state(State* state) {
-  ENTER_MUTEX { *state = isr_data.state; }
+void sample_state(uint8_t motor, State* state) {
+  assert(motor < kNumMotors);
+  ENTER_MUTEX { *state = isr_data.motors.state[motor]; }
+  EXIT_MUTEX
+}
+
+bool pop_next_anomaly(AnomalyEvent* event) {
+  bool result = false;
+  ENTER_MUTEX {
+    const AnomalyEvent* popped = anomaly_circular_buffer.pop();
+    if (popped) {
+      *event = *popped;
+      result = true;
+    }
+  }
+  EXIT_MUTEX
+  return result;
+}
+
+uint32_t get_anomaly_count(uint8_t motor) {
+  assert(motor < kNumMotors);
+  uint32_t result;
+  ENTER_MUTEX { result = isr_data.motors.anomaly_count[motor]; }
+  EXIT_MUTEX
+  return result;
+}
+
+void sample_energy(uint8_t motor, EnergyStats* stats) {
+  assert(motor < kNumMotors);
+  const MotorsData& m = isr_data.motors;
+  ENTER_MUTEX {
+    stats->ticks = m.state[motor].tick_count - m.energy_start_tick[motor];
+    // Includes the step in progress.
+    stats->total_sq_currents1 =
+        m.total_sq_currents1[motor] + m.step_sq_currents1[motor];
+    stats->total_sq_currents2 =
+        m.total_sq_currents2[motor] + m.step_sq_currents2[motor];
+  }
+  EXIT_MUTEX
+}
+
+void sample_quadrature_errors(uint8_t motor, QuadratureErrors* errors) {
+  assert(motor < kNumMotors);
+  const MotorsData& m = isr_data.motors;
+  ENTER_MUTEX {
+    for (uint8_t i = 0; i < QUADRATURE_ERROR_CLASSES_COUNT; i++) {
+      errors->class_counts[i] = m.quadrature_error_counts[motor][i];
+    }
+    errors->num_records = m.quadrature_error_records[motor].size();
+    for (uint8_t i = 0; i < errors->num_records; i++) {
+      errors->records[i] = *m.quadrature_error_records[motor].get(i);
+    }
+  }
   EXIT_MUTEX
 }
 
-// Blocks until next state is available. (50Hz)
-bool pop_next_state(State* state) {
+void sample_retractions(uint8_t motor, RetractionStats* stats) {
+  assert(motor < kNumMotors);
+  const MotorsData& m = isr_data.motors;
+  ENTER_MUTEX {
+    memcpy(stats->buckets, m.retraction_buckets[motor], sizeof(stats->buckets));
+    stats->num_events = m.retraction_events[motor].size();
+    for (uint8_t i = 0; i < stats->num_events; i++) {
+      stats->events[i] = *m.retraction_events[motor].get(i);
+    }
+  }
+  EXIT_MUTEX
+}
+
+void sample_reversals(uint8_t motor, ReversalStats* stats) {
+  assert(motor < kNumMotors);
+  const MotorsData& m = isr_data.motors;
+  ENTER_MUTEX {
+    stats->forward_reversals = m.forward_reversals[motor];
+    stats->backward_reversals = m.backward_reversals[motor];
+    memcpy(stats->dwell_buckets, m.reversal_dwell_buckets[motor],
+        sizeof(stats->dwell_buckets));
+    // The windows may have not been advanced yet.
+    const uint64_t elapsed =
+        m.state[motor].tick_count - m.reversal_window_start_tick[motor];
+    if (elapsed < kReversalRateWindowTicks) {
+      stats->last_minute_reversals = m.reversal_last_window_count[motor];
+    } else if (elapsed < 2 * kReversalRateWindowTicks) {
+      stats->last_minute_reversals = m.reversal_window_count[motor];
+    } else {
+      stats->last_minute_reversals = 0;
+    }
+  }
+  EXIT_MUTEX
+}
+
+void sample_motion(uint8_t motor, MotionStats* stats) {
+  assert(motor < kNumMotors);
+  const MotorsData& m = isr_data.motors;
+  uint32_t ticks_in_step;
+  bool is_moving;
+  ENTER_MUTEX {
+    stats->velocity = m.state[motor].velocity;
+    stats->acceleration = m.state[motor].acceleration;
+    ticks_in_step = m.state[motor].ticks_in_step;
+    is_moving = m.state[motor].last_step_direction != UNKNOWN_DIRECTION;
+    memcpy(stats->acceleration_ticks, m.acceleration_ticks[motor],
+        sizeof(stats->acceleration_ticks));
+  }
+  EXIT_MUTEX
+
+  if (!is_moving) {
+    stats->velocity = 0;
+    stats->acceleration = 0;
+    return;
+  }
+  // The step in progress bounds the current speed.
+  const int32_t max_velocity =
+      (acq_consts::kTimeTicksPerSec << kMotionFractionBits) / ticks_in_step;
+  if (abs(stats->velocity) > max_velocity) {
+    stats->velocity = (stats->velocity > 0) ? max_velocity : -max_velocity;
+    stats->acceleration = 0;
+  }
+}
+
+void sample_sensor_status(uint8_t motor, SensorStatus* status) {
+  assert(motor < kNumMotors);
+  const MotorsData& m = isr_data.motors;
+  ENTER_MUTEX {
+    status->noise_floor = m.noise_floor[motor];
+    status->non_energized_threshold = m.non_energized_threshold[motor];
+    status->energized_threshold = m.energized_threshold[motor];
+    status->offset1 = m.offset1[motor];
+    status->offset2 = m.offset2[motor];
+  }
+  EXIT_MUTEX
+}
+
+// Blocks until next state is available. (50Hz per motor)
+bool pop_next_state(State* state, uint8_t* motor) {
+  // The motor to pop first. Rotated such that the motors are
+  // serviced fairly.
+  static uint8_t next_motor = 0;
+
   for (;;) {
-    const State* popped_state;
+    const State* popped_state = nullptr;
     ENTER_MUTEX {
-      // Null if buffer is empty.
-      popped_state = state_circular_buffer.pop();
-      if (popped_state) {
-        *state = *popped_state;
+      for (uint8_t i = 0; i < kNumMotors && !popped_state; i++) {
+        const uint8_t m = next_motor;
+        next_motor = (next_motor + 1 < kNumMotors) ? next_motor + 1 : 0;
+        // Null if buffer is empty.
+        popped_state = state_circular_buffers[m].pop();
+        if (popped_state) {
+          *state = *popped_state;
+          *motor = m;
+        }
       }
     }
     EXIT_MUTEX
@@ -203,19 +748,52 @@ void reset_data() {
   ENTER_MUTEX {
     // NOTE: we don't reset the tick counter,  step counter samples and
     // the captured signals.
-
-    isr_data.state.ticks_with_errors = 0;
-    isr_data.state.non_energized_count = 0;
-    isr_data.state.full_steps = 0;
-    isr_data.state.max_full_steps = 0;
-    isr_data.state.max_retraction_steps = 0;
-    isr_data.state.quadrature_errors = 0;
-    memset(isr_data.histogram.buckets, 0, sizeof(isr_data.histogram.buckets));
+    MotorsData& m = isr_data.motors;
+    for (uint8_t motor = 0; motor < kNumMotors; motor++) {
+      m.state[motor].ticks_with_errors = 0;
+      m.state[motor].non_energized_count = 0;
+      m.state[motor].full_steps = 0;
+      m.state[motor].max_full_steps = 0;
+      m.state[motor].max_retraction_steps = 0;
+      m.state[motor].quadrature_errors = 0;
+      memset(m.histogram[motor].buckets, 0, sizeof(m.histogram[motor].buckets));
+      m.total_sq_currents1[motor] = 0;
+      m.total_sq_currents2[motor] = 0;
+      m.energy_start_tick[motor] = m.state[motor].tick_count;
+      m.anomaly_count[motor] = 0;
+      m.anomaly_last_step_ticks[motor] = 0;
+      m.anomaly_reversal_bits[motor] = 0;
+      m.anomaly_reversals[motor] = 0;
+      m.anomaly_move_peak_current[motor] = 0;
+      memset(m.quadrature_error_counts[motor], 0,
+          sizeof(m.quadrature_error_counts[motor]));
+      m.quadrature_error_records[motor].clear();
+      m.retraction_peak_steps[motor] = 0;
+      memset(m.retraction_buckets[motor], 0,
+          sizeof(m.retraction_buckets[motor]));
+      m.retraction_events[motor].clear();
+      m.forward_reversals[motor] = 0;
+      m.backward_reversals[motor] = 0;
+      memset(m.reversal_dwell_buckets[motor], 0,
+          sizeof(m.reversal_dwell_buckets[motor]));
+      m.reversal_window_start_tick[motor] = m.state[motor].tick_count;
+      m.reversal_window_count[motor] = 0;
+      m.reversal_last_window_count[motor] = 0;
+      memset(m.acceleration_ticks[motor], 0,
+          sizeof(m.acceleration_ticks[motor]));
+      // The rollups are kept, only the cumulative values they follow
+      // restart.
+      m.rollup_last_full_steps[motor] = 0;
+      m.rollup_last_quadrature_errors[motor] = 0;
+      m.rollup_last_sq_currents[motor] =
+          m.step_sq_currents1[motor] + m.step_sq_currents2[motor];
+    }
   }
   EXIT_MUTEX
 }
 
-void calibrate_zeros() {
+void calibrate_zeros(uint8_t motor) {
+  assert(motor < kNumMotors);
   // To minimize the effect of the noise on the zero offset
   // we compute an average of the last n states we entered
   // to the notification buffer. We take advantage of the fact
@@ -223,44 +801,78 @@ void calibrate_zeros() {
   // value is still available there.
   // adc_dma::disable_irq();
   ENTER_MUTEX {
-    const uint16_t n = state_circular_buffer.capacity;
+    const StateCircularBuffer& states = state_circular_buffers[motor];
+    const uint16_t n = states.capacity;
     int32_t total_v1 = 0;
     int32_t total_v2 = 0;
     for (int i = 0; i < n; i++) {
-      const State* state = state_circular_buffer.get_internal(i);
+      const State* state = states.get_internal(i);
       total_v1 += state->v1;
       total_v2 += state->v2;
     }
 
-    isr_data.offset1 += (total_v1 / n);
-    isr_data.offset2 += (total_v2 / n);
+    // The offsets are applied before the gains.
+    MotorsData& m = isr_data.motors;
+    m.offset1[motor] += (total_v1 << acq_consts::kGainFractionBits) /
+        ((int32_t)n * m.gain1[motor]);
+    m.offset2[motor] += (total_v2 << acq_consts::kGainFractionBits) /
+        ((int32_t)n * m.gain2[motor]);
+
+    // Restart the drift tracking from the new offsets.
+    isr_restart_offset_drift(motor);
+    m.drift_correction1[motor] = 0;
+    m.drift_correction2[motor] = 0;
+    m.offsets_drifted[motor] = false;
+    m.drift_mean1[motor] = 0;
+    m.drift_mean2[motor] = 0;
   }
   EXIT_MUTEX
 }
 
-void set_is_reversed_direction(bool is_reverse_direction) {
-  ENTER_MUTEX { isr_data.state.is_reverse_direction = is_reverse_direction; }
+bool take_offsets_drifted(uint8_t motor) {
+  assert(motor < kNumMotors);
+  bool result;
+  ENTER_MUTEX {
+    result = isr_data.motors.offsets_drifted[motor];
+    isr_data.motors.offsets_drifted[motor] = false;
+  }
   EXIT_MUTEX
+  return result;
 }
 
-bool get_is_reversed_direction() {
+void set_is_reversed_direction(uint8_t motor, bool is_reverse_direction) {
+  assert(motor < kNumMotors);
+  ENTER_MUTEX {
+    isr_data.motors.state[motor].is_reverse_direction = is_reverse_direction;
+  }
+  EXIT_MUTEX
+}
+
+bool get_is_reversed_direction(uint8_t motor) {
+  assert(motor < kNumMotors);
   bool result;
-  ENTER_MUTEX { result = isr_data.state.is_reverse_direction; }
+  ENTER_MUTEX { result = isr_data.motors.state[motor].is_reverse_direction; }
   EXIT_MUTEX
   return result;
 }
 
-void set_signal_capture_divider(uint8_t divider) {
+void set_signal_capture_divider(
+    uint8_t divider, CaptureDecimation decimation) {
   // Clip to a reaonsable range.
   if (divider < 1) {
     divider = 1;
   } else if (divider > 50) {
     divider = 50;
   }
+  if (decimation < 0 || decimation >= DECIMATIONS_COUNT) {
+    ESP_LOGE(TAG, "Invalid capture decimation %d", decimation);
+    decimation = DECIMATION_DROP;
+  }
 
   ENTER_MUTEX {
     isr_data.adc_capture_divider = divider;
     isr_data.adc_capture_divider_counter = 0;
+    isr_data.adc_capture_decimation = decimation;
 
     // Restart the capture buffer so we don't mix data points
     // from diferent dividers.
@@ -268,16 +880,330 @@ void set_signal_capture_divider(uint8_t divider) {
   }
   EXIT_MUTEX
 
-  ESP_LOGI(TAG, "Signal capture divider set to %hu", divider);
+  ESP_LOGI(TAG, "Signal capture divider set to %hu (decimation %d)", divider,
+      decimation);
+}
+
+void set_adc_linearity_table(const uint16_t* table) {
+  ENTER_MUTEX {
+    for (uint16_t i = 0; i < kAdcLinearityTableSize; i++) {
+      const uint16_t value = table ? table[i] : i;
+      adc_linearity_table[i] = (value > 4095) ? 4095 : value;
+    }
+  }
+  EXIT_MUTEX
+
+  ESP_LOGI(TAG, "ADC linearity table %s", table ? "set" : "cleared");
+}
+
+bool set_capture_motor(uint8_t motor) {
+  if (motor >= kNumMotors) {
+    ESP_LOGE(TAG, "Invalid capture motor %hhu", motor);
+    return false;
+  }
+
+  ENTER_MUTEX {
+    isr_data.capture_motor = motor;
+    // Restart the capture buffer so we don't mix data points
+    // from diferent motors. A long record capture in progress
+    // continues with the new motor.
+    isr_reset_adc_capture_buffer();
+    isr_restart_resonance();
+    position_stream_buffer.clear();
+  }
+  EXIT_MUTEX
+
+  ESP_LOGI(TAG, "Capture motor set to %hhu", motor);
+  return true;
+}
+
+bool set_position_stream_rate(uint16_t rate) {
+  if (rate &&
+      (rate < kMinPositionStreamRate || rate > kMaxPositionStreamRate)) {
+    ESP_LOGE(TAG, "Invalid position stream rate %hu", rate);
+    return false;
+  }
+  const uint16_t divider = rate ? acq_consts::kTimeTicksPerSec / rate : 0;
+
+  ENTER_MUTEX {
+    isr_data.position_stream_divider = divider;
+    isr_data.position_stream_counter = 0;
+    position_stream_buffer.clear();
+    mutex_update_sample_handler();
+  }
+  EXIT_MUTEX
+
+  ESP_LOGI(TAG, "Position stream rate set to %hu (divider %hu)", rate, divider);
+  return true;
+}
+
+uint16_t pop_position_stream(
+    PositionStreamItem items[], uint16_t max_items, uint16_t* divider) {
+  uint16_t n = 0;
+  ENTER_MUTEX {
+    *divider = isr_data.position_stream_divider;
+    for (; n < max_items; n++) {
+      const PositionStreamItem* item = position_stream_buffer.pop();
+      if (!item) {
+        break;
+      }
+      items[n] = *item;
+    }
+  }
+  EXIT_MUTEX
+  return n;
+}
+
+uint16_t read_rollups(uint8_t motor, RollupTier tier, uint32_t first_period,
+    uint16_t max_items, Rollup items[], uint32_t* open_period) {
+  assert(motor < kNumMotors);
+  assert(tier < ROLLUP_TIERS_COUNT);
+  const MotorsData& m = isr_data.motors;
+  uint16_t n = 0;
+  ENTER_MUTEX {
+    const RollupsCircularBuffer& rollups = m.rollups[motor][tier];
+    *open_period = m.open_rollups[motor][tier].rollup.period;
+    for (uint16_t i = 0; i < rollups.size() && n < max_items; i++) {
+      const Rollup* rollup = rollups.get(i);
+      if (rollup->period >= first_period) {
+        items[n++] = *rollup;
+      }
+    }
+  }
+  EXIT_MUTEX
+  return n;
+}
+
+bool set_resonance_bands(const uint16_t* frequencies, uint8_t num_bands) {
+  if (num_bands > kMaxResonanceBands) {
+    ESP_LOGE(TAG, "Invalid resonance bands count %hhu", num_bands);
+    return false;
+  }
+  int32_t coeffs[kMaxResonanceBands];
+  for (uint8_t b = 0; b < num_bands; b++) {
+    if (frequencies[b] < 1 || frequencies[b] > kMaxResonanceFrequency) {
+      ESP_LOGE(TAG, "Invalid resonance band frequency %hu", frequencies[b]);
+      return false;
+    }
+    const double w = 2 * M_PI * frequencies[b] / kResonanceSampleRate;
+    coeffs[b] = lround(2 * cos(w) * (1 << kResonanceCoeffBits));
+  }
+
+  ENTER_MUTEX {
+    isr_data.resonance_num_bands = num_bands;
+    for (uint8_t b = 0; b < num_bands; b++) {
+      isr_data.resonance_frequencies[b] = frequencies[b];
+      isr_data.resonance_coeffs[b] = coeffs[b];
+      isr_data.resonance_powers[b] = 0;
+    }
+    isr_restart_resonance();
+    mutex_update_sample_handler();
+  }
+  EXIT_MUTEX
+
+  ESP_LOGI(TAG, "Resonance bands set, count %hhu", num_bands);
+  return true;
+}
+
+void sample_resonance(ResonanceStatus* status) {
+  uint64_t powers[kMaxResonanceBands];
+  ENTER_MUTEX {
+    status->seq_number = isr_data.resonance_seq_number;
+    status->num_bands = isr_data.resonance_num_bands;
+    for (uint8_t b = 0; b < kMaxResonanceBands; b++) {
+      status->frequencies[b] = isr_data.resonance_frequencies[b];
+      powers[b] = isr_data.resonance_powers[b];
+    }
+  }
+  EXIT_MUTEX
+
+  // A sinusoid of amplitude A has power (A * N * D / 2)^2, with a block
+  // of N decimated samples, each the sum of D samples. Amplitude is
+  // the RMS of the two coils, sqrt(2 * (p1 + p2)) / (N * D), with 4
+  // fraction bits.
+  for (uint8_t b = 0; b < kMaxResonanceBands; b++) {
+    const double amplitude = (b < status->num_bands)
+        ? sqrt(2.0 * powers[b]) * 16 /
+            (kResonanceBlockSize * kResonanceDecimation)
+        : 0;
+    status->amplitudes[b] =
+        (amplitude > UINT16_MAX) ? UINT16_MAX : (uint16_t)amplitude;
+  }
+}
+
+uint8_t get_capture_motor() {
+  uint8_t result;
+  ENTER_MUTEX { result = isr_data.capture_motor; }
+  EXIT_MUTEX
+  return result;
+}
+
+bool set_signal_capture_zoom_lanes(uint8_t zoom_lanes) {
+  if (zoom_lanes > kAdcCaptureMaxZoomLanes) {
+    ESP_LOGE(TAG, "Invalid capture zoom lanes %hhu", zoom_lanes);
+    return false;
+  }
+
+  ENTER_MUTEX {
+    isr_data.adc_capture_zoom_lanes = zoom_lanes;
+    isr_reset_adc_capture_buffer();
+  }
+  EXIT_MUTEX
+
+  ESP_LOGI(TAG, "Signal capture zoom lanes set to %hhu", zoom_lanes);
+  return true;
+}
+
+// Should be called from ISR from when interrupts are not enabled.
+// Settings are assumed to be valid.
+static void isr_set_capture_trigger(const CaptureTriggerSettings& settings) {
+  isr_data.adc_capture_trigger = settings;
+  isr_data.adc_capture_trigger_event_mask =
+      kCaptureTriggerEventMasks[settings.mode];
+
+  const bool negate = settings.slope == TRIGGER_SLOPE_FALLING;
+  const int32_t level = negate ? -settings.level : settings.level;
+  isr_data.adc_capture_trigger_negate = negate;
+  isr_data.adc_capture_trigger_arm_level = level - settings.hysteresis;
+  isr_data.adc_capture_trigger_fire_level = level;
+
+  const uint16_t pre_trigger_items =
+      ((uint32_t)kAdcCaptureBufferSize * settings.pre_trigger_percent) / 100;
+  isr_data.adc_capture_pre_trigger_items =
+      pre_trigger_items ? pre_trigger_items : 1;
+
+  // Restart the capture buffer so the next snapshot reflects
+  // the new trigger.
+  isr_reset_adc_capture_buffer();
 }
 
-void get_settings(nvs_config::AcquistionSettings* settings) {
+bool set_capture_trigger(const CaptureTriggerSettings& settings) {
+  if (settings.mode < 0 || settings.mode >= TRIGGER_MODES_COUNT) {
+    ESP_LOGE(TAG, "Invalid capture trigger mode %d", settings.mode);
+    return false;
+  }
+  if (settings.mode == TRIGGER_STEP_PERIOD &&
+      settings.min_step_ticks > settings.max_step_ticks) {
+    ESP_LOGE(TAG, "Invalid capture trigger step period band [%lu, %lu]",
+        settings.min_step_ticks, settings.max_step_ticks);
+    return false;
+  }
+  if (settings.channel < 0 || settings.channel >= TRIGGER_CHANNELS_COUNT ||
+      settings.slope < 0 || settings.slope >= TRIGGER_SLOPES_COUNT) {
+    ESP_LOGE(TAG, "Invalid capture trigger channel %d or slope %d",
+        settings.channel, settings.slope);
+    return false;
+  }
+  // Level and hysteresis are in ADC counts of signed 12 bits values.
+  // Magnitude is never negative.
+  const int min_level =
+      (settings.channel == TRIGGER_CHANNEL_MAGNITUDE) ? 0 : -kMaxOffset;
+  if (settings.level < min_level || settings.level > kMaxOffset ||
+      settings.hysteresis > kMaxOffset) {
+    ESP_LOGE(TAG, "Invalid capture trigger level %hd or hysteresis %hu",
+        settings.level, settings.hysteresis);
+    return false;
+  }
+  if (settings.pre_trigger_percent > 100) {
+    ESP_LOGE(TAG, "Invalid capture pre trigger %hhu%%",
+        settings.pre_trigger_percent);
+    return false;
+  }
+
+  ENTER_MUTEX {
+    isr_set_capture_trigger(settings);
+    mutex_update_sample_handler();
+  }
+  EXIT_MUTEX
+
+  ESP_LOGI(TAG,
+      "Capture trigger set to %d [%lu, %lu], level %hd/%hu, ch %d, slope %d, "
+      "pre %hhu%%",
+      settings.mode, settings.min_step_ticks, settings.max_step_ticks,
+      settings.level, settings.hysteresis, settings.channel, settings.slope,
+      settings.pre_trigger_percent);
+  return true;
+}
+
+void get_capture_trigger(CaptureTriggerSettings* settings) {
+  ENTER_MUTEX { *settings = isr_data.adc_capture_trigger; }
+  EXIT_MUTEX
+}
+
+bool arm_long_capture(uint8_t divider) {
+  if (!kLongCaptureBufferSize) {
+    ESP_LOGE(TAG, "Long capture is disabled in this build");
+    return false;
+  }
+  if (divider < 1) {
+    divider = 1;
+  }
+
+  ENTER_MUTEX {
+    long_capture_items.clear();
+    isr_data.long_capture_status.state = LONG_CAPTURE_PRE_FILL;
+    isr_data.long_capture_status.divider = divider;
+    isr_data.long_capture_status.size = 0;
+    isr_data.long_capture_status.trigger_index = 0;
+    isr_data.long_capture_divider_counter = 0;
+    const uint16_t pre_trigger_items =
+        ((uint32_t)kLongCaptureBufferSize *
+            isr_data.adc_capture_trigger.pre_trigger_percent) /
+        100;
+    isr_data.long_capture_pre_trigger_items =
+        pre_trigger_items ? pre_trigger_items : 1;
+  }
+  EXIT_MUTEX
+
+  ESP_LOGI(TAG, "Long capture armed, divider %hhu", divider);
+  return true;
+}
+
+uint16_t read_long_capture(uint16_t offset, uint16_t max_items,
+    LongCaptureStatus* status, AdcCaptureItem* items) {
+  uint16_t count = 0;
+  ENTER_MUTEX {
+    *status = isr_data.long_capture_status;
+    // The ISR doesn't touch the ring once frozen.
+    if (status->state == LONG_CAPTURE_FROZEN && offset < status->size) {
+      const uint16_t available = status->size - offset;
+      count = (available < max_items) ? available : max_items;
+      for (uint16_t i = 0; i < count; i++) {
+        items[i] = *long_capture_items.get(offset + i);
+      }
+    }
+  }
+  EXIT_MUTEX
+  return count;
+}
+
+void get_settings(uint8_t motor, nvs_config::AcquistionSettings* settings) {
+  assert(motor < kNumMotors);
   // A weak check that new fields where not added to settings.
-  static_assert(sizeof(sizeof(*settings) == 6)); 
+  static_assert(sizeof(*settings) == 10);
+  const MotorsData& m = isr_data.motors;
+  ENTER_MUTEX {
+    settings->offset1 = m.offset1[motor];
+    settings->offset2 = m.offset2[motor];
+    settings->is_reverse_direction = m.state[motor].is_reverse_direction;
+    settings->gain1 = m.gain1[motor];
+    settings->gain2 = m.gain2[motor];
+  }
+  EXIT_MUTEX
+}
+
+// Force a reasonable gain setting value.
+static uint16_t clip_gain(uint16_t requested_gain) {
+  return (requested_gain > acq_consts::kMaxGain) ? acq_consts::kMaxGain
+      : (requested_gain < acq_consts::kMinGain)  ? acq_consts::kMinGain
+                                                 : requested_gain;
+}
+
+void set_gains(uint8_t motor, uint16_t gain1, uint16_t gain2) {
+  assert(motor < kNumMotors);
   ENTER_MUTEX {
-    settings->offset1 = isr_data.offset1;
-    settings->offset2 = isr_data.offset2;
-    settings->is_reverse_direction = isr_data.state.is_reverse_direction;
+    isr_data.motors.gain1[motor] = clip_gain(gain1);
+    isr_data.motors.gain2[motor] = clip_gain(gain2);
   }
   EXIT_MUTEX
 }
@@ -295,7 +1221,8 @@ void dump_state(const State& state) {
 // Assumes that ADC capture data is ready.
 void dump_adc_capture_buffer(const AdcCaptureBuffer& buffer) {
   printf("\nCapture buffer:\n");
-  printf(" seq: %hu, div=%hus\n", buffer.seq_number, buffer.divider);
+  printf(" seq: %hu, div=%hus, dec=%d, zoom=%hhu\n", buffer.seq_number,
+      buffer.divider, buffer.decimation, buffer.zoom_lanes);
   for (int i = 0; i < buffer.items.size(); i++) {
     const analyzer::AdcCaptureItem* item = buffer.items.get(i);
     printf("%hd,%hd\n", item->v1, item->v2);
@@ -305,9 +1232,10 @@ void dump_adc_capture_buffer(const AdcCaptureBuffer& buffer) {
 
 // Maybe add step's information to the histogram.
 // Called from isr on step transition.
-static inline void isr_add_step_to_histogram(uint8_t quadrant,
-    Direction entry_direction, Direction exit_direction, uint32_t ticks_in_step,
-    uint32_t max_current_in_step) {
+static inline void isr_add_step_to_histogram(const uint8_t motor,
+    uint8_t quadrant, Direction entry_direction, Direction exit_direction,
+    uint32_t ticks_in_step, uint32_t max_current_in_step) {
+  MotorsData& m = isr_data.motors;
   // Ignoring this step if not entering and exiting this step in same forward or
   // backward direction.
   if (entry_direction != exit_direction ||
@@ -323,18 +1251,414 @@ static inline void isr_add_step_to_histogram(uint8_t quadrant,
   if (bucket_index >= acq_consts::kNumHistogramBuckets) {
     bucket_index = acq_consts::kNumHistogramBuckets - 1;
   }
-  HistogramBucket& bucket = isr_data.histogram.buckets[bucket_index];
+  HistogramBucket& bucket = m.histogram[motor].buckets[bucket_index];
   bucket.total_ticks_in_steps += ticks_in_step;
   bucket.total_step_peak_currents += max_current_in_step;
   bucket.total_steps++;
+  bucket.total_sq_currents1 += m.step_sq_currents1[motor];
+  bucket.total_sq_currents2 += m.step_sq_currents2[motor];
+}
+
+// Feeds a decimated sample to a Goertzel filter.
+static inline void isr_goertzel_update(
+    const int32_t coeff, int32_t& s1, int32_t& s2, const int32_t x) {
+  const int32_t s0 =
+      x + (int32_t)(((int64_t)coeff * s1) >> kResonanceCoeffBits) - s2;
+  s2 = s1;
+  s1 = s0;
+}
+
+// Returns the power of a Goertzel filter at the end of a block.
+static inline uint64_t isr_goertzel_power(
+    const int32_t coeff, const int32_t s1, const int32_t s2) {
+  const int64_t cross = ((int64_t)coeff * s1) >> kResonanceCoeffBits;
+  return (int64_t)s1 * s1 + (int64_t)s2 * s2 - cross * s2;
+}
+
+// Per sample pipeline stage of the capture motor. Tracks the
+// resonance bands. The per sample cost is a couple of adds, and every
+// kResonanceDecimation samples a multiply-add per band and coil.
+static inline void isr_resonance_stage(const int16_t v1, const int16_t v2) {
+  if (!isr_data.resonance_num_bands) {
+    return;
+  }
+  isr_data.resonance_sum1 += v1;
+  isr_data.resonance_sum2 += v2;
+  if (++isr_data.resonance_decimation_counter < kResonanceDecimation) {
+    return;
+  }
+  isr_data.resonance_decimation_counter = 0;
+  for (uint8_t b = 0; b < isr_data.resonance_num_bands; b++) {
+    const int32_t coeff = isr_data.resonance_coeffs[b];
+    isr_goertzel_update(coeff, isr_data.resonance_s1[b][0],
+        isr_data.resonance_s2[b][0], isr_data.resonance_sum1);
+    isr_goertzel_update(coeff, isr_data.resonance_s1[b][1],
+        isr_data.resonance_s2[b][1], isr_data.resonance_sum2);
+  }
+  isr_data.resonance_sum1 = 0;
+  isr_data.resonance_sum2 = 0;
+  if (++isr_data.resonance_block_count < kResonanceBlockSize) {
+    return;
+  }
+
+  // Block completed.
+  for (uint8_t b = 0; b < isr_data.resonance_num_bands; b++) {
+    const int32_t coeff = isr_data.resonance_coeffs[b];
+    isr_data.resonance_powers[b] =
+        isr_goertzel_power(coeff, isr_data.resonance_s1[b][0],
+            isr_data.resonance_s2[b][0]) +
+        isr_goertzel_power(
+            coeff, isr_data.resonance_s1[b][1], isr_data.resonance_s2[b][1]);
+  }
+  isr_data.resonance_seq_number++;
+  isr_restart_resonance();
+}
+
+// Records an anomaly event of a motor. Rare, not performance critical.
+static void isr_raise_anomaly(
+    const uint8_t motor, const AnomalyType type, const uint32_t detail) {
+  MotorsData& m = isr_data.motors;
+  m.anomaly_count[motor]++;
+  AnomalyEvent* event = anomaly_circular_buffer.insert();
+  event->tick_count = m.state[motor].tick_count;
+  event->detail = detail;
+  event->anomaly_count = m.anomaly_count[motor];
+  event->motor = motor;
+  event->type = type;
+}
+
+// Classifies and records an invalid quadrant transition. Called before
+// the step state is updated. Returns the error class. Rare, not
+// performance critical.
+static QuadratureErrorClass isr_record_quadrature_error(const uint8_t motor,
+    const uint8_t old_quadrant, const uint8_t new_quadrant) {
+  MotorsData& m = isr_data.motors;
+  const uint16_t total_current =
+      abs(m.state[motor].v1) + abs(m.state[motor].v2);
+  // The move ended if the quadrant was held too long.
+  const uint32_t move_step_ticks =
+      (m.state[motor].ticks_in_step < kAnomalyMaxMoveStepTicks)
+      ? m.anomaly_last_step_ticks[motor]
+      : 0;
+  QuadratureErrorClass error_class;
+  if (total_current < 2 * m.energized_threshold[motor]) {
+    error_class = QUADRATURE_ERROR_LOW_CURRENT;
+  } else if (move_step_ticks) {
+    error_class = QUADRATURE_ERROR_IN_MOVE;
+  } else {
+    error_class = QUADRATURE_ERROR_AT_REST;
+  }
+  m.quadrature_error_counts[motor][error_class]++;
+
+  QuadratureErrorRecord* record = m.quadrature_error_records[motor].insert();
+  record->tick_count = m.state[motor].tick_count;
+  record->ticks_in_step = m.state[motor].ticks_in_step;
+  record->move_step_ticks = move_step_ticks;
+  record->v1 = m.state[motor].v1;
+  record->v2 = m.state[motor].v2;
+  record->old_quadrant = old_quadrant;
+  record->new_quadrant = new_quadrant;
+  record->error_class = error_class;
+  return error_class;
+}
+
+// Checks a completed step for missed step signatures. The common case
+// costs a few compares and shifts.
+static inline void isr_detect_step_anomalies(const uint8_t motor,
+    const Direction entry_direction, const Direction exit_direction,
+    const uint32_t ticks_in_step, const uint32_t max_current_in_step) {
+  MotorsData& m = isr_data.motors;
+  // Step period discontinuity within a move.
+  const uint32_t last_ticks = m.anomaly_last_step_ticks[motor];
+  const bool same_direction = entry_direction == exit_direction;
+  const bool in_move =
+      same_direction && ticks_in_step < kAnomalyMaxMoveStepTicks;
+  if (in_move && last_ticks &&
+      ((ticks_in_step >> kAnomalyPeriodJumpFactorBits) > last_ticks ||
+          (last_ticks >> kAnomalyPeriodJumpFactorBits) > ticks_in_step)) {
+    isr_raise_anomaly(motor, ANOMALY_STEP_PERIOD_JUMP, ticks_in_step);
+  }
+  m.anomaly_last_step_ticks[motor] = in_move ? ticks_in_step : 0;
+
+  // Current vector lag within a move.
+  if (!in_move) {
+    m.anomaly_move_peak_current[motor] = 0;
+  } else if (max_current_in_step > m.anomaly_move_peak_current[motor]) {
+    m.anomaly_move_peak_current[motor] = max_current_in_step;
+  } else if ((max_current_in_step << kAnomalyCurrentLagFactorBits) <
+      m.anomaly_move_peak_current[motor]) {
+    isr_raise_anomaly(motor, ANOMALY_CURRENT_LAG, max_current_in_step);
+    // Report each drop once.
+    m.anomaly_move_peak_current[motor] = max_current_in_step;
+  }
+
+  // Reversal bursts. A sliding count over the last 8 steps.
+  const uint8_t reversal =
+      !same_direction && entry_direction != UNKNOWN_DIRECTION;
+  m.anomaly_reversals[motor] +=
+      reversal - (m.anomaly_reversal_bits[motor] >> 7);
+  m.anomaly_reversal_bits[motor] =
+      (m.anomaly_reversal_bits[motor] << 1) | reversal;
+  if (m.anomaly_reversals[motor] >= kAnomalyBurstReversals) {
+    isr_raise_anomaly(
+        motor, ANOMALY_REVERSAL_BURST, m.anomaly_reversals[motor]);
+    // Report each burst once.
+    m.anomaly_reversal_bits[motor] = 0;
+    m.anomaly_reversals[motor] = 0;
+  }
+}
+
+// Records a direction reversal. Rare relative to steps, not performance
+// critical.
+static void isr_add_reversal(const uint8_t motor,
+    const Direction entry_direction, const uint32_t ticks_in_step) {
+  MotorsData& m = isr_data.motors;
+  if (entry_direction == FORWARD) {
+    m.forward_reversals[motor]++;
+  } else {
+    m.backward_reversals[motor]++;
+  }
+
+  // Bucket 0 for dwells below kReversalDwellBucketTicks, otherwise the
+  // bucket of the dwell's log2.
+  const uint32_t dwell_units = ticks_in_step / kReversalDwellBucketTicks;
+  const uint8_t index = dwell_units ? 32 - __builtin_clz(dwell_units) : 0;
+  m.reversal_dwell_buckets[motor][(index < kNumReversalDwellBuckets)
+          ? index
+          : kNumReversalDwellBuckets - 1]++;
+
+  // Advance the rate windows if needed.
+  const uint64_t elapsed =
+      m.state[motor].tick_count - m.reversal_window_start_tick[motor];
+  if (elapsed >= kReversalRateWindowTicks) {
+    m.reversal_last_window_count[motor] =
+        (elapsed < 2 * kReversalRateWindowTicks)
+        ? m.reversal_window_count[motor]
+        : 0;
+    m.reversal_window_count[motor] = 0;
+    m.reversal_window_start_tick[motor] +=
+        elapsed - elapsed % kReversalRateWindowTicks;
+  }
+  m.reversal_window_count[motor]++;
+}
+
+// Per step velocity and acceleration tracking. Called on each step
+// with the direction of the previous step. An alpha-beta tracker with
+// the step rate of the ending step as the measurement, restarted at
+// the start of each move and on reversals. A few multiplications and
+// divisions per step.
+static inline void isr_track_motion(const uint8_t motor,
+    const Direction entry_direction, const Direction exit_direction,
+    const uint32_t ticks_in_step) {
+  MotorsData& m = isr_data.motors;
+  State& isr_state = m.state[motor];  // alias
+  const int32_t rate =
+      (acq_consts::kTimeTicksPerSec << kMotionFractionBits) / ticks_in_step;
+  const int32_t measured =
+      ((exit_direction == FORWARD) != isr_state.is_reverse_direction)
+      ? rate
+      : -rate;
+
+  if (entry_direction != exit_direction ||
+      ticks_in_step >= kAnomalyMaxMoveStepTicks) {
+    // Start of a move.
+    isr_state.velocity = measured;
+    isr_state.acceleration = 0;
+    return;
+  }
+
+  const int32_t predicted = isr_state.velocity +
+      (int32_t)(((int64_t)isr_state.acceleration * ticks_in_step) /
+          acq_consts::kTimeTicksPerSec);
+  const int32_t residual = measured - predicted;
+  isr_state.velocity = predicted + (residual >> kMotionAlphaBits);
+  isr_state.acceleration +=
+      (int32_t)((((int64_t)residual * acq_consts::kTimeTicksPerSec) /
+                    ticks_in_step) >>
+          kMotionBetaBits);
+
+  uint32_t bucket_index = (abs(isr_state.acceleration) >>
+                              kMotionFractionBits) /
+      kAccelerationBucketStepsPerSec2;
+  if (bucket_index >= kNumAccelerationBuckets) {
+    bucket_index = kNumAccelerationBuckets - 1;
+  }
+  m.acceleration_ticks[motor][bucket_index] += ticks_in_step;
+}
+
+// Adds the squared coil currents of the ending step to the energy totals
+// and restarts them for the next step.
+static inline void isr_end_step_energy(const uint8_t motor) {
+  MotorsData& m = isr_data.motors;
+  m.total_sq_currents1[motor] += m.step_sq_currents1[motor];
+  m.total_sq_currents2[motor] += m.step_sq_currents2[motor];
+  m.step_sq_currents1[motor] = 0;
+  m.step_sq_currents2[motor] = 0;
+}
+
+// Returns the coil current of a sample by the selected current metric.
+static inline uint32_t isr_current_metric(
+    const int16_t v1, const int16_t v2, const uint32_t max_current) {
+  return (isr_data.current_metric == CURRENT_METRIC_MAGNITUDE)
+      ? isr_current_magnitude(v1, v2, max_current)
+      : max_current;
+}
+
+// Track the level trigger with the given captured sample. Returns
+// true if the trigger fired.
+static inline bool isr_update_level_trigger(int16_t v1, int16_t v2) {
+  int32_t value;
+  switch (isr_data.adc_capture_trigger.channel) {
+    case TRIGGER_CHANNEL_V1:
+      value = v1;
+      break;
+    case TRIGGER_CHANNEL_V2:
+      value = v2;
+      break;
+    default: {
+      const int32_t abs_v1 = abs(v1);
+      const int32_t abs_v2 = abs(v2);
+      value = isr_current_metric(
+          v1, v2, abs_v1 > abs_v2 ? abs_v1 : abs_v2);
+    } break;
+  }
+  if (isr_data.adc_capture_trigger_negate) {
+    value = -value;
+  }
+
+  if (value < isr_data.adc_capture_trigger_arm_level) {
+    isr_data.adc_capture_trigger_armed = true;
+    return false;
+  }
+  return isr_data.adc_capture_trigger_armed &&
+      value >= isr_data.adc_capture_trigger_fire_level;
+}
+
+// Called on each trigger of the signal capture, including pre trigger
+// timeouts. A long record capture that is waiting for a trigger keeps
+// its pre trigger items and starts filling the rest of the ring.
+static inline void isr_long_capture_on_trigger() {
+  if (isr_data.long_capture_status.state != LONG_CAPTURE_PRE_TRIGGER) {
+    return;
+  }
+  long_capture_items.keep_at_most(isr_data.long_capture_pre_trigger_items);
+  isr_data.long_capture_status.trigger_index = long_capture_items.size() - 1;
+  isr_data.long_capture_status.state = LONG_CAPTURE_POST_TRIGGER;
+}
+
+// Insert a sample to the long record capture, if armed and not frozen.
+static inline void isr_long_capture_sample(const int16_t v1, const int16_t v2) {
+  LongCaptureStatus& status = isr_data.long_capture_status;  // alias
+  if (status.state == LONG_CAPTURE_IDLE ||
+      status.state == LONG_CAPTURE_FROZEN) {
+    return;
+  }
+  if (++isr_data.long_capture_divider_counter < status.divider) {
+    return;
+  }
+  isr_data.long_capture_divider_counter = 0;
+
+  AdcCaptureItem* item = long_capture_items.insert();
+  item->v1 = v1;
+  item->v2 = v2;
+
+  if (status.state == LONG_CAPTURE_PRE_FILL) {
+    if (long_capture_items.size() >= isr_data.long_capture_pre_trigger_items) {
+      status.state = LONG_CAPTURE_PRE_TRIGGER;
+    }
+  } else if (status.state == LONG_CAPTURE_POST_TRIGGER) {
+    if (long_capture_items.is_full()) {
+      status.size = long_capture_items.size();
+      status.seq_number++;
+      status.state = LONG_CAPTURE_FROZEN;
+    }
+  }
+}
+
+// Flag the capture trigger events of a step transition.
+// Called from isr on step transition.
+static inline void isr_flag_step_capture_events(const uint8_t motor,
+    Direction entry_direction, Direction exit_direction,
+    uint32_t ticks_in_step) {
+  MotorsData& m = isr_data.motors;
+  if (entry_direction == UNKNOWN_DIRECTION) {
+    return;
+  }
+  if (entry_direction != exit_direction) {
+    m.capture_events[motor] |= CAPTURE_EVENT_DIRECTION_REVERSAL;
+  } else if (ticks_in_step < isr_data.adc_capture_trigger.min_step_ticks ||
+      ticks_in_step > isr_data.adc_capture_trigger.max_step_ticks) {
+    m.capture_events[motor] |= CAPTURE_EVENT_STEP_PERIOD;
+  }
 }
 
 // A helper for the isr function.
-static inline void isr_update_full_steps_counter(int increment) {
-  State& isr_state = isr_data.state;  // alias
+// Records a completed retraction episode. Rare, not performance
+// critical.
+static void isr_end_retraction(const uint8_t motor) {
+  MotorsData& m = isr_data.motors;
+  const uint32_t steps = m.retraction_peak_steps[motor];
+  m.retraction_peak_steps[motor] = 0;
+  if (steps < kMinRetractionSteps) {
+    return;
+  }
+
+  RetractionEvent* event = m.retraction_events[motor].insert();
+  event->tick_count = m.state[motor].tick_count;
+  event->steps = steps;
+  event->retraction_ticks =
+      m.retraction_peak_tick[motor] - m.retraction_start_tick[motor];
+  event->dwell_ticks =
+      m.unretraction_start_tick[motor] - m.retraction_peak_tick[motor];
+  event->unretraction_ticks =
+      m.state[motor].tick_count - m.unretraction_start_tick[motor];
+
+  const uint8_t index =
+      31 - __builtin_clz(steps / kMinRetractionSteps);
+  RetractionBucket& bucket = m.retraction_buckets[motor][(
+      index < kNumRetractionBuckets) ? index : kNumRetractionBuckets - 1];
+  bucket.episodes++;
+  bucket.total_steps += steps;
+  bucket.total_retraction_ticks += event->retraction_ticks;
+  bucket.total_dwell_ticks += event->dwell_ticks;
+  bucket.total_unretraction_ticks += event->unretraction_ticks;
+}
+
+// Tracks the retraction episodes, given the retraction after a step.
+// Forward steps at the max position cost a couple of compares.
+static inline void isr_track_retraction(
+    const uint8_t motor, const int retraction_steps) {
+  MotorsData& m = isr_data.motors;
+  if (retraction_steps == 0) {
+    if (m.retraction_peak_steps[motor]) {
+      // Back at the max position.
+      isr_end_retraction(motor);
+    }
+    return;
+  }
+  if (retraction_steps > m.retraction_peak_steps[motor]) {
+    // Retracting deeper.
+    if (!m.retraction_peak_steps[motor]) {
+      m.retraction_start_tick[motor] = m.state[motor].tick_count;
+    }
+    m.retraction_peak_steps[motor] = retraction_steps;
+    m.retraction_peak_tick[motor] = m.state[motor].tick_count;
+    m.unretraction_start_tick[motor] = 0;
+  } else if (retraction_steps == m.retraction_peak_steps[motor]) {
+    // Jitter at the deepest position, the unretraction didn't start.
+    m.unretraction_start_tick[motor] = 0;
+  } else if (!m.unretraction_start_tick[motor]) {
+    m.unretraction_start_tick[motor] = m.state[motor].tick_count;
+  }
+}
+
+static inline void isr_update_full_steps_counter(
+    const uint8_t motor, int increment) {
+  MotorsData& m = isr_data.motors;
+  State& isr_state = m.state[motor];  // alias
 
   // Update step counter based on direction setting.
-  if (isr_data.state.is_reverse_direction) {
+  if (isr_state.is_reverse_direction) {
     isr_state.full_steps -= increment;
   } else {
     isr_state.full_steps += increment;
@@ -348,207 +1672,719 @@ static inline void isr_update_full_steps_counter(int increment) {
   if (retraction_steps > isr_state.max_retraction_steps) {
     isr_state.max_retraction_steps = retraction_steps;
   }
+  isr_track_retraction(motor, retraction_steps);
 }
 
-// NOTE: these four filters slow the interrupt handling. Consider
-// to eliminate if free CPU time is insufficient.
-//
-// We use these filters to reduce internal and external noise.
-static filters::Adc12BitsLowPassFilter<kFilterFactor> signal1_filter;
-static filters::Adc12BitsLowPassFilter<kFilterFactor> signal2_filter;
+// Insert an item to a capture lane. If the buffer is full it drops
+// the oldest item, except after the trigger, where a full lane is
+// complete and waits for the slower lanes.
+static inline void isr_insert_capture_item(
+    AdcCaptureItems& items, const int16_t v1, const int16_t v2) {
+  if (isr_data.adc_capture_state == ADC_CAPTURE_POST_TRIGER &&
+      items.is_full()) {
+    return;
+  }
+  AdcCaptureItem* item = items.insert();
+  item->v1 = v1;
+  item->v2 = v2;
+}
 
-// This function performs the bulk of the IRQ processing. It accepts
-// one pair of ADC1, ADC2 readings, analyzes it, and updates the
-// state.
-void isr_handle_one_sample(const uint16_t raw_v1, const uint16_t raw_v2) {
-  isr_data.state.tick_count++;
+// Feed a captured item to the cascaded zoom lanes.
+static inline void isr_capture_zoom_sample(int16_t v1, int16_t v2) {
+  const bool average = isr_data.adc_capture_decimation != DECIMATION_DROP;
+  for (uint8_t i = 0; i < isr_data.adc_capture_zoom_lanes; i++) {
+    isr_data.adc_capture_zoom_sums1[i] += v1;
+    isr_data.adc_capture_zoom_sums2[i] += v2;
+    if (++isr_data.adc_capture_zoom_counters[i] < kAdcCaptureZoomFactor) {
+      return;
+    }
+    isr_data.adc_capture_zoom_counters[i] = 0;
+    if (average) {
+      v1 = isr_data.adc_capture_zoom_sums1[i] / kAdcCaptureZoomFactor;
+      v2 = isr_data.adc_capture_zoom_sums2[i] / kAdcCaptureZoomFactor;
+    }
+    isr_data.adc_capture_zoom_sums1[i] = 0;
+    isr_data.adc_capture_zoom_sums2[i] = 0;
+    isr_insert_capture_item(isr_data.adc_capture_buffer.zoom_items[i], v1, v2);
+  }
+}
 
-  // Every N ADC ticks, capture the steps values.
-  if (++isr_data.steps_capture_divider_counter >= kStepsCaptureDivider) {
-    isr_data.steps_capture_divider_counter = 0;
-    StepsCaptureItem* item = isr_data.steps_capture_buffer.insert();
-    item->full_steps = isr_data.state.full_steps;
-    item->max_full_steps = isr_data.state.max_full_steps;
+// Each zoom lane fills slower than the previous one so it's
+// sufficient to check the last one.
+static inline const AdcCaptureItems& isr_slowest_zoom_lane() {
+  return isr_data.adc_capture_buffer
+      .zoom_items[isr_data.adc_capture_zoom_lanes - 1];
+}
+
+static inline bool isr_zoom_lanes_have_at_least(uint16_t n) {
+  return !isr_data.adc_capture_zoom_lanes ||
+      isr_slowest_zoom_lane().size() >= n;
+}
+
+static inline bool isr_zoom_lanes_full() {
+  return !isr_data.adc_capture_zoom_lanes || isr_slowest_zoom_lane().is_full();
+}
+
+// Called on a capture trigger. Keep only the pre trigger points. This way
+// the trigger will always be at the same position in the buffer. Zoom
+// lanes are aligned to their last item, up to one item before the
+// trigger.
+static inline void isr_trigger_capture() {
+  isr_data.adc_capture_buffer.items.keep_at_most(
+      isr_data.adc_capture_pre_trigger_items);
+  for (uint8_t i = 0; i < isr_data.adc_capture_zoom_lanes; i++) {
+    isr_data.adc_capture_buffer.zoom_items[i].keep_at_most(
+        isr_data.adc_capture_pre_trigger_items);
   }
+  isr_data.adc_capture_state = ADC_CAPTURE_POST_TRIGER;
+  isr_long_capture_on_trigger();
+}
 
-  // Slight filtering for signal cleanup.
-  const int16_t v1 = (int16_t)signal1_filter.update(raw_v1) - isr_data.offset1;
-  const int16_t v2 = (int16_t)signal2_filter.update(raw_v2) - isr_data.offset2;
+// Insert a decimated sample to the capture buffer and advance the
+// capture state machine.
+static inline void isr_capture_sample(const int16_t v1, const int16_t v2) {
+  isr_insert_capture_item(isr_data.adc_capture_buffer.items, v1, v2);
+  if (isr_data.adc_capture_zoom_lanes) {
+    isr_capture_zoom_sample(v1, v2);
+  }
 
-  isr_data.state.v1 = v1;
-  isr_data.state.v2 = v2;
+  switch (isr_data.adc_capture_state) {
+    // In this sate we blindly fill the pre trigger part of the buffer.
+    // The level trigger may get armed though.
+    case ADC_CAPTURE_PRE_FILL:
+      isr_update_level_trigger(v1, v2);
+      if (isr_data.adc_capture_buffer.items.size() >=
+              isr_data.adc_capture_pre_trigger_items &&
+          isr_zoom_lanes_have_at_least(
+              isr_data.adc_capture_pre_trigger_items)) {
+        isr_data.adc_capture_state = ADC_CAPTURE_PRE_TRIGGER;
+      }
+      break;
 
-  // Handle adc signal capturing.
-  if (++isr_data.adc_capture_divider_counter >= isr_data.adc_capture_divider) {
-    isr_data.adc_capture_divider_counter = 0;
-    // Insert sample to circular buffer. If the buffer is full it drops
-    // the oldest item.
-    AdcCaptureItem* adc_capture_item =
-        isr_data.adc_capture_buffer.items.insert();
-    adc_capture_item->v1 = v1;
-    adc_capture_item->v2 = v2;
-
-    switch (isr_data.adc_capture_state) {
-      // In this sate we blindly fill half of the buffer.
-      case ADC_CAPTURE_HALF_FILL:
-        if (isr_data.adc_capture_buffer.items.size() >=
-            kAdcCaptureBufferSize / 2) {
-          isr_data.adc_capture_state = ADC_CAPTURE_PRE_TRIGGER;
+    // In this state we look for a trigger event or a pre trigger timeout.
+    case ADC_CAPTURE_PRE_TRIGGER: {
+      // Event trigger. These wait indefinitely for the event and
+      // keep the pre trigger history rolling in the circular buffer.
+      if (isr_data.adc_capture_trigger_event_mask) {
+        if (isr_data.motors.capture_events[isr_data.capture_motor] &
+            isr_data.adc_capture_trigger_event_mask) {
+          isr_trigger_capture();
         }
         break;
+      }
 
-      // In this state we look for a trigger event or a pre trigger timeout.
-      case ADC_CAPTURE_PRE_TRIGGER: {
-        // Pre trigger timeout?
-        if (isr_data.adc_capture_pre_trigger_items_left == 0) {
-          // NOTE: if the buffer is full here we could terminate
-          // the capture but we go through the normal motions for simplicity.
-          isr_data.adc_capture_state = ADC_CAPTURE_POST_TRIGER;
-          break;
-        }
-        isr_data.adc_capture_pre_trigger_items_left--;
-        // Is this a trigger event?
-        const int16_t old_v1 =
-            isr_data.adc_capture_buffer.items.get_reversed(5)->v1;
-        // Trigger criteria: crossing up the zero line.
-        if (old_v1 < -10 && v1 >= 0) {
-          // Keep only the last n/2 points. This way the trigger will
-          // always be in the middle of the buffer.
-          isr_data.adc_capture_buffer.items.keep_at_most(
-              kAdcCaptureBufferSize / 2);
-          isr_data.adc_capture_state = ADC_CAPTURE_POST_TRIGER;
-        }
-      } break;
-
-      // In this state we blindly fill the rest of the buffer. Note
-      // that the current sample was already inserted above.
-      case ADC_CAPTURE_POST_TRIGER:
-        if (isr_data.adc_capture_buffer.items.is_full()) {
-          // We completed a capture cycle. Snapshot the result and start
-          // a new cycle.
-          isr_restart_adc_capture_cycle();
-        }
+      // Pre trigger timeout?
+      if (isr_data.adc_capture_pre_trigger_items_left == 0) {
+        // NOTE: if the buffer is full here we could terminate
+        // the capture but we go through the normal motions for simplicity.
+        isr_data.adc_capture_state = ADC_CAPTURE_POST_TRIGER;
+        isr_long_capture_on_trigger();
         break;
+      }
+      isr_data.adc_capture_pre_trigger_items_left--;
+      // Is this a trigger event?
+      if (isr_update_level_trigger(v1, v2)) {
+        isr_trigger_capture();
+      }
+    } break;
+
+    // In this state we blindly fill the rest of the buffer and the
+    // zoom lanes. Note that the current sample was already inserted above.
+    case ADC_CAPTURE_POST_TRIGER:
+      if (isr_data.adc_capture_buffer.items.is_full() &&
+          isr_zoom_lanes_full()) {
+        // We completed a capture cycle. Snapshot the result and start
+        // a new cycle.
+        isr_restart_adc_capture_cycle();
+      }
+      break;
+  }
+
+  // Events are consumed by the captured sample that follows them.
+  isr_data.motors.capture_events[isr_data.capture_motor] = 0;
+}
+
+// Handles the signal captures with a sample of the capture motor.
+static inline void isr_capture_motor_sample(
+    const int16_t v1, const int16_t v2) {
+  // Handle long record capturing. Done before the signal capture so the
+  // current sample is in the ring if the signal capture triggers.
+  // Compiled out if disabled.
+  if (kLongCaptureBufferSize) {
+    isr_long_capture_sample(v1, v2);
+  }
+
+  // Handle adc signal capturing. The decimators accumulate every
+  // sample and produce an output once per divider samples.
+  const CaptureDecimation decimation = isr_data.adc_capture_decimation;
+  if (decimation == DECIMATION_BOXCAR) {
+    isr_data.adc_capture_decimator1.update1(v1);
+    isr_data.adc_capture_decimator2.update1(v2);
+  } else if (decimation == DECIMATION_CIC2) {
+    isr_data.adc_capture_decimator1.update2(v1);
+    isr_data.adc_capture_decimator2.update2(v2);
+  }
+  if (++isr_data.adc_capture_divider_counter >= isr_data.adc_capture_divider) {
+    isr_data.adc_capture_divider_counter = 0;
+    const uint8_t divider = isr_data.adc_capture_divider;
+    if (decimation == DECIMATION_DROP) {
+      isr_capture_sample(v1, v2);
+    } else if (decimation == DECIMATION_BOXCAR) {
+      isr_capture_sample(isr_data.adc_capture_decimator1.output1(divider),
+          isr_data.adc_capture_decimator2.output1(divider));
+    } else {
+      const uint32_t r_squared = (uint32_t)divider * divider;
+      const int16_t d1 = isr_data.adc_capture_decimator1.output2(r_squared);
+      const int16_t d2 = isr_data.adc_capture_decimator2.output2(r_squared);
+      if (isr_data.adc_capture_decimator_skip) {
+        isr_data.adc_capture_decimator_skip--;
+      } else {
+        isr_capture_sample(d1, d2);
+      }
     }
   }
+}
+
+// Per sample pipeline stage. Every N ADC ticks, capture the steps values.
+static inline void isr_steps_capture_stage(const uint8_t motor) {
+  MotorsData& m = isr_data.motors;
+  if (++m.steps_capture_divider_counter[motor] >= kStepsCaptureDivider) {
+    m.steps_capture_divider_counter[motor] = 0;
+    StepsCaptureItem* item = m.steps_capture_buffer[motor].insert();
+    item->full_steps = m.state[motor].full_steps;
+    item->max_full_steps = m.state[motor].max_full_steps;
+  }
+}
+
+// Per sample pipeline stage of the capture motor. Streams every n'th
+// sample's state. A single compare when the stream is disabled.
+static inline void isr_position_stream_stage(const uint8_t motor) {
+  const MotorsData& m = isr_data.motors;
+  if (!isr_data.position_stream_divider ||
+      ++isr_data.position_stream_counter < isr_data.position_stream_divider) {
+    return;
+  }
+  isr_data.position_stream_counter = 0;
+  PositionStreamItem* item = position_stream_buffer.insert();
+  item->tick_count = m.state[motor].tick_count;
+  item->motor = motor;
+  item->full_steps = m.state[motor].full_steps;
+  item->v1 = m.state[motor].v1;
+  item->v2 = m.state[motor].v2;
+  item->quadrant = m.state[motor].quadrant;
+  item->is_energized = m.state[motor].is_energized;
+  item->is_reverse_direction = m.state[motor].is_reverse_direction;
+}
 
-  // Determine if motor is energized. Use hysteresis for noise rejection.
-  // Release: 200ns. Debug: 600ns.
-  const bool old_is_energized = isr_data.state.is_energized;
+// Per sample pipeline stage. Determines if the motor is energized, using
+// hysteresis for noise rejection, and handles the transition to non
+// energized. Returns the new energized state.
+// Release: 200ns. Debug: 600ns.
+template <uint8_t kStages>
+static inline bool isr_energized_stage(
+    const uint8_t motor, const int16_t v1, const int16_t v2) {
+  MotorsData& m = isr_data.motors;
+  const bool old_is_energized = m.state[motor].is_energized;
   const uint16_t total_current = abs(v1) + abs(v2);
   // Using histeresis.
   const uint16_t energized_threshold = old_is_energized
-      ? kNonEnergizedThresholdCounts
-      : kEnergizedThresholdCounts;
+      ? m.non_energized_threshold[motor]
+      : m.energized_threshold[motor];
   const bool new_is_energized = total_current > energized_threshold;
-  isr_data.state.is_energized = new_is_energized;
-
-  // Handle the non energized case. No need to go through quadrant decoding.
-  // Pass through case: Release: 110ns. Debug: 250ns.
-  if (!new_is_energized) {
-    if (old_is_energized) {
-      // Becoming non energized.
-      isr_data.state.last_step_direction = UNKNOWN_DIRECTION;
-      isr_data.state.ticks_in_step = 0;
-      isr_data.state.non_energized_count++;
-    } else {
-      // Staying non energized
+  m.state[motor].is_energized = new_is_energized;
+
+  if (!new_is_energized && old_is_energized) {
+    // Becoming non energized.
+    m.state[motor].last_step_direction = UNKNOWN_DIRECTION;
+    m.state[motor].ticks_in_step = 0;
+    m.state[motor].non_energized_count++;
+    if constexpr (kStages & STAGE_EVENT_TRIGGERS) {
+      m.capture_events[motor] |= CAPTURE_EVENT_NON_ENERGIZED;
     }
+    isr_end_step_energy(motor);
+  }
+  return new_is_energized;
+}
+
+// Returns the one count correction of an offset with the given window
+// average, or zero if none.
+static inline int16_t isr_drift_step(
+    const int32_t average, const int16_t total_correction) {
+  if (average == 0 || average > kMaxDriftErrorCounts ||
+      average < -kMaxDriftErrorCounts) {
+    return 0;
+  }
+  const int16_t step = (average > 0) ? 1 : -1;
+  const int16_t new_total = total_correction + step;
+  return (new_total > kMaxDriftCorrectionCounts ||
+             new_total < -kMaxDriftCorrectionCounts)
+      ? 0
+      : step;
+}
+
+// Updates the noise floor with the mean absolute deviation of a
+// completed drift window and derives the energized limits from it,
+// within the bounds of the sensor. Once per drift window, not
+// performance critical.
+static void isr_update_thresholds(
+    const uint8_t motor, const uint16_t mad) {
+  MotorsData& m = isr_data.motors;
+  // Smoothed over windows. The first window sets the initial value.
+  m.noise_floor[motor] = m.noise_floor[motor]
+      ? (uint16_t)(((uint32_t)m.noise_floor[motor] * 3 + mad) >> 2)
+      : mad;
+  const uint32_t threshold =
+      ((kNoiseThresholdFactor * m.noise_floor[motor]) >> 4) +
+      abs(m.drift_mean1[motor]) + abs(m.drift_mean2[motor]);
+  m.non_energized_threshold[motor] =
+      (threshold < isr_data.min_non_energized_threshold)
+      ? isr_data.min_non_energized_threshold
+      : (threshold > isr_data.max_non_energized_threshold)
+      ? isr_data.max_non_energized_threshold
+      : threshold;
+  m.energized_threshold[motor] =
+      m.non_energized_threshold[motor] * kEnergizedThresholdRatio;
+}
+
+// Per sample pipeline stage. Tracks the zero offsets drift and the
+// noise floor of a non energized sample. See kDriftWindowSamples.
+static inline void isr_non_energized_stage(const uint8_t motor,
+    const bool old_is_energized, const int16_t v1, const int16_t v2) {
+  MotorsData& m = isr_data.motors;
+  if (old_is_energized) {
+    // Just became non energized. Wait for the current to decay.
+    isr_restart_offset_drift(motor);
+    return;
+  }
+  if (++m.drift_count[motor] <= 0) {
+    // Still settling.
+    return;
+  }
+  m.drift_sum1[motor] += v1;
+  m.drift_sum2[motor] += v2;
+  m.noise_sum[motor] +=
+      abs(v1 - m.drift_mean1[motor]) + abs(v2 - m.drift_mean2[motor]);
+  if (m.drift_count[motor] < kDriftWindowSamples) {
     return;
   }
 
-  // Here when energized. Decode quadrant.
-  // We now go through a decision tree to collect the new quadrant, sector
-  // and max coil current. Optimized for speed. See quadrants_plot.png
-  // for the individual cases.
-  uint8_t new_quadrant;  // set below to [0, 3]
-  uint32_t max_current;  // max coil current
+  // Window completed. The averages are after the gains but only
+  // their sign and magnitude limit matter.
+  const int32_t average1 = m.drift_sum1[motor] / kDriftWindowSamples;
+  const int32_t average2 = m.drift_sum2[motor] / kDriftWindowSamples;
+  const int16_t step1 = isr_drift_step(average1, m.drift_correction1[motor]);
+  const int16_t step2 = isr_drift_step(average2, m.drift_correction2[motor]);
+  if (step1 || step2) {
+    m.offset1[motor] += step1;
+    m.offset2[motor] += step2;
+    m.drift_correction1[motor] += step1;
+    m.drift_correction2[motor] += step2;
+    m.offsets_drifted[motor] = true;
+  }
+
+  // Windows with an actual current are not noise.
+  const bool is_quiet = average1 <= kMaxDriftErrorCounts &&
+      average1 >= -kMaxDriftErrorCounts &&
+      average2 <= kMaxDriftErrorCounts && average2 >= -kMaxDriftErrorCounts;
+  if (is_quiet) {
+    // The mean absolute deviation, with 4 fraction bits.
+    const uint32_t mad = (m.noise_sum[motor] << 4) / kDriftWindowSamples;
+    isr_update_thresholds(motor, mad > 0xffff ? 0xffff : mad);
+  }
+  m.drift_mean1[motor] = is_quiet ? average1 : 0;
+  m.drift_mean2[motor] = is_quiet ? average2 : 0;
+
+  m.drift_count[motor] = 0;
+  m.drift_sum1[motor] = 0;
+  m.drift_sum2[motor] = 0;
+  m.noise_sum[motor] = 0;
+}
+
+// Per sample pipeline stage. Returns the quadrant [0, 3] of an energized
+// sample and sets max_current to its max coil current.
+// We go through a decision tree to collect the new quadrant, sector
+// and max coil current. Optimized for speed. See quadrants_plot.png
+// for the individual cases.
+static inline uint8_t isr_quadrant_stage(
+    const int16_t v1, const int16_t v2, uint32_t* max_current) {
   if (v2 >= 0) {
     if (v1 >= 0) {
       // Quadrant 0: v1 > 0, V2 > 0.
-      new_quadrant = 0;
-      if (v1 > v2) {
-        // Sector 0: v1 > 0, V2 > 0.  |v1| > |v2|
-        max_current = v1;
-      } else {
-        // Sector 1: v1 > 0, V2 > 0.  |v1| < |v2|
-        max_current = v2;
-      }
-    } else {
-      // Quadrant 1: v1 < 0, V2 > 0
-      new_quadrant = 1;
-      if (-v1 < v2) {
-        // Sector 2: v1 < 0, V2 > 0.  |v1| < |v2|
-        max_current = v2;
-      } else {
-        // Sector 3: v1 < 0, V2 > 0.  |v1| > |v2|
-        max_current = -v1;
-      }
-    }
-  } else {
-    if (v1 < 0) {
-      // Quadrant 2:  v1 < 0, V2 < 0
-      new_quadrant = 2;
-      if (-v1 > -v2) {
-        // Sector 4: v1 < 0, V2 < 0.  |v1| > |v2|
-        max_current = -v1;
-      } else {
-        // Sector 5: v1 < 0, V2 < 0.  |v1| < |v2|
-        max_current = -v2;
-      }
-    } else {
-      // Quadrant 3 v1 > 0, V2 < 0.
-      new_quadrant = 3;
-      if (v1 < -v2) {
-        // Sector 6: v1 > 1, V2 < 0.  |v1| < |v2|
-        max_current = -v2;
-      } else {
-        // Sector 7: v1 > 0, V2 < 0.  |v1| > |v2|
-        max_current = v1;
-      }
+      // Sector 0: |v1| > |v2|. Sector 1: |v1| < |v2|.
+      *max_current = (v1 > v2) ? v1 : v2;
+      return 0;
     }
+    // Quadrant 1: v1 < 0, V2 > 0
+    // Sector 2: |v1| < |v2|. Sector 3: |v1| > |v2|.
+    *max_current = (-v1 < v2) ? v2 : -v1;
+    return 1;
   }
+  if (v1 < 0) {
+    // Quadrant 2:  v1 < 0, V2 < 0
+    // Sector 4: |v1| > |v2|. Sector 5: |v1| < |v2|.
+    *max_current = (-v1 > -v2) ? -v1 : -v2;
+    return 2;
+  }
+  // Quadrant 3 v1 > 0, V2 < 0.
+  // Sector 6: |v1| < |v2|. Sector 7: |v1| > |v2|.
+  *max_current = (v1 < -v2) ? -v2 : v1;
+  return 3;
+}
 
-  const uint8_t old_quadrant = isr_data.state.quadrant;  // old quadrant [0, 3]
-  isr_data.state.quadrant = new_quadrant;
+// Per sample pipeline stage. Tracks the quadrant transitions of an
+// energized sample and updates the steps and the histogram.
+template <uint8_t kStages>
+static inline void isr_step_stage(const uint8_t motor,
+    const bool old_is_energized, const uint8_t new_quadrant,
+    const uint32_t max_current) {
+  MotorsData& m = isr_data.motors;
+  State& isr_state = m.state[motor];  // alias
+  const uint8_t old_quadrant = isr_state.quadrant;  // old quadrant [0, 3]
+  isr_state.quadrant = new_quadrant;
 
-  // Track quadrant transitions and update steps.
   if (!old_is_energized) {
     // Case 1: motor just became energized. Direction is still not known.
-    isr_data.state.last_step_direction = UNKNOWN_DIRECTION;
-    isr_data.state.ticks_in_step = 1;
-    isr_data.state.max_current_in_step = max_current;
+    if constexpr (kStages & STAGE_EVENT_TRIGGERS) {
+      m.capture_events[motor] |= CAPTURE_EVENT_ENERGIZED;
+    }
+    isr_state.last_step_direction = UNKNOWN_DIRECTION;
+    isr_state.ticks_in_step = 1;
+    isr_state.max_current_in_step = max_current;
   } else if (new_quadrant == old_quadrant) {
     // Case 2: staying in same quadrant
-    isr_data.state.ticks_in_step++;
-    if (max_current > isr_data.state.max_current_in_step) {
-      isr_data.state.max_current_in_step = max_current;
+    isr_state.ticks_in_step++;
+    if (max_current > isr_state.max_current_in_step) {
+      isr_state.max_current_in_step = max_current;
     }
   } else if (new_quadrant == ((old_quadrant + 1) & 0x03)) {
     // Case 3: Moved to next quadrant.
-    isr_update_full_steps_counter(+1);
-    isr_add_step_to_histogram(old_quadrant, isr_data.state.last_step_direction,
-        FORWARD, isr_data.state.ticks_in_step,
-        isr_data.state.max_current_in_step);
-    isr_data.state.last_step_direction = FORWARD;
-    isr_data.state.ticks_in_step = 1;
-    isr_data.state.max_current_in_step = max_current;
+    isr_update_full_steps_counter(motor, +1);
+    if constexpr (kStages & STAGE_EVENT_TRIGGERS) {
+      isr_flag_step_capture_events(motor, isr_state.last_step_direction,
+          FORWARD, isr_state.ticks_in_step);
+    }
+    isr_detect_step_anomalies(motor, isr_state.last_step_direction, FORWARD,
+        isr_state.ticks_in_step, isr_state.max_current_in_step);
+    isr_track_motion(
+        motor, isr_state.last_step_direction, FORWARD, isr_state.ticks_in_step);
+    if (isr_state.last_step_direction == BACKWARD) {
+      isr_add_reversal(motor, BACKWARD, isr_state.ticks_in_step);
+    }
+    isr_add_step_to_histogram(motor, old_quadrant,
+        isr_state.last_step_direction, FORWARD, isr_state.ticks_in_step,
+        isr_state.max_current_in_step);
+    isr_end_step_energy(motor);
+    isr_state.last_step_direction = FORWARD;
+    isr_state.ticks_in_step = 1;
+    isr_state.max_current_in_step = max_current;
   } else if (new_quadrant == ((old_quadrant - 1) & 0x03)) {
     // Case 4: Moved to previous quadrant.
-    isr_update_full_steps_counter(-1);
-    isr_add_step_to_histogram(old_quadrant, isr_data.state.last_step_direction,
-        BACKWARD, isr_data.state.ticks_in_step,
-        isr_data.state.max_current_in_step);
-    isr_data.state.last_step_direction = BACKWARD;
-    isr_data.state.ticks_in_step = 1;
-    isr_data.state.max_current_in_step = max_current;
+    isr_update_full_steps_counter(motor, -1);
+    if constexpr (kStages & STAGE_EVENT_TRIGGERS) {
+      isr_flag_step_capture_events(motor, isr_state.last_step_direction,
+          BACKWARD, isr_state.ticks_in_step);
+    }
+    isr_detect_step_anomalies(motor, isr_state.last_step_direction, BACKWARD,
+        isr_state.ticks_in_step, isr_state.max_current_in_step);
+    isr_track_motion(motor, isr_state.last_step_direction, BACKWARD,
+        isr_state.ticks_in_step);
+    if (isr_state.last_step_direction == FORWARD) {
+      isr_add_reversal(motor, FORWARD, isr_state.ticks_in_step);
+    }
+    isr_add_step_to_histogram(motor, old_quadrant,
+        isr_state.last_step_direction, BACKWARD, isr_state.ticks_in_step,
+        isr_state.max_current_in_step);
+    isr_end_step_energy(motor);
+    isr_state.last_step_direction = BACKWARD;
+    isr_state.ticks_in_step = 1;
+    isr_state.max_current_in_step = max_current;
   } else {
     // Case 5: Invalid quadrant transition.
-    // TODO: count and report errors.
-    isr_data.state.quadrature_errors++;
-    isr_data.state.last_step_direction = UNKNOWN_DIRECTION;
-    isr_data.state.ticks_in_step = 1;
-    isr_data.state.max_current_in_step = max_current;
+    isr_state.quadrature_errors++;
+    const QuadratureErrorClass error_class =
+        isr_record_quadrature_error(motor, old_quadrant, new_quadrant);
+    if constexpr (kStages & STAGE_EVENT_TRIGGERS) {
+      m.capture_events[motor] |= CAPTURE_EVENT_QUADRATURE_ERROR;
+    }
+    // Low current and at rest errors are typically noise, e.g. while
+    // homing, and are only counted.
+    if (error_class == QUADRATURE_ERROR_IN_MOVE) {
+      isr_raise_anomaly(
+          motor, ANOMALY_QUADRATURE_ERROR, isr_state.quadrature_errors);
+    }
+    m.anomaly_last_step_ticks[motor] = 0;
+    m.anomaly_move_peak_current[motor] = 0;
+    isr_end_step_energy(motor);
+    isr_state.last_step_direction = UNKNOWN_DIRECTION;
+    isr_state.ticks_in_step = 1;
+    isr_state.max_current_in_step = max_current;
+  }
+}
+
+// This function performs the bulk of the IRQ processing. It accepts
+// one pair of ADC1, ADC2 readings of a motor, analyzes it, and updates
+// the motor's state. It's composed of the stages above and instantiated
+// per filter kernel and optional stages, see isr_sample_handler. The
+// sensor scale is a runtime parameter of the rare threshold updates.
+template <class Filter, uint8_t kStages>
+static void isr_process_sample(
+    const uint8_t motor, const uint16_t raw_v1, const uint16_t raw_v2) {
+  MotorsData& m = isr_data.motors;  // alias
+
+  // Streams the state of the previous sample, before it's updated.
+  if constexpr (kStages & STAGE_POSITION_STREAM) {
+    if (kNumMotors == 1 || motor == isr_data.capture_motor) {
+      isr_position_stream_stage(motor);
+    }
+  }
+
+  m.state[motor].tick_count++;
+
+  isr_steps_capture_stage(motor);
+
+  // ADC nonlinearity correction. A single load per reading.
+  uint16_t filtered_v1 = adc_linearity_table[raw_v1 & 0x0fff];
+  uint16_t filtered_v2 = adc_linearity_table[raw_v2 & 0x0fff];
+
+  // Slight filtering for signal cleanup. Both channels in one pass.
+  filters::DualFilter<Filter>::update(m.signal1_filter[motor],
+      m.signal2_filter[motor], &filtered_v1, &filtered_v2);
+  const int32_t f1 = (int16_t)filtered_v1 - m.offset1[motor];
+  const int32_t f2 = (int16_t)filtered_v2 - m.offset2[motor];
+
+  // Balance the channels. A multiply-shift per channel.
+  const int16_t v1 = (f1 * m.gain1[motor]) >> acq_consts::kGainFractionBits;
+  const int16_t v2 = (f2 * m.gain2[motor]) >> acq_consts::kGainFractionBits;
+
+  m.state[motor].v1 = v1;
+  m.state[motor].v2 = v2;
+
+  // The signal captures follow a single motor. The motor check is
+  // compiled out with a single motor.
+  if (kNumMotors == 1 || motor == isr_data.capture_motor) {
+    isr_capture_motor_sample(v1, v2);
+    if constexpr (kStages & STAGE_RESONANCE) {
+      isr_resonance_stage(v1, v2);
+    }
+  }
+
+  const bool old_is_energized = m.state[motor].is_energized;
+  if (!isr_energized_stage<kStages>(motor, v1, v2)) {
+    // Non energized. No need to go through quadrant decoding.
+    // Pass through case: Release: 110ns. Debug: 250ns.
+    isr_non_energized_stage(motor, old_is_energized, v1, v2);
+    return;
+  }
+
+  // Here when energized.
+  uint32_t max_current;  // max coil current
+  const uint8_t new_quadrant = isr_quadrant_stage(v1, v2, &max_current);
+  isr_step_stage<kStages>(motor, old_is_energized, new_quadrant,
+      isr_current_metric(v1, v2, max_current));
+
+  // Coil energy. A multiply-accumulate per channel, 32x32 bits to 64
+  // bits, which can't overflow in practice.
+  m.step_sq_currents1[motor] += (uint32_t)(v1 * v1);
+  m.step_sq_currents2[motor] += (uint32_t)(v2 * v2);
+}
+
+// The pipeline instance of the signal filter and the enabled optional
+// stages. Set by setup(), before the ADC task
+// starts, and then within the mutex.
+SampleHandler isr_sample_handler = nullptr;
+
+// The current signal filter. Protected by the mutex.
+static SignalFilter signal_filter = kDefaultSignalFilter;
+
+// Indexed by a PipelineStageBits mask. Every combination of the
+// optional stages has its own instance.
+template <class Filter>
+static SampleHandler stages_sample_handler(uint8_t stages) {
+  static constexpr SampleHandler kHandlers[] = {
+      isr_process_sample<Filter, 0>,
+      isr_process_sample<Filter, 1>,
+      isr_process_sample<Filter, 2>,
+      isr_process_sample<Filter, 3>,
+      isr_process_sample<Filter, 4>,
+      isr_process_sample<Filter, 5>,
+      isr_process_sample<Filter, 6>,
+      isr_process_sample<Filter, 7>,
+  };
+  return kHandlers[stages & 0x07];
+}
+
+// Returns the pipeline instance of a signal filter and a
+// PipelineStageBits mask of optional stages, or null if not supported.
+static SampleHandler sample_handler(SignalFilter filter, uint8_t stages) {
+  switch (filter) {
+    case FILTER_BYPASS:
+      return stages_sample_handler<filters::BypassFilter>(stages);
+    case FILTER_LOW_PASS_LIGHT:
+      return stages_sample_handler<filters::LowPassFilter<500>>(stages);
+    case FILTER_LOW_PASS:
+      return stages_sample_handler<filters::LowPassFilter<700>>(stages);
+    case FILTER_LOW_PASS_HEAVY:
+      return stages_sample_handler<filters::LowPassFilter<900>>(stages);
+    case FILTER_BIQUAD:
+      return stages_sample_handler<filters::BiquadFilter>(stages);
+    case FILTER_MEDIAN3:
+      return stages_sample_handler<filters::FilterChain<
+          filters::Median3Filter, filters::LowPassFilter<700>>>(stages);
+    default:
+      return nullptr;
+  }
+}
+
+// The optional stages that are enabled. Called within the mutex.
+static uint8_t mutex_enabled_stages() {
+  uint8_t stages = 0;
+  if (isr_data.position_stream_divider) {
+    stages |= STAGE_POSITION_STREAM;
+  }
+  if (isr_data.resonance_num_bands) {
+    stages |= STAGE_RESONANCE;
+  }
+  if (isr_data.adc_capture_trigger_event_mask) {
+    stages |= STAGE_EVENT_TRIGGERS;
+  }
+  return stages;
+}
+
+static void mutex_update_sample_handler() {
+  isr_sample_handler = sample_handler(signal_filter, mutex_enabled_stages());
+  assert(isr_sample_handler);
+}
+
+bool set_signal_filter(SignalFilter filter) {
+  SampleHandler handler;
+  ENTER_MUTEX {
+    handler = sample_handler(filter, mutex_enabled_stages());
+    if (handler) {
+      signal_filter = filter;
+      isr_sample_handler = handler;
+      // Start the new filter from the current filtered values, before
+      // the gains and the offsets.
+      for (uint8_t motor = 0; motor < kNumMotors; motor++) {
+        MotorsData& m = isr_data.motors;
+        m.signal1_filter[motor].reset(
+            ((int32_t)m.state[motor].v1 << acq_consts::kGainFractionBits) /
+                m.gain1[motor] +
+            m.offset1[motor]);
+        m.signal2_filter[motor].reset(
+            ((int32_t)m.state[motor].v2 << acq_consts::kGainFractionBits) /
+                m.gain2[motor] +
+            m.offset2[motor]);
+      }
+    }
+  }
+  EXIT_MUTEX
+
+  if (!handler) {
+    ESP_LOGE(TAG, "Invalid signal filter %d", filter);
+    return false;
+  }
+  ESP_LOGI(TAG, "Signal filter set to %d", filter);
+  return true;
+}
+
+bool set_adc_ticks_per_amp(uint16_t ticks_per_amp) {
+  if (!ticks_per_amp) {
+    ESP_LOGE(TAG, "Invalid ADC ticks per amp: %hu", ticks_per_amp);
+    return false;
+  }
+  ENTER_MUTEX {
+    // The noise floor is in the old sensor units.
+    isr_reset_thresholds(ticks_per_amp);
+  }
+  EXIT_MUTEX
+
+  ESP_LOGI(TAG, "ADC ticks per amp set to %hu", ticks_per_amp);
+  return true;
+}
+
+SignalFilter get_signal_filter() {
+  SignalFilter result;
+  ENTER_MUTEX { result = signal_filter; }
+  EXIT_MUTEX
+  return result;
+}
+
+bool set_current_metric(CurrentMetric metric) {
+  if (metric < 0 || metric >= CURRENT_METRICS_COUNT) {
+    ESP_LOGE(TAG, "Invalid current metric %d", metric);
+    return false;
+  }
+
+  ENTER_MUTEX { isr_data.current_metric = metric; }
+  EXIT_MUTEX
+
+  ESP_LOGI(TAG, "Current metric set to %d", metric);
+  return true;
+}
+
+CurrentMetric get_current_metric() {
+  CurrentMetric result;
+  ENTER_MUTEX { result = isr_data.current_metric; }
+  EXIT_MUTEX
+  return result;
+}
+
+// Called on each state snapshot. Adds the changes since the previous
+// snapshot to the periods in progress, and completes the periods that
+// the snapshot passed. The snapshot interval that crosses a period
+// boundary is attributed to the completed period.
+static void isr_update_rollups(const uint8_t motor) {
+  MotorsData& m = isr_data.motors;
+  const State& s = m.state[motor];
+  const uint32_t ticks = s.tick_count - m.rollup_last_tick[motor];
+  const int32_t steps = s.full_steps - m.rollup_last_full_steps[motor];
+  const uint32_t quadrature_errors =
+      s.quadrature_errors - m.rollup_last_quadrature_errors[motor];
+  const uint64_t total_sq_currents =
+      m.total_sq_currents1[motor] + m.step_sq_currents1[motor] +
+      m.total_sq_currents2[motor] + m.step_sq_currents2[motor];
+  const uint64_t sq_currents =
+      total_sq_currents - m.rollup_last_sq_currents[motor];
+  m.rollup_last_tick[motor] = s.tick_count;
+  m.rollup_last_full_steps[motor] = s.full_steps;
+  m.rollup_last_quadrature_errors[motor] = s.quadrature_errors;
+  m.rollup_last_sq_currents[motor] = total_sq_currents;
+
+  const uint32_t speed = abs(state_velocity(s));
+  // The step current is not tracked while non energized.
+  const uint32_t current = s.is_energized ? s.max_current_in_step : 0;
+  const uint16_t peak_current = (current > UINT16_MAX) ? UINT16_MAX : current;
+
+  for (uint8_t tier = 0; tier < ROLLUP_TIERS_COUNT; tier++) {
+    OpenRollup& open = m.open_rollups[motor][tier];
+    Rollup& rollup = open.rollup;
+    open.ticks += ticks;
+    open.sq_currents += sq_currents;
+    rollup.steps += steps;
+    if (speed > rollup.max_speed) {
+      rollup.max_speed = (speed > UINT16_MAX) ? UINT16_MAX : speed;
+    }
+    if (peak_current > rollup.peak_current) {
+      rollup.peak_current = peak_current;
+    }
+    const uint32_t total_quadrature_errors =
+        rollup.quadrature_errors + quadrature_errors;
+    rollup.quadrature_errors = (total_quadrature_errors > UINT16_MAX)
+        ? UINT16_MAX
+        : total_quadrature_errors;
+    if (s.is_energized) {
+      rollup.energized_ticks += ticks;
+    }
+
+    const uint32_t period = s.tick_count /
+        ((uint32_t)kRollupTierSecs[tier] * acq_consts::kTimeTicksPerSec);
+    if (period != rollup.period) {
+      rollup.mean_sq_current =
+          open.ticks ? open.sq_currents / (2 * open.ticks) : 0;
+      *m.rollups[motor][tier].insert() = rollup;
+      open = {};
+      rollup.period = period;
+    }
   }
 }
 
@@ -556,10 +2392,13 @@ void isr_handle_one_sample(const uint16_t raw_v1, const uint16_t raw_v2) {
 // isr_handle_one_sample. Used to snapshot the state at fixed time intervals.
 void isr_snapshot_state() {
   // This drops the oldest entry if buffer becomes full.
-  State* entry = state_circular_buffer.insert();
-  *entry = isr_data.state;
-  // Notify the notification thread that a new state is available.
-  xSemaphoreGive(circular_state_semaphore);
+  for (uint8_t motor = 0; motor < kNumMotors; motor++) {
+    isr_update_rollups(motor);
+    State* entry = state_circular_buffers[motor].insert();
+    *entry = isr_data.motors.state[motor];
+    // Notify the notification thread that a new state is available.
+    xSemaphoreGive(circular_state_semaphore);
+  }
 }
 
 // Force a reasonable offset setting value.
@@ -571,27 +2410,62 @@ static int clip_offset(int requested_offset) {
 
 // Call once on program initialization, before ADC interrupts are
 // enabled.
-void setup(const nvs_config::AcquistionSettings& settings) {
+bool setup(const nvs_config::AcquistionSettings settings[],
+    uint16_t ticks_per_amp) {
+  if (!ticks_per_amp) {
+    ESP_LOGE(TAG, "Invalid ADC ticks per amp: %hu", ticks_per_amp);
+    return false;
+  }
+
   data_mutex = xSemaphoreCreateMutex();
   assert(data_mutex);
 
   circular_state_semaphore =
-      xSemaphoreCreateCounting(state_circular_buffer.capacity, 0);
+      xSemaphoreCreateCounting(kNumMotors * StateCircularBuffer::capacity, 0);
   assert(circular_state_semaphore);
 
   ENTER_MUTEX {
-    isr_data.adc_capture_state = ADC_CAPTURE_HALF_FILL;
+    isr_data.adc_capture_state = ADC_CAPTURE_PRE_FILL;
     isr_data.adc_capture_divider = 1;
+    isr_data.adc_capture_decimation = DECIMATION_DROP;
+    isr_set_capture_trigger(kDefaultCaptureTriggerSettings);
+    mutex_update_sample_handler();
+    isr_reset_thresholds(ticks_per_amp);
+    isr_data.current_metric = kDefaultCurrentMetric;
+
+    for (uint16_t i = 0; i < kAdcLinearityTableSize; i++) {
+      adc_linearity_table[i] = i;
+    }
 
-    isr_data.offset1 = clip_offset(settings.offset1);
-    isr_data.offset2 = clip_offset(settings.offset2);
-    isr_data.state.is_reverse_direction = settings.is_reverse_direction;
+    for (uint8_t motor = 0; motor < kNumMotors; motor++) {
+      MotorsData& m = isr_data.motors;
+      m.offset1[motor] = clip_offset(settings[motor].offset1);
+      m.offset2[motor] = clip_offset(settings[motor].offset2);
+      m.state[motor].is_reverse_direction =
+          settings[motor].is_reverse_direction;
+      m.gain1[motor] = clip_gain(settings[motor].gain1);
+      m.gain2[motor] = clip_gain(settings[motor].gain2);
+      isr_restart_offset_drift(motor);
+    }
 
     // We reset the capture without incrementing the capture
     // sequence number since we didn't completed it.
     isr_reset_adc_capture_buffer();
   }
   EXIT_MUTEX
+
+  return true;
+}
+
+int32_t state_velocity(const State& state) {
+  if (state.last_step_direction == UNKNOWN_DIRECTION ||
+      !state.ticks_in_step) {
+    return 0;
+  }
+  const int32_t speed = abs(state.velocity) >> kMotionFractionBits;
+  const int32_t max_speed = acq_consts::kTimeTicksPerSec / state.ticks_in_step;
+  const int32_t result = (speed > max_speed) ? max_speed : speed;
+  return (state.velocity < 0) ? -result : result;
 }
 
 // This involves floating point operations and thus slow. Do not
@@ -13,15 +13,136 @@
 namespace analyzer {
 
 // Number of pairs of ADC readings to capture for the signal
-// capture page. The capture logic try to sync a ch1 up crossing
-// the horizontal axis at the middle of the buffer for better
-// visual stability.
+// capture page. By default, the capture logic try to sync a ch1 up
+// crossing the horizontal axis at the middle of the buffer for better
+// visual stability. See CaptureTriggerSettings.
 constexpr uint16_t kAdcCaptureBufferSize = 400;
 
 // Number of captured samples to wait for a trigger. If this number
-// of samples is reached, we force a trigger.
+// of samples is reached, we force a trigger. Applies only to
+// TRIGGER_LEVEL. Event triggers wait indefinitely for their event.
 constexpr uint16_t kAdcCaptureMaxWaitToTrigger = kAdcCaptureBufferSize;
 
+// Max number of signal capture zoom out lanes. When enabled, each zoom
+// lane records in parallel to the capture buffer, one item per
+// kAdcCaptureZoomFactor items of the previous lane, with the same
+// trigger. E.g. with divider 1 and two lanes, items are 1, 8 and
+// 64 ADC ticks apart.
+constexpr uint8_t kAdcCaptureMaxZoomLanes = 2;
+constexpr uint8_t kAdcCaptureZoomFactor = 8;
+
+// Signal capture trigger modes. TRIGGER_LEVEL syncs the capture on a
+// ch1 up crossing for visual stability. The other modes trigger on
+// analyzer events such that anomalies are captured at the moment
+// they happen, with the pre trigger history in the capture buffer.
+enum CaptureTriggerMode {
+  // Trigger channel crossing the trigger level, or pre trigger timeout.
+  TRIGGER_LEVEL,
+  // An invalid quadrant transition.
+  TRIGGER_QUADRATURE_ERROR,
+  // A step in the opposite direction of the previous step.
+  TRIGGER_DIRECTION_REVERSAL,
+  // Coils becoming energized.
+  TRIGGER_ENERGIZED,
+  // Coils becoming non energized.
+  TRIGGER_NON_ENERGIZED,
+  // A step period outside of [min_step_ticks, max_step_ticks].
+  TRIGGER_STEP_PERIOD,
+  // Number of trigger modes. Not a valid mode.
+  TRIGGER_MODES_COUNT,
+};
+
+// The signal tracked by TRIGGER_LEVEL.
+enum CaptureTriggerChannel {
+  TRIGGER_CHANNEL_V1,
+  TRIGGER_CHANNEL_V2,
+  // The coil current of the selected CurrentMetric, same as the step
+  // current. See set_current_metric().
+  TRIGGER_CHANNEL_MAGNITUDE,
+  // Number of trigger channels. Not a valid channel.
+  TRIGGER_CHANNELS_COUNT,
+};
+
+enum CaptureTriggerSlope {
+  TRIGGER_SLOPE_RISING,
+  TRIGGER_SLOPE_FALLING,
+  // Number of trigger slopes. Not a valid slope.
+  TRIGGER_SLOPES_COUNT,
+};
+
+struct CaptureTriggerSettings {
+  CaptureTriggerMode mode;
+  // Valid step period band, in ADC ticks, for TRIGGER_STEP_PERIOD.
+  // Only steps entered and exited in the same direction are checked.
+  uint32_t min_step_ticks;
+  uint32_t max_step_ticks;
+  // TRIGGER_LEVEL parameters, in ADC counts. A rising trigger is
+  // armed when the channel is below (level - hysteresis) and fires
+  // when it then reaches level. Falling is the mirror image.
+  int16_t level;
+  uint16_t hysteresis;
+  CaptureTriggerChannel channel;
+  CaptureTriggerSlope slope;
+  // Position of the trigger in the capture buffer, as percents of
+  // the buffer size [0, 100]. Applies to all trigger modes.
+  uint8_t pre_trigger_percent;
+};
+
+// Default trigger: ch1 crossing up the horizontal axis at the middle
+// of the capture buffer.
+extern const CaptureTriggerSettings kDefaultCaptureTriggerSettings;
+
+// How the signal capture reduces the sample rate by its divider.
+enum CaptureDecimation {
+  // Keep every n'th sample. Cheapest but aliases high frequency
+  // components such as the chopper ripple.
+  DECIMATION_DROP,
+  // Average of each n samples.
+  DECIMATION_BOXCAR,
+  // Second order CIC decimator. Better alias rejection than boxcar.
+  DECIMATION_CIC2,
+  // Number of decimation modes. Not a valid mode.
+  DECIMATIONS_COUNT,
+};
+
+// The signal filter of the ADC readings, before the zero offsets are
+// applied. See filters.h. Values are persistent and used by the BLE
+// protocol.
+enum SignalFilter {
+  // No filtering. Fastest.
+  FILTER_BYPASS = 0,
+  // First order low pass, k = 500.
+  FILTER_LOW_PASS_LIGHT = 1,
+  // First order low pass, k = 700. The default.
+  FILTER_LOW_PASS = 2,
+  // First order low pass, k = 900.
+  FILTER_LOW_PASS_HEAVY = 3,
+  // Second order Butterworth low pass at 1/16 of the sample rate.
+  FILTER_BIQUAD = 4,
+  // 3 samples median for glitch rejection, followed by the default
+  // low pass.
+  FILTER_MEDIAN3 = 5,
+  // Number of filters. Not a valid filter.
+  FILTERS_COUNT,
+};
+
+constexpr SignalFilter kDefaultSignalFilter = FILTER_LOW_PASS;
+
+// The coil current metric of the current histogram and the magnitude
+// capture trigger. Values are persistent and used by the BLE protocol.
+enum CurrentMetric {
+  // max(|v1|, |v2|). Exact at full step angles and down to 0.71 of the
+  // current between them.
+  CURRENT_METRIC_MAX_COIL = 0,
+  // sqrt(v1^2 + v2^2), using an integer approximation that is within
+  // -3% and +1% of the current vector magnitude at all angles.
+  CURRENT_METRIC_MAGNITUDE = 1,
+  // Number of metrics. Not a valid metric.
+  CURRENT_METRICS_COUNT,
+};
+
+constexpr CurrentMetric kDefaultCurrentMetric = CURRENT_METRIC_MAX_COIL;
+
 // A single captured item. These are the signed values
 // in adc counts of the two curent sensing channels.
 struct AdcCaptureItem {
@@ -36,7 +157,9 @@ struct AdcCaptureItem {
 typedef CircularBuffer<AdcCaptureItem, kAdcCaptureBufferSize> AdcCaptureItems;
 
 struct AdcCaptureBuffer {
-  AdcCaptureBuffer() : seq_number(0), divider(1) {};
+  AdcCaptureBuffer() :
+      seq_number(0), divider(1), decimation(DECIMATION_DROP),
+      zoom_lanes(0) {};
   // Incremented on each capture snapshot. Users should handle
   // overflow gracefully.
   uint16_t seq_number;
@@ -44,9 +167,56 @@ struct AdcCaptureBuffer {
   // samples are included. Value of 2 indicates every other sample
   // is included and so on.
   uint8_t divider;
+  // How samples were reduced by the divider.
+  CaptureDecimation decimation;
+
+  // Number of valid entries in zoom_items.
+  uint8_t zoom_lanes;
 
   // The actual items as a circular buffer.
   AdcCaptureItems items;
+
+  // The zoom out lanes. Lane i has a time divider of
+  // divider * kAdcCaptureZoomFactor^(i+1). Unless decimation is
+  // DECIMATION_DROP, lane items are the average of the items they
+  // replace.
+  AdcCaptureItems zoom_items[kAdcCaptureMaxZoomLanes];
+};
+
+// Number of items in the long record capture ring. At 4 bytes per item,
+// this is a static reservation of tens of KB. Build with
+// -DANALYZER_LONG_CAPTURE_SIZE=0 to disable the long record capture
+// and release this memory.
+#ifndef ANALYZER_LONG_CAPTURE_SIZE
+#define ANALYZER_LONG_CAPTURE_SIZE 10000
+#endif
+// The item indices are 16 bits.
+static_assert(ANALYZER_LONG_CAPTURE_SIZE <= UINT16_MAX);
+constexpr uint16_t kLongCaptureBufferSize = ANALYZER_LONG_CAPTURE_SIZE;
+
+enum LongCaptureState {
+  // Not armed. The ring content is undefined.
+  LONG_CAPTURE_IDLE,
+  // Armed and filling the pre trigger part of the ring.
+  LONG_CAPTURE_PRE_FILL,
+  // Waiting for the next trigger of the signal capture.
+  LONG_CAPTURE_PRE_TRIGGER,
+  // Filling the rest of the ring.
+  LONG_CAPTURE_POST_TRIGGER,
+  // Ring is full and frozen until rearmed. Can be read in chunks.
+  LONG_CAPTURE_FROZEN,
+};
+
+struct LongCaptureStatus {
+  LongCaptureState state;
+  // Incremented each time the ring is frozen.
+  uint16_t seq_number;
+  // Time divider, as in AdcCaptureBuffer.
+  uint8_t divider;
+  // Number of items in the ring. Valid when frozen.
+  uint16_t size;
+  // Index of the trigger item. Valid when frozen.
+  uint16_t trigger_index;
 };
 
 // Max number of capture steps items. Stpes are captures at
@@ -73,6 +243,9 @@ typedef CircularBuffer<StepsCaptureItem, kStepsCaptureBufferSize>
 // is reversed at the middle of the step.
 enum Direction { UNKNOWN_DIRECTION, FORWARD, BACKWARD };
 
+// Fraction bits of State::velocity and State::acceleration.
+constexpr uint8_t kMotionFractionBits = 4;
+
 // A single histogram bucket
 struct HistogramBucket {
   // Total adc samples in steps in this bucket. This is a proxy
@@ -84,6 +257,11 @@ struct HistogramBucket {
   // Total steps. This is a proxy for the distance (in either direction)
   // done in this speed range.
   uint32_t total_steps;
+  // Total squared coil currents of the samples in the steps, in ADC
+  // counts squared. The RMS coil current of this speed range is
+  // sqrt(total_sq_currents / total_ticks_in_steps).
+  uint64_t total_sq_currents1;
+  uint64_t total_sq_currents2;
 };
 
 // Analyzer state. Does not include signal captures and histogram.
@@ -105,7 +283,9 @@ struct State {
       quadrature_errors(0),
       last_step_direction(UNKNOWN_DIRECTION),
       max_current_in_step(0),
-      ticks_in_step(0) { }
+      ticks_in_step(0),
+      velocity(0),
+      acceleration(0) { }
 
   // Number of ADC pair samples since last data reset. This is
   // also a proxy for the time passed. The number of time ticks
@@ -142,8 +322,8 @@ struct State {
   // Max value of full_steps so far. Momentary retraction value
   // can computed as max(0, max_full_steps - full_steps).
   int max_full_steps;
-  // Max value of (max_full_steps - full_steps). As of Jan 2021,
-  // this value is computed but not used.
+  // Max value of (max_full_steps - full_steps). Per retraction
+  // analytics are sampled with sample_retractions().
   int max_retraction_steps;
   // Total invalid quadrant transitions. Typically indicate
   // distorted stepper coils current patterns.
@@ -156,6 +336,13 @@ struct State {
   // Time in current state, in 100Khz ADC sample time unit. This is
   // a proxy for the time in current step.
   uint32_t ticks_in_step;
+  // Step rate in the full_steps direction and its rate of change, in
+  // steps/sec and steps/sec^2 with kMotionFractionBits fraction bits.
+  // Estimated by an alpha-beta tracker from the period of each step,
+  // and restarted at the start of each move. As of the last step, see
+  // sample_motion() for the values at the sampling time.
+  int32_t velocity;
+  int32_t acceleration;
 };
 
 struct Histogram {
@@ -169,28 +356,331 @@ void dump_state(const State& state);
 void dump_adc_capture_buffer(const AdcCaptureBuffer& adc_capture_buffer);
 
 // Called once during program initialization, before enabling
-// ADC interrupts.
-void setup(const nvs_config::AcquistionSettings& settings);
+// ADC interrupts. Accepts the settings of each of the
+// acq_consts::kNumMotors motors and the ADC ticks per amp of the
+// current sensors, which scales the energized limits. Returns false if
+// the ADC ticks per amp is zero.
+bool setup(const nvs_config::AcquistionSettings settings[],
+    uint16_t adc_ticks_per_amp);
+
+// The motor arguments below are in [0, acq_consts::kNumMotors).
 
 void get_last_capture_snapshot(AdcCaptureBuffer* buffer);
 
 // Sample histogram. Does not resets or mutate the
 // histogram tracking.
-void sample_histogram(Histogram* histogram);
+void sample_histogram(uint8_t motor, Histogram* histogram);
 
 // Sample capture steps items since last call to this function.
 // Returns a pointer to an internal buffer with the consumed
 // items, if any.
-const StepsCaptureBuffer* sample_steps_capture();
+const StepsCaptureBuffer* sample_steps_capture(uint8_t motor);
 
 // Sample the current state into given buffer.
-void sample_state(State* state);
+void sample_state(uint8_t motor, State* state);
+
+// Current sensing status of a motor.
+struct SensorStatus {
+  // Mean absolute deviation of the non energized current, in ADC counts
+  // with 4 fraction bits. Zero if not measured yet.
+  uint16_t noise_floor;
+  // Energized detection hysteresis limits, in ADC counts. Derived
+  // from the noise floor.
+  uint16_t non_energized_threshold;
+  uint16_t energized_threshold;
+  // Current zero offsets, including the drift corrections.
+  int16_t offset1;
+  int16_t offset2;
+};
+
+// Sample the current sensing status into given buffer.
+void sample_sensor_status(uint8_t motor, SensorStatus* status);
+
+// Coil energy of a motor since the last data reset.
+struct EnergyStats {
+  // ADC ticks since the last data reset.
+  uint64_t ticks;
+  // Total squared coil currents of the energized samples, in ADC counts
+  // squared. The I^2*t of a coil is its total divided by the squares of
+  // the ADC ticks per amp and by the time ticks per sec.
+  uint64_t total_sq_currents1;
+  uint64_t total_sq_currents2;
+};
+
+// Sample the coil energy into given buffer.
+void sample_energy(uint8_t motor, EnergyStats* stats);
+
+// Missed step and stall signatures, detected on step transitions.
+// Values are used by the BLE protocol.
+enum AnomalyType {
+  // A step period that is 2^kAnomalyPeriodJumpFactorBits times longer
+  // or shorter than the previous one, in the same direction and within
+  // a move (faster than 10 steps/sec). Detail is the new step period in
+  // ADC ticks.
+  ANOMALY_STEP_PERIOD_JUMP = 0,
+  // kAnomalyBurstReversals or more direction reversals within the last
+  // 8 steps. Detail is the number of reversals.
+  ANOMALY_REVERSAL_BURST = 1,
+  // An invalid quadrant transition within a move, see
+  // QUADRATURE_ERROR_IN_MOVE. The other classes are only counted, see
+  // sample_quadrature_errors(). Detail is the total quadrature errors
+  // of the motor.
+  ANOMALY_QUADRATURE_ERROR = 2,
+  // A step peak current 2^kAnomalyCurrentLagFactorBits times lower than
+  // the highest step peak current of the move. The back EMF keeps the
+  // driver from reaching the commanded current, the current vector lags
+  // the commanded angle and the torque collapses, which precedes a
+  // stall. Reported once per drop. Detail is the step peak current in
+  // ADC counts, per the current metric.
+  ANOMALY_CURRENT_LAG = 3,
+};
+
+constexpr uint8_t kAnomalyPeriodJumpFactorBits = 2;
+constexpr uint8_t kAnomalyBurstReversals = 3;
+constexpr uint8_t kAnomalyCurrentLagFactorBits = 1;
+
+struct AnomalyEvent {
+  // The motor's tick count at the detection.
+  uint64_t tick_count;
+  // Type specific value, see AnomalyType.
+  uint32_t detail;
+  // The motor's total anomalies since the last data reset, including
+  // this one.
+  uint32_t anomaly_count;
+  uint8_t motor;
+  AnomalyType type;
+};
+
+// For notification. Non blocking. Returns false if there are no pending
+// anomaly events. Oldest events are dropped if not popped in time.
+bool pop_next_anomaly(AnomalyEvent* event);
+
+// Returns the total anomalies of a motor since the last data reset.
+uint32_t get_anomaly_count(uint8_t motor);
+
+// Classes of invalid quadrant transitions. Values are used by the BLE
+// protocol.
+enum QuadratureErrorClass {
+  // The current was below twice the energized threshold. Typically
+  // noise around the zero crossing of a barely energized motor.
+  QUADRATURE_ERROR_LOW_CURRENT = 0,
+  // Within a move, see ANOMALY_STEP_PERIOD_JUMP. Typically a step rate
+  // beyond the sampling rate or a distorted current pattern.
+  QUADRATURE_ERROR_IN_MOVE = 1,
+  // At rest, at the start of a move or after a reversal. Typically a
+  // glitch of the driver or the sensor.
+  QUADRATURE_ERROR_AT_REST = 2,
+  QUADRATURE_ERROR_CLASSES_COUNT
+};
+
+// Number of quadrature error records kept per motor.
+constexpr uint8_t kQuadratureErrorRecords = 8;
+
+// The signal at an invalid quadrant transition.
+struct QuadratureErrorRecord {
+  // The motor's tick count at the transition.
+  uint64_t tick_count;
+  // Ticks in the quadrant that was left.
+  uint32_t ticks_in_step;
+  // The step period of the move in ADC ticks, or zero if not in a
+  // move. The step rate is kTimeTicksPerSec / move_step_ticks.
+  uint32_t move_step_ticks;
+  // The sample that entered the new quadrant, in ADC counts.
+  int16_t v1;
+  int16_t v2;
+  uint8_t old_quadrant;
+  uint8_t new_quadrant;
+  QuadratureErrorClass error_class;
+};
+
+struct QuadratureErrors {
+  // Errors by QuadratureErrorClass since the last data reset.
+  uint32_t class_counts[QUADRATURE_ERROR_CLASSES_COUNT];
+  // The newest records since the last data reset, oldest first.
+  uint8_t num_records;
+  QuadratureErrorRecord records[kQuadratureErrorRecords];
+};
+
+// Sample the quadrature error counters and records of a motor.
+void sample_quadrature_errors(uint8_t motor, QuadratureErrors* errors);
 
-// For notification. Blocking.
-bool pop_next_state(State* state);
+// Retraction episodes. An episode starts when the motor steps back from
+// State::max_full_steps, typically dwells while the head travels, and
+// ends when it steps forward to max_full_steps again. Episodes with less
+// than kMinRetractionSteps steps are ignored as jitter.
+constexpr uint16_t kMinRetractionSteps = 4;
 
-// Clears state and histogram data. This resets counters, min/max values,
-// histograms, etc. This does not reset the tick counter
+// Episodes are histogrammed by retraction distance. Bucket i covers
+// [kMinRetractionSteps << i, kMinRetractionSteps << (i + 1)) steps, the
+// last bucket also covers longer retractions.
+constexpr uint8_t kNumRetractionBuckets = 8;
+
+// Number of latest episodes kept per motor.
+constexpr uint8_t kRetractionEventsSize = 8;
+
+struct RetractionEvent {
+  // The motor's tick count at the end of the episode.
+  uint64_t tick_count;
+  // Retraction distance in full steps.
+  uint32_t steps;
+  // Ticks from the first to the deepest retraction step. The retraction
+  // speed is (steps - 1) / retraction_ticks.
+  uint32_t retraction_ticks;
+  // Ticks from the deepest retraction step to the first unretraction
+  // step.
+  uint32_t dwell_ticks;
+  // Ticks from the first unretraction step to the end of the episode.
+  // The unretraction speed is (steps - 1) / unretraction_ticks.
+  uint32_t unretraction_ticks;
+};
+
+struct RetractionBucket {
+  // Number of episodes and the totals of their RetractionEvent values.
+  uint32_t episodes;
+  uint64_t total_steps;
+  uint64_t total_retraction_ticks;
+  uint64_t total_dwell_ticks;
+  uint64_t total_unretraction_ticks;
+};
+
+struct RetractionStats {
+  // Episodes since the last data reset by retraction distance.
+  RetractionBucket buckets[kNumRetractionBuckets];
+  // The latest episodes since the last data reset, oldest first.
+  uint8_t num_events;
+  RetractionEvent events[kRetractionEventsSize];
+};
+
+// Sample the retraction episodes of a motor.
+void sample_retractions(uint8_t motor, RetractionStats* stats);
+
+// Direction reversals are histogrammed by their dwell, the ticks from
+// the last step in one direction to the first step in the other. Bucket
+// 0 covers [0, kReversalDwellBucketTicks) and bucket i > 0 covers
+// [kReversalDwellBucketTicks << (i - 1), kReversalDwellBucketTicks << i)
+// ticks. The last bucket also covers longer dwells.
+constexpr uint32_t kReversalDwellBucketTicks = 16;
+constexpr uint8_t kNumReversalDwellBuckets = 12;
+
+struct ReversalStats {
+  // Reversals since the last data reset, by the direction before the
+  // reversal.
+  uint32_t forward_reversals;
+  uint32_t backward_reversals;
+  // Reversals in the last completed minute.
+  uint32_t last_minute_reversals;
+  // Reversals since the last data reset by dwell.
+  uint32_t dwell_buckets[kNumReversalDwellBuckets];
+};
+
+// Sample the direction reversal statistics of a motor.
+void sample_reversals(uint8_t motor, ReversalStats* stats);
+
+// The time in moves is histogrammed by the absolute acceleration
+// estimate. Bucket i covers [i, i + 1) * kAccelerationBucketStepsPerSec2
+// steps/sec^2, the last bucket also covers higher accelerations.
+constexpr uint32_t kAccelerationBucketStepsPerSec2 = 1000;
+constexpr uint8_t kNumAccelerationBuckets = 32;
+
+struct MotionStats {
+  // The State velocity and acceleration at the sampling time. Zero if
+  // not moving. The velocity is limited by the time since the last
+  // step, such that it decays when the motor stops, and the
+  // acceleration is zero in that case.
+  int32_t velocity;
+  int32_t acceleration;
+  // Total ticks in moves since the last data reset, by acceleration.
+  uint64_t acceleration_ticks[kNumAccelerationBuckets];
+};
+
+// Sample the velocity, acceleration and acceleration histogram of a
+// motor.
+void sample_motion(uint8_t motor, MotionStats* stats);
+
+// High rate position stream of the capture motor, for a smooth
+// position trace. Every n'th sample of the motor is streamed, for a
+// rate in [kMinPositionStreamRate, kMaxPositionStreamRate] Hz, or the
+// stream is disabled, the default.
+constexpr uint16_t kMinPositionStreamRate = 10;
+constexpr uint16_t kMaxPositionStreamRate = 2000;
+
+// Streamed items buffering. 64ms at the max rate.
+constexpr uint16_t kPositionStreamBufferSize = 128;
+
+// A streamed sample. The fractional position within the step can be
+// computed from the currents and the quadrant, see the Python client's
+// ProbeState.microsteps().
+struct PositionStreamItem {
+  // The motor's tick count of the sample.
+  uint64_t tick_count;
+  uint8_t motor;
+  // Snapshots of the corresponding State fields.
+  int full_steps;
+  int16_t v1;
+  int16_t v2;
+  uint8_t quadrant;
+  bool is_energized;
+  bool is_reverse_direction;
+};
+
+// Sets the position stream rate in Hz, or 0 to disable the stream.
+// Returns false if the rate is out of range. The actual rate is
+// kTimeTicksPerSec / divider, see pop_position_stream().
+bool set_position_stream_rate(uint16_t rate);
+
+// For notification. Non blocking. Pops the pending stream items,
+// oldest first, up to max_items, and sets the sample divider of the
+// stream. Returns the number of items. Oldest items are dropped if
+// not popped in time, see kPositionStreamBufferSize.
+uint16_t pop_position_stream(
+    PositionStreamItem items[], uint16_t max_items, uint16_t* divider);
+
+// On device history of per period aggregates, such that a client can
+// catch up on reconnection. Each tier keeps the kRollupsPerTier latest
+// completed periods of its length. Updated at the state snapshot rate
+// and kept across data resets. Values are used by the BLE protocol.
+enum RollupTier {
+  ROLLUP_TIER_1_SEC = 0,
+  ROLLUP_TIER_10_SECS = 1,
+  ROLLUP_TIER_1_MIN = 2,
+  ROLLUP_TIERS_COUNT,
+};
+
+constexpr uint16_t kRollupTierSecs[ROLLUP_TIERS_COUNT] = {1, 10, 60};
+constexpr uint16_t kRollupsPerTier = 60;
+
+struct Rollup {
+  // Index of the period since initialization. The period starts at tick
+  // period * kRollupTierSecs[tier] * kTimeTicksPerSec.
+  uint32_t period;
+  // Net full steps in the period.
+  int32_t steps;
+  // Max speed of the state snapshots, in steps/sec.
+  uint16_t max_speed;
+  // Max of the snapshots max_current_in_step, in ADC counts.
+  uint16_t peak_current;
+  // Mean squared coil current over the period, averaged over the two
+  // coils, in ADC counts squared. Non energized samples count as zero.
+  uint32_t mean_sq_current;
+  // Invalid quadrant transitions in the period. Saturates.
+  uint16_t quadrature_errors;
+  // Ticks of the period the coils were energized, at the state
+  // snapshots resolution.
+  uint32_t energized_ticks;
+};
+
+// Copies up to max_items completed rollups of a motor and tier, oldest
+// first, starting at the first one whose period is >= first_period.
+// Sets the period that is in progress. Returns the number of rollups.
+uint16_t read_rollups(uint8_t motor, RollupTier tier, uint32_t first_period,
+    uint16_t max_items, Rollup items[], uint32_t* open_period);
+
+// For notification. Blocking. Returns the states of all motors,
+// interleaved, with the motor index of each.
+bool pop_next_state(State* state, uint8_t* motor);
+
+// Clears state and histogram data of all motors. This resets counters,
+// min/max values, histograms, etc. This does not reset the tick counter
 // which provides a consistent time base since initialization, nor the
 // capture buffer.
 void reset_data();
@@ -198,22 +688,126 @@ void reset_data();
 // Return the steps value of the given state.
 double state_steps(const State& state);
 
+// Returns the velocity of the given state in steps/sec, zero if not
+// moving. The State velocity is as of the last step, so it's limited by
+// the time in the step in progress.
+int32_t state_velocity(const State& state);
+
 // Call this when the coil current is known to be zero to
 // calibrate the internal offset1 and offset2.
-void calibrate_zeros();
+void calibrate_zeros(uint8_t motor);
+
+// Returns true if the zero offsets of the motor were corrected by the
+// drift tracking since the last call, and thus should be persisted.
+bool take_offsets_drifted(uint8_t motor);
 
 // Set direction. This updates the current settings.
 // Controlled by the user in the Settings screen.
-void set_is_reversed_direction(bool is_reverse_direction);
+void set_is_reversed_direction(uint8_t motor, bool is_reverse_direction);
+
+bool get_is_reversed_direction(uint8_t motor);
+
+// Sets the per channel gains of a motor. Clipped internally to the
+// allowed range. See acq_consts::kUnityGain.
+void set_gains(uint8_t motor, uint16_t gain1, uint16_t gain2);
+
+// Number of entries of the ADC linearity correction table, one per 12 bit
+// ADC code.
+constexpr uint16_t kAdcLinearityTableSize = 4096;
+
+// Sets the ADC linearity correction table of all channels. Entry i is the
+// corrected 12 bit value of the raw ADC code i, and it's applied before
+// the signal filter. Null restores the identity table. The zero offsets
+// should be recalibrated after a table change.
+void set_adc_linearity_table(const uint16_t* table);
 
-bool get_is_reversed_direction();
+// Selects the signal filter of all motors. Returns false if the filter
+// is not valid.
+bool set_signal_filter(SignalFilter filter);
+
+SignalFilter get_signal_filter();
+
+// Selects the coil current metric of all motors. Returns false if the
+// metric is not valid. Applies from the next step.
+bool set_current_metric(CurrentMetric metric);
+
+CurrentMetric get_current_metric();
+
+// Changes the ADC ticks per amp of the current sensors, e.g. when a
+// sensor profile is selected at runtime. Resets the energized limits to
+// the defaults of the sensor. Returns false if zero.
+bool set_adc_ticks_per_amp(uint16_t adc_ticks_per_amp);
+
+// Selects the motor that is captured by the signal capture and the
+// long record capture. Restarts the current capture cycle.
+bool set_capture_motor(uint8_t motor);
+
+uint8_t get_capture_motor();
 
 // Clipped internally to allowed range.
-void set_signal_capture_divider(uint8_t divider);
+void set_signal_capture_divider(
+    uint8_t divider, CaptureDecimation decimation = DECIMATION_DROP);
+
+// Sets the number of active zoom out lanes, in the range
+// [0, kAdcCaptureMaxZoomLanes]. Each active lane extends the capture
+// cycle by kAdcCaptureZoomFactor so zero is the default.
+bool set_signal_capture_zoom_lanes(uint8_t zoom_lanes);
+
+// Set the signal capture trigger. Returns false if the settings
+// are invalid, in which case the current trigger is not changed.
+// Restarts the current capture cycle.
+bool set_capture_trigger(const CaptureTriggerSettings& settings);
+
+void get_capture_trigger(CaptureTriggerSettings* settings);
+
+// Clear and arm the long record capture. It records every divider'th
+// sample and freezes when the ring is filled past the next trigger
+// of the signal capture, using the same trigger position. Returns
+// false if the long record capture is disabled at build time.
+bool arm_long_capture(uint8_t divider);
+
+// Copies up to max_items items of a frozen long record capture,
+// starting at item offset, 0 is the oldest. Returns the number of items
+// copied, zero if not frozen. Status is set regardless.
+uint16_t read_long_capture(uint16_t offset, uint16_t max_items,
+    LongCaptureStatus* status, AdcCaptureItem* items);
+
+// Resonance monitoring. A bank of Goertzel filters runs continuously on
+// the coil currents of the capture motor, decimated by
+// kResonanceDecimation, in blocks of one state interval (20ms). The
+// frequency resolution is thus about 50Hz.
+constexpr uint8_t kMaxResonanceBands = 4;
+constexpr uint8_t kResonanceDecimation = 8;
+// Max band frequency, the Nyquist frequency of the decimated samples.
+constexpr uint16_t kMaxResonanceFrequency =
+    acq_consts::kTimeTicksPerSec / kResonanceDecimation / 2;
+
+struct ResonanceStatus {
+  // Incremented on each completed block. Users should handle
+  // overflow gracefully.
+  uint16_t seq_number;
+  // Number of valid bands.
+  uint8_t num_bands;
+  // Band frequencies in Hz.
+  uint16_t frequencies[kMaxResonanceBands];
+  // Coil current amplitudes at the band frequencies in the last
+  // completed block, as the RMS of the amplitudes of the two coils. In
+  // ADC counts with 4 fraction bits.
+  uint16_t amplitudes[kMaxResonanceBands];
+};
+
+// Sets the resonance monitoring band frequencies, in Hz. Zero bands
+// disables the monitoring. Returns false if the number of bands or a
+// frequency is not in [1, kMaxResonanceFrequency], in which case the
+// bands are not changed.
+bool set_resonance_bands(const uint16_t* frequencies, uint8_t num_bands);
+
+// Sample the resonance monitoring status into given buffer.
+void sample_resonance(ResonanceStatus* status);
 
 // Return a copy of the internal settings. Used after
 // calibrate_zeros() to save the current settings in the
 // EEPROM.
-void get_settings(nvs_config::AcquistionSettings* settings);
+void get_settings(uint8_t motor, nvs_config::AcquistionSettings* settings);
 
 }  // namespace analyzer
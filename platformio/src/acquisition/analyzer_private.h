@@ -8,7 +8,17 @@ namespace analyzer {
 void enter_mutex();
 void exit_mutex();
 
-void isr_handle_one_sample(const uint16_t raw_v1, const uint16_t raw_v2);
+// Handler of one pair of ADC readings of a motor. A specialized
+// instance per signal filter and optional stages, selected by setup()
+// and switched as they change.
+typedef void (*SampleHandler)(
+    const uint8_t motor, const uint16_t raw_v1, const uint16_t raw_v2);
+extern SampleHandler isr_sample_handler;
+
+inline void isr_handle_one_sample(
+    const uint8_t motor, const uint16_t raw_v1, const uint16_t raw_v2) {
+  isr_sample_handler(motor, raw_v1, raw_v2);
+}
 void isr_snapshot_state();
 
 }  // namespace analyzer
@@ -0,0 +1,24 @@
+// Coil current vector magnitude approximation. A header of its own such
+// that the host tests can check its error bound.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+namespace analyzer {
+
+// Approximates the coil current vector magnitude sqrt(v1^2 + v2^2) of a
+// sample, given its max coil current, as max(hi, 7/8 hi + 1/2 lo) where
+// hi and lo are the larger and smaller of |v1| and |v2|. Error is within
+// -3% and +1%, plus up to one count of rounding, vs -29% of the max coil
+// current alone. Shifts and adds only, no multiplication. Checked by
+// test/current_magnitude_test.cpp.
+static inline uint32_t isr_current_magnitude(
+    const int16_t v1, const int16_t v2, const uint32_t max_current) {
+  const uint32_t lo = (uint32_t)(abs(v1) + abs(v2)) - max_current;
+  const uint32_t estimate = max_current - (max_current >> 3) + (lo >> 1);
+  return (estimate > max_current) ? estimate : max_current;
+}
+
+}  // namespace analyzer
@@ -1,4 +1,4 @@
-// First order ADC 12 bit signal filter.
+// ADC signal filters and decimators.
 
 #pragma once
 
@@ -6,27 +6,188 @@
 
 namespace filters {
 
-// K is in the range (0, 1024). The higher the value of K, the more the filter
-// smooths the signal. We use fixed point integers for efficiency since
-// this filter is used by the acquisition interrut routine.
+// State of the signal filter of one ADC channel. Shared by the filter
+// kernels below such that the kernel can be switched at run time. Each
+// kernel uses its own fields so kernels can also be chained.
+struct AdcFilterState {
+  // Low pass. The current value with additional 10 bits representing the
+  // fraction.
+  uint32_t scaled_12bit_value;  // current value << 10
+  // Biquad. Previous inputs and previous outputs with additional 4 bits
+  // representing the fraction.
+  int32_t x1;
+  int32_t x2;
+  int32_t y1;
+  int32_t y2;
+  // Median. Previous two inputs.
+  uint16_t m1;
+  uint16_t m2;
+
+  // Sets the state of all the kernels to a steady 12 bit value,
+  // to avoid a transient when a kernel is switched.
+  inline void reset(uint16_t adc_12_bit_value) {
+    scaled_12bit_value = ((uint32_t)adc_12_bit_value) << 10;
+    x1 = adc_12_bit_value;
+    x2 = adc_12_bit_value;
+    y1 = ((int32_t)adc_12_bit_value) << 4;
+    y2 = ((int32_t)adc_12_bit_value) << 4;
+    m1 = adc_12_bit_value;
+    m2 = adc_12_bit_value;
+  }
+};
+
+// The filter kernels. Each has a static update() that accepts the new
+// 12 bit sample, updates the state and returns the new filter value. They
+// are used as template arguments so each kernel gets its own specialized
+// code in the acquisition interrupt routine.
+
+// Returns the sample as is.
+struct BypassFilter {
+  static inline uint16_t update(AdcFilterState& state,
+      uint16_t adc_12_bit_value) {
+    return adc_12_bit_value;
+  }
+};
+
+// First order low pass. K is in the range (0, 1024). The higher the value
+// of K, the more the filter smooths the signal. We use fixed point integers
+// for efficiency since this filter is used by the acquisition interrut
+// routine.
+//
+// Computes s' = (t * (1024 - k) + s * k) >> 10 as
+// ((s << 10) + (t - s) * (1024 - k)) >> 10, with a single multiplication.
+// The intermediate terms may wrap around but the sum is the same as of the
+// original form, which is below 2^32, so the result is bit exact.
 template <uint32_t k>
-class Adc12BitsLowPassFilter {
- public:
-  Adc12BitsLowPassFilter() : scaled_12bit_value_(0 << 10) { }
+struct LowPassFilter {
+  static_assert(k > 0 && k < 1024, "Invalid low pass filter k");
 
-  // Accepts the new 12 bit sample and update and return the new
-  // filter values.
-  inline uint16_t update(uint16_t adc_12_bit_value) {
+  static inline uint16_t update(AdcFilterState& state,
+      uint16_t adc_12_bit_value) {
+    const uint32_t s = state.scaled_12bit_value;
     const uint32_t t1 = ((uint32_t)adc_12_bit_value) << 10;
-    const uint32_t t2 = (t1 * (1024 - k)) + (scaled_12bit_value_ * k);
-    scaled_12bit_value_ = t2 >> 10;
-    return scaled_12bit_value_ >> 10;
+    const uint32_t t2 = (s << 10) + (t1 - s) * (1024 - k);
+    state.scaled_12bit_value = t2 >> 10;
+    return state.scaled_12bit_value >> 10;
+  }
+};
+
+// Second order Butterworth low pass with a cutoff at 1/16 of the sample
+// rate (2.5khz with a single motor). Direct form I with 13 bits fixed point
+// coefficients. The b coefficients are rounded such that the DC gain is
+// exactly 1, so the zero offsets are not affected.
+struct BiquadFilter {
+  static constexpr int32_t kB0 = 245;
+  static constexpr int32_t kB1 = 492;
+  static constexpr int32_t kB2 = 245;
+  static constexpr int32_t kA1 = -11913;
+  static constexpr int32_t kA2 = 4703;
+  static_assert(kB0 + kB1 + kB2 == (1 << 13) + kA1 + kA2, "DC gain");
+
+  static inline uint16_t update(AdcFilterState& state,
+      uint16_t adc_12_bit_value) {
+    const int32_t x0 = adc_12_bit_value;
+    // Max magnitude is about 2^30, within int32.
+    const int32_t acc = ((kB0 * x0 + kB1 * state.x1 + kB2 * state.x2) << 4) -
+        kA1 * state.y1 - kA2 * state.y2;
+    const int32_t y0 = acc >> 13;
+    state.x2 = state.x1;
+    state.x1 = x0;
+    state.y2 = state.y1;
+    state.y1 = y0;
+    // Overshoots are clipped to the 12 bits range.
+    const int32_t result = (y0 + 8) >> 4;
+    return (result < 0) ? 0 : (result > 4095) ? 4095 : result;
+  }
+};
+
+// Median of the last 3 samples. Rejects single sample glitches at the cost
+// of one sample delay.
+struct Median3Filter {
+  static inline uint16_t update(AdcFilterState& state,
+      uint16_t adc_12_bit_value) {
+    const uint16_t a = adc_12_bit_value;
+    const uint16_t b = state.m1;
+    const uint16_t c = state.m2;
+    state.m2 = b;
+    state.m1 = a;
+    if (a > b) {
+      return (b > c) ? b : (a > c) ? c : a;
+    }
+    return (a > c) ? a : (b > c) ? c : b;
+  }
+};
+
+// Applies filter F1 and then filter F2.
+template <class F1, class F2>
+struct FilterChain {
+  static inline uint16_t update(AdcFilterState& state,
+      uint16_t adc_12_bit_value) {
+    return F2::update(state, F1::update(state, adc_12_bit_value));
+  }
+};
+
+// Filters both channels of a motor, as the pipeline calls the kernels.
+// Each channel goes through the kernel in turn. A kernel can specialize
+// this with an update that interleaves the two channels, if it's faster
+// on the target and bit exact with the single channel kernel.
+template <class Filter>
+struct DualFilter {
+  static inline void update(AdcFilterState& state1, AdcFilterState& state2,
+      uint16_t* adc_12_bit_value1, uint16_t* adc_12_bit_value2) {
+    *adc_12_bit_value1 = Filter::update(state1, *adc_12_bit_value1);
+    *adc_12_bit_value2 = Filter::update(state2, *adc_12_bit_value2);
+  }
+};
+
+// Integer CIC decimator of a single signed channel. Order 1 is a boxcar
+// average and order 2 is a two stage CIC. The integrators are updated on
+// each sample while the combs and the normalization run only once per
+// decimated output. Integrators wrap around by design and thus use
+// unsigned arithmetic.
+class CicDecimator {
+ public:
+  CicDecimator() { reset(); }
+
+  inline void reset() {
+    integrator1_ = 0;
+    integrator2_ = 0;
+    comb1_ = 0;
+    comb2_ = 0;
+  }
+
+  // Order 1. One add per sample.
+  inline void update1(int16_t value) { integrator1_ += (int32_t)value; }
+
+  // Order 1. Returns the average of the r samples since the last output.
+  inline int16_t output1(uint16_t r) {
+    const int32_t sum = (int32_t)integrator1_;
+    integrator1_ = 0;
+    return sum / r;
+  }
+
+  // Order 2. Two adds per sample.
+  inline void update2(int16_t value) {
+    integrator1_ += (int32_t)value;
+    integrator2_ += integrator1_;
+  }
+
+  // Order 2 with decimation ratio r, normalized by the r^2 gain. The
+  // first output after reset() is partial and should be dropped.
+  inline int16_t output2(uint32_t r_squared) {
+    const uint32_t comb1_out = integrator2_ - comb1_;
+    comb1_ = integrator2_;
+    const uint32_t comb2_out = comb1_out - comb2_;
+    comb2_ = comb1_out;
+    return (int32_t)comb2_out / (int32_t)r_squared;
   }
 
  private:
-  // The current value with additional 10 bits representing the
-  // fraction.
-  uint32_t scaled_12bit_value_;  // current value << 10
+  uint32_t integrator1_;
+  uint32_t integrator2_;
+  // Previous integrator2_ and comb1 outputs.
+  uint32_t comb1_;
+  uint32_t comb2_;
 };
 
 }  // namespace filters
@@ -0,0 +1,163 @@
+#include "spectrum.h"
+
+#include <math.h>
+
+namespace spectrum {
+
+// Twiddle factors exp(-2*pi*i*k/kFftSize) for k in [0, kFftSize/2), with
+// 15 fraction bits. Initialized on first use.
+static int16_t twiddle_re[kFftSize / 2];
+static int16_t twiddle_im[kFftSize / 2];
+static bool twiddles_initialized = false;
+
+// The FFT working buffer. The windowed v1 values are the real part and
+// the windowed v2 values are the imaginary part, such that a single
+// complex FFT yields the spectra of both coils. In ADC counts with 4
+// fraction bits. The gain of the FFT is at most kFftSize, so the values
+// stay within 24 bits.
+static int32_t data_re[kFftSize];
+static int32_t data_im[kFftSize];
+
+static void init_twiddles() {
+  for (uint16_t k = 0; k < kFftSize / 2; k++) {
+    const double angle = -2 * M_PI * k / kFftSize;
+    twiddle_re[k] = (int16_t)lround(cos(angle) * 32767);
+    twiddle_im[k] = (int16_t)lround(sin(angle) * 32767);
+  }
+  twiddles_initialized = true;
+}
+
+// Integer square root, rounded down.
+static uint32_t isqrt(uint64_t value) {
+  uint64_t result = 0;
+  uint64_t bit = (uint64_t)1 << 62;
+  while (bit > value) {
+    bit >>= 2;
+  }
+  while (bit) {
+    if (value >= result + bit) {
+      value -= result + bit;
+      result = (result >> 1) + bit;
+    } else {
+      result >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (uint32_t)result;
+}
+
+// In place radix-2 decimation in time FFT of data_re/data_im.
+static void fft() {
+  // Bit reversal permutation.
+  for (uint16_t i = 0, j = 0; i < kFftSize; i++) {
+    if (i < j) {
+      const int32_t tmp_re = data_re[i];
+      const int32_t tmp_im = data_im[i];
+      data_re[i] = data_re[j];
+      data_im[i] = data_im[j];
+      data_re[j] = tmp_re;
+      data_im[j] = tmp_im;
+    }
+    uint16_t bit = kFftSize >> 1;
+    for (; j & bit; bit >>= 1) {
+      j ^= bit;
+    }
+    j |= bit;
+  }
+
+  // Butterflies. Products are 64 bits to keep the full precision.
+  for (uint16_t len = 2; len <= kFftSize; len <<= 1) {
+    const uint16_t half = len >> 1;
+    const uint16_t twiddle_step = kFftSize / len;
+    for (uint16_t start = 0; start < kFftSize; start += len) {
+      for (uint16_t k = 0; k < half; k++) {
+        const int32_t w_re = twiddle_re[k * twiddle_step];
+        const int32_t w_im = twiddle_im[k * twiddle_step];
+        const uint16_t a = start + k;
+        const uint16_t b = a + half;
+        const int32_t t_re = ((int64_t)data_re[b] * w_re -
+                                 (int64_t)data_im[b] * w_im) >>
+            15;
+        const int32_t t_im = ((int64_t)data_re[b] * w_im +
+                                 (int64_t)data_im[b] * w_re) >>
+            15;
+        data_re[b] = data_re[a] - t_re;
+        data_im[b] = data_im[a] - t_im;
+        data_re[a] += t_re;
+        data_im[a] += t_im;
+      }
+    }
+  }
+}
+
+bool compute(const analyzer::AdcCaptureItems& items, uint16_t bins[kNumBins]) {
+  const uint16_t n = items.size();
+  if (n < kMinItems) {
+    return false;
+  }
+  if (!twiddles_initialized) {
+    init_twiddles();
+  }
+
+  // The DC, in ADC counts with 4 fraction bits.
+  int32_t sum1 = 0;
+  int32_t sum2 = 0;
+  for (uint16_t i = 0; i < n; i++) {
+    const analyzer::AdcCaptureItem* item = items.get(i);
+    sum1 += item->v1;
+    sum2 += item->v2;
+  }
+  const int32_t dc1 = (sum1 << 4) / n;
+  const int32_t dc2 = (sum2 << 4) / n;
+
+  // Hann window with 15 fraction bits, and zero padding.
+  uint32_t window_sum = 0;
+  for (uint16_t i = 0; i < n; i++) {
+    const analyzer::AdcCaptureItem* item = items.get(i);
+    const int32_t w =
+        (int32_t)lround((0.5 - 0.5 * cos(2 * M_PI * i / (n - 1))) * 32767);
+    window_sum += w;
+    data_re[i] = (((item->v1 << 4) - dc1) * w) >> 15;
+    data_im[i] = (((item->v2 << 4) - dc2) * w) >> 15;
+  }
+  for (uint16_t i = n; i < kFftSize; i++) {
+    data_re[i] = 0;
+    data_im[i] = 0;
+  }
+
+  fft();
+
+  // Separate the two real spectra Z[k] = X1[k] + i*X2[k] and combine
+  // them. A sinusoid of amplitude A at bin k has |X[k]| = A * sum(w) / 2,
+  // and the result is the RMS of the two coils amplitudes,
+  // sqrt((A1^2 + A2^2) / 2) = sqrt(2 * (|X1|^2 + |X2|^2)) / sum(w).
+  for (uint8_t bin = 0; bin < kNumBins; bin++) {
+    uint32_t peak = 0;
+    for (uint8_t j = 0; j < kFftBinsPerBin; j++) {
+      const uint16_t k = bin * kFftBinsPerBin + j;
+      if (k == 0) {
+        // DC was removed.
+        continue;
+      }
+      const int64_t zk_re = data_re[k];
+      const int64_t zk_im = data_im[k];
+      const int64_t zn_re = data_re[kFftSize - k];
+      const int64_t zn_im = data_im[kFftSize - k];
+      const int64_t x1_re = (zk_re + zn_re) / 2;
+      const int64_t x1_im = (zk_im - zn_im) / 2;
+      const int64_t x2_re = (zk_im + zn_im) / 2;
+      const int64_t x2_im = (zn_re - zk_re) / 2;
+      const uint64_t sq = x1_re * x1_re + x1_im * x1_im + x2_re * x2_re +
+          x2_im * x2_im;
+      const uint32_t amplitude =
+          ((uint64_t)isqrt(2 * sq) * 32767) / window_sum;
+      if (amplitude > peak) {
+        peak = amplitude;
+      }
+    }
+    bins[bin] = (peak > UINT16_MAX) ? UINT16_MAX : peak;
+  }
+  return true;
+}
+
+}  // namespace spectrum
@@ -0,0 +1,38 @@
+// Magnitude spectrum of the signal capture. Computed on demand by the
+// BLE thread, never by the ADC task.
+
+#pragma once
+
+#include <stdint.h>
+
+#include "analyzer.h"
+
+namespace spectrum {
+
+// FFT size. Captures are zero padded to this size.
+constexpr uint16_t kFftSize = 512;
+constexpr uint8_t kFftSizeBits = 9;
+static_assert((1 << kFftSizeBits) == kFftSize);
+static_assert(analyzer::kAdcCaptureBufferSize <= kFftSize);
+
+// Number of returned spectrum bins. Each bin is the peak of
+// kFftBinsPerBin consecutive FFT bins, such that narrow resonances
+// are not averaged out. Bin i covers the frequencies
+// [i, i + 1) * kFftBinsPerBin * sample_rate / kFftSize.
+constexpr uint8_t kNumBins = 32;
+constexpr uint8_t kFftBinsPerBin = kFftSize / 2 / kNumBins;
+
+// Minimal number of items to compute a spectrum.
+constexpr uint16_t kMinItems = 16;
+
+// Computes the coil current spectrum of the given capture items, in
+// ADC counts with 4 fraction bits. Each FFT bin is the RMS of the two
+// coil amplitudes at that frequency, sqrt((A1^2 + A2^2) / 2), after
+// removing the DC and applying a Hann window. Two coils driven with
+// the same amplitude A thus read A. Returns false if there are less
+// than kMinItems items.
+//
+// Uses static buffers and thus should be called from a single thread.
+bool compute(const analyzer::AdcCaptureItems& items, uint16_t bins[kNumBins]);
+
+}  // namespace spectrum
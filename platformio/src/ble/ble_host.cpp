@@ -1,6 +1,7 @@
 #include "ble_host.h"
 
 #include <algorithm>
+#include <math.h>
 #include <string.h>
 
 #include "esp_bt.h"
@@ -18,8 +19,10 @@
 
 #include "acquisition/acq_consts.h"
 #include "acquisition/analyzer.h"
+#include "acquisition/spectrum.h"
 #include "ble_util.h"
 #include "misc/util.h"
+#include "recording/recorder.h"
 #include "settings/controls.h"
 
 // Based on the sexample at
@@ -65,6 +68,19 @@ static const uint8_t time_histogram_uuid[] = {ENCODE_UUID_16(0xff04)};
 static const uint8_t distance_histogram_uuid[] = {ENCODE_UUID_16(0xff05)};
 static const uint8_t command_uuid[] = {ENCODE_UUID_16(0xff06)};
 static const uint8_t capture_uuid[] = {ENCODE_UUID_16(0xff07)};
+static const uint8_t long_capture_uuid[] = {ENCODE_UUID_16(0xff08)};
+static const uint8_t sensor_status_uuid[] = {ENCODE_UUID_16(0xff09)};
+static const uint8_t energy_uuid[] = {ENCODE_UUID_16(0xff0a)};
+static const uint8_t spectrum_uuid[] = {ENCODE_UUID_16(0xff0b)};
+static const uint8_t resonance_uuid[] = {ENCODE_UUID_16(0xff0c)};
+static const uint8_t anomalies_uuid[] = {ENCODE_UUID_16(0xff0d)};
+static const uint8_t quadrature_errors_uuid[] = {ENCODE_UUID_16(0xff0e)};
+static const uint8_t retractions_uuid[] = {ENCODE_UUID_16(0xff0f)};
+static const uint8_t reversals_uuid[] = {ENCODE_UUID_16(0xff10)};
+static const uint8_t motion_uuid[] = {ENCODE_UUID_16(0xff11)};
+static const uint8_t position_stream_uuid[] = {ENCODE_UUID_16(0xff12)};
+static const uint8_t rollups_uuid[] = {ENCODE_UUID_16(0xff13)};
+static const uint8_t recording_uuid[] = {ENCODE_UUID_16(0xff14)};
 
 // The length of constructed adv and scan respn data must be
 // less than 31 bytes. For this reason we split the device
@@ -128,13 +144,39 @@ struct Vars {
   uint8_t manufacturer_data[20] = {0};
   uint16_t manufacturer_data_len = 0;
   uint16_t conn_mtu = 0;
+  // The motor of state and histogram reads and of the direction
+  // toggle command. Also the motor of the signal captures.
+  uint8_t selected_motor = 0;
+  // The position stream rate in Hz, zero if disabled.
+  uint16_t position_stream_rate = 0;
+  // The rollups tier that is being read, and the first period of the
+  // next read. Reads advance the period past the rollups they return.
+  analyzer::RollupTier rollups_read_tier = analyzer::ROLLUP_TIER_1_SEC;
+  uint32_t rollups_read_period = 0;
+  // Staging buffer for a single rollups read. Larger than the max
+  // number of rollups per read with kMaxRequestedMtu.
+  analyzer::Rollup rollups_chunk[16];
   analyzer::State stepper_state_buffer = {};
   analyzer::Histogram histogram_buffer = {};
   // Number of capture points already read from the current
   // snapshot. Resets each time a new snapshot is taken.
   // Sould be in [0, adc_capture_snapshot.items.size()].
   uint16_t adc_capture_items_read_so_far = 0;
+  // The snapshot lane that is being read. Zero for the capture
+  // buffer, 1 and above for the zoom lanes.
+  uint8_t adc_capture_read_lane = 0;
   analyzer::AdcCaptureBuffer adc_capture_snapshot;
+  // The long capture items window that is left to read. Reads advance
+  // the offset until it reaches the end.
+  uint16_t long_capture_read_offset = 0;
+  uint16_t long_capture_read_end = 0;
+  // Staging buffer for a single long capture read. Larger than
+  // the max number of items per read with a 512 bytes MTU.
+  analyzer::AdcCaptureItem long_capture_chunk[128];
+  // Staging buffer of an ADC linearity table upload and the number
+  // of entries uploaded so far.
+  uint16_t adc_linearity_upload[analyzer::kAdcLinearityTableSize] = {};
+  uint16_t adc_linearity_upload_size = 0;
   esp_gatt_rsp_t rsp = {};
 };
 
@@ -147,6 +189,17 @@ struct ProtextedVars {
   // Set per connection.
   uint16_t conn_id = kInvalidConnId;
   bool state_notifications_enabled = false;
+  bool anomaly_notifications_enabled = false;
+  bool position_stream_notifications_enabled = false;
+  bool recording_notifications_enabled = false;
+  // The recording pages [download_next, download_end) that are left to
+  // notify. Set by command 0x1a.
+  uint32_t download_next = 0;
+  uint32_t download_end = 0;
+  // True while the stack is out of notification buffers.
+  bool is_congested = false;
+  // Same as Vars::conn_mtu, for the notifications.
+  uint16_t conn_mtu = 0;
   // Track the optional connection WDT feature.
   // WDT is disabled if conn_wdt_period_millis is zero.
   uint32_t conn_wdt_period_millis = 0;
@@ -177,6 +230,9 @@ static const uint8_t kChrPropertyWriteOptionalResponse =
 
 // TODO: what does it do?
 static uint8_t state_ccc_val[2] = {};
+static uint8_t anomalies_ccc_val[2] = {};
+static uint8_t position_stream_ccc_val[2] = {};
+static uint8_t recording_ccc_val[2] = {};
 
 // TODO: why do we need this?
 static uint8_t command_val[1] = {};
@@ -227,6 +283,48 @@ enum {
   ATTR_IDX_CAPTURE,
   ATTR_IDX_CAPTURE_VAL,
 
+  ATTR_IDX_LONG_CAPTURE,
+  ATTR_IDX_LONG_CAPTURE_VAL,
+
+  ATTR_IDX_SENSOR_STATUS,
+  ATTR_IDX_SENSOR_STATUS_VAL,
+
+  ATTR_IDX_ENERGY,
+  ATTR_IDX_ENERGY_VAL,
+
+  ATTR_IDX_SPECTRUM,
+  ATTR_IDX_SPECTRUM_VAL,
+
+  ATTR_IDX_RESONANCE,
+  ATTR_IDX_RESONANCE_VAL,
+
+  ATTR_IDX_ANOMALIES,
+  ATTR_IDX_ANOMALIES_VAL,
+  ATTR_IDX_ANOMALIES_CCC,
+
+  ATTR_IDX_QUADRATURE_ERRORS,
+  ATTR_IDX_QUADRATURE_ERRORS_VAL,
+
+  ATTR_IDX_RETRACTIONS,
+  ATTR_IDX_RETRACTIONS_VAL,
+
+  ATTR_IDX_REVERSALS,
+  ATTR_IDX_REVERSALS_VAL,
+
+  ATTR_IDX_MOTION,
+  ATTR_IDX_MOTION_VAL,
+
+  ATTR_IDX_POSITION_STREAM,
+  ATTR_IDX_POSITION_STREAM_VAL,
+  ATTR_IDX_POSITION_STREAM_CCC,
+
+  ATTR_IDX_ROLLUPS,
+  ATTR_IDX_ROLLUPS_VAL,
+
+  ATTR_IDX_RECORDING,
+  ATTR_IDX_RECORDING_VAL,
+  ATTR_IDX_RECORDING_CCC,
+
   ATTR_IDX_COUNT,  // Attributes count.
 };
 
@@ -359,6 +457,166 @@ static const esp_gatts_attr_db_t attr_table[ATTR_IDX_COUNT] = {
     [ATTR_IDX_CAPTURE_VAL] = {{ESP_GATT_RSP_BY_APP},
         {LEN_BYTES(capture_uuid), ESP_GATT_PERM_READ, 0, 0, nullptr}},
 
+    // ----- Long capture.
+    //
+    // Characteristic
+    [ATTR_IDX_LONG_CAPTURE] = {{ESP_GATT_AUTO_RSP},
+        {LEN_BYTES(kCharDeclUuid), ESP_GATT_PERM_READ,
+            LEN_LEN_BYTES(kChrPropertyReadOnly)}},
+
+    // Value
+    [ATTR_IDX_LONG_CAPTURE_VAL] = {{ESP_GATT_RSP_BY_APP},
+        {LEN_BYTES(long_capture_uuid), ESP_GATT_PERM_READ, 0, 0, nullptr}},
+
+    // ----- Sensor status.
+    //
+    // Characteristic
+    [ATTR_IDX_SENSOR_STATUS] = {{ESP_GATT_AUTO_RSP},
+        {LEN_BYTES(kCharDeclUuid), ESP_GATT_PERM_READ,
+            LEN_LEN_BYTES(kChrPropertyReadOnly)}},
+
+    // Value
+    [ATTR_IDX_SENSOR_STATUS_VAL] = {{ESP_GATT_RSP_BY_APP},
+        {LEN_BYTES(sensor_status_uuid), ESP_GATT_PERM_READ, 0, 0, nullptr}},
+
+    // ----- Energy.
+    //
+    // Characteristic
+    [ATTR_IDX_ENERGY] = {{ESP_GATT_AUTO_RSP},
+        {LEN_BYTES(kCharDeclUuid), ESP_GATT_PERM_READ,
+            LEN_LEN_BYTES(kChrPropertyReadOnly)}},
+
+    // Value
+    [ATTR_IDX_ENERGY_VAL] = {{ESP_GATT_RSP_BY_APP},
+        {LEN_BYTES(energy_uuid), ESP_GATT_PERM_READ, 0, 0, nullptr}},
+
+    // ----- Spectrum.
+    //
+    // Characteristic
+    [ATTR_IDX_SPECTRUM] = {{ESP_GATT_AUTO_RSP},
+        {LEN_BYTES(kCharDeclUuid), ESP_GATT_PERM_READ,
+            LEN_LEN_BYTES(kChrPropertyReadOnly)}},
+
+    // Value
+    [ATTR_IDX_SPECTRUM_VAL] = {{ESP_GATT_RSP_BY_APP},
+        {LEN_BYTES(spectrum_uuid), ESP_GATT_PERM_READ, 0, 0, nullptr}},
+
+    // ----- Resonance.
+    //
+    // Characteristic
+    [ATTR_IDX_RESONANCE] = {{ESP_GATT_AUTO_RSP},
+        {LEN_BYTES(kCharDeclUuid), ESP_GATT_PERM_READ,
+            LEN_LEN_BYTES(kChrPropertyReadOnly)}},
+
+    // Value
+    [ATTR_IDX_RESONANCE_VAL] = {{ESP_GATT_RSP_BY_APP},
+        {LEN_BYTES(resonance_uuid), ESP_GATT_PERM_READ, 0, 0, nullptr}},
+
+    // ----- Anomalies.
+    //
+    // Characteristic
+    [ATTR_IDX_ANOMALIES] = {{ESP_GATT_AUTO_RSP},
+        {LEN_BYTES(kCharDeclUuid), ESP_GATT_PERM_READ,
+            LEN_LEN_BYTES(kChrPropertyReadNotify)}},
+    // Value
+    [ATTR_IDX_ANOMALIES_VAL] = {{ESP_GATT_RSP_BY_APP},
+        {LEN_BYTES(anomalies_uuid), ESP_GATT_PERM_READ, 0, 0, nullptr}},
+
+    // Client Characteristic Configuration Descriptor
+    [ATTR_IDX_ANOMALIES_CCC] = {{ESP_GATT_AUTO_RSP},
+        {LEN_BYTES(kChrConfigDeclUuid),
+            ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE,
+            LEN_LEN_BYTES(anomalies_ccc_val)}},
+
+    // ----- Quadrature errors.
+    //
+    // Characteristic
+    [ATTR_IDX_QUADRATURE_ERRORS] = {{ESP_GATT_AUTO_RSP},
+        {LEN_BYTES(kCharDeclUuid), ESP_GATT_PERM_READ,
+            LEN_LEN_BYTES(kChrPropertyReadOnly)}},
+
+    // Value
+    [ATTR_IDX_QUADRATURE_ERRORS_VAL] = {{ESP_GATT_RSP_BY_APP},
+        {LEN_BYTES(quadrature_errors_uuid), ESP_GATT_PERM_READ, 0, 0,
+            nullptr}},
+
+    // ----- Retractions.
+    //
+    // Characteristic
+    [ATTR_IDX_RETRACTIONS] = {{ESP_GATT_AUTO_RSP},
+        {LEN_BYTES(kCharDeclUuid), ESP_GATT_PERM_READ,
+            LEN_LEN_BYTES(kChrPropertyReadOnly)}},
+
+    // Value
+    [ATTR_IDX_RETRACTIONS_VAL] = {{ESP_GATT_RSP_BY_APP},
+        {LEN_BYTES(retractions_uuid), ESP_GATT_PERM_READ, 0, 0, nullptr}},
+
+    // ----- Reversals.
+    //
+    // Characteristic
+    [ATTR_IDX_REVERSALS] = {{ESP_GATT_AUTO_RSP},
+        {LEN_BYTES(kCharDeclUuid), ESP_GATT_PERM_READ,
+            LEN_LEN_BYTES(kChrPropertyReadOnly)}},
+
+    // Value
+    [ATTR_IDX_REVERSALS_VAL] = {{ESP_GATT_RSP_BY_APP},
+        {LEN_BYTES(reversals_uuid), ESP_GATT_PERM_READ, 0, 0, nullptr}},
+
+    // ----- Motion.
+    //
+    // Characteristic
+    [ATTR_IDX_MOTION] = {{ESP_GATT_AUTO_RSP},
+        {LEN_BYTES(kCharDeclUuid), ESP_GATT_PERM_READ,
+            LEN_LEN_BYTES(kChrPropertyReadOnly)}},
+
+    // Value
+    [ATTR_IDX_MOTION_VAL] = {{ESP_GATT_RSP_BY_APP},
+        {LEN_BYTES(motion_uuid), ESP_GATT_PERM_READ, 0, 0, nullptr}},
+
+    // ----- Position stream.
+    //
+    // Characteristic
+    [ATTR_IDX_POSITION_STREAM] = {{ESP_GATT_AUTO_RSP},
+        {LEN_BYTES(kCharDeclUuid), ESP_GATT_PERM_READ,
+            LEN_LEN_BYTES(kChrPropertyReadNotify)}},
+    // Value
+    [ATTR_IDX_POSITION_STREAM_VAL] = {{ESP_GATT_RSP_BY_APP},
+        {LEN_BYTES(position_stream_uuid), ESP_GATT_PERM_READ, 0, 0,
+            nullptr}},
+
+    // Client Characteristic Configuration Descriptor
+    [ATTR_IDX_POSITION_STREAM_CCC] = {{ESP_GATT_AUTO_RSP},
+        {LEN_BYTES(kChrConfigDeclUuid),
+            ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE,
+            LEN_LEN_BYTES(position_stream_ccc_val)}},
+
+    // ----- Rollups.
+    //
+    // Characteristic
+    [ATTR_IDX_ROLLUPS] = {{ESP_GATT_AUTO_RSP},
+        {LEN_BYTES(kCharDeclUuid), ESP_GATT_PERM_READ,
+            LEN_LEN_BYTES(kChrPropertyReadOnly)}},
+
+    // Value
+    [ATTR_IDX_ROLLUPS_VAL] = {{ESP_GATT_RSP_BY_APP},
+        {LEN_BYTES(rollups_uuid), ESP_GATT_PERM_READ, 0, 0, nullptr}},
+
+    // ----- Recording.
+    //
+    // Characteristic
+    [ATTR_IDX_RECORDING] = {{ESP_GATT_AUTO_RSP},
+        {LEN_BYTES(kCharDeclUuid), ESP_GATT_PERM_READ,
+            LEN_LEN_BYTES(kChrPropertyReadNotify)}},
+    // Value
+    [ATTR_IDX_RECORDING_VAL] = {{ESP_GATT_RSP_BY_APP},
+        {LEN_BYTES(recording_uuid), ESP_GATT_PERM_READ, 0, 0, nullptr}},
+
+    // Client Characteristic Configuration Descriptor
+    [ATTR_IDX_RECORDING_CCC] = {{ESP_GATT_AUTO_RSP},
+        {LEN_BYTES(kChrConfigDeclUuid),
+            ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE,
+            LEN_LEN_BYTES(recording_ccc_val)}},
+
 };
 
 // Parallel to the entries of attr_table.  Accessed only
@@ -386,7 +644,7 @@ static esp_gatt_status_t on_probe_info_read(
 }
 
 // The max number of bytes in the response prefix.
-static constexpr uint16_t kCaptureValuePrefixMaxLen = 9;
+static constexpr uint16_t kCaptureValuePrefixMaxLen = 11;
 
 static esp_gatt_status_t on_capture_read(
     const gatts_read_evt_param& read_param, ble_util::Serializer* ser) {
@@ -405,11 +663,16 @@ static esp_gatt_status_t on_capture_read(
     return ESP_GATT_OUT_OF_RANGE;
   }
 
+  // The items of the selected lane.
+  const uint8_t lane = vars.adc_capture_read_lane;
+  const analyzer::AdcCaptureItems& items = lane
+      ? vars.adc_capture_snapshot.zoom_items[lane - 1]
+      : vars.adc_capture_snapshot.items;
+
   // Index of first item to transfer.
   const int start_item_index = vars.adc_capture_items_read_so_far;
   // How many left to transfer.
-  const int desired_item_count =
-      vars.adc_capture_snapshot.items.size() - start_item_index;
+  const int desired_item_count = items.size() - start_item_index;
   // How many can we transfer now. Using 4 bytes per entry.
   const int available_item_count = (max_bytes - kCaptureValuePrefixMaxLen) / 4;
   // How many we are going to transfer now.
@@ -420,7 +683,9 @@ static esp_gatt_status_t on_capture_read(
   ESP_LOGD(TAG, "Capture read: start=%d, desired=%d, actual=%d",
       start_item_index, desired_item_count, actual_item_count);
 
-  ser->append_uint8(0x40);  // format id.
+  // Format 0x40 for the capture buffer, 0x41 for the zoom lanes
+  // which also include the lane and a wider divider.
+  ser->append_uint8(lane ? 0x41 : 0x40);  // format id.
 
   // Flags (uint8)
   uint8_t flags = 0x00;
@@ -435,15 +700,23 @@ static esp_gatt_status_t on_capture_read(
 
   if (actual_item_count) {
     ser->append_uint16(vars.adc_capture_snapshot.seq_number);
-    ser->append_uint8(vars.adc_capture_snapshot.divider);
+    if (lane) {
+      uint16_t divider = vars.adc_capture_snapshot.divider;
+      for (uint8_t i = 0; i < lane; i++) {
+        divider *= analyzer::kAdcCaptureZoomFactor;
+      }
+      ser->append_uint8(lane);
+      ser->append_uint16(divider);
+    } else {
+      ser->append_uint8(vars.adc_capture_snapshot.divider);
+    }
     ser->append_uint16((uint16_t)actual_item_count);
     ser->append_uint16((uint16_t)start_item_index);
 
     // Encode data points as pairs of int16_t.
     for (int i = start_item_index; i < start_item_index + actual_item_count;
          i++) {
-      const analyzer::AdcCaptureItem* item =
-          vars.adc_capture_snapshot.items.get(i);
+      const analyzer::AdcCaptureItem* item = items.get(i);
       ser->append_int16(item->v1);
       ser->append_int16(item->v2);
     }
@@ -455,8 +728,414 @@ static esp_gatt_status_t on_capture_read(
   return ESP_GATT_OK;
 }
 
+// The number of bytes in the long capture response prefix.
+static constexpr uint16_t kLongCaptureValuePrefixLen = 13;
+
+// Returns the next chunk of the long capture read window. The
+// header is always returned so the client can poll the state.
+static esp_gatt_status_t on_long_capture_read(
+    const gatts_read_evt_param& read_param, ble_util::Serializer* ser) {
+  ESP_LOGD(TAG, "on_long_capture_read() called");
+
+  assert(ser->size() == 0);
+  const uint16_t max_bytes =
+      std::min(vars.conn_mtu - kMtuOverhead, ser->capacity());
+  if (max_bytes < 100) {
+    ESP_LOGE(TAG, "Long capture read: max_len %hu is too small (mtu=%hu)",
+        max_bytes, vars.conn_mtu);
+    return ESP_GATT_OUT_OF_RANGE;
+  }
+
+  // How many we are going to transfer now. Using 4 bytes per entry.
+  const uint16_t start_item_index = vars.long_capture_read_offset;
+  uint16_t max_items = (max_bytes - kLongCaptureValuePrefixLen) / 4;
+  max_items = std::min(max_items,
+      (uint16_t)(sizeof(vars.long_capture_chunk) /
+          sizeof(vars.long_capture_chunk[0])));
+  max_items = std::min(max_items,
+      (uint16_t)(vars.long_capture_read_end - vars.long_capture_read_offset));
+
+  analyzer::LongCaptureStatus status;
+  const uint16_t actual_item_count = analyzer::read_long_capture(
+      start_item_index, max_items, &status, vars.long_capture_chunk);
+
+  ser->append_uint8(0x50);  // format id.
+  ser->append_uint8((uint8_t)status.state);
+  ser->append_uint16(status.seq_number);
+  ser->append_uint8(status.divider);
+  ser->append_uint16(status.size);
+  ser->append_uint16(status.trigger_index);
+  ser->append_uint16(start_item_index);
+  ser->append_uint16(actual_item_count);
+  assert(ser->size() == kLongCaptureValuePrefixLen);
+
+  // Encode data points as pairs of int16_t.
+  for (uint16_t i = 0; i < actual_item_count; i++) {
+    ser->append_int16(vars.long_capture_chunk[i].v1);
+    ser->append_int16(vars.long_capture_chunk[i].v2);
+  }
+
+  // Update for next chunk read.
+  vars.long_capture_read_offset += actual_item_count;
+
+  return ESP_GATT_OK;
+}
+
+// Returns the magnitude spectrum of the selected lane of the last capture
+// snapshot, see command 0x02. Computed here, in the BLE thread.
+static esp_gatt_status_t on_spectrum_read(
+    const gatts_read_evt_param& read_param, ble_util::Serializer* ser) {
+  ESP_LOGD(TAG, "on_spectrum_read() called");
+
+  const uint8_t lane = vars.adc_capture_read_lane;
+  const analyzer::AdcCaptureItems& items = lane
+      ? vars.adc_capture_snapshot.zoom_items[lane - 1]
+      : vars.adc_capture_snapshot.items;
+  uint16_t divider = vars.adc_capture_snapshot.divider;
+  for (uint8_t i = 0; i < lane; i++) {
+    divider *= analyzer::kAdcCaptureZoomFactor;
+  }
+
+  uint16_t bins[spectrum::kNumBins];
+  const bool ok = spectrum::compute(items, bins);
+
+  assert(ser->size() == 0);
+  ser->append_uint8(0x80);            // format id.
+  ser->append_uint8(ok ? 0x80 : 0x00);  // Flags. Spectrum available.
+  ser->append_uint16(vars.adc_capture_snapshot.seq_number);
+  ser->append_uint8(lane);
+  ser->append_uint16(divider);
+  ser->append_uint16(spectrum::kFftSize);
+  ser->append_uint8(spectrum::kFftBinsPerBin);
+  ser->append_uint8(ok ? spectrum::kNumBins : 0);
+  if (ok) {
+    for (uint8_t i = 0; i < spectrum::kNumBins; i++) {
+      ser->append_uint16(bins[i]);
+    }
+  }
+
+  return ESP_GATT_OK;
+}
+
+// Returns the total anomalies of the selected motor since the last data
+// reset. The anomaly events are sent as notifications, see
+// notify_anomaly_if_enabled().
+static esp_gatt_status_t on_anomalies_read(
+    const gatts_read_evt_param& read_param, ble_util::Serializer* ser) {
+  ESP_LOGD(TAG, "on_anomalies_read() called");
+
+  assert(ser->size() == 0);
+  ser->append_uint8(0xa0);  // format id.
+  ser->append_uint8(vars.selected_motor);
+  ser->append_uint32(analyzer::get_anomaly_count(vars.selected_motor));
+
+  return ESP_GATT_OK;
+}
+
+// Returns the quadrature error counters of the selected motor by error
+// class, and its newest error records that fit in the MTU.
+static esp_gatt_status_t on_quadrature_errors_read(
+    const gatts_read_evt_param& read_param, ble_util::Serializer* ser) {
+  ESP_LOGD(TAG, "on_quadrature_errors_read() called");
+
+  // Format id, motor, class counts and number of records.
+  constexpr uint16_t kPrefixLen =
+      3 + 4 * analyzer::QUADRATURE_ERROR_CLASSES_COUNT;
+  constexpr uint16_t kRecordLen = 21;
+  const uint16_t max_bytes =
+      std::min(vars.conn_mtu - kMtuOverhead, ser->capacity());
+  if (max_bytes < kPrefixLen) {
+    ESP_LOGE(TAG,
+        "Quadrature errors read: max_len %hu is too small (mtu=%hu)",
+        max_bytes, vars.conn_mtu);
+    return ESP_GATT_OUT_OF_RANGE;
+  }
+
+  analyzer::QuadratureErrors errors;
+  analyzer::sample_quadrature_errors(vars.selected_motor, &errors);
+
+  // Drop the oldest records that don't fit.
+  const uint8_t num_records = std::min((uint16_t)errors.num_records,
+      (uint16_t)((max_bytes - kPrefixLen) / kRecordLen));
+  const uint8_t first_record = errors.num_records - num_records;
+
+  assert(ser->size() == 0);
+  ser->append_uint8(0xb0);  // format id.
+  ser->append_uint8(vars.selected_motor);
+  for (uint8_t i = 0; i < analyzer::QUADRATURE_ERROR_CLASSES_COUNT; i++) {
+    ser->append_uint32(errors.class_counts[i]);
+  }
+  ser->append_uint8(num_records);
+  for (uint8_t i = first_record; i < errors.num_records; i++) {
+    const analyzer::QuadratureErrorRecord& record = errors.records[i];
+    ser->append_uint48(record.tick_count);
+    ser->append_uint8(record.old_quadrant);
+    ser->append_uint8(record.new_quadrant);
+    ser->append_uint8(record.error_class);
+    ser->append_int16(record.v1);
+    ser->append_int16(record.v2);
+    ser->append_uint32(record.ticks_in_step);
+    ser->append_uint32(record.move_step_ticks);
+  }
+  assert(ser->size() == kPrefixLen + num_records * kRecordLen);
+
+  return ESP_GATT_OK;
+}
+
+// Returns the speed in steps/sec of a move with given step intervals,
+// saturated to 16 bits. Zero if unknown.
+static uint16_t move_steps_per_sec(
+    const uint64_t step_intervals, const uint64_t ticks) {
+  if (!ticks) {
+    return 0;
+  }
+  const uint64_t result =
+      step_intervals * acq_consts::kTimeTicksPerSec / ticks;
+  return (result > UINT16_MAX) ? UINT16_MAX : result;
+}
+
+// Returns the retraction episodes histogram of the selected motor by
+// retraction distance, and its latest episodes that fit in the MTU.
+// Speeds are in steps/sec and dwells in ADC ticks.
+static esp_gatt_status_t on_retractions_read(
+    const gatts_read_evt_param& read_param, ble_util::Serializer* ser) {
+  ESP_LOGD(TAG, "on_retractions_read() called");
+
+  // Format id, motor, buckets and number of events.
+  constexpr uint16_t kPrefixLen = 4 + 14 * analyzer::kNumRetractionBuckets;
+  constexpr uint16_t kEventLen = 16;
+  const uint16_t max_bytes =
+      std::min(vars.conn_mtu - kMtuOverhead, ser->capacity());
+  if (max_bytes < kPrefixLen) {
+    ESP_LOGE(TAG, "Retractions read: max_len %hu is too small (mtu=%hu)",
+        max_bytes, vars.conn_mtu);
+    return ESP_GATT_OUT_OF_RANGE;
+  }
+
+  analyzer::RetractionStats stats;
+  analyzer::sample_retractions(vars.selected_motor, &stats);
+
+  // Drop the oldest events that don't fit.
+  const uint8_t num_events = std::min((uint16_t)stats.num_events,
+      (uint16_t)((max_bytes - kPrefixLen) / kEventLen));
+  const uint8_t first_event = stats.num_events - num_events;
+
+  assert(ser->size() == 0);
+  ser->append_uint8(0xc0);  // format id.
+  ser->append_uint8(vars.selected_motor);
+  ser->append_uint8(analyzer::kNumRetractionBuckets);
+  for (uint8_t i = 0; i < analyzer::kNumRetractionBuckets; i++) {
+    const analyzer::RetractionBucket& bucket = stats.buckets[i];
+    const uint32_t episodes = bucket.episodes;
+    ser->append_uint32(episodes);
+    ser->append_uint16(episodes
+            ? std::min(bucket.total_steps / episodes, (uint64_t)UINT16_MAX)
+            : 0);
+    ser->append_uint16(move_steps_per_sec(
+        bucket.total_steps - episodes, bucket.total_retraction_ticks));
+    ser->append_uint16(move_steps_per_sec(
+        bucket.total_steps - episodes, bucket.total_unretraction_ticks));
+    ser->append_uint32(episodes ? bucket.total_dwell_ticks / episodes : 0);
+  }
+  ser->append_uint8(num_events);
+  for (uint8_t i = first_event; i < stats.num_events; i++) {
+    const analyzer::RetractionEvent& event = stats.events[i];
+    ser->append_uint48(event.tick_count);
+    ser->append_uint16(std::min(event.steps, (uint32_t)UINT16_MAX));
+    ser->append_uint16(
+        move_steps_per_sec(event.steps - 1, event.retraction_ticks));
+    ser->append_uint16(
+        move_steps_per_sec(event.steps - 1, event.unretraction_ticks));
+    ser->append_uint32(event.dwell_ticks);
+  }
+  assert(ser->size() == kPrefixLen + num_events * kEventLen);
+
+  return ESP_GATT_OK;
+}
+
+// Returns the direction reversal counters, rate and dwell histogram of
+// the selected motor.
+static esp_gatt_status_t on_reversals_read(
+    const gatts_read_evt_param& read_param, ble_util::Serializer* ser) {
+  ESP_LOGD(TAG, "on_reversals_read() called");
+
+  analyzer::ReversalStats stats;
+  analyzer::sample_reversals(vars.selected_motor, &stats);
+
+  assert(ser->size() == 0);
+  ser->append_uint8(0xd0);  // format id.
+  ser->append_uint8(vars.selected_motor);
+  ser->append_uint32(stats.forward_reversals);
+  ser->append_uint32(stats.backward_reversals);
+  ser->append_uint32(stats.last_minute_reversals);
+  ser->append_uint16(analyzer::kReversalDwellBucketTicks);
+  ser->append_uint8(analyzer::kNumReversalDwellBuckets);
+  for (uint8_t i = 0; i < analyzer::kNumReversalDwellBuckets; i++) {
+    ser->append_uint32(stats.dwell_buckets[i]);
+  }
+
+  return ESP_GATT_OK;
+}
+
+// Returns the velocity and acceleration of the selected motor, and its
+// time in moves by acceleration, as permils of the total.
+static esp_gatt_status_t on_motion_read(
+    const gatts_read_evt_param& read_param, ble_util::Serializer* ser) {
+  ESP_LOGD(TAG, "on_motion_read() called");
+
+  analyzer::MotionStats stats;
+  analyzer::sample_motion(vars.selected_motor, &stats);
+
+  uint64_t total_ticks = 0;
+  for (uint8_t i = 0; i < analyzer::kNumAccelerationBuckets; i++) {
+    total_ticks += stats.acceleration_ticks[i];
+  }
+
+  assert(ser->size() == 0);
+  ser->append_uint8(0xe0);  // format id.
+  ser->append_uint8(vars.selected_motor);
+  ser->encode_int32(stats.velocity);
+  ser->encode_int32(stats.acceleration);
+  ser->append_uint16(analyzer::kAccelerationBucketStepsPerSec2);
+  ser->append_uint8(analyzer::kNumAccelerationBuckets);
+  for (uint8_t i = 0; i < analyzer::kNumAccelerationBuckets; i++) {
+    // Zero if the total time is too low, as in the time histogram.
+    ser->append_uint16((total_ticks < 10)
+            ? 0
+            : (stats.acceleration_ticks[i] * 1000) / total_ticks);
+  }
+
+  return ESP_GATT_OK;
+}
+
+// Returns the position stream rate. The stream itself is notified.
+static esp_gatt_status_t on_position_stream_read(
+    const gatts_read_evt_param& read_param, ble_util::Serializer* ser) {
+  ESP_LOGD(TAG, "on_position_stream_read() called");
+
+  assert(ser->size() == 0);
+  ser->append_uint8(0xf0);  // format id.
+  ser->append_uint8(vars.selected_motor);
+  ser->append_uint16(vars.position_stream_rate);
+
+  return ESP_GATT_OK;
+}
+
+// Format id, motor, tier, tier secs, the period in progress and the
+// rollups count.
+static constexpr uint16_t kRollupsValuePrefixLen = 10;
+static constexpr uint16_t kRollupLen = 18;
+
+// Returns the next chunk of completed rollups of the selected motor, in
+// the tier and from the period that command 0x17 set. An empty chunk
+// indicates that the client caught up.
+static esp_gatt_status_t on_rollups_read(
+    const gatts_read_evt_param& read_param, ble_util::Serializer* ser) {
+  ESP_LOGD(TAG, "on_rollups_read() called");
+
+  assert(ser->size() == 0);
+  const uint16_t max_bytes =
+      std::min(vars.conn_mtu - kMtuOverhead, ser->capacity());
+  if (max_bytes < kRollupsValuePrefixLen + kRollupLen) {
+    ESP_LOGE(TAG, "Rollups read: max_len %hu is too small (mtu=%hu)",
+        max_bytes, vars.conn_mtu);
+    return ESP_GATT_OUT_OF_RANGE;
+  }
+  const uint16_t max_items =
+      std::min((max_bytes - kRollupsValuePrefixLen) / kRollupLen,
+          (int)(sizeof(vars.rollups_chunk) / sizeof(vars.rollups_chunk[0])));
+
+  const analyzer::RollupTier tier = vars.rollups_read_tier;
+  uint32_t open_period;
+  const uint16_t n = analyzer::read_rollups(vars.selected_motor, tier,
+      vars.rollups_read_period, max_items, vars.rollups_chunk, &open_period);
+
+  const uint32_t period_ticks =
+      (uint32_t)analyzer::kRollupTierSecs[tier] * acq_consts::kTimeTicksPerSec;
+  ser->append_uint8(0x02);  // format id.
+  ser->append_uint8(vars.selected_motor);
+  ser->append_uint8(tier);
+  ser->append_uint16(analyzer::kRollupTierSecs[tier]);
+  ser->append_uint32(open_period);
+  ser->append_uint8(n);
+  assert(ser->size() == kRollupsValuePrefixLen);
+
+  // The RMS current is in ADC counts with 4 fraction bits, as in the
+  // energy read.
+  for (uint16_t i = 0; i < n; i++) {
+    const analyzer::Rollup& rollup = vars.rollups_chunk[i];
+    const double rms = sqrt((double)rollup.mean_sq_current) * 16;
+    ser->append_uint32(rollup.period);
+    ser->encode_int32(rollup.steps);
+    ser->append_uint16(rollup.max_speed);
+    ser->append_uint16(rollup.peak_current);
+    ser->append_uint16((rms > UINT16_MAX) ? UINT16_MAX : (uint16_t)rms);
+    ser->append_uint16(rollup.quadrature_errors);
+    ser->append_uint16(
+        ((uint64_t)rollup.energized_ticks * 1000) / period_ticks);
+  }
+
+  // Update for next chunk read.
+  if (n) {
+    vars.rollups_read_period = vars.rollups_chunk[n - 1].period + 1;
+  }
+
+  return ESP_GATT_OK;
+}
+
+// Returns the offline recording status. The pages of a download are
+// notified.
+static esp_gatt_status_t on_recording_read(
+    const gatts_read_evt_param& read_param, ble_util::Serializer* ser) {
+  ESP_LOGD(TAG, "on_recording_read() called");
+
+  recorder::Status status;
+  recorder::get_status(&status);
+
+  assert(ser->size() == 0);
+  ser->append_uint8(0x03);  // format id.
+  ser->append_uint8(status.is_available);
+  ser->append_uint8(status.is_recording);
+  ser->append_uint16(status.session);
+  ser->append_uint16(status.state_interval_millis);
+  ser->append_uint32(status.tail_seq);
+  ser->append_uint32(status.head_seq);
+  ser->append_uint32(status.capacity_pages);
+  ser->append_uint32(status.dropped_records);
+  ser->append_uint32(status.flash_errors);
+  ser->append_uint32(status.max_erase_millis);
+
+  return ESP_GATT_OK;
+}
+
+// Returns the resonance band amplitudes of the capture motor. Refreshed
+// at the state rate.
+static esp_gatt_status_t on_resonance_read(
+    const gatts_read_evt_param& read_param, ble_util::Serializer* ser) {
+  ESP_LOGD(TAG, "on_resonance_read() called");
+
+  analyzer::ResonanceStatus status;
+  analyzer::sample_resonance(&status);
+
+  assert(ser->size() == 0);
+  ser->append_uint8(0x90);  // format id.
+  ser->append_uint8(vars.selected_motor);
+  ser->append_uint16(status.seq_number);
+  ser->append_uint8(status.num_bands);
+  for (uint8_t i = 0; i < status.num_bands; i++) {
+    ser->append_uint16(status.frequencies[i]);
+    ser->append_uint16(status.amplitudes[i]);
+  }
+
+  return ESP_GATT_OK;
+}
+
+// The state packet size. Multi motor builds append the motor index.
+static constexpr uint16_t kStatePacketLen =
+    (acq_consts::kNumMotors > 1) ? 20 : 19;
+
 static void serialize_state(
-    const analyzer::State& state, ble_util::Serializer* ser) {
+    const analyzer::State& state, uint8_t motor, ble_util::Serializer* ser) {
   // Flags.
   // * bit5 : true IFF energized.
   // * bit4 : true IFF reversed direction.
@@ -476,15 +1155,77 @@ static void serialize_state(
   ser->append_int16(state.v1);
   ser->append_int16(state.v2);
   ser->append_uint32(state.non_energized_count);
-  assert(ser->size() == 19);
+  if (acq_consts::kNumMotors > 1) {
+    ser->append_uint8(motor);
+  }
+  assert(ser->size() == kStatePacketLen);
 }
 
 static esp_gatt_status_t on_stepper_state_read(
     const gatts_read_evt_param& read_param, ble_util::Serializer* ser) {
   ESP_LOGD(TAG, "on_stepper_state_read() called");
 
-  analyzer::sample_state(&vars.stepper_state_buffer);
-  serialize_state(vars.stepper_state_buffer, ser);
+  analyzer::sample_state(vars.selected_motor, &vars.stepper_state_buffer);
+  serialize_state(vars.stepper_state_buffer, vars.selected_motor, ser);
+
+  return ESP_GATT_OK;
+}
+
+// Returns the noise floor, energized limits and zero offsets of the
+// selected motor.
+static esp_gatt_status_t on_sensor_status_read(
+    const gatts_read_evt_param& read_param, ble_util::Serializer* ser) {
+  ESP_LOGD(TAG, "on_sensor_status_read() called");
+
+  analyzer::SensorStatus status;
+  analyzer::sample_sensor_status(vars.selected_motor, &status);
+
+  assert(ser->size() == 0);
+  ser->append_uint8(0x60);  // format id.
+  ser->append_uint8(vars.selected_motor);
+  ser->append_uint16(status.noise_floor);
+  ser->append_uint16(status.non_energized_threshold);
+  ser->append_uint16(status.energized_threshold);
+  ser->append_int16(status.offset1);
+  ser->append_int16(status.offset2);
+
+  return ESP_GATT_OK;
+}
+
+// Returns the coil energy of the selected motor since the last data
+// reset, and its RMS coil current by speed range.
+static esp_gatt_status_t on_energy_read(
+    const gatts_read_evt_param& read_param, ble_util::Serializer* ser) {
+  ESP_LOGD(TAG, "on_energy_read() called");
+
+  analyzer::EnergyStats stats;
+  analyzer::sample_energy(vars.selected_motor, &stats);
+  analyzer::sample_histogram(vars.selected_motor, &vars.histogram_buffer);
+
+  assert(ser->size() == 0);
+  ser->append_uint8(0x70);  // format id.
+  ser->append_uint8(vars.selected_motor);
+  ser->append_uint48(stats.ticks);
+  ser->append_uint64(stats.total_sq_currents1);
+  ser->append_uint64(stats.total_sq_currents2);
+
+  ser->append_uint8(acq_consts::kNumHistogramBuckets);  // Num of buckets
+
+  // Format the RMS coil current of each bucket, averaged over the two
+  // coils, in ADC counts with 4 fraction bits (2 bytes each). Zero
+  // indicates zero steps.
+  for (int i = 0; i < acq_consts::kNumHistogramBuckets; i++) {
+    const analyzer::HistogramBucket& bucket = vars.histogram_buffer.buckets[i];
+    uint16_t value = 0;
+    if (bucket.total_ticks_in_steps) {
+      const double mean_sq =
+          (double)(bucket.total_sq_currents1 + bucket.total_sq_currents2) /
+          (2 * bucket.total_ticks_in_steps);
+      const double rms = sqrt(mean_sq) * 16;
+      value = (rms > UINT16_MAX) ? UINT16_MAX : (uint16_t)rms;
+    }
+    ser->append_uint16(value);
+  }
 
   return ESP_GATT_OK;
 }
@@ -493,7 +1234,7 @@ static esp_gatt_status_t on_current_histogram_read(
     const gatts_read_evt_param& read_param, ble_util::Serializer* ser) {
   ESP_LOGD(TAG, "on_current_histogram_read() called");
 
-  analyzer::sample_histogram(&vars.histogram_buffer);
+  analyzer::sample_histogram(vars.selected_motor, &vars.histogram_buffer);
 
   assert(ser->size() == 0);
   ser->append_uint8(0x10);  // format id.
@@ -523,7 +1264,7 @@ static esp_gatt_status_t on_time_histogram_read(
     const gatts_read_evt_param& read_param, ble_util::Serializer* ser) {
   ESP_LOGD(TAG, "on_time_histogram_read() called");
 
-  analyzer::sample_histogram(&vars.histogram_buffer);
+  analyzer::sample_histogram(vars.selected_motor, &vars.histogram_buffer);
 
   assert(ser->size() == 0);
   ser->append_uint8(0x20);  // format id.
@@ -559,7 +1300,7 @@ static esp_gatt_status_t on_distance_histogram_read(
     const gatts_read_evt_param& read_param, ble_util::Serializer* ser) {
   ESP_LOGD(TAG, "on_distance_histogram_read() called");
 
-  analyzer::sample_histogram(&vars.histogram_buffer);
+  analyzer::sample_histogram(vars.selected_motor, &vars.histogram_buffer);
 
   assert(ser->size() == 0);
   ser->append_uint8(0x30);  // Format id.
@@ -609,6 +1350,66 @@ static esp_gatt_status_t on_state_notification_control_write(
   return ESP_GATT_OK;
 }
 
+static esp_gatt_status_t on_anomaly_notification_control_write(
+    const gatts_write_evt_param& write_param) {
+  if (write_param.len != 2 || write_param.is_prep) {
+    return ESP_GATT_ERROR;
+  }
+
+  const uint16_t descr_value = write_param.value[1] << 8 | write_param.value[0];
+  const bool notifications_enabled = descr_value & 0x0001;
+
+  ENTER_MUTEX {
+    ESP_LOGI(TAG, "Anomaly notifications 0x%04x: %d -> %d", descr_value,
+        protected_vars.anomaly_notifications_enabled, notifications_enabled);
+    protected_vars.anomaly_notifications_enabled = notifications_enabled;
+  }
+  EXIT_MUTEX
+
+  return ESP_GATT_OK;
+}
+
+static esp_gatt_status_t on_position_stream_notification_control_write(
+    const gatts_write_evt_param& write_param) {
+  if (write_param.len != 2 || write_param.is_prep) {
+    return ESP_GATT_ERROR;
+  }
+
+  const uint16_t descr_value = write_param.value[1] << 8 | write_param.value[0];
+  const bool notifications_enabled = descr_value & 0x0001;
+
+  ENTER_MUTEX {
+    ESP_LOGI(TAG, "Position stream notifications 0x%04x: %d -> %d",
+        descr_value, protected_vars.position_stream_notifications_enabled,
+        notifications_enabled);
+    protected_vars.position_stream_notifications_enabled =
+        notifications_enabled;
+  }
+  EXIT_MUTEX
+
+  return ESP_GATT_OK;
+}
+
+static esp_gatt_status_t on_recording_notification_control_write(
+    const gatts_write_evt_param& write_param) {
+  if (write_param.len != 2 || write_param.is_prep) {
+    return ESP_GATT_ERROR;
+  }
+
+  const uint16_t descr_value = write_param.value[1] << 8 | write_param.value[0];
+  const bool notifications_enabled = descr_value & 0x0001;
+
+  ENTER_MUTEX {
+    ESP_LOGI(TAG, "Recording notifications 0x%04x: %d -> %d", descr_value,
+        protected_vars.recording_notifications_enabled,
+        notifications_enabled);
+    protected_vars.recording_notifications_enabled = notifications_enabled;
+  }
+  EXIT_MUTEX
+
+  return ESP_GATT_OK;
+}
+
 // Ser is for encoding an optional response.
 static esp_gatt_status_t on_command_write(
     const gatts_write_evt_param& write_param, ble_util::Serializer* ser) {
@@ -646,20 +1447,32 @@ static esp_gatt_status_t on_command_write(
       }
       analyzer::get_last_capture_snapshot(&vars.adc_capture_snapshot);
       vars.adc_capture_items_read_so_far = 0;
+      vars.adc_capture_read_lane = 0;
       ESP_LOGD(TAG, "ADC signal captured.");
       return ESP_GATT_OK;
 
     // Command = Set ADC capture divider. Note that until the new capture
     // will be ready, the last capture is still with the old divider.
-    case 0x03:
-      if (len != 2) {
+    // An optional second byte selects the decimation mode. Default is
+    // to drop samples.
+    case 0x03: {
+      if (len != 2 && len != 3) {
         ESP_LOGE(TAG, "Set divider command wrong length : %hu", len);
         return ESP_GATT_INVALID_ATTR_LEN;
       }
-      analyzer::set_signal_capture_divider(data[1]);
+      const uint8_t decimation =
+          (len == 3) ? data[2] : analyzer::DECIMATION_DROP;
+      if (decimation >= analyzer::DECIMATIONS_COUNT) {
+        ESP_LOGE(TAG, "Set divider command invalid decimation : %hhu",
+            decimation);
+        return ESP_GATT_OUT_OF_RANGE;
+      }
+      analyzer::set_signal_capture_divider(
+          data[1], (analyzer::CaptureDecimation)decimation);
       ESP_LOGI(TAG, "signal capture divider set to %hhu", data[1]);
 
       return ESP_GATT_OK;
+    }
 
       // Command = toggle direction. This doesn't reverses the motors
       // buy just the direction of the step counting. New value is
@@ -670,7 +1483,7 @@ static esp_gatt_status_t on_command_write(
         return ESP_GATT_INVALID_ATTR_LEN;
       }
       bool new_direction = false;
-      if (!controls::toggle_direction(&new_direction)) {
+      if (!controls::toggle_direction(vars.selected_motor, &new_direction)) {
         ESP_LOGE(TAG, "Direction change failed");
         return ESP_GATT_WRITE_NOT_PERMIT;
       }
@@ -750,6 +1563,394 @@ static esp_gatt_status_t on_command_write(
       return ESP_GATT_OK;
     }
 
+      // Command = set signal capture trigger. The step period band
+      // (two uint32, big endian) is passed only with the step period
+      // trigger mode.
+    case 0x08: {
+      if (len < 2) {
+        ESP_LOGE(TAG, "Set trigger command wrong length : %hu", len);
+        return ESP_GATT_INVALID_ATTR_LEN;
+      }
+      analyzer::CaptureTriggerSettings settings;
+      analyzer::get_capture_trigger(&settings);
+      settings.mode = (analyzer::CaptureTriggerMode)data[1];
+      settings.min_step_ticks = 0;
+      settings.max_step_ticks = UINT32_MAX;
+      const int expected_len =
+          (settings.mode == analyzer::TRIGGER_STEP_PERIOD) ? 10 : 2;
+      if (len != expected_len) {
+        ESP_LOGE(TAG, "Set trigger command wrong length : %hu", len);
+        return ESP_GATT_INVALID_ATTR_LEN;
+      }
+      if (settings.mode == analyzer::TRIGGER_STEP_PERIOD) {
+        settings.min_step_ticks = ((uint32_t)data[2] << 24) |
+            ((uint32_t)data[3] << 16) | ((uint32_t)data[4] << 8) | data[5];
+        settings.max_step_ticks = ((uint32_t)data[6] << 24) |
+            ((uint32_t)data[7] << 16) | ((uint32_t)data[8] << 8) | data[9];
+      }
+      if (!analyzer::set_capture_trigger(settings)) {
+        return ESP_GATT_OUT_OF_RANGE;
+      }
+      return ESP_GATT_OK;
+    }
+
+      // Command = set signal capture level trigger and trigger position.
+      // Level (int16), hysteresis (uint16), channel (uint8), slope (uint8)
+      // and pre trigger percents (uint8). Doesn't change the trigger mode.
+    case 0x09: {
+      if (len != 8) {
+        ESP_LOGE(TAG, "Set trigger level command wrong length : %hu", len);
+        return ESP_GATT_INVALID_ATTR_LEN;
+      }
+      analyzer::CaptureTriggerSettings settings;
+      analyzer::get_capture_trigger(&settings);
+      settings.level = (int16_t)(data[1] << 8 | data[2]);
+      settings.hysteresis = data[3] << 8 | data[4];
+      settings.channel = (analyzer::CaptureTriggerChannel)data[5];
+      settings.slope = (analyzer::CaptureTriggerSlope)data[6];
+      settings.pre_trigger_percent = data[7];
+      if (!analyzer::set_capture_trigger(settings)) {
+        return ESP_GATT_OUT_OF_RANGE;
+      }
+      return ESP_GATT_OK;
+    }
+
+    // Command = arm the long record capture. An optional second byte
+    // sets the capture divider, default is 1. Also resets the read
+    // window to the entire capture.
+    case 0x0a: {
+      if (len != 1 && len != 2) {
+        ESP_LOGE(TAG, "Arm long capture command wrong length : %hu", len);
+        return ESP_GATT_INVALID_ATTR_LEN;
+      }
+      const uint8_t divider = (len == 2) ? data[1] : 1;
+      if (!analyzer::arm_long_capture(divider)) {
+        return ESP_GATT_REQ_NOT_SUPPORTED;
+      }
+      vars.long_capture_read_offset = 0;
+      vars.long_capture_read_end = analyzer::kLongCaptureBufferSize;
+      return ESP_GATT_OK;
+    }
+
+    // Command = set the long capture read window. Offset (uint16) and
+    // items count (uint16). Following reads return consecutive chunks
+    // of this window.
+    case 0x0b: {
+      if (len != 5) {
+        ESP_LOGE(TAG, "Set long capture window command wrong length : %hu",
+            len);
+        return ESP_GATT_INVALID_ATTR_LEN;
+      }
+      const uint16_t offset = data[1] << 8 | data[2];
+      const uint16_t count = data[3] << 8 | data[4];
+      if (offset > analyzer::kLongCaptureBufferSize ||
+          count > analyzer::kLongCaptureBufferSize - offset) {
+        ESP_LOGE(TAG, "Long capture window out of range: %hu, %hu", offset,
+            count);
+        return ESP_GATT_OUT_OF_RANGE;
+      }
+      vars.long_capture_read_offset = offset;
+      vars.long_capture_read_end = offset + count;
+      return ESP_GATT_OK;
+    }
+
+    // Command = set the number of signal capture zoom lanes.
+    case 0x0c: {
+      if (len != 2) {
+        ESP_LOGE(TAG, "Set zoom lanes command wrong length : %hu", len);
+        return ESP_GATT_INVALID_ATTR_LEN;
+      }
+      if (!analyzer::set_signal_capture_zoom_lanes(data[1])) {
+        return ESP_GATT_OUT_OF_RANGE;
+      }
+      return ESP_GATT_OK;
+    }
+
+    // Command = select the lane of the last ADC signal snapshot to read,
+    // without taking a new snapshot. Zero selects the capture buffer.
+    case 0x0d: {
+      if (len != 2) {
+        ESP_LOGE(TAG, "Select capture lane command wrong length : %hu", len);
+        return ESP_GATT_INVALID_ATTR_LEN;
+      }
+      const uint8_t lane = data[1];
+      if (lane > vars.adc_capture_snapshot.zoom_lanes) {
+        ESP_LOGE(TAG, "Capture lane %hhu not in snapshot", lane);
+        return ESP_GATT_OUT_OF_RANGE;
+      }
+      vars.adc_capture_read_lane = lane;
+      vars.adc_capture_items_read_so_far = 0;
+      return ESP_GATT_OK;
+    }
+
+    // Command = select a motor, in multi motor builds. Applies to the
+    // state and histogram reads, the toggle direction command and the
+    // signal captures. State notifications include all motors.
+    case 0x0e: {
+      if (len != 2) {
+        ESP_LOGE(TAG, "Select motor command wrong length : %hu", len);
+        return ESP_GATT_INVALID_ATTR_LEN;
+      }
+      const uint8_t motor = data[1];
+      if (!analyzer::set_capture_motor(motor)) {
+        return ESP_GATT_OUT_OF_RANGE;
+      }
+      vars.selected_motor = motor;
+      return ESP_GATT_OK;
+    }
+
+    // Command = set the signal filter of all motors. See
+    // analyzer::SignalFilter for the values. New value is persisted
+    // on the eeprom.
+    case 0x0f: {
+      if (len != 2) {
+        ESP_LOGE(TAG, "Set signal filter command wrong length : %hu", len);
+        return ESP_GATT_INVALID_ATTR_LEN;
+      }
+      const uint8_t filter = data[1];
+      if (filter >= analyzer::FILTERS_COUNT) {
+        ESP_LOGE(TAG, "Invalid signal filter : %hhu", filter);
+        return ESP_GATT_OUT_OF_RANGE;
+      }
+      if (!controls::set_signal_filter(filter)) {
+        ESP_LOGE(TAG, "Signal filter change failed");
+        return ESP_GATT_WRITE_NOT_PERMIT;
+      }
+      return ESP_GATT_OK;
+    }
+
+    // Command = upload a chunk of an ADC linearity table. Args are
+    // the big endian u16 offset of the first entry and one or more
+    // big endian u16 entries. Chunks should be sent in order, starting
+    // at offset 0. See command 0x11.
+    case 0x10: {
+      if (len < 5 || (len - 3) % 2 != 0) {
+        ESP_LOGE(TAG, "Linearity table chunk command wrong length : %hu", len);
+        return ESP_GATT_INVALID_ATTR_LEN;
+      }
+      const uint16_t offset = ((uint16_t)data[1] << 8) | data[2];
+      const uint16_t count = (len - 3) / 2;
+      // Offset 0 restarts the upload.
+      if (offset == 0) {
+        vars.adc_linearity_upload_size = 0;
+      }
+      if (offset != vars.adc_linearity_upload_size ||
+          offset + count > analyzer::kAdcLinearityTableSize) {
+        ESP_LOGE(TAG, "Linearity table chunk out of order : %hu, %hu (%hu)",
+            offset, count, vars.adc_linearity_upload_size);
+        return ESP_GATT_OUT_OF_RANGE;
+      }
+      for (uint16_t i = 0; i < count; i++) {
+        vars.adc_linearity_upload[offset + i] =
+            ((uint16_t)data[3 + 2 * i] << 8) | data[4 + 2 * i];
+      }
+      vars.adc_linearity_upload_size = offset + count;
+      return ESP_GATT_OK;
+    }
+
+    // Command = apply an ADC linearity table. Arg is 1 to apply and
+    // persist the uploaded table, which should be complete, or 0 to
+    // restore the identity table.
+    case 0x11: {
+      if (len != 2 || data[1] > 1) {
+        ESP_LOGE(TAG, "Linearity table apply command invalid : %hu", len);
+        return ESP_GATT_INVALID_ATTR_LEN;
+      }
+      const bool apply = data[1];
+      if (apply &&
+          vars.adc_linearity_upload_size != analyzer::kAdcLinearityTableSize) {
+        ESP_LOGE(TAG, "Linearity table upload incomplete : %hu",
+            vars.adc_linearity_upload_size);
+        return ESP_GATT_OUT_OF_RANGE;
+      }
+      const nvs_config::WriteStatus status = controls::set_adc_linearity_table(
+          apply ? vars.adc_linearity_upload : nullptr);
+      vars.adc_linearity_upload_size = 0;
+      if (status == nvs_config::WRITE_NO_SPACE) {
+        // Applied until the next boot.
+        ESP_LOGE(TAG, "Linearity table doesn't fit the nvs partition");
+        return ESP_GATT_INSUF_RESOURCE;
+      }
+      if (status != nvs_config::WRITE_OK) {
+        ESP_LOGE(TAG, "Linearity table change failed");
+        return ESP_GATT_WRITE_NOT_PERMIT;
+      }
+      return ESP_GATT_OK;
+    }
+
+    // Command = set the per channel gains of the selected motor. Args
+    // are the big endian u16 gains, with 4096 representing 1.0. New
+    // values are persisted on the eeprom.
+    case 0x12: {
+      if (len != 5) {
+        ESP_LOGE(TAG, "Set gains command wrong length : %hu", len);
+        return ESP_GATT_INVALID_ATTR_LEN;
+      }
+      const uint16_t gain1 = ((uint16_t)data[1] << 8) | data[2];
+      const uint16_t gain2 = ((uint16_t)data[3] << 8) | data[4];
+      if (!controls::set_gains(vars.selected_motor, gain1, gain2)) {
+        ESP_LOGE(TAG, "Gains change failed");
+        return ESP_GATT_WRITE_NOT_PERMIT;
+      }
+      return ESP_GATT_OK;
+    }
+
+    // Command = set the sensor profile. Arg is an index in
+    // acq_consts::kSensorProfiles, or 0xff for the profile of the
+    // hardware config. New value is persisted on the eeprom and
+    // reported by the probe info.
+    case 0x13: {
+      if (len != 2) {
+        ESP_LOGE(TAG, "Set sensor profile command wrong length : %hu", len);
+        return ESP_GATT_INVALID_ATTR_LEN;
+      }
+      const bool ok = controls::set_sensor_profile(
+          vars.hardware_config, data[1], &vars.adc_ticks_per_amp);
+      if (!ok) {
+        ESP_LOGE(TAG, "Sensor profile change failed");
+        return ESP_GATT_WRITE_NOT_PERMIT;
+      }
+      return ESP_GATT_OK;
+    }
+
+    // Command = set the coil current metric of all motors. See
+    // analyzer::CurrentMetric for the values. New value is persisted
+    // on the eeprom.
+    case 0x14: {
+      if (len != 2) {
+        ESP_LOGE(TAG, "Set current metric command wrong length : %hu", len);
+        return ESP_GATT_INVALID_ATTR_LEN;
+      }
+      const uint8_t metric = data[1];
+      if (metric >= analyzer::CURRENT_METRICS_COUNT) {
+        ESP_LOGE(TAG, "Invalid current metric : %hhu", metric);
+        return ESP_GATT_OUT_OF_RANGE;
+      }
+      if (!controls::set_current_metric(metric)) {
+        ESP_LOGE(TAG, "Current metric change failed");
+        return ESP_GATT_WRITE_NOT_PERMIT;
+      }
+      return ESP_GATT_OK;
+    }
+
+    // Command = set the resonance monitoring bands of the capture motor.
+    // Args are zero to analyzer::kMaxResonanceBands big endian u16
+    // frequencies in Hz. No frequencies disables the monitoring.
+    case 0x15: {
+      if (len < 1 || (len - 1) % 2 != 0 ||
+          (len - 1) / 2 > analyzer::kMaxResonanceBands) {
+        ESP_LOGE(TAG, "Set resonance bands command wrong length : %hu", len);
+        return ESP_GATT_INVALID_ATTR_LEN;
+      }
+      const uint8_t num_bands = (len - 1) / 2;
+      uint16_t frequencies[analyzer::kMaxResonanceBands];
+      for (uint8_t i = 0; i < num_bands; i++) {
+        frequencies[i] = ((uint16_t)data[1 + 2 * i] << 8) | data[2 + 2 * i];
+      }
+      if (!analyzer::set_resonance_bands(frequencies, num_bands)) {
+        return ESP_GATT_OUT_OF_RANGE;
+      }
+      return ESP_GATT_OK;
+    }
+
+    // Command = set the position stream rate of the capture motor.
+    // Arg is a big endian u16 rate in Hz, or zero to disable the
+    // stream. The stream is disabled on disconnection.
+    case 0x16: {
+      if (len != 3) {
+        ESP_LOGE(TAG, "Set position stream rate command wrong length : %hu",
+            len);
+        return ESP_GATT_INVALID_ATTR_LEN;
+      }
+      const uint16_t rate = ((uint16_t)data[1] << 8) | data[2];
+      if (!analyzer::set_position_stream_rate(rate)) {
+        return ESP_GATT_OUT_OF_RANGE;
+      }
+      vars.position_stream_rate = rate;
+      return ESP_GATT_OK;
+    }
+
+    // Command = set the rollups read cursor. Tier (uint8) and the first
+    // period (uint32) of the following rollups reads. A client that
+    // reconnects passes the period after the last one it read.
+    case 0x17: {
+      if (len != 6) {
+        ESP_LOGE(TAG, "Set rollups cursor command wrong length : %hu", len);
+        return ESP_GATT_INVALID_ATTR_LEN;
+      }
+      const uint8_t tier = data[1];
+      if (tier >= analyzer::ROLLUP_TIERS_COUNT) {
+        ESP_LOGE(TAG, "Invalid rollups tier: %hhu", tier);
+        return ESP_GATT_OUT_OF_RANGE;
+      }
+      vars.rollups_read_tier = (analyzer::RollupTier)tier;
+      vars.rollups_read_period = ((uint32_t)data[2] << 24) |
+          ((uint32_t)data[3] << 16) | ((uint32_t)data[4] << 8) | data[5];
+      return ESP_GATT_OK;
+    }
+
+    // Command = start or stop the offline recording. Enabled (uint8)
+    // and an optional state interval in millis (uint16). Recording
+    // continues after disconnection.
+    case 0x18: {
+      if (len != 2 && len != 4) {
+        ESP_LOGE(TAG, "Set recording command wrong length : %hu", len);
+        return ESP_GATT_INVALID_ATTR_LEN;
+      }
+      if (!data[1]) {
+        recorder::stop();
+        return ESP_GATT_OK;
+      }
+      const uint16_t interval_millis = (len == 4)
+          ? ((uint16_t)data[2] << 8) | data[3]
+          : recorder::kDefaultStateIntervalMillis;
+      if (!recorder::start(interval_millis)) {
+        return ESP_GATT_OUT_OF_RANGE;
+      }
+      return ESP_GATT_OK;
+    }
+
+    // Command = clear the recorded pages. No args.
+    case 0x19: {
+      if (len != 1) {
+        ESP_LOGE(TAG, "Clear recording command wrong length : %hu", len);
+        return ESP_GATT_INVALID_ATTR_LEN;
+      }
+      recorder::clear();
+      return ESP_GATT_OK;
+    }
+
+    // Command = download recorded pages, as notifications of the
+    // recording characteristic. First seq (uint32) and pages count
+    // (uint16). A zero count stops a download in progress. Or, to seek
+    // by time, session (uint16), millis (uint32) and pages count
+    // (uint16), starting at the last page that starts at or before that
+    // time, see recorder::find_page().
+    case 0x1a: {
+      if (len != 7 && len != 9) {
+        ESP_LOGE(TAG, "Download recording command wrong length : %hu", len);
+        return ESP_GATT_INVALID_ATTR_LEN;
+      }
+      uint32_t first_seq;
+      if (len == 7) {
+        first_seq = ((uint32_t)data[1] << 24) | ((uint32_t)data[2] << 16) |
+            ((uint32_t)data[3] << 8) | data[4];
+      } else {
+        const uint16_t session = ((uint16_t)data[1] << 8) | data[2];
+        const uint32_t millis = ((uint32_t)data[3] << 24) |
+            ((uint32_t)data[4] << 16) | ((uint32_t)data[5] << 8) | data[6];
+        first_seq = recorder::find_page(session, millis);
+      }
+      const uint16_t count =
+          ((uint16_t)data[len - 2] << 8) | data[len - 1];
+      ENTER_MUTEX {
+        protected_vars.download_next = first_seq;
+        protected_vars.download_end = first_seq + count;
+      }
+      EXIT_MUTEX
+      return ESP_GATT_OK;
+    }
+
     default:
       ESP_LOGE(TAG, "on_command_write: unknown opcode: %02lx", opcode);
       return ESP_GATT_REQ_NOT_SUPPORTED;
@@ -932,6 +2133,37 @@ static void gatts_event_handler(esp_gatts_cb_event_t event,
         status = on_distance_histogram_read(read_param, &ser);
       } else if (read_param.handle == handle_table[ATTR_IDX_CAPTURE_VAL]) {
         status = on_capture_read(read_param, &ser);
+      } else if (read_param.handle ==
+          handle_table[ATTR_IDX_LONG_CAPTURE_VAL]) {
+        status = on_long_capture_read(read_param, &ser);
+      } else if (read_param.handle ==
+          handle_table[ATTR_IDX_SENSOR_STATUS_VAL]) {
+        status = on_sensor_status_read(read_param, &ser);
+      } else if (read_param.handle == handle_table[ATTR_IDX_ENERGY_VAL]) {
+        status = on_energy_read(read_param, &ser);
+      } else if (read_param.handle == handle_table[ATTR_IDX_SPECTRUM_VAL]) {
+        status = on_spectrum_read(read_param, &ser);
+      } else if (read_param.handle == handle_table[ATTR_IDX_RESONANCE_VAL]) {
+        status = on_resonance_read(read_param, &ser);
+      } else if (read_param.handle == handle_table[ATTR_IDX_ANOMALIES_VAL]) {
+        status = on_anomalies_read(read_param, &ser);
+      } else if (read_param.handle ==
+          handle_table[ATTR_IDX_QUADRATURE_ERRORS_VAL]) {
+        status = on_quadrature_errors_read(read_param, &ser);
+      } else if (read_param.handle ==
+          handle_table[ATTR_IDX_RETRACTIONS_VAL]) {
+        status = on_retractions_read(read_param, &ser);
+      } else if (read_param.handle == handle_table[ATTR_IDX_REVERSALS_VAL]) {
+        status = on_reversals_read(read_param, &ser);
+      } else if (read_param.handle == handle_table[ATTR_IDX_MOTION_VAL]) {
+        status = on_motion_read(read_param, &ser);
+      } else if (read_param.handle ==
+          handle_table[ATTR_IDX_POSITION_STREAM_VAL]) {
+        status = on_position_stream_read(read_param, &ser);
+      } else if (read_param.handle == handle_table[ATTR_IDX_ROLLUPS_VAL]) {
+        status = on_rollups_read(read_param, &ser);
+      } else if (read_param.handle == handle_table[ATTR_IDX_RECORDING_VAL]) {
+        status = on_recording_read(read_param, &ser);
       }
 
       const uint16_t len = (status == ESP_GATT_OK) ? ser.size() : 0;
@@ -967,6 +2199,13 @@ static void gatts_event_handler(esp_gatts_cb_event_t event,
       } else if (handle_table[ATTR_IDX_STEPPER_STATE_CCC] ==
           write_param.handle) {
         status = on_state_notification_control_write(write_param);
+      } else if (handle_table[ATTR_IDX_ANOMALIES_CCC] == write_param.handle) {
+        status = on_anomaly_notification_control_write(write_param);
+      } else if (handle_table[ATTR_IDX_POSITION_STREAM_CCC] ==
+          write_param.handle) {
+        status = on_position_stream_notification_control_write(write_param);
+      } else if (handle_table[ATTR_IDX_RECORDING_CCC] == write_param.handle) {
+        status = on_recording_notification_control_write(write_param);
       } else if (handle_table[ATTR_IDX_COMMAND_VAL] == write_param.handle) {
         ESP_LOGD(TAG,
             "Command write:  is_prep=%d, need_rsp=%d, "
@@ -995,6 +2234,8 @@ static void gatts_event_handler(esp_gatts_cb_event_t event,
     case ESP_GATTS_MTU_EVT:
       ESP_LOGI(TAG, "ESP_GATTS_MTU_EVT, mtu set to %d", param->mtu.mtu);
       vars.conn_mtu = param->mtu.mtu;
+      ENTER_MUTEX { protected_vars.conn_mtu = param->mtu.mtu; }
+      EXIT_MUTEX
       break;
 
     case ESP_GATTS_START_EVT:
@@ -1013,6 +2254,13 @@ static void gatts_event_handler(esp_gatts_cb_event_t event,
       ENTER_MUTEX {
         protected_vars.conn_id = param->connect.conn_id;
         protected_vars.state_notifications_enabled = false;
+        protected_vars.anomaly_notifications_enabled = false;
+        protected_vars.position_stream_notifications_enabled = false;
+        protected_vars.recording_notifications_enabled = false;
+        protected_vars.download_next = 0;
+        protected_vars.download_end = 0;
+        protected_vars.is_congested = false;
+        protected_vars.conn_mtu = 23;
         protected_vars.conn_wdt_period_millis = 0;
         protected_vars.conn_wdt_timestamp_millis = 0;
       }
@@ -1036,10 +2284,20 @@ static void gatts_event_handler(esp_gatts_cb_event_t event,
       ESP_LOGI(TAG, "ESP_GATTS_DISCONNECT_EVT, reason = 0x%x",
           param->disconnect.reason);
       vars.conn_mtu = 0;
+      // The stream costs CPU time, don't leave it running.
+      analyzer::set_position_stream_rate(0);
+      vars.position_stream_rate = 0;
 
       ENTER_MUTEX {
         protected_vars.conn_id = kInvalidConnId;
         protected_vars.state_notifications_enabled = false;
+        protected_vars.anomaly_notifications_enabled = false;
+        protected_vars.position_stream_notifications_enabled = false;
+        protected_vars.recording_notifications_enabled = false;
+        protected_vars.download_next = 0;
+        protected_vars.download_end = 0;
+        protected_vars.is_congested = false;
+        protected_vars.conn_mtu = 0;
         protected_vars.conn_wdt_period_millis = 0;
         protected_vars.conn_wdt_timestamp_millis = 0;
       }
@@ -1089,6 +2347,15 @@ static void gatts_event_handler(esp_gatts_cb_event_t event,
     case ESP_GATTS_CONF_EVT:
       break;
 
+    // The stack ran out of, or recovered, notification buffers. Bulk
+    // notifications pause while congested.
+    case ESP_GATTS_CONGEST_EVT:
+      ESP_LOGD(TAG, "ESP_GATTS_CONGEST_EVT, congested = %d",
+          param->congest.congested);
+      ENTER_MUTEX { protected_vars.is_congested = param->congest.congested; }
+      EXIT_MUTEX
+      break;
+
     // Unexpected, so logging it.
     default:
       ESP_LOGI(TAG, "Gatt event handler: ignored event %d, %s", event,
@@ -1199,7 +2466,7 @@ void setup(uint8_t hardware_config, uint16_t adc_ticks_per_amp) {
 
 static uint8_t state_notification_buffer[50] = {};
 
-void notify_state_if_enabled(const analyzer::State& state) {
+void notify_state_if_enabled(const analyzer::State& state, uint8_t motor) {
   // Snapshot protected vars in a mutec.
   ProtextedVars prot_vars;
   ENTER_MUTEX { prot_vars = protected_vars; }
@@ -1215,7 +2482,7 @@ void notify_state_if_enabled(const analyzer::State& state) {
 
   ble_util::Serializer ser(
       state_notification_buffer, sizeof(state_notification_buffer));
-  serialize_state(state, &ser);
+  serialize_state(state, motor, &ser);
 
   // NOTE: need_config == false to indicate a notification (vs. indication).
   const esp_err_t err = esp_ble_gatts_send_indicate(prot_vars.gatts_if,
@@ -1228,4 +2495,314 @@ void notify_state_if_enabled(const analyzer::State& state) {
   }
 }
 
-}  // namespace ble_host
\ No newline at end of file
+static uint8_t anomaly_notification_buffer[20] = {};
+
+void notify_anomaly_if_enabled(const analyzer::AnomalyEvent& event) {
+  // Snapshot protected vars in a mutec.
+  ProtextedVars prot_vars;
+  ENTER_MUTEX { prot_vars = protected_vars; }
+  EXIT_MUTEX
+
+  if (!prot_vars.anomaly_notifications_enabled) {
+    return;
+  }
+
+  assert(prot_vars.gatts_if != ESP_GATT_IF_NONE);
+  assert(prot_vars.conn_id != kInvalidConnId);
+
+  // Fits in the initial MTU.
+  ble_util::Serializer ser(
+      anomaly_notification_buffer, sizeof(anomaly_notification_buffer));
+  ser.append_uint8(0xa1);  // format id.
+  ser.append_uint8(event.motor);
+  ser.append_uint8((uint8_t)event.type);
+  ser.append_uint48(event.tick_count);
+  ser.append_uint32(event.detail);
+  ser.append_uint32(event.anomaly_count);
+
+  // NOTE: need_config == false to indicate a notification (vs. indication).
+  const esp_err_t err = esp_ble_gatts_send_indicate(prot_vars.gatts_if,
+      prot_vars.conn_id, handle_table[ATTR_IDX_ANOMALIES_VAL], ser.size(),
+      anomaly_notification_buffer, false);
+
+  if (err) {
+    ESP_LOGE(TAG, "esp_ble_gatts_send_indicate() returned err 0x%x %s", err,
+        esp_err_to_name(err));
+  }
+}
+
+// Fraction bits of the streamed positions.
+static constexpr uint8_t kPositionFractionBits = 8;
+
+// Format id, motor, sequence number, first item tick, divider, items
+// count and the first item position.
+static constexpr uint16_t kPositionStreamHeaderLen = 17;
+
+// Staging buffers of the position stream notifications.
+static analyzer::PositionStreamItem
+    position_stream_items[analyzer::kPositionStreamBufferSize];
+static uint8_t
+    position_stream_notification_buffer[kMaxRequestedMtu - kMtuOverhead];
+static uint16_t position_stream_seq_number = 0;
+
+// Returns the position of a stream item in full steps with
+// kPositionFractionBits fraction bits. The fraction is computed as in
+// the Python client's ProbeState.microsteps().
+static int32_t position_stream_item_position(
+    const analyzer::PositionStreamItem& item) {
+  float adjustment = 0;  // [-0.5, 0.5]
+  if (item.is_energized) {
+    // Range [0, 2] steps.
+    const float microsteps = fabsf(atan2f(item.v2, item.v1) * 2 / M_PI);
+    switch (item.quadrant) {
+      case 0:
+        adjustment = microsteps - 0.5f;
+        break;
+      case 1:
+        adjustment = microsteps - 1.5f;
+        break;
+      case 2:
+        adjustment = -microsteps + 1.5f;
+        break;
+      default:
+        adjustment = -microsteps + 0.5f;
+        break;
+    }
+  }
+  const int32_t fraction =
+      lroundf(adjustment * (1 << kPositionFractionBits));
+  const int32_t position = item.full_steps << kPositionFractionBits;
+  return item.is_reverse_direction ? position - fraction
+                                   : position + fraction;
+}
+
+// Appends a position delta of delta with a prefix code, '0' for zero,
+// and '10', '110', '1110' and '1111' followed by a 7, 12, 20 and 32
+// bits two's complement value respectively. Returns false if there is
+// no room.
+static bool append_delta_of_delta(
+    ble_util::BitWriter* bits, const int32_t delta_of_delta) {
+  if (delta_of_delta == 0) {
+    if (!bits->has_room(1)) {
+      return false;
+    }
+    bits->append_bits(0, 1);
+    return true;
+  }
+  uint8_t prefix_bits;
+  uint8_t value_bits;
+  if (delta_of_delta >= -(1 << 6) && delta_of_delta < (1 << 6)) {
+    prefix_bits = 2;
+    value_bits = 7;
+  } else if (delta_of_delta >= -(1 << 11) && delta_of_delta < (1 << 11)) {
+    prefix_bits = 3;
+    value_bits = 12;
+  } else if (delta_of_delta >= -(1 << 19) && delta_of_delta < (1 << 19)) {
+    prefix_bits = 4;
+    value_bits = 20;
+  } else {
+    prefix_bits = 4;
+    value_bits = 32;
+  }
+  if (!bits->has_room(prefix_bits + value_bits)) {
+    return false;
+  }
+  // Ones followed by a zero, except for the longest code.
+  const uint8_t prefix =
+      (value_bits == 32) ? 0x0f : (1 << prefix_bits) - 2;
+  bits->append_bits(prefix, prefix_bits);
+  bits->append_bits((uint32_t)delta_of_delta, value_bits);
+  return true;
+}
+
+// Sends a notification with a prefix of the given stream items, and
+// returns the number of items sent. Items are sent until the packet is
+// full or there is a gap in the item ticks.
+static uint16_t notify_position_stream_packet(const ProtextedVars& prot_vars,
+    const analyzer::PositionStreamItem items[], const uint16_t num_items,
+    const uint16_t divider, const uint16_t max_bytes) {
+  uint8_t* const buffer = position_stream_notification_buffer;
+  ble_util::BitWriter bits(
+      buffer + kPositionStreamHeaderLen, max_bytes - kPositionStreamHeaderLen);
+
+  // The first item is sent in full, the next ones as delta of delta
+  // from a zero delta.
+  const int32_t first_position = position_stream_item_position(items[0]);
+  int32_t last_position = first_position;
+  int32_t last_delta = 0;
+  uint16_t count = 1;
+  for (; count < num_items && count < UINT8_MAX; count++) {
+    const analyzer::PositionStreamItem& item = items[count];
+    if (item.motor != items[0].motor ||
+        item.tick_count != items[count - 1].tick_count + divider) {
+      break;
+    }
+    const int32_t position = position_stream_item_position(item);
+    const int32_t delta = position - last_position;
+    if (!append_delta_of_delta(&bits, delta - last_delta)) {
+      break;
+    }
+    last_position = position;
+    last_delta = delta;
+  }
+
+  ble_util::Serializer ser(buffer, kPositionStreamHeaderLen);
+  ser.append_uint8(0xf1);  // format id.
+  ser.append_uint8(items[0].motor);
+  ser.append_uint16(position_stream_seq_number++);
+  ser.append_uint48(items[0].tick_count);
+  ser.append_uint16(divider);
+  ser.append_uint8(count);
+  ser.encode_int32(first_position);
+
+  // NOTE: need_config == false to indicate a notification (vs. indication).
+  const esp_err_t err = esp_ble_gatts_send_indicate(prot_vars.gatts_if,
+      prot_vars.conn_id, handle_table[ATTR_IDX_POSITION_STREAM_VAL],
+      kPositionStreamHeaderLen + bits.size(), buffer, false);
+
+  if (err) {
+    ESP_LOGE(TAG, "esp_ble_gatts_send_indicate() returned err 0x%x %s", err,
+        esp_err_to_name(err));
+  }
+  return count;
+}
+
+void notify_position_stream_if_enabled() {
+  // Pop also when disabled, such that stale items are not sent later.
+  uint16_t divider;
+  const uint16_t num_items = analyzer::pop_position_stream(
+      position_stream_items, analyzer::kPositionStreamBufferSize, &divider);
+  if (!num_items) {
+    return;
+  }
+
+  // Snapshot protected vars in a mutec.
+  ProtextedVars prot_vars;
+  ENTER_MUTEX { prot_vars = protected_vars; }
+  EXIT_MUTEX
+
+  if (!prot_vars.position_stream_notifications_enabled) {
+    return;
+  }
+
+  assert(prot_vars.gatts_if != ESP_GATT_IF_NONE);
+  assert(prot_vars.conn_id != kInvalidConnId);
+
+  const uint16_t max_bytes = std::min(prot_vars.conn_mtu - kMtuOverhead,
+      (int)sizeof(position_stream_notification_buffer));
+  if (max_bytes < kPositionStreamHeaderLen + 8) {
+    ESP_LOGE(TAG, "Position stream: max_len %hu is too small (mtu=%hu)",
+        max_bytes, prot_vars.conn_mtu);
+    return;
+  }
+
+  for (uint16_t i = 0; i < num_items;) {
+    i += notify_position_stream_packet(prot_vars, position_stream_items + i,
+        num_items - i, divider, max_bytes);
+  }
+}
+
+// Format id, page seq and the offset of the chunk in the page.
+static constexpr uint16_t kRecordingChunkHeaderLen = 6;
+
+// Pages per call, such that a download doesn't starve the state
+// notifications. About 50KB/sec at the 200Hz loop rate, if the link
+// keeps up.
+static constexpr uint16_t kMaxDownloadPagesPerCall = 4;
+
+static uint8_t recording_page_buffer[flash_log::kPageSize];
+static uint8_t
+    recording_notification_buffer[kMaxRequestedMtu - kMtuOverhead];
+
+// Sends a page as chunks that fit in the MTU. Returns false if a
+// notification failed, in which case the page should be resent.
+static bool notify_recording_page(const ProtextedVars& prot_vars,
+    uint32_t seq, uint16_t page_size, uint16_t max_bytes) {
+  const uint16_t max_chunk_bytes = max_bytes - kRecordingChunkHeaderLen;
+  for (uint16_t offset = 0; offset < page_size;) {
+    const uint16_t n =
+        std::min(max_chunk_bytes, (uint16_t)(page_size - offset));
+    ble_util::Serializer ser(
+        recording_notification_buffer, sizeof(recording_notification_buffer));
+    ser.append_uint8(0x04);  // format id.
+    ser.append_uint32(seq);
+    ser.append_uint8(offset);
+    assert(ser.size() == kRecordingChunkHeaderLen);
+    memcpy(recording_notification_buffer + kRecordingChunkHeaderLen,
+        recording_page_buffer + offset, n);
+
+    // NOTE: need_config == false to indicate a notification (vs. indication).
+    const esp_err_t err = esp_ble_gatts_send_indicate(prot_vars.gatts_if,
+        prot_vars.conn_id, handle_table[ATTR_IDX_RECORDING_VAL],
+        kRecordingChunkHeaderLen + n, recording_notification_buffer, false);
+    if (err) {
+      ESP_LOGW(TAG, "Recording page %lu: send_indicate() err 0x%x %s", seq,
+          err, esp_err_to_name(err));
+      return false;
+    }
+    offset += n;
+  }
+  return true;
+}
+
+void notify_recording_download_if_enabled() {
+  // Snapshot protected vars in a mutec.
+  ProtextedVars prot_vars;
+  ENTER_MUTEX { prot_vars = protected_vars; }
+  EXIT_MUTEX
+
+  if (!prot_vars.recording_notifications_enabled ||
+      prot_vars.download_next == prot_vars.download_end ||
+      prot_vars.is_congested) {
+    return;
+  }
+
+  assert(prot_vars.gatts_if != ESP_GATT_IF_NONE);
+  assert(prot_vars.conn_id != kInvalidConnId);
+
+  const uint16_t max_bytes = std::min(prot_vars.conn_mtu - kMtuOverhead,
+      (int)sizeof(recording_notification_buffer));
+  if (max_bytes < kRecordingChunkHeaderLen + 8) {
+    ESP_LOGE(TAG, "Recording download: max_len %hu is too small (mtu=%hu)",
+        max_bytes, prot_vars.conn_mtu);
+    return;
+  }
+
+  recorder::Status status;
+  recorder::get_status(&status);
+
+  uint32_t next = prot_vars.download_next;
+  uint32_t end = prot_vars.download_end;
+  // Pages that were dropped or overwritten are skipped. Pages that are
+  // not written yet end the download.
+  if (next < status.tail_seq) {
+    next = std::min(status.tail_seq, end);
+  }
+  if (end > status.head_seq) {
+    end = std::max(status.head_seq, next);
+  }
+  for (uint16_t i = 0; i < kMaxDownloadPagesPerCall && next < end; i++) {
+    uint16_t page_size;
+    if (!recorder::read_page(next, recording_page_buffer, &page_size)) {
+      ESP_LOGE(TAG, "Recording download: failed to read page %lu", next);
+      next++;
+      continue;
+    }
+    if (!notify_recording_page(prot_vars, next, page_size, max_bytes)) {
+      break;
+    }
+    next++;
+  }
+
+  // Unless a download command changed the range meanwhile.
+  ENTER_MUTEX {
+    if (protected_vars.download_next == prot_vars.download_next &&
+        protected_vars.download_end == prot_vars.download_end) {
+      protected_vars.download_next = next;
+      protected_vars.download_end = end;
+    }
+  }
+  EXIT_MUTEX
+}
+
+}  // namespace ble_host
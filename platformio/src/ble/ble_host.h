@@ -8,8 +8,21 @@ namespace ble_host {
 void setup(uint8_t hardware_config, uint16_t adc_ticks_per_amp);
 
 // If state notification is enabled, send a notification with
-// this state.
-void notify_state_if_enabled(const analyzer::State& state);
+// this state of the given motor.
+void notify_state_if_enabled(const analyzer::State& state, uint8_t motor);
+
+// If anomaly notification is enabled, send a notification with
+// this anomaly event.
+void notify_anomaly_if_enabled(const analyzer::AnomalyEvent& event);
+
+// Pops the pending position stream items and, if position stream
+// notification is enabled, sends them in delta of delta encoded
+// notifications.
+void notify_position_stream_if_enabled();
+
+// If a recording download is in progress and its notification is
+// enabled, sends the next few pages, unless the link is congested.
+void notify_recording_download_if_enabled();
 
 // Returns true if a host is connected. Used also to check
 // connection WDT expriation.
@@ -93,6 +93,11 @@ class Serializer {
     *_p_next++ = v >> 0;
   }
 
+  inline void append_uint64(uint64_t v) {
+    append_uint32((uint32_t)(v >> 32));
+    append_uint32((uint32_t)v);
+  }
+
   // Length <= 255.
   inline void append_str(const char* str) {
     size_t len = strlen(str);
@@ -119,6 +124,43 @@ class Serializer {
   }
 };
 
+// Packs bit fields to a byte buffer. Most significant bit first.
+class BitWriter {
+ public:
+  BitWriter(uint8_t* p_start, uint16_t size) :
+      _p_start(p_start), _capacity_bits(size * 8), _num_bits(0) {};
+
+  // Number of bytes encoded so far, including a partial last byte.
+  int size() { return (_num_bits + 7) / 8; }
+  // True if num_bits more bits can be encoded.
+  bool has_room(uint16_t num_bits) {
+    return _num_bits + num_bits <= _capacity_bits;
+  }
+
+  // Appends the num_bits low bits of v. num_bits <= 32.
+  inline void append_bits(uint32_t v, uint8_t num_bits) {
+    assert(has_room(num_bits));
+    while (num_bits) {
+      const uint8_t bit_offset = _num_bits & 0x07;
+      const uint8_t n =
+          (num_bits < 8 - bit_offset) ? num_bits : 8 - bit_offset;
+      const uint8_t bits = (v >> (num_bits - n)) & ((1 << n) - 1);
+      uint8_t* p = _p_start + (_num_bits >> 3);
+      if (!bit_offset) {
+        *p = 0;
+      }
+      *p |= bits << (8 - bit_offset - n);
+      _num_bits += n;
+      num_bits -= n;
+    }
+  }
+
+ private:
+  uint8_t* const _p_start;
+  const uint32_t _capacity_bits;
+  uint32_t _num_bits;
+};
+
 const char* gatts_event_name(esp_gatts_cb_event_t event);
 const char* gap_ble_event_name(esp_gap_ble_cb_event_t event);
 const char* gatts_status_name(esp_gatt_status_t status);
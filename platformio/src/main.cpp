@@ -15,6 +15,7 @@
 #include "misc/efuses.h"
 #include "misc/elapsed.h"
 #include "misc/util.h"
+#include "recording/recorder.h"
 #include "settings/controls.h"
 #include "settings/nvs_config.h"
 #include "tools/enum_code_gen.h"
@@ -22,6 +23,7 @@
 static constexpr auto TAG = "main";
 
 static analyzer::State state;
+static uint8_t state_motor;
 
 static analyzer::AdcCaptureBuffer capture_buffer;
 
@@ -33,6 +35,11 @@ static uint16_t led2_counter;
 
 static Elapsed periodic_timer;
 
+// Drift corrected offsets are persisted lazily, at this interval,
+// to limit the flash writes.
+static constexpr uint32_t kDriftFlushIntervalMillis = 10 * 60 * 1000;
+static Elapsed drift_flush_timer;
+
 // Used to generate blink to indicates that
 // acquisition is working.
 static uint32_t analyzer_counter = 0;
@@ -43,25 +50,6 @@ static void start_led2_blinks(uint16_t n) {
   io::LED2.write(led2_counter > 0);
 }
 
-// Determine hardware configuration based on configuration
-// resistors.
-static uint16_t determine_adc_ticks_per_amp(uint8_t hardware_config) {
-  switch (hardware_config) {
-    case 0:
-      // CFG1, CFG2 resistors not installed.
-      return acq_consts::CC6920BSO5A_ADC_TICKS_PER_AMP;
-      break;
-    case 1:
-      // Only CFG1 resistors is installed.
-      return acq_consts::TMCS1108A4B_ADC_TICKS_PER_AMP;
-      break;
-    // Configurations 0, 1 are reserved.
-    default:
-      ESP_LOGE(TAG, "Unexpected hardware config %hhu", hardware_config);
-      return 0;
-  }
-}
-
 static void setup() {
   // Set initial LEDs values.
   io::LED1.clr();
@@ -75,29 +63,69 @@ static void setup() {
   // Init nvs. Used also by ble_host.
   util::nvs_init();
 
-  // Fetch acquisition settings.
-  nvs_config::AcquistionSettings settings;
-  if (!nvs_config::read_acquisition_settings(&settings)) {
-    ESP_LOGE(TAG, "Failed to read acquisition settings, will use default.");
-    settings = nvs_config::kDefaultAcquisitionSettings;
+  // Fetch acquisition settings of each motor.
+  nvs_config::AcquistionSettings settings[acq_consts::kNumMotors];
+  for (uint8_t motor = 0; motor < acq_consts::kNumMotors; motor++) {
+    if (!nvs_config::read_acquisition_settings(motor, &settings[motor])) {
+      ESP_LOGE(TAG,
+          "Failed to read acquisition settings %hhu, will use default.",
+          motor);
+      settings[motor] = nvs_config::kDefaultAcquisitionSettings;
+    }
+    ESP_LOGI(TAG, "Acqusition settings %hhu: %d, %d, %d, %hu, %hu", motor,
+        settings[motor].offset1, settings[motor].offset2,
+        settings[motor].is_reverse_direction, settings[motor].gain1,
+        settings[motor].gain2);
   }
-  ESP_LOGI(TAG, "Acqusition settings: %d, %d, %d", settings.offset1,
-      settings.offset2, settings.is_reverse_direction);
-
-  // Init acquisition.
-  analyzer::setup(settings);
-  adc_task::setup();
 
-  // Determine the hardware confiuration to pass to ble host.
+  // Determine the hardware confiuration to pass to the analyzer and
+  // ble host.
   const uint8_t hardware_config = io::read_hardware_config();
   ESP_LOGI(TAG, "Hardware config: %hhu", hardware_config);
-  const uint16_t adc_ticks_per_amp =
-      determine_adc_ticks_per_amp(hardware_config);
-  if (!adc_ticks_per_amp) {
+  const int sensor_profile = controls::determine_sensor_profile(hardware_config);
+  if (sensor_profile < 0) {
     ESP_LOGE(TAG, "Invalid hardware config: %hhu", hardware_config);
     assert(0);
   }
-  ESP_LOGI(TAG, "ADC ticks per Amp: %hu", adc_ticks_per_amp);
+  const uint16_t adc_ticks_per_amp =
+      acq_consts::kSensorProfiles[sensor_profile].adc_ticks_per_amp;
+  ESP_LOGI(TAG, "Sensor %s, ADC ticks per Amp: %hu",
+      acq_consts::kSensorProfiles[sensor_profile].name, adc_ticks_per_amp);
+
+  // Init acquisition.
+  if (!analyzer::setup(settings, adc_ticks_per_amp)) {
+    assert(0);
+  }
+
+  // Fetch the ADC linearity correction table, if any. Static since
+  // it's large for the stack.
+  static uint16_t adc_linearity_table[analyzer::kAdcLinearityTableSize];
+  if (nvs_config::read_adc_linearity_table(
+          adc_linearity_table, analyzer::kAdcLinearityTableSize)) {
+    analyzer::set_adc_linearity_table(adc_linearity_table);
+  } else {
+    ESP_LOGI(TAG, "No ADC linearity table, will use identity.");
+  }
+
+  // Fetch the signal filter.
+  nvs_config::FilterSettings filter_settings;
+  if (!nvs_config::read_filter_settings(&filter_settings) ||
+      !analyzer::set_signal_filter(
+          (analyzer::SignalFilter)filter_settings.signal_filter)) {
+    ESP_LOGE(TAG, "Failed to read the signal filter, will use default.");
+  }
+
+  // Fetch the current metric.
+  nvs_config::CurrentMetricSettings metric_settings;
+  if (!nvs_config::read_current_metric_settings(&metric_settings) ||
+      !analyzer::set_current_metric(
+          (analyzer::CurrentMetric)metric_settings.current_metric)) {
+    ESP_LOGE(TAG, "Failed to read the current metric, will use default.");
+  }
+  adc_task::setup();
+
+  // Mount the offline recording log, if any.
+  recorder::setup();
 
   // Initialize ble host.
   ble_host::setup(hardware_config, adc_ticks_per_amp);
@@ -111,10 +139,11 @@ static void loop() {
   if (button_event != Button::EVENT_NONE) {
     ESP_LOGI(TAG, "Button event: %d", button_event);
 
-    // Handle single click. Reverse direction.
+    // Handle single click. Reverse direction of the first motor.
     if (button_event == Button::EVENT_SHORT_CLICK) {
       bool new_is_reversed_direcction;
-      const bool ok = controls::toggle_direction(&new_is_reversed_direcction);
+      const bool ok =
+          controls::toggle_direction(0, &new_is_reversed_direcction);
       const uint16_t num_blinks = !ok ? 10 : new_is_reversed_direcction ? 2 : 1;
       start_led2_blinks(num_blinks);
     }
@@ -133,6 +162,12 @@ static void loop() {
     is_connected = ble_host::is_connected();
   }
 
+  // Persist the drift corrected offsets, if any.
+  if (drift_flush_timer.elapsed_millis() >= kDriftFlushIntervalMillis) {
+    drift_flush_timer.reset();
+    controls::flush_drifted_offsets();
+  }
+
   // Update LED blinks.  Blinking indicates analyzer works
   // and provides states. High speed blink indicates connection
   // status.
@@ -148,14 +183,33 @@ static void loop() {
     io::LED2.write(led2_counter > 0 && !(led2_counter & 0x1));
   }
 
-  // Blocking. 50Hz.
-  analyzer::pop_next_state(&state);
+  // Blocking. 50Hz per motor.
+  analyzer::pop_next_state(&state, &state_motor);
+
+  // LED blinks and state dumps follow the first motor.
+  if (state_motor == 0) {
+    analyzer_counter++;
+  }
+  ble_host::notify_state_if_enabled(state, state_motor);
+  recorder::add_state(state, state_motor);
+
+  // Anomaly events, if any. Rare.
+  analyzer::AnomalyEvent anomaly_event;
+  while (analyzer::pop_next_anomaly(&anomaly_event)) {
+    ble_host::notify_anomaly_if_enabled(anomaly_event);
+    recorder::add_anomaly(anomaly_event);
+  }
+
+  // Position stream items, if enabled.
+  ble_host::notify_position_stream_if_enabled();
 
-  analyzer_counter++;
-  ble_host::notify_state_if_enabled(state);
+  // Offline recording. At most one flash operation per loop, and pages
+  // of a download, if any.
+  recorder::service();
+  ble_host::notify_recording_download_if_enabled();
 
   // Dump ADC state
-  if (analyzer_counter % 100 == 0) {
+  if (state_motor == 0 && analyzer_counter % 100 == 0) {
     analyzer::dump_state(state);
     // adc_task::dump_stats();
   }
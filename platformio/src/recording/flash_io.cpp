@@ -0,0 +1,65 @@
+#include "flash_io.h"
+
+#include "esp_log.h"
+#include "esp_partition.h"
+
+namespace flash_io {
+
+static constexpr auto TAG = "flash_io";
+
+// Custom data subtype of the recording partition, see partitions.csv.
+static constexpr esp_partition_subtype_t kPartitionSubtype =
+    (esp_partition_subtype_t)0x40;
+
+static const esp_partition_t* partition = nullptr;
+
+bool setup() {
+  partition = esp_partition_find_first(
+      ESP_PARTITION_TYPE_DATA, kPartitionSubtype, "recording");
+  if (!partition) {
+    ESP_LOGW(TAG, "No recording partition.");
+    return false;
+  }
+  ESP_LOGI(TAG, "Recording partition at 0x%lx, size 0x%lx",
+      partition->address, partition->size);
+  return true;
+}
+
+uint32_t size() {
+  return partition ? partition->size - (partition->size % kSectorSize) : 0;
+}
+
+bool read(uint32_t offset, void* dst, uint32_t len) {
+  const esp_err_t err = esp_partition_read(partition, offset, dst, len);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Read at 0x%lx failed: %s", offset, esp_err_to_name(err));
+    return false;
+  }
+  return true;
+}
+
+// Stalls the flash cache, and with it the tasks that are not in IRAM,
+// for about a millisecond per page.
+bool write(uint32_t offset, const void* src, uint32_t len) {
+  const esp_err_t err = esp_partition_write(partition, offset, src, len);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Write at 0x%lx failed: %s", offset, esp_err_to_name(err));
+    return false;
+  }
+  return true;
+}
+
+// Stalls the flash cache for typically 45ms, up to 400ms. The ADC
+// conversions are buffered by the IRAM safe ADC ISR meanwhile, for up
+// to 100ms, see adc_task.
+bool erase_sector(uint32_t offset) {
+  const esp_err_t err =
+      esp_partition_erase_range(partition, offset, kSectorSize);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Erase at 0x%lx failed: %s", offset, esp_err_to_name(err));
+    return false;
+  }
+  return true;
+}
+
+}  // namespace flash_io
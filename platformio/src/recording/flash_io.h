@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+
+// Raw access to the flash region of the offline recording. On the
+// device this is the 'recording' data partition, see partitions.csv.
+// This header has no ESP-IDF dependencies such that flash_log can be
+// linked on a host with a file backed implementation.
+namespace flash_io {
+
+// The erase unit. Writes may only clear bits of erased bytes.
+constexpr uint32_t kSectorSize = 4096;
+
+// Finds the flash region. Returns false if it doesn't exist, e.g. with
+// an older partition table.
+bool setup();
+
+// Size of the region in bytes, a multiple of kSectorSize. Zero if
+// setup() failed.
+uint32_t size();
+
+// Offsets are relative to the region start. Return false on errors.
+bool read(uint32_t offset, void* dst, uint32_t len);
+bool write(uint32_t offset, const void* src, uint32_t len);
+bool erase_sector(uint32_t offset);
+
+}  // namespace flash_io
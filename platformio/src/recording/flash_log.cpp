@@ -0,0 +1,244 @@
+#include "flash_log.h"
+
+#include <assert.h>
+#include <string.h>
+
+namespace flash_log {
+
+static constexpr uint16_t kPageMagic = 0x5250;
+
+static inline uint16_t get_uint16(const uint8_t* p) {
+  return ((uint16_t)p[0] << 8) | p[1];
+}
+
+static inline uint32_t get_uint32(const uint8_t* p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+      ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void put_uint16(uint8_t* p, uint16_t v) {
+  p[0] = v >> 8;
+  p[1] = v;
+}
+
+static inline void put_uint32(uint8_t* p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+// CRC-16/CCITT-FALSE, as Python's binascii.crc_hqx(data, 0xffff).
+static uint16_t crc16(const uint8_t* p, uint32_t len) {
+  uint16_t crc = 0xffff;
+  while (len--) {
+    crc ^= (uint16_t)*p++ << 8;
+    for (uint8_t i = 0; i < 8; i++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+// Parses the header fields, without checking the magic and the CRC.
+static void decode_header(const uint8_t* p, PageHeader* header) {
+  header->seq = get_uint32(p + 4);
+  header->first_seq = get_uint32(p + 8);
+  header->session = get_uint16(p + 12);
+  header->base_millis = get_uint32(p + 14);
+  header->data_size = p[18];
+  header->num_records = p[19];
+}
+
+bool decode_page(const uint8_t* page, uint16_t size, PageHeader* header) {
+  if (size < kPageHeaderSize || get_uint16(page) != kPageMagic) {
+    return false;
+  }
+  decode_header(page, header);
+  if (header->data_size > kPageDataSize ||
+      kPageHeaderSize + header->data_size > size) {
+    return false;
+  }
+  return get_uint16(page + 2) ==
+      crc16(page + 4, kPageHeaderSize - 4 + header->data_size);
+}
+
+bool FlashLog::read_header_at(uint32_t page_index, PageHeader* header) {
+  uint8_t bytes[kPageHeaderSize];
+  if (!flash_io::read(page_index * kPageSize, bytes, sizeof(bytes)) ||
+      get_uint16(bytes) != kPageMagic) {
+    return false;
+  }
+  decode_header(bytes, header);
+  return true;
+}
+
+bool FlashLog::is_erased_at(uint32_t page_index) {
+  uint8_t bytes[kPageHeaderSize];
+  if (!flash_io::read(page_index * kPageSize, bytes, sizeof(bytes))) {
+    return false;
+  }
+  for (uint8_t b : bytes) {
+    if (b != 0xff) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool FlashLog::mount() {
+  is_mounted_ = false;
+  num_pages_ = flash_io::size() / kPageSize;
+  tail_ = 0;
+  head_ = 0;
+  is_next_sector_erased_ = false;
+  if (num_pages_ < 2 * kPagesPerSector) {
+    return false;
+  }
+
+  // The sector that was written last is the one whose first page has the
+  // largest seq. Sectors that were erased but not written yet are
+  // skipped.
+  bool found = false;
+  uint32_t head_sector_seq = 0;
+  for (uint32_t i = 0; i < num_pages_; i += kPagesPerSector) {
+    PageHeader header;
+    if (!read_header_at(i, &header) || header.seq % num_pages_ != i) {
+      continue;
+    }
+    if (!found || header.seq > head_sector_seq) {
+      found = true;
+      head_sector_seq = header.seq;
+    }
+  }
+  if (!found) {
+    is_mounted_ = true;
+    return true;
+  }
+
+  // The pages of a sector are written in order. A torn page counts as
+  // written since it can't be rewritten before an erase.
+  uint32_t last_seq = head_sector_seq;
+  for (uint32_t seq = last_seq + 1; seq % kPagesPerSector; seq++) {
+    PageHeader header;
+    if (!read_header_at(seq % num_pages_, &header) || header.seq != seq) {
+      break;
+    }
+    last_seq = seq;
+  }
+  head_ = last_seq + 1;
+
+  // The sector after the head one is the oldest, unless it was already
+  // erased for the next page, e.g. by a power loss between the erase and
+  // the append. The sector is still erased again before the append, in
+  // case only its first page reads as erased.
+  uint32_t sector_end =
+      head_ + (kPagesPerSector - head_ % kPagesPerSector) % kPagesPerSector;
+  if (head_ % kPagesPerSector == 0 && is_erased_at(head_ % num_pages_)) {
+    sector_end += kPagesPerSector;
+  }
+  tail_ = (sector_end > num_pages_) ? sector_end - num_pages_ : 0;
+  is_mounted_ = true;
+
+  // Honor the latest clear(), as of the newest intact page.
+  for (uint32_t seq = head_; seq-- > head_sector_seq;) {
+    uint8_t page[kPageSize];
+    uint16_t size;
+    PageHeader header;
+    if (read_page(seq, page, &size) && decode_page(page, size, &header)) {
+      if (header.first_seq > tail_ && header.first_seq <= head_) {
+        tail_ = header.first_seq;
+      }
+      break;
+    }
+  }
+  return true;
+}
+
+bool FlashLog::erase_next_sector() {
+  assert(is_mounted_);
+  assert(head_ % kPagesPerSector == 0);
+  if (!flash_io::erase_sector(page_offset(head_))) {
+    return false;
+  }
+  is_next_sector_erased_ = true;
+  // The pages of the previous round in this sector are gone.
+  if (head_ + kPagesPerSector > num_pages_ &&
+      tail_ < head_ + kPagesPerSector - num_pages_) {
+    tail_ = head_ + kPagesPerSector - num_pages_;
+  }
+  return true;
+}
+
+bool FlashLog::append(uint16_t session, uint32_t base_millis,
+    uint8_t num_records, const uint8_t* data, uint8_t data_size) {
+  assert(is_mounted_);
+  assert(!needs_erase());
+  assert(data_size <= kPageDataSize);
+
+  uint8_t page[kPageSize];
+  put_uint16(page, kPageMagic);
+  put_uint32(page + 4, head_);
+  put_uint32(page + 8, tail_);
+  put_uint16(page + 12, session);
+  put_uint32(page + 14, base_millis);
+  page[18] = data_size;
+  page[19] = num_records;
+  memcpy(page + kPageHeaderSize, data, data_size);
+  put_uint16(page + 2, crc16(page + 4, kPageHeaderSize - 4 + data_size));
+
+  // The unused bytes of the page are left erased.
+  const bool ok =
+      flash_io::write(page_offset(head_), page, kPageHeaderSize + data_size);
+  head_++;
+  if (head_ % kPagesPerSector == 0) {
+    is_next_sector_erased_ = false;
+  }
+  return ok;
+}
+
+bool FlashLog::read_page(uint32_t seq, uint8_t* page, uint16_t* size) {
+  assert(is_mounted_);
+  if (seq < tail_ || seq >= head_) {
+    return false;
+  }
+  const uint32_t offset = page_offset(seq);
+  if (!flash_io::read(offset, page, kPageHeaderSize)) {
+    return false;
+  }
+  // Reads the data only if the header is sane, otherwise returns the
+  // header for diagnostics.
+  *size = kPageHeaderSize;
+  if (get_uint16(page) == kPageMagic && page[18] <= kPageDataSize) {
+    if (!flash_io::read(
+            offset + kPageHeaderSize, page + kPageHeaderSize, page[18])) {
+      return false;
+    }
+    *size += page[18];
+  }
+  return true;
+}
+
+uint32_t FlashLog::find_page(uint16_t session, uint32_t millis) {
+  assert(is_mounted_);
+  // Invariant: the result is in [lo, hi). Pages with an unreadable
+  // header are treated as being before the time.
+  uint32_t lo = tail_;
+  uint32_t hi = head_;
+  while (hi - lo > 1) {
+    const uint32_t mid = lo + (hi - lo) / 2;
+    PageHeader header;
+    const bool is_after = read_header_at(mid % num_pages_, &header) &&
+        header.seq == mid &&
+        (header.session > session ||
+            (header.session == session && header.base_millis > millis));
+    if (is_after) {
+      hi = mid;
+    } else {
+      lo = mid;
+    }
+  }
+  return lo;
+}
+
+}  // namespace flash_log
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "flash_io.h"
+
+// A log structured store of pages in the flash_io region. The region is
+// used as a ring of pages that are written in order, such that all the
+// sectors wear evenly. A sector is erased just before its first page is
+// written, which drops the oldest pages once the ring is full.
+//
+// Pages are addressed by a sequence number that continues across
+// mounts, and page seq is stored at physical page seq % capacity(), so
+// seeking by seq is O(1). Seeking by time is a binary search of the page
+// headers, see find_page().
+//
+// Each flash operation is a separate call, such that the caller can
+// bound the flash stalls per call. Not thread safe.
+namespace flash_log {
+
+// The write unit.
+constexpr uint32_t kPageSize = 256;
+constexpr uint32_t kPagesPerSector = flash_io::kSectorSize / kPageSize;
+
+// Page format, big endian. Magic (0x5250), CRC-16/CCITT-FALSE of the
+// rest of the header and the data, seq (uint32), first seq (uint32),
+// session (uint16), base millis (uint32), data size (uint8) and records
+// count (uint8), followed by data size bytes of data.
+constexpr uint16_t kPageHeaderSize = 20;
+constexpr uint16_t kPageDataSize = kPageSize - kPageHeaderSize;
+
+struct PageHeader {
+  uint32_t seq;
+  // The oldest page of the log when this page was written. Persists
+  // clear() across mounts.
+  uint32_t first_seq;
+  // The recording session and the time of its first record, in millis.
+  // Pages are ordered by (session, base_millis).
+  uint16_t session;
+  uint32_t base_millis;
+  uint8_t data_size;
+  uint8_t num_records;
+};
+
+// Parses a page that was read with read_page(). Returns false if it's
+// not a valid page, e.g. torn by a power loss while written.
+bool decode_page(const uint8_t* page, uint16_t size, PageHeader* header);
+
+class FlashLog {
+ public:
+  // Scans the region and recovers the log. Returns false if the region
+  // is too small, in which case the log stays unmounted.
+  bool mount();
+  bool is_mounted() const { return is_mounted_; }
+
+  // Capacity in pages. The log holds at least capacity() -
+  // kPagesPerSector of the latest pages.
+  uint32_t capacity() const { return num_pages_; }
+  // The pages of the log are [tail(), head()).
+  uint32_t tail() const { return tail_; }
+  uint32_t head() const { return head_; }
+
+  // True if erase_next_sector() should be called before the next
+  // append().
+  bool needs_erase() const {
+    return (head_ % kPagesPerSector) == 0 && !is_next_sector_erased_;
+  }
+  bool erase_next_sector();
+
+  // Writes the next page. Its seq is head() and the log advances also
+  // if the write fails. data_size <= kPageDataSize.
+  bool append(uint16_t session, uint32_t base_millis, uint8_t num_records,
+      const uint8_t* data, uint8_t data_size);
+
+  // Drops all pages, without erasing. Persisted by the next append().
+  void clear() { tail_ = head_; }
+
+  // Reads the header and the data of a page, as written, to a
+  // kPageSize buffer, and sets the number of bytes read. Returns false
+  // if seq is not in the log or on a flash error.
+  bool read_page(uint32_t seq, uint8_t* page, uint16_t* size);
+
+  // Returns the seq of the last page that starts at or before the given
+  // time, or tail() if none. The records of a page may start after its
+  // base millis only, so reading from the returned page covers the time.
+  uint32_t find_page(uint16_t session, uint32_t millis);
+
+ private:
+  // Reads the header of physical page index. Returns false if erased,
+  // not a page, or on a flash error. Doesn't check the CRC.
+  bool read_header_at(uint32_t page_index, PageHeader* header);
+  // True if the header of physical page index reads as erased.
+  bool is_erased_at(uint32_t page_index);
+
+  uint32_t page_offset(uint32_t seq) const {
+    return (seq % num_pages_) * kPageSize;
+  }
+
+  bool is_mounted_ = false;
+  uint32_t num_pages_ = 0;
+  uint32_t tail_ = 0;
+  uint32_t head_ = 0;
+  bool is_next_sector_erased_ = false;
+};
+
+}  // namespace flash_log
@@ -0,0 +1,274 @@
+#include "recorder.h"
+
+#include "acquisition/acq_consts.h"
+#include "ble/ble_util.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "misc/circular_buffer.h"
+#include "misc/elapsed.h"
+
+namespace recorder {
+
+static constexpr auto TAG = "recorder";
+
+using flash_log::kPageDataSize;
+
+static SemaphoreHandle_t recorder_mutex;
+#define ENTER_MUTEX \
+  { xSemaphoreTake(recorder_mutex, portMAX_DELAY); }
+#define EXIT_MUTEX \
+  { xSemaphoreGive(recorder_mutex); }
+
+// Type and motor byte and the time offset.
+static constexpr uint8_t kRecordHeaderSize = 3;
+
+// A page of records that is not written yet.
+struct StagedPage {
+  uint16_t session;
+  uint32_t base_millis;
+  uint8_t num_records;
+  uint8_t size;
+  uint8_t data[kPageDataSize];
+};
+
+// Full pages that wait for service(). A page holds seconds of records
+// so a few pages ride out slow flash erases.
+typedef CircularBuffer<StagedPage, 4> StagedPagesCircularBuffer;
+
+static flash_log::FlashLog flash_log;
+static StagedPage open_page;
+static StagedPagesCircularBuffer staged_pages;
+
+static bool is_recording = false;
+static uint16_t session = 0;
+static uint16_t state_interval_millis = kDefaultStateIntervalMillis;
+// Time of the last recorded state of each motor.
+static uint32_t last_state_millis[acq_consts::kNumMotors];
+static bool has_last_state[acq_consts::kNumMotors];
+static uint32_t dropped_records = 0;
+static uint32_t flash_errors = 0;
+static uint32_t max_erase_millis = 0;
+
+// The device time of a tick count. Wraps around after 49 days.
+static inline uint32_t ticks_to_millis(uint64_t tick_count) {
+  return (tick_count * 1000) / acq_consts::kTimeTicksPerSec;
+}
+
+// Called within the mutex.
+static void mutex_stage_open_page() {
+  if (!open_page.num_records) {
+    return;
+  }
+  if (staged_pages.is_full()) {
+    // Drops the oldest staged page.
+    dropped_records += staged_pages.get(0)->num_records;
+  }
+  *staged_pages.insert() = open_page;
+  open_page.num_records = 0;
+  open_page.size = 0;
+}
+
+// Called within the mutex. Returns a serializer of the record fields,
+// after the record header.
+static ble_util::Serializer mutex_add_record(
+    RecordType type, uint8_t motor, uint32_t millis, uint8_t fields_size) {
+  const uint8_t record_size = kRecordHeaderSize + fields_size;
+  // Records that are timed before the page base, e.g. an anomaly that
+  // is serviced after a later state, are timed at the page base and
+  // don't start a new page.
+  int32_t delta = (int32_t)(millis - open_page.base_millis);
+  if (open_page.num_records &&
+      (open_page.size + record_size > kPageDataSize ||
+          delta > UINT16_MAX)) {
+    mutex_stage_open_page();
+  }
+  if (!open_page.num_records) {
+    open_page.session = session;
+    open_page.base_millis = millis;
+    delta = 0;
+  }
+  const uint16_t offset = (delta < 0) ? 0 : delta;
+
+  ble_util::Serializer ser(open_page.data + open_page.size, record_size);
+  ser.append_uint8((type << 4) | motor);
+  ser.append_uint16(offset);
+  open_page.num_records++;
+  open_page.size += record_size;
+  return ser;
+}
+
+void setup() {
+  recorder_mutex = xSemaphoreCreateMutex();
+  assert(recorder_mutex);
+
+  if (!flash_io::setup() || !flash_log.mount()) {
+    ESP_LOGW(TAG, "Recording is not available.");
+    return;
+  }
+
+  // Continue the session numbers of the log.
+  const uint32_t head = flash_log.head();
+  if (head > flash_log.tail()) {
+    uint8_t page[flash_log::kPageSize];
+    uint16_t size;
+    flash_log::PageHeader header;
+    if (flash_log.read_page(head - 1, page, &size) &&
+        flash_log::decode_page(page, size, &header)) {
+      session = header.session;
+    }
+  }
+  ESP_LOGI(TAG, "Recording log: pages [%lu, %lu) of %lu, session %hu",
+      flash_log.tail(), head, flash_log.capacity(), session);
+}
+
+bool start(uint16_t interval_millis) {
+  if (interval_millis < kMinStateIntervalMillis) {
+    ESP_LOGE(TAG, "Invalid state interval %hu", interval_millis);
+    return false;
+  }
+  bool ok = false;
+  ENTER_MUTEX {
+    if (flash_log.is_mounted()) {
+      mutex_stage_open_page();
+      session++;
+      state_interval_millis = interval_millis;
+      for (uint8_t motor = 0; motor < acq_consts::kNumMotors; motor++) {
+        has_last_state[motor] = false;
+      }
+      is_recording = true;
+      ok = true;
+    }
+  }
+  EXIT_MUTEX
+  if (ok) {
+    ESP_LOGI(TAG, "Recording session %hu started, interval %hu ms", session,
+        interval_millis);
+  }
+  return ok;
+}
+
+void stop() {
+  ENTER_MUTEX {
+    is_recording = false;
+    mutex_stage_open_page();
+  }
+  EXIT_MUTEX
+}
+
+void clear() {
+  ENTER_MUTEX {
+    if (flash_log.is_mounted()) {
+      flash_log.clear();
+    }
+  }
+  EXIT_MUTEX
+}
+
+void add_state(const analyzer::State& state, uint8_t motor) {
+  assert(motor < acq_consts::kNumMotors);
+  const uint32_t millis = ticks_to_millis(state.tick_count);
+  const int32_t velocity = analyzer::state_velocity(state);
+  const uint32_t current = state.is_energized ? state.max_current_in_step : 0;
+  ENTER_MUTEX {
+    if (is_recording && (!has_last_state[motor] ||
+                            millis - last_state_millis[motor] >=
+                                state_interval_millis)) {
+      if (!has_last_state[motor]) {
+        ble_util::Serializer ser =
+            mutex_add_record(RECORD_SESSION_START, motor, millis, 3);
+        ser.append_uint16(state_interval_millis);
+        ser.append_uint8(acq_consts::kNumMotors);
+      }
+      has_last_state[motor] = true;
+      last_state_millis[motor] = millis;
+      ble_util::Serializer ser =
+          mutex_add_record(RECORD_STATE, motor, millis, 11);
+      ser.encode_int32(state.full_steps);
+      ser.append_int16((velocity > INT16_MAX) ? INT16_MAX
+              : (velocity < INT16_MIN)        ? INT16_MIN
+                                              : velocity);
+      ser.append_uint16((current > UINT16_MAX) ? UINT16_MAX : current);
+      ser.append_uint16(state.quadrature_errors);
+      ser.append_uint8(state.is_energized ? 0x01 : 0x00);
+    }
+  }
+  EXIT_MUTEX
+}
+
+void add_anomaly(const analyzer::AnomalyEvent& event) {
+  const uint32_t millis = ticks_to_millis(event.tick_count);
+  ENTER_MUTEX {
+    if (is_recording) {
+      ble_util::Serializer ser =
+          mutex_add_record(RECORD_ANOMALY, event.motor, millis, 5);
+      ser.append_uint8(event.type);
+      ser.append_uint32(event.detail);
+    }
+  }
+  EXIT_MUTEX
+}
+
+void service() {
+  ENTER_MUTEX {
+    if (flash_log.is_mounted() && !staged_pages.is_empty()) {
+      if (flash_log.needs_erase()) {
+        Elapsed elapsed;
+        if (!flash_log.erase_next_sector()) {
+          flash_errors++;
+        }
+        const uint32_t millis = elapsed.elapsed_millis();
+        if (millis > max_erase_millis) {
+          max_erase_millis = millis;
+        }
+      } else {
+        const StagedPage* page = staged_pages.pop();
+        if (!flash_log.append(page->session, page->base_millis,
+                page->num_records, page->data, page->size)) {
+          flash_errors++;
+        }
+      }
+    }
+  }
+  EXIT_MUTEX
+}
+
+void get_status(Status* status) {
+  ENTER_MUTEX {
+    status->is_available = flash_log.is_mounted();
+    status->is_recording = is_recording;
+    status->session = session;
+    status->state_interval_millis = state_interval_millis;
+    status->tail_seq = flash_log.tail();
+    status->head_seq = flash_log.head();
+    status->capacity_pages = flash_log.capacity();
+    status->dropped_records = dropped_records;
+    status->flash_errors = flash_errors;
+    status->max_erase_millis = max_erase_millis;
+  }
+  EXIT_MUTEX
+}
+
+bool read_page(uint32_t seq, uint8_t* page, uint16_t* size) {
+  bool ok = false;
+  ENTER_MUTEX {
+    if (flash_log.is_mounted()) {
+      ok = flash_log.read_page(seq, page, size);
+    }
+  }
+  EXIT_MUTEX
+  return ok;
+}
+
+uint32_t find_page(uint16_t session, uint32_t millis) {
+  uint32_t seq = 0;
+  ENTER_MUTEX {
+    if (flash_log.is_mounted()) {
+      seq = flash_log.find_page(session, millis);
+    }
+  }
+  EXIT_MUTEX
+  return seq;
+}
+
+}  // namespace recorder
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "acquisition/analyzer.h"
+#include "recording/flash_log.h"
+
+// Optional offline recording of compact state and anomaly records to
+// the flash log, for long unattended prints. Records are staged in RAM
+// pages that service() writes from the main loop, one flash operation
+// per call, such that the flash stalls are bounded. Thread safe.
+namespace recorder {
+
+// Record types, the high nibble of the first record byte. The low
+// nibble is the motor. Followed by the record time, in millis since
+// the page base millis (uint16), and the type specific fields. Big
+// endian.
+enum RecordType {
+  // First record of a session. State interval millis (uint16) and the
+  // number of motors (uint8).
+  RECORD_SESSION_START = 1,
+  // A state of the motor. Full steps (int32), velocity in steps/sec
+  // (int16), max current in step in ADC counts (uint16), quadrature
+  // errors (uint16, low bits of the State counter) and flags (uint8),
+  // bit 0 is energized.
+  RECORD_STATE = 2,
+  // An anomaly event of the motor. Type (uint8) and detail (uint32),
+  // see analyzer::AnomalyEvent.
+  RECORD_ANOMALY = 3,
+};
+
+// States of each motor are recorded every state interval. At the
+// default, the 960KB partition holds about 17 hours of a single motor.
+constexpr uint16_t kMinStateIntervalMillis = 20;
+constexpr uint16_t kDefaultStateIntervalMillis = 1000;
+
+struct Status {
+  // False if there is no recording partition.
+  bool is_available;
+  bool is_recording;
+  // The current, or last, session. Incremented on each start.
+  uint16_t session;
+  uint16_t state_interval_millis;
+  // The pages of the log are [tail_seq, head_seq).
+  uint32_t tail_seq;
+  uint32_t head_seq;
+  uint32_t capacity_pages;
+  // Records that were dropped since the staging pages were full, and
+  // failed flash operations, since initialization.
+  uint32_t dropped_records;
+  uint32_t flash_errors;
+  // The longest sector erase since initialization, in millis, at the
+  // 10ms resolution of the RTOS ticks. Erases stall the ADC task, see
+  // adc_task.cpp.
+  uint32_t max_erase_millis;
+};
+
+// Call once, on program initialization. Mounts the flash log.
+void setup();
+
+// Starts a new recording session. Returns false if not available or
+// the interval is out of range.
+bool start(uint16_t state_interval_millis);
+// Stops the recording. The staged records are still written.
+void stop();
+// Drops all the recorded pages.
+void clear();
+
+// Called from the main loop with each popped state and anomaly event.
+// No-ops if not recording.
+void add_state(const analyzer::State& state, uint8_t motor);
+void add_anomaly(const analyzer::AnomalyEvent& event);
+
+// Called from the main loop. Writes a staged page, or erases the sector
+// of the next one, if any.
+void service();
+
+void get_status(Status* status);
+
+// Reads a page for download, see flash_log::FlashLog::read_page().
+bool read_page(uint32_t seq, uint8_t* page, uint16_t* size);
+
+// Returns the seq of the page to download from to cover the given time
+// of a session, see flash_log::FlashLog::find_page(). Costs a page
+// header read per halving of the log, about 12 reads for a full log.
+uint32_t find_page(uint16_t session, uint32_t millis);
+
+}  // namespace recorder
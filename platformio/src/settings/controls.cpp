@@ -2,6 +2,7 @@
 
 #include "controls.h"
 
+#include "acquisition/acq_consts.h"
 #include "acquisition/analyzer.h"
 #include "esp_log.h"
 #include "settings/nvs_config.h"
@@ -12,29 +13,153 @@ namespace controls {
 static constexpr auto TAG = "config";
 
 bool zero_calibration() {
-  analyzer::calibrate_zeros();
-  nvs_config::AcquistionSettings settings;
-  analyzer::get_settings(&settings);
-  const bool write_ok = nvs_config::write_acquisition_settings(settings);
-  ESP_LOGI(TAG, "Zero calibration (%hd, %hd). Write %s", settings.offset1,
-      settings.offset2, write_ok ? "OK" : "FAILED");
-  return write_ok;
+  bool all_ok = true;
+  for (uint8_t motor = 0; motor < acq_consts::kNumMotors; motor++) {
+    analyzer::calibrate_zeros(motor);
+    nvs_config::AcquistionSettings settings;
+    analyzer::get_settings(motor, &settings);
+    const bool write_ok =
+        nvs_config::write_acquisition_settings(motor, settings);
+    ESP_LOGI(TAG, "Zero calibration %hhu (%hd, %hd). Write %s", motor,
+        settings.offset1, settings.offset2, write_ok ? "OK" : "FAILED");
+    all_ok = all_ok && write_ok;
+  }
+  return all_ok;
+}
+
+bool flush_drifted_offsets() {
+  bool all_ok = true;
+  for (uint8_t motor = 0; motor < acq_consts::kNumMotors; motor++) {
+    if (!analyzer::take_offsets_drifted(motor)) {
+      continue;
+    }
+    nvs_config::AcquistionSettings settings;
+    analyzer::get_settings(motor, &settings);
+    const bool write_ok =
+        nvs_config::write_acquisition_settings(motor, settings);
+    ESP_LOGI(TAG, "Drifted offsets %hhu (%hd, %hd). Write %s", motor,
+        settings.offset1, settings.offset2, write_ok ? "OK" : "FAILED");
+    all_ok = all_ok && write_ok;
+  }
+  return all_ok;
 }
 
 // Ok for new_reversed_direction to be null.
-bool toggle_direction(bool* new_reversed_direction) {
-  const bool new_direction = !analyzer::get_is_reversed_direction();
-  analyzer::set_is_reversed_direction(new_direction);
+bool toggle_direction(uint8_t motor, bool* new_reversed_direction) {
+  const bool new_direction = !analyzer::get_is_reversed_direction(motor);
+  analyzer::set_is_reversed_direction(motor, new_direction);
   if (new_reversed_direction) {
     *new_reversed_direction = new_direction;
   }
   // We also reset the steps counter and such.
   analyzer::reset_data();
   nvs_config::AcquistionSettings settings;
-  analyzer::get_settings(&settings);
-  const bool write_ok = nvs_config::write_acquisition_settings(settings);
-  ESP_LOGI(TAG, "%s direction. Write %s", new_direction ? "REVERSED" : "NORMAL",
+  analyzer::get_settings(motor, &settings);
+  const bool write_ok =
+      nvs_config::write_acquisition_settings(motor, settings);
+  ESP_LOGI(TAG, "%s direction %hhu. Write %s",
+      new_direction ? "REVERSED" : "NORMAL", motor, write_ok ? "OK" : "FAILED");
+  return write_ok;
+}
+
+bool set_signal_filter(uint8_t filter) {
+  if (filter >= analyzer::FILTERS_COUNT ||
+      !analyzer::set_signal_filter((analyzer::SignalFilter)filter)) {
+    return false;
+  }
+  const nvs_config::FilterSettings settings = {.signal_filter = filter};
+  const bool write_ok = nvs_config::write_filter_settings(settings);
+  ESP_LOGI(TAG, "Signal filter %hhu. Write %s", filter,
       write_ok ? "OK" : "FAILED");
   return write_ok;
 }
+
+bool set_current_metric(uint8_t metric) {
+  if (metric >= analyzer::CURRENT_METRICS_COUNT ||
+      !analyzer::set_current_metric((analyzer::CurrentMetric)metric)) {
+    return false;
+  }
+  const nvs_config::CurrentMetricSettings settings = {
+      .current_metric = metric};
+  const bool write_ok = nvs_config::write_current_metric_settings(settings);
+  ESP_LOGI(TAG, "Current metric %hhu. Write %s", metric,
+      write_ok ? "OK" : "FAILED");
+  return write_ok;
+}
+
+bool set_gains(uint8_t motor, uint16_t gain1, uint16_t gain2) {
+  analyzer::set_gains(motor, gain1, gain2);
+  nvs_config::AcquistionSettings settings;
+  analyzer::get_settings(motor, &settings);
+  const bool write_ok =
+      nvs_config::write_acquisition_settings(motor, settings);
+  ESP_LOGI(TAG, "Gains %hhu (%hu, %hu). Write %s", motor, settings.gain1,
+      settings.gain2, write_ok ? "OK" : "FAILED");
+  return write_ok;
+}
+
+int hardware_sensor_profile(uint8_t hardware_config) {
+  switch (hardware_config) {
+    case 0:
+      // CFG1, CFG2 resistors not installed.
+      return 0;  // CC6920BSO5A
+    case 1:
+      // Only CFG1 resistors is installed.
+      return 1;  // TMCS1108A4B
+    default:
+      ESP_LOGE(TAG, "Unexpected hardware config %hhu", hardware_config);
+      return -1;
+  }
+}
+
+int determine_sensor_profile(uint8_t hardware_config) {
+  nvs_config::SensorSettings settings;
+  if (!nvs_config::read_sensor_settings(&settings)) {
+    settings = nvs_config::kDefaultSensorSettings;
+  }
+  if (settings.sensor_profile < acq_consts::kNumSensorProfiles) {
+    ESP_LOGI(TAG, "Sensor profile override: %hhu", settings.sensor_profile);
+    return settings.sensor_profile;
+  }
+  return hardware_sensor_profile(hardware_config);
+}
+
+bool set_sensor_profile(
+    uint8_t hardware_config, uint8_t profile, uint16_t* adc_ticks_per_amp) {
+  const int actual_profile = (profile == nvs_config::kSensorProfileByHardware)
+      ? hardware_sensor_profile(hardware_config)
+      : profile;
+  if (actual_profile < 0 || actual_profile >= acq_consts::kNumSensorProfiles) {
+    ESP_LOGE(TAG, "Invalid sensor profile %hhu", profile);
+    return false;
+  }
+  const acq_consts::SensorProfile& sensor_profile =
+      acq_consts::kSensorProfiles[actual_profile];
+  if (!analyzer::set_adc_ticks_per_amp(sensor_profile.adc_ticks_per_amp)) {
+    return false;
+  }
+  *adc_ticks_per_amp = sensor_profile.adc_ticks_per_amp;
+  const nvs_config::SensorSettings settings = {.sensor_profile = profile};
+  const bool write_ok = nvs_config::write_sensor_settings(settings);
+  ESP_LOGI(TAG, "Sensor profile %s. Write %s", sensor_profile.name,
+      write_ok ? "OK" : "FAILED");
+  return write_ok;
+}
+
+nvs_config::WriteStatus set_adc_linearity_table(const uint16_t* table) {
+  analyzer::set_adc_linearity_table(table);
+  nvs_config::WriteStatus status;
+  if (table) {
+    status = nvs_config::write_adc_linearity_table(
+        table, analyzer::kAdcLinearityTableSize);
+  } else {
+    status = nvs_config::erase_adc_linearity_table() ? nvs_config::WRITE_OK
+                                                     : nvs_config::WRITE_FAILED;
+  }
+  ESP_LOGI(TAG, "ADC linearity table %s. Write %s", table ? "set" : "cleared",
+      (status == nvs_config::WRITE_OK)         ? "OK"
+          : (status == nvs_config::WRITE_NO_SPACE) ? "NO SPACE"
+                                                   : "FAILED");
+  return status;
+}
 }  // namespace controls
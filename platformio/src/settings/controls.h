@@ -1,9 +1,40 @@
 
 #pragma once
 
+#include <stdint.h>
+
+#include "settings/nvs_config.h"
+
 namespace controls {
 
+// Zero calibrates all motors.
 bool zero_calibration();
-bool toggle_direction(bool* new_reversed_direction);
+bool toggle_direction(uint8_t motor, bool* new_reversed_direction);
+// Persists the offsets of motors that were corrected by the analyzer's
+// drift tracking. Called periodically.
+bool flush_drifted_offsets();
+// Sets the signal filter of all motors and persists it. Filter is
+// an analyzer::SignalFilter value.
+bool set_signal_filter(uint8_t filter);
+// Sets the coil current metric of all motors and persists it. Metric is
+// an analyzer::CurrentMetric value.
+bool set_current_metric(uint8_t metric);
+// Sets the ADC linearity correction table and persists it. Table has
+// analyzer::kAdcLinearityTableSize entries. Null restores the identity
+// table. The table is applied even if it can't be persisted.
+nvs_config::WriteStatus set_adc_linearity_table(const uint16_t* table);
+// Sets the per channel gains of a motor and persists them.
+bool set_gains(uint8_t motor, uint16_t gain1, uint16_t gain2);
+// Returns the default sensor profile of a hardware config, or -1 if the
+// hardware config is not supported.
+int hardware_sensor_profile(uint8_t hardware_config);
+// Returns the sensor profile to use, considering the persisted profile
+// override, or -1 if none.
+int determine_sensor_profile(uint8_t hardware_config);
+// Sets the sensor profile override and persists it. Profile is an index in
+// acq_consts::kSensorProfiles or nvs_config::kSensorProfileByHardware.
+// Sets adc_ticks_per_amp to the new value if the profile was applied.
+bool set_sensor_profile(
+    uint8_t hardware_config, uint8_t profile, uint16_t* adc_ticks_per_amp);
 
 }  // namespace controls
@@ -1,6 +1,7 @@
 
 #include "settings/nvs_config.h"
 
+#include "acquisition/acq_consts.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -17,12 +18,62 @@ static constexpr auto TAG = "nvs_config";
 
 static constexpr auto kStorageNamespace = "settings";
 
-const AcquistionSettings kDefaultAcquisitionSettings = {
-    .offset1 = 1800, .offset2 = 1800, .is_reverse_direction = false};
+const AcquistionSettings kDefaultAcquisitionSettings = {.offset1 = 1800,
+    .offset2 = 1800,
+    .is_reverse_direction = false,
+    .gain1 = acq_consts::kUnityGain,
+    .gain2 = acq_consts::kUnityGain};
+
+const SensorSettings kDefaultSensorSettings = {
+    .sensor_profile = kSensorProfileByHardware};
 
 const BleSettings kDefaultBleDefaultSetting = {.nickname = ""};
 
-[[nodiscard]] bool read_acquisition_settings(AcquistionSettings* settings) {
+// NVS keys of the acquisition settings of a motor. Motor 0 uses
+// the original single motor keys, such that existing settings
+// are preserved.
+struct AcquisitionKeys {
+  char offset1[16];
+  char offset2[16];
+  char is_reverse[16];
+  char gain1[16];
+  char gain2[16];
+};
+
+static void get_acquisition_keys(uint8_t motor, AcquisitionKeys* keys) {
+  if (motor == 0) {
+    strcpy(keys->offset1, "offset1");
+    strcpy(keys->offset2, "offset2");
+    strcpy(keys->is_reverse, "is_reverse");
+    strcpy(keys->gain1, "gain1");
+    strcpy(keys->gain2, "gain2");
+    return;
+  }
+  snprintf(keys->offset1, sizeof(keys->offset1), "m%hhu_offset1", motor);
+  snprintf(keys->offset2, sizeof(keys->offset2), "m%hhu_offset2", motor);
+  snprintf(keys->is_reverse, sizeof(keys->is_reverse), "m%hhu_is_reverse",
+      motor);
+  snprintf(keys->gain1, sizeof(keys->gain1), "m%hhu_gain1", motor);
+  snprintf(keys->gain2, sizeof(keys->gain2), "m%hhu_gain2", motor);
+}
+
+// Reads an optional u16 value. Returns ESP_OK with the default value if
+// it doesn't exist, e.g. settings that were written by an older version.
+static esp_err_t get_optional_u16(nvs_handle_t handle, const char* key,
+    uint16_t default_value, uint16_t* value) {
+  const esp_err_t err = nvs_get_u16(handle, key, value);
+  if (err == ESP_ERR_NVS_NOT_FOUND) {
+    *value = default_value;
+    return ESP_OK;
+  }
+  return err;
+}
+
+[[nodiscard]] bool read_acquisition_settings(
+    uint8_t motor, AcquistionSettings* settings) {
+  AcquisitionKeys keys;
+  get_acquisition_keys(motor, &keys);
+
   // Open
   nvs_handle_t my_handle = -1;
   esp_err_t err = nvs_open(kStorageNamespace, NVS_READONLY, &my_handle);
@@ -33,7 +84,7 @@ const BleSettings kDefaultBleDefaultSetting = {.nickname = ""};
 
   // Read offset1.
   int16_t offset1;
-  err = nvs_get_i16(my_handle, "offset1", &offset1);
+  err = nvs_get_i16(my_handle, keys.offset1, &offset1);
   if (err != ESP_OK) {
     ESP_LOGW(TAG, "read_acquisition_settings() failed read offset1: %04x", err);
   }
@@ -41,7 +92,7 @@ const BleSettings kDefaultBleDefaultSetting = {.nickname = ""};
   // Read offset 2.
   int16_t offset2;
   if (err == ESP_OK) {
-    err = nvs_get_i16(my_handle, "offset2", &offset2);
+    err = nvs_get_i16(my_handle, keys.offset2, &offset2);
     if (err != ESP_OK) {
       ESP_LOGW(
           TAG, "read_acquisition_settings() failed read offset2: %04x", err);
@@ -51,13 +102,31 @@ const BleSettings kDefaultBleDefaultSetting = {.nickname = ""};
   // Read is_reverse flag.
   uint8_t is_reverse_direction;
   if (err == ESP_OK) {
-    err = nvs_get_u8(my_handle, "is_reverse", &is_reverse_direction);
+    err = nvs_get_u8(my_handle, keys.is_reverse, &is_reverse_direction);
     if (err != ESP_OK) {
       ESP_LOGW(
           TAG, "read_acquisition_settings() failed read is_reverse: %04x", err);
     }
   }
 
+  // Read the gains. Optional.
+  uint16_t gain1;
+  if (err == ESP_OK) {
+    err = get_optional_u16(
+        my_handle, keys.gain1, acq_consts::kUnityGain, &gain1);
+    if (err != ESP_OK) {
+      ESP_LOGW(TAG, "read_acquisition_settings() failed read gain1: %04x", err);
+    }
+  }
+  uint16_t gain2;
+  if (err == ESP_OK) {
+    err = get_optional_u16(
+        my_handle, keys.gain2, acq_consts::kUnityGain, &gain2);
+    if (err != ESP_OK) {
+      ESP_LOGW(TAG, "read_acquisition_settings() failed read gain2: %04x", err);
+    }
+  }
+
   // Close.
   nvs_close(my_handle);
 
@@ -68,10 +137,16 @@ const BleSettings kDefaultBleDefaultSetting = {.nickname = ""};
   settings->offset1 = offset1;
   settings->offset2 = offset2;
   settings->is_reverse_direction = (bool)is_reverse_direction;
+  settings->gain1 = gain1;
+  settings->gain2 = gain2;
   return true;
 }
 
-[[nodiscard]] bool write_acquisition_settings(const AcquistionSettings& settings) {
+[[nodiscard]] bool write_acquisition_settings(
+    uint8_t motor, const AcquistionSettings& settings) {
+  AcquisitionKeys keys;
+  get_acquisition_keys(motor, &keys);
+
   // Open
   nvs_handle_t my_handle = -1;
   esp_err_t err = nvs_open(kStorageNamespace, NVS_READWRITE, &my_handle);
@@ -91,7 +166,7 @@ const BleSettings kDefaultBleDefaultSetting = {.nickname = ""};
   // Write offset1.
   if (err == ESP_OK) {
     taskDISABLE_INTERRUPTS();
-    err = nvs_set_i16(my_handle, "offset1", settings.offset1);
+    err = nvs_set_i16(my_handle, keys.offset1, settings.offset1);
     taskENABLE_INTERRUPTS();
     if (err != ESP_OK) {
       ESP_LOGE(TAG,
@@ -102,7 +177,7 @@ const BleSettings kDefaultBleDefaultSetting = {.nickname = ""};
   // Write offset2.
   if (err == ESP_OK) {
     taskDISABLE_INTERRUPTS();
-    err = nvs_set_i16(my_handle, "offset2", settings.offset2);
+    err = nvs_set_i16(my_handle, keys.offset2, settings.offset2);
     taskENABLE_INTERRUPTS();
     if (err != ESP_OK) {
       ESP_LOGE(TAG,
@@ -114,7 +189,7 @@ const BleSettings kDefaultBleDefaultSetting = {.nickname = ""};
   if (err == ESP_OK) {
     taskDISABLE_INTERRUPTS();
     err = nvs_set_u8(
-        my_handle, "is_reverse", settings.is_reverse_direction ? 0 : 1);
+        my_handle, keys.is_reverse, settings.is_reverse_direction ? 0 : 1);
     taskENABLE_INTERRUPTS();
     if (err != ESP_OK) {
       ESP_LOGE(TAG,
@@ -122,6 +197,26 @@ const BleSettings kDefaultBleDefaultSetting = {.nickname = ""};
     }
   }
 
+  // Write the gains.
+  if (err == ESP_OK) {
+    taskDISABLE_INTERRUPTS();
+    err = nvs_set_u16(my_handle, keys.gain1, settings.gain1);
+    taskENABLE_INTERRUPTS();
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG,
+          "write_acquisition_settings() failed to write gain1: %04x", err);
+    }
+  }
+  if (err == ESP_OK) {
+    taskDISABLE_INTERRUPTS();
+    err = nvs_set_u16(my_handle, keys.gain2, settings.gain2);
+    taskENABLE_INTERRUPTS();
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG,
+          "write_acquisition_settings() failed to write gain2: %04x", err);
+    }
+  }
+
   // Commit updates.
   if (err == ESP_OK) {
     taskDISABLE_INTERRUPTS();
@@ -137,6 +232,319 @@ const BleSettings kDefaultBleDefaultSetting = {.nickname = ""};
   return err == ESP_OK;
 }
 
+[[nodiscard]] bool read_sensor_settings(SensorSettings* settings) {
+  // Open
+  nvs_handle_t my_handle = -1;
+  esp_err_t err = nvs_open(kStorageNamespace, NVS_READONLY, &my_handle);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "read_sensor_settings() failed to open nvs: %04x", err);
+    return false;
+  }
+
+  // Read sensor profile.
+  uint8_t sensor_profile;
+  err = nvs_get_u8(my_handle, "sensor_profile", &sensor_profile);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "read_sensor_settings() failed read sensor_profile: %04x",
+        err);
+  }
+
+  // Close.
+  nvs_close(my_handle);
+
+  // Handle results.
+  if (err != ESP_OK) {
+    return false;
+  }
+  settings->sensor_profile = sensor_profile;
+  return true;
+}
+
+[[nodiscard]] bool write_sensor_settings(const SensorSettings& settings) {
+  // Open
+  nvs_handle_t my_handle = -1;
+  esp_err_t err = nvs_open(kStorageNamespace, NVS_READWRITE, &my_handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "write_sensor_settings() failed to open nvs: %04x", err);
+    return false;
+  }
+
+  // See write_acquisition_settings() regarding disabling the
+  // interrupts.
+
+  // Write sensor profile.
+  if (err == ESP_OK) {
+    taskDISABLE_INTERRUPTS();
+    err = nvs_set_u8(my_handle, "sensor_profile", settings.sensor_profile);
+    taskENABLE_INTERRUPTS();
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG,
+          "write_sensor_settings() failed to write sensor_profile: %04x", err);
+    }
+  }
+
+  // Commit updates.
+  if (err == ESP_OK) {
+    taskDISABLE_INTERRUPTS();
+    err = nvs_commit(my_handle);
+    taskENABLE_INTERRUPTS();
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "write_sensor_settings() failed to commit: %04x", err);
+    }
+  }
+
+  // Close.
+  nvs_close(my_handle);
+  return err == ESP_OK;
+}
+
+[[nodiscard]] bool read_filter_settings(FilterSettings* settings) {
+  // Open
+  nvs_handle_t my_handle = -1;
+  esp_err_t err = nvs_open(kStorageNamespace, NVS_READONLY, &my_handle);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "read_filter_settings() failed to open nvs: %04x", err);
+    return false;
+  }
+
+  // Read signal filter.
+  uint8_t signal_filter;
+  err = nvs_get_u8(my_handle, "signal_filter", &signal_filter);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "read_filter_settings() failed read signal_filter: %04x",
+        err);
+  }
+
+  // Close.
+  nvs_close(my_handle);
+
+  // Handle results.
+  if (err != ESP_OK) {
+    return false;
+  }
+  settings->signal_filter = signal_filter;
+  return true;
+}
+
+[[nodiscard]] bool write_filter_settings(const FilterSettings& settings) {
+  // Open
+  nvs_handle_t my_handle = -1;
+  esp_err_t err = nvs_open(kStorageNamespace, NVS_READWRITE, &my_handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "write_filter_settings() failed to open nvs: %04x", err);
+    return false;
+  }
+
+  // See write_acquisition_settings() regarding disabling the
+  // interrupts.
+
+  // Write signal filter.
+  if (err == ESP_OK) {
+    taskDISABLE_INTERRUPTS();
+    err = nvs_set_u8(my_handle, "signal_filter", settings.signal_filter);
+    taskENABLE_INTERRUPTS();
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG,
+          "write_filter_settings() failed to write signal_filter: %04x", err);
+    }
+  }
+
+  // Commit updates.
+  if (err == ESP_OK) {
+    taskDISABLE_INTERRUPTS();
+    err = nvs_commit(my_handle);
+    taskENABLE_INTERRUPTS();
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "write_filter_settings() failed to commit: %04x", err);
+    }
+  }
+
+  // Close.
+  nvs_close(my_handle);
+  return err == ESP_OK;
+}
+
+[[nodiscard]] bool read_current_metric_settings(
+    CurrentMetricSettings* settings) {
+  // Open
+  nvs_handle_t my_handle = -1;
+  esp_err_t err = nvs_open(kStorageNamespace, NVS_READONLY, &my_handle);
+  if (err != ESP_OK) {
+    ESP_LOGW(
+        TAG, "read_current_metric_settings() failed to open nvs: %04x", err);
+    return false;
+  }
+
+  // Read current metric.
+  uint8_t current_metric;
+  err = nvs_get_u8(my_handle, "current_metric", &current_metric);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG,
+        "read_current_metric_settings() failed read current_metric: %04x",
+        err);
+  }
+
+  // Close.
+  nvs_close(my_handle);
+
+  // Handle results.
+  if (err != ESP_OK) {
+    return false;
+  }
+  settings->current_metric = current_metric;
+  return true;
+}
+
+[[nodiscard]] bool write_current_metric_settings(
+    const CurrentMetricSettings& settings) {
+  // Open
+  nvs_handle_t my_handle = -1;
+  esp_err_t err = nvs_open(kStorageNamespace, NVS_READWRITE, &my_handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(
+        TAG, "write_current_metric_settings() failed to open nvs: %04x", err);
+    return false;
+  }
+
+  // See write_acquisition_settings() regarding disabling the
+  // interrupts.
+
+  // Write current metric.
+  if (err == ESP_OK) {
+    taskDISABLE_INTERRUPTS();
+    err = nvs_set_u8(my_handle, "current_metric", settings.current_metric);
+    taskENABLE_INTERRUPTS();
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG,
+          "write_current_metric_settings() failed to write current_metric: "
+          "%04x",
+          err);
+    }
+  }
+
+  // Commit updates.
+  if (err == ESP_OK) {
+    taskDISABLE_INTERRUPTS();
+    err = nvs_commit(my_handle);
+    taskENABLE_INTERRUPTS();
+    if (err != ESP_OK) {
+      ESP_LOGE(
+          TAG, "write_current_metric_settings() failed to commit: %04x", err);
+    }
+  }
+
+  // Close.
+  nvs_close(my_handle);
+  return err == ESP_OK;
+}
+
+[[nodiscard]] bool read_adc_linearity_table(uint16_t* table, uint16_t size) {
+  // Open
+  nvs_handle_t my_handle = -1;
+  esp_err_t err = nvs_open(kStorageNamespace, NVS_READONLY, &my_handle);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "read_adc_linearity_table() failed to open nvs: %04x", err);
+    return false;
+  }
+
+  // Read the table blob. Note that 'blob_size' is an input/output
+  // argument.
+  size_t blob_size = size * sizeof(uint16_t);
+  err = nvs_get_blob(my_handle, "adc_lut", table, &blob_size);
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "read_adc_linearity_table() failed read adc_lut: %04x", err);
+  } else if (blob_size != size * sizeof(uint16_t)) {
+    ESP_LOGE(TAG, "read_adc_linearity_table() unexpected size: %zu",
+        blob_size);
+    err = ESP_ERR_NVS_INVALID_LENGTH;
+  }
+
+  // Close.
+  nvs_close(my_handle);
+  return (err == ESP_OK);
+}
+
+[[nodiscard]] WriteStatus write_adc_linearity_table(
+    const uint16_t* table, uint16_t size) {
+  // Open
+  nvs_handle_t my_handle = -1;
+  esp_err_t err = nvs_open(kStorageNamespace, NVS_READWRITE, &my_handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "write_adc_linearity_table() failed to open nvs: %04x", err);
+    return WRITE_FAILED;
+  }
+
+  // Unlike the small settings, the interrupts are kept enabled. The blob
+  // spans a few nvs pages and disabling the interrupts for the whole
+  // write would stall the ADC and the BLE for tens of ms. The flash
+  // driver itself suspends the interrupts that are not IRAM safe during
+  // each flash operation, and the ADC interrupt is IRAM safe.
+
+  // Write the table blob. NVS writes the new blob before releasing the
+  // old one, so replacing a table needs room for both. If there is no
+  // room, the old table is erased first.
+  err = nvs_set_blob(my_handle, "adc_lut", table, size * sizeof(uint16_t));
+  if (err == ESP_ERR_NVS_NOT_ENOUGH_SPACE) {
+    ESP_LOGW(TAG, "write_adc_linearity_table() no space, erasing old adc_lut");
+    err = nvs_erase_key(my_handle, "adc_lut");
+    if (err == ESP_OK || err == ESP_ERR_NVS_NOT_FOUND) {
+      err = nvs_commit(my_handle);
+    }
+    if (err == ESP_OK) {
+      err = nvs_set_blob(my_handle, "adc_lut", table, size * sizeof(uint16_t));
+    }
+  }
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "write_adc_linearity_table() failed to write adc_lut: %04x",
+        err);
+  }
+
+  // Commit updates.
+  if (err == ESP_OK) {
+    err = nvs_commit(my_handle);
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "write_adc_linearity_table() failed to commit: %04x", err);
+    }
+  }
+
+  // Close.
+  nvs_close(my_handle);
+  return (err == ESP_OK)                       ? WRITE_OK
+      : (err == ESP_ERR_NVS_NOT_ENOUGH_SPACE) ? WRITE_NO_SPACE
+                                               : WRITE_FAILED;
+}
+
+[[nodiscard]] bool erase_adc_linearity_table() {
+  // Open
+  nvs_handle_t my_handle = -1;
+  esp_err_t err = nvs_open(kStorageNamespace, NVS_READWRITE, &my_handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "erase_adc_linearity_table() failed to open nvs: %04x", err);
+    return false;
+  }
+
+  // Erase the table blob. Ok if it doesn't exist. Interrupts are kept
+  // enabled, see write_adc_linearity_table().
+  err = nvs_erase_key(my_handle, "adc_lut");
+  if (err == ESP_ERR_NVS_NOT_FOUND) {
+    err = ESP_OK;
+  } else if (err != ESP_OK) {
+    ESP_LOGE(TAG, "erase_adc_linearity_table() failed to erase: %04x", err);
+  }
+
+  // Commit updates.
+  if (err == ESP_OK) {
+    err = nvs_commit(my_handle);
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "erase_adc_linearity_table() failed to commit: %04x", err);
+    }
+  }
+
+  // Close.
+  nvs_close(my_handle);
+  return err == ESP_OK;
+}
+
 [[nodiscard]] bool write_ble_settings(const BleSettings& settings) {
   // Open
   nvs_handle_t my_handle = -1;
@@ -16,13 +16,71 @@ struct AcquistionSettings {
   int16_t offset2;
   // If true, reverse interpretation of forward/backward movement.
   bool is_reverse_direction;
+  // Per channel gains, applied after the offsets. See
+  // acq_consts::kUnityGain.
+  uint16_t gain1;
+  uint16_t gain2;
 };
 
 extern const AcquistionSettings kDefaultAcquisitionSettings;
 
-[[nodiscard]] bool read_acquisition_settings(AcquistionSettings* settings);
+// Settings are per motor. Motor is in [0, acq_consts::kNumMotors).
+[[nodiscard]] bool read_acquisition_settings(
+    uint8_t motor, AcquistionSettings* settings);
 [[nodiscard]] bool write_acquisition_settings(
-    const AcquistionSettings& settings);
+    uint8_t motor, const AcquistionSettings& settings);
+
+// Sensor profile override.
+struct SensorSettings {
+  // Index in acq_consts::kSensorProfiles or kSensorProfileByHardware.
+  uint8_t sensor_profile;
+};
+
+// Use the profile of the hardware config.
+constexpr uint8_t kSensorProfileByHardware = 0xff;
+
+extern const SensorSettings kDefaultSensorSettings;
+
+[[nodiscard]] bool read_sensor_settings(SensorSettings* settings);
+[[nodiscard]] bool write_sensor_settings(const SensorSettings& settings);
+
+struct FilterSettings {
+  // An analyzer::SignalFilter value.
+  uint8_t signal_filter;
+};
+
+// Settings are common to all motors.
+[[nodiscard]] bool read_filter_settings(FilterSettings* settings);
+[[nodiscard]] bool write_filter_settings(const FilterSettings& settings);
+
+struct CurrentMetricSettings {
+  // An analyzer::CurrentMetric value.
+  uint8_t current_metric;
+};
+
+// Settings are common to all motors.
+[[nodiscard]] bool read_current_metric_settings(
+    CurrentMetricSettings* settings);
+[[nodiscard]] bool write_current_metric_settings(
+    const CurrentMetricSettings& settings);
+
+// Result of writing a large blob, which may not fit the free space of
+// the nvs partition.
+enum WriteStatus {
+  WRITE_OK,
+  // The nvs partition has no room for the blob. A previous blob of the
+  // same key may have been erased.
+  WRITE_NO_SPACE,
+  WRITE_FAILED,
+};
+
+// ADC linearity correction table. Size is
+// analyzer::kAdcLinearityTableSize entries, 8KB. Erase restores the
+// identity table on the next boot.
+[[nodiscard]] bool read_adc_linearity_table(uint16_t* table, uint16_t size);
+[[nodiscard]] WriteStatus write_adc_linearity_table(
+    const uint16_t* table, uint16_t size);
+[[nodiscard]] bool erase_adc_linearity_table();
 
 // Null terminated str. Max len 16 chars.
 typedef char BleNickname[17];
@@ -0,0 +1,71 @@
+// Benchmark of the per sample analyzer pipeline with the configured
+// number of motors. Built once per ANALYZER_NUM_MOTORS value. The ADC
+// conversions rate is shared by the motors, so the pipeline cost of a
+// second of signal should stay flat as motors are added, i.e. the
+// per motor cost scales linearly. Also checks that each motor's steps
+// are decoded independently.
+
+#include <math.h>
+#include <stdio.h>
+
+#include "acquisition/analyzer.h"
+#include "acquisition/analyzer_private.h"
+#include "test_util.h"
+
+using acq_consts::kNumMotors;
+using acq_consts::kTimeTicksPerSec;
+
+// Distinct speeds, in full steps per second, and directions per motor.
+// Multiples of 4 steps, i.e. of full electrical cycles, such that the
+// precomputed second of signal repeats seamlessly.
+static constexpr int kStepsPerSec[] = {500, -300, 40};
+static constexpr int kSeconds = 20;
+
+// Precomputed raw ADC samples of one second of each motor.
+static uint16_t raw_v1[kNumMotors][kTimeTicksPerSec];
+static uint16_t raw_v2[kNumMotors][kTimeTicksPerSec];
+
+int main() {
+  nvs_config::AcquistionSettings settings[kNumMotors];
+  for (uint8_t motor = 0; motor < kNumMotors; motor++) {
+    settings[motor] = {1800, 1800, false, acq_consts::kUnityGain,
+        acq_consts::kUnityGain};
+  }
+  CHECK(analyzer::setup(settings, 340));
+
+  // A quadrant per full step, so the phase advances pi/2 per step.
+  for (uint8_t motor = 0; motor < kNumMotors; motor++) {
+    for (uint32_t i = 0; i < kTimeTicksPerSec; i++) {
+      const double phase =
+          (M_PI / 2) * kStepsPerSec[motor] * i / kTimeTicksPerSec;
+      raw_v1[motor][i] = 1800 + lround(800 * cos(phase));
+      raw_v2[motor][i] = 1800 + lround(800 * sin(phase));
+    }
+  }
+
+  const double start_ns = test_util::now_ns();
+  for (int sec = 0; sec < kSeconds; sec++) {
+    for (uint32_t i = 0; i < kTimeTicksPerSec; i++) {
+      for (uint8_t motor = 0; motor < kNumMotors; motor++) {
+        analyzer::isr_handle_one_sample(
+            motor, raw_v1[motor][i], raw_v2[motor][i]);
+      }
+    }
+  }
+  const double elapsed_ns = test_util::now_ns() - start_ns;
+
+  const double pairs = (double)kSeconds * kTimeTicksPerSec * kNumMotors;
+  printf("motors: %d, ns per sample pair: %.1f, ns per signal second: %.0f\n",
+      kNumMotors, elapsed_ns / pairs, elapsed_ns / kSeconds);
+
+  for (uint8_t motor = 0; motor < kNumMotors; motor++) {
+    analyzer::State state;
+    analyzer::sample_state(motor, &state);
+    printf("motor %d: %d steps, %lu quadrature errors\n", motor,
+        state.full_steps, (unsigned long)state.quadrature_errors);
+    CHECK(state.tick_count == (uint64_t)kSeconds * kTimeTicksPerSec);
+    CHECK(abs(state.full_steps - kSeconds * kStepsPerSec[motor]) <= 2);
+    CHECK(state.quadrature_errors == 0);
+  }
+  return 0;
+}
@@ -0,0 +1,126 @@
+// Error bound test of the coil current vector magnitude approximation,
+// over all the sample values of the 12 bit signals and over a synthetic
+// microstepped waveform, with the cost of the magnitude vs the max coil
+// current.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "acquisition/current_magnitude.h"
+#include "test_util.h"
+
+using analyzer::isr_current_magnitude;
+
+// The documented bounds of the relative error, plus the integer rounding
+// of up to one ADC count that dominates at low currents.
+static constexpr double kMinError = -0.03;
+static constexpr double kMaxError = 0.01;
+static constexpr double kRoundingCounts = 1;
+
+// True if the estimate of the magnitude is within the error bounds.
+static bool is_within_bounds(uint32_t estimate, double magnitude) {
+  return estimate >= magnitude * (1 + kMinError) - kRoundingCounts &&
+         estimate <= magnitude * (1 + kMaxError) + kRoundingCounts;
+}
+
+// Error of the estimates of the magnitudes that are large enough for the
+// rounding to be negligible, for printing only. In ADC counts.
+static constexpr int kMinPrintedMagnitude = 256;
+
+static uint32_t max_coil_current(int16_t v1, int16_t v2) {
+  const uint32_t abs_v1 = abs(v1);
+  const uint32_t abs_v2 = abs(v2);
+  return abs_v1 > abs_v2 ? abs_v1 : abs_v2;
+}
+
+// Checks all the pairs of signed 12 bit sample values.
+static void check_all_samples() {
+  double min_error = 0;
+  double max_error = 0;
+  uint32_t out_of_bounds = 0;
+  for (int v1 = -2048; v1 < 2048; v1++) {
+    for (int v2 = -2048; v2 < 2048; v2++) {
+      const double magnitude = hypot(v1, v2);
+      const uint32_t estimate =
+          isr_current_magnitude(v1, v2, max_coil_current(v1, v2));
+      if (!is_within_bounds(estimate, magnitude)) {
+        out_of_bounds++;
+      }
+      if (magnitude >= kMinPrintedMagnitude) {
+        const double error = estimate / magnitude - 1;
+        min_error = fmin(min_error, error);
+        max_error = fmax(max_error, error);
+      }
+    }
+  }
+  printf("all samples: error [%.2f%%, %.2f%%], %u out of bounds\n",
+      min_error * 100, max_error * 100, out_of_bounds);
+  CHECK(out_of_bounds == 0);
+}
+
+// 1/16 microsteps of a full electrical cycle at the given amplitude.
+// Returns the worst errors of both metrics.
+static void check_microsteps(double amplitude) {
+  double magnitude_min_error = 0;
+  double magnitude_max_error = 0;
+  double max_coil_min_error = 0;
+  for (int microstep = 0; microstep < 64; microstep++) {
+    const double angle = microstep * (M_PI / 2) / 16;
+    const int16_t v1 = lround(amplitude * cos(angle));
+    const int16_t v2 = lround(amplitude * sin(angle));
+    const double magnitude = hypot(v1, v2);
+    const uint32_t max_current = max_coil_current(v1, v2);
+    const uint32_t estimate = isr_current_magnitude(v1, v2, max_current);
+    CHECK(is_within_bounds(estimate, magnitude));
+    const double error = estimate / magnitude - 1;
+    magnitude_min_error = fmin(magnitude_min_error, error);
+    magnitude_max_error = fmax(magnitude_max_error, error);
+    max_coil_min_error = fmin(max_coil_min_error, max_current / magnitude - 1);
+  }
+  printf("microsteps of %4.0f: magnitude error [%.2f%%, %.2f%%], "
+         "max coil error down to %.2f%%\n",
+      amplitude, magnitude_min_error * 100, magnitude_max_error * 100,
+      max_coil_min_error * 100);
+  // The max coil current reads down to cos(45) of the magnitude.
+  CHECK(max_coil_min_error < -0.28);
+}
+
+// Prints the ns per sample of the metrics over random samples.
+static void bench() {
+  static constexpr int kNumSamples = 4096;
+  static constexpr int kRepeats = 2000;
+  static int16_t samples1[kNumSamples];
+  static int16_t samples2[kNumSamples];
+  srand(1);
+  for (int i = 0; i < kNumSamples; i++) {
+    samples1[i] = rand() % 4096 - 2048;
+    samples2[i] = rand() % 4096 - 2048;
+  }
+  for (int metric = 0; metric < 2; metric++) {
+    uint32_t sum = 0;
+    const double start_ns = test_util::now_ns();
+    for (int r = 0; r < kRepeats; r++) {
+      for (int i = 0; i < kNumSamples; i++) {
+        const uint32_t max_current =
+            max_coil_current(samples1[i], samples2[i]);
+        sum += metric ? isr_current_magnitude(
+                            samples1[i], samples2[i], max_current)
+                      : max_current;
+      }
+    }
+    const double ns =
+        (test_util::now_ns() - start_ns) / ((double)kRepeats * kNumSamples);
+    printf("%s: %.2f ns/sample (sum %u)\n", metric ? "magnitude" : "max coil",
+        ns, sum);
+  }
+}
+
+int main() {
+  check_all_samples();
+  check_microsteps(100);
+  check_microsteps(600);
+  check_microsteps(2000);
+  bench();
+  return 0;
+}
@@ -0,0 +1,62 @@
+// Differential test of the dual channel filter updates against the
+// single channel kernels.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "acquisition/filters.h"
+#include "test_util.h"
+
+using namespace filters;
+
+static constexpr int kNumPairs = 4096;
+
+static uint16_t samples1[kNumPairs];
+static uint16_t samples2[kNumPairs];
+
+// Runs the dual update and the single channel kernel side by side over
+// the samples, from a few initial states, and checks that the outputs
+// and the states match.
+template <class Filter>
+static void check_bit_exact(const char* name) {
+  static constexpr uint16_t kInitialValues[] = {0, 2048, 4095};
+  for (const uint16_t initial : kInitialValues) {
+    AdcFilterState dual1, dual2, single1, single2;
+    dual1.reset(initial);
+    dual2.reset(4095 - initial);
+    single1 = dual1;
+    single2 = dual2;
+    for (int i = 0; i < kNumPairs; i++) {
+      uint16_t v1 = samples1[i];
+      uint16_t v2 = samples2[i];
+      DualFilter<Filter>::update(dual1, dual2, &v1, &v2);
+      CHECK(v1 == Filter::update(single1, samples1[i]));
+      CHECK(v2 == Filter::update(single2, samples2[i]));
+      CHECK(dual1.scaled_12bit_value == single1.scaled_12bit_value);
+      CHECK(dual2.scaled_12bit_value == single2.scaled_12bit_value);
+    }
+  }
+  printf("%-16s bit exact\n", name);
+}
+
+int main() {
+  // Random full range samples, with runs of the extremes that drive the
+  // low pass states to their limits.
+  srand(1);
+  for (int i = 0; i < kNumPairs; i++) {
+    const bool is_extreme = (i / 256) % 2;
+    samples1[i] = is_extreme ? ((i / 512) % 2 ? 4095 : 0) : rand() % 4096;
+    samples2[i] = is_extreme ? 4095 - samples1[i] : rand() % 4096;
+  }
+
+  check_bit_exact<BypassFilter>("bypass");
+  check_bit_exact<LowPassFilter<1>>("low pass 1");
+  check_bit_exact<LowPassFilter<500>>("low pass 500");
+  check_bit_exact<LowPassFilter<700>>("low pass 700");
+  check_bit_exact<LowPassFilter<900>>("low pass 900");
+  check_bit_exact<LowPassFilter<1023>>("low pass 1023");
+  check_bit_exact<BiquadFilter>("biquad");
+  check_bit_exact<FilterChain<Median3Filter, LowPassFilter<700>>>(
+      "median3 + lp 700");
+  return 0;
+}
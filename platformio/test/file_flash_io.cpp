@@ -0,0 +1,102 @@
+#include "file_flash_io.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace flash_io {
+
+uint32_t erase_counts[kMaxSectors];
+int32_t torn_write_bytes = -1;
+
+static FILE* file = nullptr;
+static uint32_t region_size = 0;
+
+// Flash writes are within a page.
+static constexpr uint32_t kWritePageSize = 256;
+
+static bool write_file(uint32_t offset, const void* src, uint32_t len) {
+  return fseek(file, offset, SEEK_SET) == 0 &&
+      fwrite(src, 1, len, file) == len && fflush(file) == 0;
+}
+
+bool open_file(const char* path, uint32_t size) {
+  assert(size % kSectorSize == 0 && size / kSectorSize <= kMaxSectors);
+  close_file();
+  file = fopen(path, "r+b");
+  region_size = size;
+  memset(erase_counts, 0, sizeof(erase_counts));
+  if (file) {
+    return true;
+  }
+  file = fopen(path, "w+b");
+  if (!file) {
+    return false;
+  }
+  for (uint32_t offset = 0; offset < size; offset += kSectorSize) {
+    if (!erase_sector(offset)) {
+      return false;
+    }
+  }
+  memset(erase_counts, 0, sizeof(erase_counts));
+  return true;
+}
+
+void close_file() {
+  if (file) {
+    fclose(file);
+    file = nullptr;
+  }
+  region_size = 0;
+}
+
+bool setup() { return file != nullptr; }
+
+uint32_t size() { return region_size; }
+
+bool read(uint32_t offset, void* dst, uint32_t len) {
+  if (offset + len > region_size) {
+    fprintf(stderr, "Read out of range at 0x%x\n", offset);
+    abort();
+  }
+  return fseek(file, offset, SEEK_SET) == 0 &&
+      fread(dst, 1, len, file) == len;
+}
+
+bool write(uint32_t offset, const void* src, uint32_t len) {
+  if (offset + len > region_size ||
+      offset % kWritePageSize + len > kWritePageSize) {
+    fprintf(stderr, "Write out of range at 0x%x, %u bytes\n", offset, len);
+    abort();
+  }
+  uint8_t current[kWritePageSize];
+  if (!read(offset, current, len)) {
+    return false;
+  }
+  const uint8_t* bytes = (const uint8_t*)src;
+  const bool is_torn =
+      torn_write_bytes >= 0 && (uint32_t)torn_write_bytes < len;
+  const uint32_t n = is_torn ? torn_write_bytes : len;
+  for (uint32_t i = 0; i < n; i++) {
+    if ((current[i] & bytes[i]) != bytes[i]) {
+      fprintf(stderr, "Write sets bits at 0x%x\n", offset + i);
+      abort();
+    }
+    current[i] = bytes[i];
+  }
+  return write_file(offset, current, len);
+}
+
+bool erase_sector(uint32_t offset) {
+  if (offset % kSectorSize || offset >= region_size) {
+    fprintf(stderr, "Invalid erase at 0x%x\n", offset);
+    abort();
+  }
+  erase_counts[offset / kSectorSize]++;
+  uint8_t erased[kSectorSize];
+  memset(erased, 0xff, sizeof(erased));
+  return write_file(offset, erased, kSectorSize);
+}
+
+}  // namespace flash_io
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "recording/flash_io.h"
+
+// Host implementation of flash_io, backed by a file, with the NOR flash
+// semantics. Writes may only clear bits and erases set a sector to
+// 0xff. Writes that would set bits abort the test.
+namespace flash_io {
+
+// Opens the backing file, creating it erased if it doesn't exist.
+// Call before setup().
+bool open_file(const char* path, uint32_t size);
+void close_file();
+
+// Erases per sector, for the wear checks.
+constexpr uint32_t kMaxSectors = 256;
+extern uint32_t erase_counts[kMaxSectors];
+
+// If not negative, the next writes keep only their first bytes, as a
+// power loss during the write would.
+extern int32_t torn_write_bytes;
+
+}  // namespace flash_io
@@ -0,0 +1,87 @@
+// Benchmark of the signal filter kernels, one per SignalFilter choice.
+// Prints the ns per sample of each kernel and checks that each kernel
+// passes a steady level as is, such that switching the kernel at run
+// time doesn't shift the zero offsets.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "acquisition/filters.h"
+#include "test_util.h"
+
+using namespace filters;
+
+static constexpr int kNumSamples = 4096;
+static constexpr int kRepeats = 500;
+
+// A noisy sine with occasional single sample glitches, in 12 bit ADC
+// counts.
+static uint16_t samples[kNumSamples];
+
+// Runs the kernel over the samples and returns the ns per sample. The
+// sum of the outputs keeps the compiler from dropping the loop.
+template <class Filter>
+static double time_kernel(uint32_t* sum) {
+  AdcFilterState state;
+  state.reset(samples[0]);
+  uint32_t total = 0;
+  const double start_ns = test_util::now_ns();
+  for (int r = 0; r < kRepeats; r++) {
+    for (int i = 0; i < kNumSamples; i++) {
+      total += Filter::update(state, samples[i]);
+    }
+  }
+  const double elapsed_ns = test_util::now_ns() - start_ns;
+  *sum = total;
+  return elapsed_ns / ((double)kRepeats * kNumSamples);
+}
+
+// Returns the output of the kernel after a long steady input.
+template <class Filter>
+static uint16_t steady_output(uint16_t value) {
+  AdcFilterState state;
+  state.reset(value);
+  uint16_t result = 0;
+  for (int i = 0; i < 100; i++) {
+    result = Filter::update(state, value);
+  }
+  return result;
+}
+
+template <class Filter>
+static void bench_kernel(const char* name) {
+  uint32_t sum;
+  const double ns = time_kernel<Filter>(&sum);
+  printf("%-16s %5.2f ns/sample (sum %u)\n", name, ns, sum);
+  static constexpr uint16_t kLevels[] = {0, 1, 1900, 4095};
+  for (const uint16_t level : kLevels) {
+    CHECK(steady_output<Filter>(level) == level);
+  }
+}
+
+int main() {
+  srand(1);
+  for (int i = 0; i < kNumSamples; i++) {
+    const int noise = rand() % 21 - 10;
+    const int glitch = (i % 97 == 0) ? 600 : 0;
+    const int triangle = abs(i % 512 - 256) * 6;
+    samples[i] = 600 + triangle + noise + glitch;
+  }
+
+  bench_kernel<BypassFilter>("bypass");
+  bench_kernel<LowPassFilter<500>>("low pass 500");
+  bench_kernel<LowPassFilter<700>>("low pass 700");
+  bench_kernel<LowPassFilter<900>>("low pass 900");
+  bench_kernel<BiquadFilter>("biquad");
+  bench_kernel<FilterChain<Median3Filter, LowPassFilter<700>>>(
+      "median3 + lp 700");
+
+  // The median rejects a single sample glitch.
+  AdcFilterState state;
+  state.reset(1000);
+  CHECK(Median3Filter::update(state, 1000) == 1000);
+  CHECK(Median3Filter::update(state, 3000) == 1000);
+  CHECK(Median3Filter::update(state, 1000) == 1000);
+  CHECK(Median3Filter::update(state, 1000) == 1000);
+  return 0;
+}
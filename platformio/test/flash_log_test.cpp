@@ -0,0 +1,206 @@
+// Test of the flash log over a file backed flash region. Covers the
+// wrap around, remounts, the seek by time, the wear leveling, clear()
+// and torn page writes.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "file_flash_io.h"
+#include "recording/flash_log.h"
+#include "test_util.h"
+
+using namespace flash_log;
+
+static constexpr auto kPath = "flash_log_test.bin";
+// 16 sectors of 16 pages.
+static constexpr uint32_t kNumSectors = 16;
+static constexpr uint32_t kRegionSize = kNumSectors * flash_io::kSectorSize;
+static constexpr uint32_t kCapacity = kNumSectors * kPagesPerSector;
+
+// The data of a page is derived from its seq, with a varying size.
+static uint8_t page_data_size(uint32_t seq) {
+  return (seq * 7) % kPageDataSize + 1;
+}
+
+// Appends the next page, erasing its sector first if needed, as
+// recorder::service() does.
+static bool append_page(FlashLog& log, uint16_t session, uint32_t millis) {
+  if (log.needs_erase() && !log.erase_next_sector()) {
+    return false;
+  }
+  const uint32_t seq = log.head();
+  uint8_t data[kPageDataSize];
+  const uint8_t size = page_data_size(seq);
+  for (uint8_t i = 0; i < size; i++) {
+    data[i] = seq + i;
+  }
+  return log.append(session, millis, size / 3, data, size);
+}
+
+// True if the page reads back as appended.
+static bool is_page_valid(FlashLog& log, uint32_t seq) {
+  uint8_t page[kPageSize];
+  uint16_t size;
+  PageHeader header;
+  if (!log.read_page(seq, page, &size) ||
+      !decode_page(page, size, &header)) {
+    return false;
+  }
+  if (header.seq != seq || header.data_size != page_data_size(seq)) {
+    return false;
+  }
+  for (uint8_t i = 0; i < header.data_size; i++) {
+    if (page[kPageHeaderSize + i] != (uint8_t)(seq + i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Checks that a fresh mount of the region sees the given pages range.
+static void check_remount(uint32_t tail, uint32_t head) {
+  FlashLog log;
+  CHECK(log.mount());
+  CHECK(log.tail() == tail);
+  CHECK(log.head() == head);
+}
+
+static void check_first_round(FlashLog& log) {
+  CHECK(log.mount());
+  CHECK(log.head() == 0 && log.tail() == 0);
+  CHECK(log.capacity() == kCapacity);
+  CHECK(log.find_page(0, 0) == 0);
+
+  // A page per second of session 1.
+  for (uint32_t i = 0; i < 40; i++) {
+    CHECK(append_page(log, 1, i * 1000));
+  }
+  for (uint32_t seq = 0; seq < 40; seq++) {
+    CHECK(is_page_valid(log, seq));
+  }
+  CHECK(log.find_page(1, 5000) == 5);
+  CHECK(log.find_page(1, 5500) == 5);
+  CHECK(log.find_page(0, 99999) == 0);
+  CHECK(log.find_page(2, 0) == 39);
+  check_remount(0, 40);
+}
+
+static void check_wrap_around(FlashLog& log) {
+  for (uint32_t i = 40; i < 1000; i++) {
+    CHECK(append_page(log, 2, i * 1000));
+  }
+  // The sector of the head was erased, dropping its older pages.
+  const uint32_t tail = 1000 - 1000 % kPagesPerSector + kPagesPerSector -
+      kCapacity;
+  printf("after wrap around: pages [%u, %u)\n", log.tail(), log.head());
+  CHECK(log.head() == 1000);
+  CHECK(log.tail() == tail);
+  for (uint32_t seq = log.tail(); seq < log.head(); seq++) {
+    CHECK(is_page_valid(log, seq));
+  }
+  uint8_t page[kPageSize];
+  uint16_t size;
+  CHECK(!log.read_page(log.tail() - 1, page, &size));
+  CHECK(!log.read_page(log.head(), page, &size));
+  CHECK(log.find_page(2, 900500) == 900);
+  CHECK(log.find_page(1, 0) == log.tail());
+  check_remount(tail, 1000);
+
+  // Remount on a sector boundary, before the erase of the next sector.
+  while (log.head() < 1008) {
+    CHECK(append_page(log, 2, 0));
+  }
+  check_remount(1008 - kCapacity, 1008);
+
+  // A power loss between the erase of the next sector and the append
+  // drops the erased pages from the remounted log.
+  CHECK(log.needs_erase() && log.erase_next_sector());
+  CHECK(log.tail() == 1008 + kPagesPerSector - kCapacity);
+  {
+    FlashLog remounted;
+    CHECK(remounted.mount());
+    CHECK(remounted.tail() == log.tail() && remounted.head() == 1008);
+    for (uint32_t seq = remounted.tail(); seq < remounted.head(); seq++) {
+      uint8_t page[kPageSize];
+      uint16_t size;
+      PageHeader header;
+      CHECK(remounted.read_page(seq, page, &size));
+      CHECK(decode_page(page, size, &header) && header.seq == seq);
+    }
+  }
+
+  uint32_t min_erases = UINT32_MAX;
+  uint32_t max_erases = 0;
+  for (uint32_t sector = 0; sector < kNumSectors; sector++) {
+    const uint32_t erases = flash_io::erase_counts[sector];
+    min_erases = (erases < min_erases) ? erases : min_erases;
+    max_erases = (erases > max_erases) ? erases : max_erases;
+  }
+  printf("erases per sector: [%u, %u]\n", min_erases, max_erases);
+  CHECK(max_erases - min_erases <= 1);
+}
+
+// Clearing is persisted by the next append.
+static void check_clear(FlashLog& log) {
+  log.clear();
+  CHECK(log.tail() == log.head());
+  CHECK(append_page(log, 3, 0));
+  check_remount(1008, 1009);
+}
+
+// A power loss during a page write leaves a page that fails to decode
+// and is skipped, and the log continues after it.
+static void check_torn_page(FlashLog& log) {
+  flash_io::torn_write_bytes = 10;
+  CHECK(append_page(log, 3, 5));
+  flash_io::torn_write_bytes = -1;
+
+  FlashLog remounted;
+  CHECK(remounted.mount());
+  CHECK(remounted.tail() == 1008 && remounted.head() == 1010);
+  uint8_t page[kPageSize];
+  uint16_t size;
+  PageHeader header;
+  CHECK(remounted.read_page(1009, page, &size));
+  CHECK(!decode_page(page, size, &header));
+  CHECK(append_page(remounted, 3, 6));
+  CHECK(is_page_valid(remounted, 1010));
+}
+
+// A region with foreign data mounts and is usable.
+static void check_foreign_data() {
+  flash_io::close_file();
+  remove(kPath);
+  FILE* file = fopen(kPath, "wb");
+  CHECK(file);
+  srand(1);
+  for (uint32_t i = 0; i < kRegionSize; i++) {
+    fputc(rand() & 0xff, file);
+  }
+  fclose(file);
+  CHECK(flash_io::open_file(kPath, kRegionSize));
+
+  FlashLog log;
+  CHECK(log.mount());
+  printf("foreign data: pages [%u, %u)\n", log.tail(), log.head());
+  for (uint32_t i = 0; i < 300; i++) {
+    CHECK(append_page(log, 1, i));
+  }
+  for (uint32_t seq = log.tail(); seq < log.head(); seq++) {
+    CHECK(is_page_valid(log, seq));
+  }
+}
+
+int main() {
+  remove(kPath);
+  CHECK(flash_io::open_file(kPath, kRegionSize));
+  FlashLog log;
+  check_first_round(log);
+  check_wrap_around(log);
+  check_clear(log);
+  check_torn_page(log);
+  check_foreign_data();
+  flash_io::close_file();
+  remove(kPath);
+  return 0;
+}
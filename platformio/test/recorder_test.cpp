@@ -0,0 +1,112 @@
+// Test of the offline recorder over a file backed flash region. Records
+// a session of states and anomalies, reads the pages back and checks
+// the session numbering across remounts and clear().
+
+#include <stdio.h>
+
+#include "file_flash_io.h"
+#include "recording/recorder.h"
+#include "test_util.h"
+
+static constexpr auto kPath = "recorder_test.bin";
+static constexpr uint32_t kRegionSize = 32 * flash_io::kSectorSize;
+
+int main() {
+  remove(kPath);
+  CHECK(flash_io::open_file(kPath, kRegionSize));
+  recorder::setup();
+  recorder::Status status;
+  recorder::get_status(&status);
+  CHECK(status.is_available && !status.is_recording);
+  CHECK(status.session == 0 && status.head_seq == 0);
+
+  CHECK(!recorder::start(recorder::kMinStateIntervalMillis - 1));
+  CHECK(recorder::start(100));
+
+  // States every 20ms, of which every 5th is recorded, and a few
+  // anomalies. Serviced after each, as by the main loop.
+  analyzer::State state;
+  uint32_t anomalies = 0;
+  for (uint32_t i = 0; i < 20000; i++) {
+    state.tick_count = (uint64_t)i * acq_consts::kTimeTicksPerSec / 50;
+    state.full_steps = i * 3;
+    state.is_energized = true;
+    state.max_current_in_step = 1234;
+    state.quadrature_errors = i / 100;
+    recorder::add_state(state, 0);
+    if (i % 500 == 7) {
+      analyzer::AnomalyEvent event = {};
+      event.tick_count = state.tick_count;
+      event.detail = i;
+      event.motor = 0;
+      event.type = analyzer::ANOMALY_REVERSAL_BURST;
+      recorder::add_anomaly(event);
+      anomalies++;
+    }
+    if (i % 500 == 257) {
+      // Serviced late, timed before the open page.
+      analyzer::AnomalyEvent event = {};
+      event.tick_count = state.tick_count - 3 * acq_consts::kTimeTicksPerSec;
+      event.detail = i;
+      event.motor = 0;
+      event.type = analyzer::ANOMALY_STEP_PERIOD_JUMP;
+      recorder::add_anomaly(event);
+      anomalies++;
+    }
+    recorder::service();
+  }
+  recorder::stop();
+  for (int i = 0; i < 10; i++) {
+    recorder::service();
+  }
+  recorder::get_status(&status);
+  printf("session %u, pages [%u, %u) of %u, %u dropped, %u errors\n",
+      status.session, status.tail_seq, status.head_seq,
+      status.capacity_pages, status.dropped_records, status.flash_errors);
+  CHECK(status.session == 1 && !status.is_recording);
+  CHECK(status.dropped_records == 0 && status.flash_errors == 0);
+
+  // The session start, a state per 100ms and the anomalies. The late
+  // anomalies don't start pages out of time order, or short pages.
+  uint32_t records = 0;
+  uint32_t min_page_records = UINT32_MAX;
+  uint32_t last_base_millis = 0;
+  for (uint32_t seq = status.tail_seq; seq < status.head_seq; seq++) {
+    uint8_t page[flash_log::kPageSize];
+    uint16_t size;
+    flash_log::PageHeader header;
+    CHECK(recorder::read_page(seq, page, &size));
+    CHECK(flash_log::decode_page(page, size, &header));
+    CHECK(header.session == 1);
+    CHECK(header.base_millis >= last_base_millis);
+    last_base_millis = header.base_millis;
+    if (seq + 1 < status.head_seq && header.num_records < min_page_records) {
+      min_page_records = header.num_records;
+    }
+    records += header.num_records;
+  }
+  printf("%u records, min %u per page\n", records, min_page_records);
+  CHECK(min_page_records >= 10);
+  CHECK(status.tail_seq == 0);
+  CHECK(records == 1 + 20000 / 5 + anomalies);
+
+  // Seek by time, 100 secs into the session.
+  const uint32_t seq = recorder::find_page(1, 100000);
+  CHECK(seq > status.tail_seq && seq < status.head_seq);
+
+  // A remount continues the session numbers.
+  recorder::setup();
+  recorder::get_status(&status);
+  CHECK(status.session == 1);
+  CHECK(recorder::start(1000));
+  recorder::get_status(&status);
+  CHECK(status.session == 2);
+
+  recorder::clear();
+  recorder::get_status(&status);
+  CHECK(status.tail_seq == status.head_seq);
+
+  flash_io::close_file();
+  remove(kPath);
+  return 0;
+}
@@ -0,0 +1,163 @@
+// Test of the fixed point coil current spectrum against a double
+// precision DFT reference of the same windowed and zero padded signals.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "acquisition/spectrum.h"
+#include "test_util.h"
+
+using spectrum::kFftBinsPerBin;
+using spectrum::kFftSize;
+using spectrum::kNumBins;
+
+// Tolerance vs the reference, in ADC counts with 4 fraction bits. The
+// fixed point rounding of the window, the twiddles and the butterflies.
+static constexpr double kToleranceCounts = 4;
+static constexpr double kToleranceRatio = 0.005;
+
+// Computes the reference spectrum of the items, as documented in
+// spectrum.h, in ADC counts with 4 fraction bits.
+static void reference_spectrum(
+    const analyzer::AdcCaptureItems& items, double bins[kNumBins]) {
+  const int n = items.size();
+  double dc1 = 0;
+  double dc2 = 0;
+  for (int i = 0; i < n; i++) {
+    dc1 += items.get(i)->v1;
+    dc2 += items.get(i)->v2;
+  }
+  dc1 /= n;
+  dc2 /= n;
+  static double x1[kFftSize];
+  static double x2[kFftSize];
+  double window_sum = 0;
+  for (int i = 0; i < n; i++) {
+    const double w = 0.5 - 0.5 * cos(2 * M_PI * i / (n - 1));
+    window_sum += w;
+    x1[i] = (items.get(i)->v1 - dc1) * w;
+    x2[i] = (items.get(i)->v2 - dc2) * w;
+  }
+  for (int bin = 0; bin < kNumBins; bin++) {
+    double peak = 0;
+    for (int j = 0; j < kFftBinsPerBin; j++) {
+      const int k = bin * kFftBinsPerBin + j;
+      if (k == 0) {
+        continue;
+      }
+      double x1_re = 0, x1_im = 0, x2_re = 0, x2_im = 0;
+      for (int i = 0; i < n; i++) {
+        const double angle = -2 * M_PI * k * i / kFftSize;
+        x1_re += x1[i] * cos(angle);
+        x1_im += x1[i] * sin(angle);
+        x2_re += x2[i] * cos(angle);
+        x2_im += x2[i] * sin(angle);
+      }
+      // A1 = 2 * |X1| / sum(w), and the RMS of A1 and A2.
+      const double a1 = 2 * hypot(x1_re, x1_im) / window_sum;
+      const double a2 = 2 * hypot(x2_re, x2_im) / window_sum;
+      peak = fmax(peak, sqrt((a1 * a1 + a2 * a2) / 2));
+    }
+    bins[bin] = peak * 16;
+  }
+}
+
+// Computes the spectrum of the items and checks it vs the reference.
+// Returns the computed bins.
+static void check_vs_reference(const char* name,
+    const analyzer::AdcCaptureItems& items, uint16_t bins[kNumBins]) {
+  double ref[kNumBins];
+  reference_spectrum(items, ref);
+  CHECK(spectrum::compute(items, bins));
+  double max_diff = 0;
+  for (int bin = 0; bin < kNumBins; bin++) {
+    const double diff = fabs(bins[bin] - ref[bin]);
+    max_diff = fmax(max_diff, diff);
+    if (diff > kToleranceCounts + ref[bin] * kToleranceRatio) {
+      printf("%s: bin %d is %u, reference %.1f\n", name, bin, bins[bin],
+          ref[bin]);
+      CHECK(false);
+    }
+  }
+  printf("%s: max diff %.2f counts/16\n", name, max_diff);
+}
+
+// Fills the items with sinusoids of the given amplitudes, in ADC counts,
+// at the given FFT bin. The coils are in quadrature, as in a running
+// stepper.
+static void fill_sinusoids(analyzer::AdcCaptureItems* items, int n,
+    double fft_bin, double a1, double a2, int16_t dc) {
+  items->clear();
+  for (int i = 0; i < n; i++) {
+    const double angle = 2 * M_PI * fft_bin * i / kFftSize;
+    analyzer::AdcCaptureItem* item = items->insert();
+    item->v1 = dc + lround(a1 * cos(angle));
+    item->v2 = dc + lround(a2 * sin(angle));
+  }
+}
+
+// Same amplitude on both coils reads that amplitude, and the doc
+// comment formula holds for unequal amplitudes.
+static void check_amplitudes() {
+  static analyzer::AdcCaptureItems items;
+  uint16_t bins[kNumBins];
+  // On an FFT bin such that there is no scalloping loss.
+  static constexpr int kFftBin = 40;
+  static constexpr int kBin = kFftBin / kFftBinsPerBin;
+
+  fill_sinusoids(&items, analyzer::kAdcCaptureBufferSize, kFftBin, 500,
+      500, 100);
+  check_vs_reference("equal", items, bins);
+  CHECK(fabs(bins[kBin] - 500 * 16) < 500 * 16 * 0.01);
+
+  fill_sinusoids(&items, analyzer::kAdcCaptureBufferSize, kFftBin, 600, 0,
+      -50);
+  check_vs_reference("single coil", items, bins);
+  const double rms = 600 / sqrt(2);
+  CHECK(fabs(bins[kBin] - rms * 16) < rms * 16 * 0.01);
+
+  fill_sinusoids(&items, analyzer::kAdcCaptureBufferSize, kFftBin, 800,
+      200, 0);
+  check_vs_reference("unequal", items, bins);
+  const double rms2 = sqrt((800.0 * 800 + 200 * 200) / 2);
+  CHECK(fabs(bins[kBin] - rms2 * 16) < rms2 * 16 * 0.01);
+}
+
+// Random signals, full scale steps and short captures.
+static void check_signals() {
+  static analyzer::AdcCaptureItems items;
+  uint16_t bins[kNumBins];
+
+  srand(1);
+  items.clear();
+  for (int i = 0; i < analyzer::kAdcCaptureBufferSize; i++) {
+    analyzer::AdcCaptureItem* item = items.insert();
+    item->v1 = rand() % 4096 - 2048;
+    item->v2 = rand() % 4096 - 2048;
+  }
+  check_vs_reference("noise", items, bins);
+
+  items.clear();
+  for (int i = 0; i < analyzer::kAdcCaptureBufferSize; i++) {
+    analyzer::AdcCaptureItem* item = items.insert();
+    item->v1 = ((i / 25) & 1) ? 2047 : -2047;
+    item->v2 = ((i / 50) & 1) ? 2047 : -2047;
+  }
+  check_vs_reference("square", items, bins);
+
+  fill_sinusoids(&items, spectrum::kMinItems, 3.3, 1000, 1000, 0);
+  check_vs_reference("min items", items, bins);
+
+  items.clear();
+  for (int i = 0; i < spectrum::kMinItems - 1; i++) {
+    items.insert();
+  }
+  CHECK(!spectrum::compute(items, bins));
+}
+
+int main() {
+  check_amplitudes();
+  check_signals();
+  return 0;
+}
@@ -0,0 +1,218 @@
+// Replay test of the missed step and stall detector. Feeds synthetic
+// coil current waveforms of normal moves and of injected faults through
+// the analyzer pipeline and checks the anomaly events.
+
+#include <math.h>
+#include <stdio.h>
+
+#include "acquisition/analyzer.h"
+#include "acquisition/analyzer_private.h"
+#include "test_util.h"
+
+using acq_consts::kTimeTicksPerSec;
+using analyzer::AnomalyEvent;
+using analyzer::AnomalyType;
+
+static constexpr uint16_t kOffset = 1800;
+static constexpr double kAmplitude = 800;
+
+// The generated waveform. The phase advances pi/2 per full step.
+static double phase = M_PI / 4;
+static double amplitude = kAmplitude;
+
+// Generates the given time of signal with the step rate and the
+// amplitude changing linearly from their current values to the given
+// ones. Step rates are in full steps per sec, signed by direction.
+static double steps_per_sec = 0;
+static void run(double secs, double end_steps_per_sec, double end_amplitude) {
+  const uint32_t n = lround(secs * kTimeTicksPerSec);
+  const double start_steps_per_sec = steps_per_sec;
+  const double start_amplitude = amplitude;
+  for (uint32_t i = 0; i < n; i++) {
+    const double f = (double)(i + 1) / n;
+    steps_per_sec =
+        start_steps_per_sec + (end_steps_per_sec - start_steps_per_sec) * f;
+    amplitude = start_amplitude + (end_amplitude - start_amplitude) * f;
+    phase += (M_PI / 2) * steps_per_sec / kTimeTicksPerSec;
+    analyzer::isr_handle_one_sample(0, kOffset + lround(amplitude * cos(phase)),
+        kOffset + lround(amplitude * sin(phase)));
+  }
+}
+
+// Runs at a constant step rate and amplitude.
+static void hold(double secs) { run(secs, steps_per_sec, amplitude); }
+
+// Moves the given number of full steps at the given rate, from and to
+// the middle of a quadrant, and rests.
+static void move_steps(int steps, double rate) {
+  const uint32_t n = lround(fabs(steps / rate) * kTimeTicksPerSec);
+  const double end_phase = phase + (M_PI / 2) * steps;
+  steps_per_sec = steps * (double)kTimeTicksPerSec / n;
+  hold((double)n / kTimeTicksPerSec);
+  phase = end_phase;
+  steps_per_sec = 0;
+  hold(0.2);
+}
+
+// Pops the pending anomaly events and returns their count. Optionally
+// returns the type and detail of the last one.
+static int pop_anomalies(AnomalyEvent* last = nullptr) {
+  int count = 0;
+  AnomalyEvent event;
+  while (analyzer::pop_next_anomaly(&event)) {
+    printf("  anomaly type %d, detail %lu\n", event.type,
+        (unsigned long)event.detail);
+    count++;
+    if (last) {
+      *last = event;
+    }
+  }
+  return count;
+}
+
+// Starts a scenario at rest, after a forward move.
+static void start(const char* name) {
+  printf("%s\n", name);
+  amplitude = kAmplitude;
+  move_steps(4, 400);
+  hold(0.5);
+  analyzer::reset_data();
+  AnomalyEvent event;
+  while (analyzer::pop_next_anomaly(&event)) {
+  }
+}
+
+// A trapezoid move profile.
+static void trapezoid(double cruise_steps_per_sec) {
+  run(0.3, cruise_steps_per_sec, kAmplitude);
+  hold(0.5);
+  run(0.3, 0, kAmplitude);
+  hold(0.3);
+}
+
+// Moves with ramps, pauses and reversals are not anomalies.
+static void check_normal_moves() {
+  start("normal moves");
+  trapezoid(1000);
+  trapezoid(-600);
+  move_steps(10, 200);
+  move_steps(-10, 200);
+  // A gradual current reduction, e.g. of a driver with load adaptive
+  // current, is not a lag.
+  run(0.5, 800, kAmplitude);
+  run(0.5, 800, kAmplitude * 0.6);
+  run(0.3, 0, kAmplitude * 0.6);
+  hold(0.3);
+  CHECK(pop_anomalies() == 0);
+  CHECK(analyzer::get_anomaly_count(0) == 0);
+}
+
+// The motor stops for a few step periods within a move.
+static void check_stall() {
+  start("stall");
+  run(0.3, 800, kAmplitude);
+  hold(0.2);
+  const double rate = steps_per_sec;
+  steps_per_sec = 0;
+  hold(0.02);
+  steps_per_sec = rate;
+  hold(0.2);
+  AnomalyEvent event;
+  CHECK(pop_anomalies(&event) >= 1);
+  CHECK(event.type == analyzer::ANOMALY_STEP_PERIOD_JUMP);
+}
+
+// The motor oscillates around a position.
+static void check_reversal_burst() {
+  start("reversal burst");
+  for (int i = 0; i < 3; i++) {
+    move_steps(1, 400);
+    move_steps(-1, 400);
+  }
+  AnomalyEvent event;
+  CHECK(pop_anomalies(&event) == 1);
+  CHECK(event.type == analyzer::ANOMALY_REVERSAL_BURST);
+  CHECK(event.detail == analyzer::kAnomalyBurstReversals);
+}
+
+// The data reset clears the partial reversal count.
+static void check_reset_clears_reversals() {
+  start("reset clears reversals");
+  move_steps(-1, 400);
+  move_steps(1, 400);
+  analyzer::reset_data();
+  move_steps(-1, 400);
+  move_steps(1, 400);
+  CHECK(pop_anomalies() == 0);
+}
+
+// The current collapses within a move, e.g. by the back EMF.
+static void check_current_lag() {
+  start("current lag");
+  run(0.3, 800, kAmplitude);
+  hold(0.2);
+  run(0.02, steps_per_sec, kAmplitude * 0.3);
+  hold(0.2);
+  AnomalyEvent event;
+  CHECK(pop_anomalies(&event) == 1);
+  CHECK(event.type == analyzer::ANOMALY_CURRENT_LAG);
+  CHECK(event.detail < kAmplitude / 2);
+  CHECK(analyzer::get_anomaly_count(0) == 1);
+}
+
+// The current vector skips a quadrant within a move. Unfiltered, such
+// that the skip doesn't pass through a low current.
+static void check_quadrant_skip() {
+  start("quadrant skip");
+  CHECK(analyzer::set_signal_filter(analyzer::FILTER_BYPASS));
+  run(0.3, 400, kAmplitude);
+  hold(0.2);
+  phase += M_PI;
+  hold(0.1);
+  AnomalyEvent event;
+  CHECK(pop_anomalies(&event) == 1);
+  CHECK(event.type == analyzer::ANOMALY_QUADRATURE_ERROR);
+  analyzer::QuadratureErrors errors;
+  analyzer::sample_quadrature_errors(0, &errors);
+  CHECK(errors.class_counts[analyzer::QUADRATURE_ERROR_IN_MOVE] == 1);
+  CHECK(analyzer::set_signal_filter(analyzer::kDefaultSignalFilter));
+}
+
+// Quadrant skips at rest and of a barely energized motor, e.g. noise
+// while homing, are counted but are not anomalies.
+static void check_quadrant_skips_at_rest() {
+  start("quadrant skips at rest");
+  CHECK(analyzer::set_signal_filter(analyzer::FILTER_BYPASS));
+  phase += M_PI;
+  hold(0.2);
+  amplitude = 60;
+  hold(0.2);
+  for (int i = 0; i < 20; i++) {
+    phase += M_PI;
+    hold(0.05);
+  }
+  CHECK(pop_anomalies() == 0);
+  analyzer::QuadratureErrors errors;
+  analyzer::sample_quadrature_errors(0, &errors);
+  printf("  errors at rest %u, low current %u\n",
+      errors.class_counts[analyzer::QUADRATURE_ERROR_AT_REST],
+      errors.class_counts[analyzer::QUADRATURE_ERROR_LOW_CURRENT]);
+  CHECK(errors.class_counts[analyzer::QUADRATURE_ERROR_AT_REST] == 1);
+  CHECK(errors.class_counts[analyzer::QUADRATURE_ERROR_LOW_CURRENT] == 20);
+  CHECK(analyzer::set_signal_filter(analyzer::kDefaultSignalFilter));
+}
+
+int main() {
+  nvs_config::AcquistionSettings settings[] = {{kOffset, kOffset, false,
+      acq_consts::kUnityGain, acq_consts::kUnityGain}};
+  CHECK(analyzer::setup(settings, 340));
+
+  check_normal_moves();
+  check_stall();
+  check_reversal_burst();
+  check_reset_clears_reversals();
+  check_current_lag();
+  check_quadrant_skip();
+  check_quadrant_skips_at_rest();
+  return 0;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+// Host stand-in of the ESP-IDF GAP types, as used by the ble_util.h
+// serializer.
+
+typedef int esp_gap_ble_cb_event_t;
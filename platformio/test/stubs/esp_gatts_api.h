@@ -0,0 +1,13 @@
+#pragma once
+
+// Host stand-in of the ESP-IDF GATT server types, as used by the
+// ble_util.h serializer.
+
+#include <stdint.h>
+
+typedef int esp_gatts_cb_event_t;
+
+typedef enum {
+  ESP_GATT_OK = 0,
+  ESP_GATT_ERROR = 0x85,
+} esp_gatt_status_t;
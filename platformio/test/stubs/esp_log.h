@@ -0,0 +1,13 @@
+#pragma once
+
+// Host stand-in of the ESP-IDF logging. Errors and warnings are
+// printed, the rest is dropped to keep the test output short.
+
+#include <stdio.h>
+
+#define ESP_LOGE(tag, format, ...) \
+  fprintf(stderr, "E %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) \
+  fprintf(stderr, "W %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) (void)(tag)
+#define ESP_LOGD(tag, format, ...) (void)(tag)
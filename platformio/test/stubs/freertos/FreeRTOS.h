@@ -0,0 +1,20 @@
+#pragma once
+
+// Host stand-in of the FreeRTOS types. The host tests are single
+// threaded. Includes assert() as the ESP-IDF headers do.
+
+#include <assert.h>
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define portMAX_DELAY 0xffffffff
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdMS_TO_TICKS(ms) (ms)
+#define pdTICKS_TO_MS(ticks) (ticks)
+
+#define taskDISABLE_INTERRUPTS()
+#define taskENABLE_INTERRUPTS()
@@ -0,0 +1,38 @@
+// Host implementations of the stand-in ESP-IDF and FreeRTOS functions.
+// The host tests are single threaded so the semaphores are never
+// contended.
+
+#include "driver/gpio.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+static int dummy_semaphore;
+static TickType_t tick_count = 0;
+
+SemaphoreHandle_t xSemaphoreCreateMutex() { return &dummy_semaphore; }
+
+SemaphoreHandle_t xSemaphoreCreateCounting(
+    UBaseType_t max_count, UBaseType_t initial_count) {
+  return &dummy_semaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) { return pdTRUE; }
+
+// Advances one tick per call such that polling loops progress.
+TickType_t xTaskGetTickCount() { return tick_count++; }
+
+void vTaskDelay(TickType_t ticks) { tick_count += ticks; }
+
+int gpio_get_level(gpio_num_t pin) { return 0; }
+
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level) { return 0; }
+
+esp_err_t gpio_set_direction(gpio_num_t pin, gpio_mode_t mode) { return 0; }
+
+esp_err_t gpio_set_pull_mode(gpio_num_t pin, gpio_pull_mode_t mode) {
+  return 0;
+}
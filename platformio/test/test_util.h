@@ -0,0 +1,29 @@
+#pragma once
+
+// Minimal checks and timing for the host tests. A failed check prints
+// its location and exits with a non zero status, which fails the ctest
+// test.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define CHECK(condition)                                        \
+  do {                                                          \
+    if (!(condition)) {                                         \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__,    \
+          __LINE__, #condition);                                \
+      exit(1);                                                  \
+    }                                                           \
+  } while (0)
+
+namespace test_util {
+
+// A monotonic time stamp in nanoseconds, for the benchmarks.
+inline double now_ns() {
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+}  // namespace test_util
@@ -0,0 +1,116 @@
+# Builds an ADC linearity correction table from a sweep recording and
+# optionally uploads it to the device.
+#
+# The sweep recording is a CSV file with a 'raw,ideal' line per
+# measurement point. 'raw' is the ADC code the device reads and 'ideal'
+# is the code a perfectly linear ADC would read for the same input, e.g.
+# computed from a reference voltmeter as volts * 4095 / full_scale_volts.
+# Points should cover as much of the [0, 4095] range as possible, in
+# any order. Lines that don't start with a number are ignored.
+#
+# Usage examples:
+#   python adc_linearity.py --sweep sweep.csv --output table.csv
+#   python adc_linearity.py --sweep sweep.csv --upload --device STP-xxxx
+#   python adc_linearity.py --clear --device STP-xxxx
+
+import argparse
+import asyncio
+import csv
+import sys
+
+import numpy as np
+
+# A workaround to avoid auto formatting.
+if True:
+    sys.path.append("..")
+    from common import connections
+    from common.probe import Probe
+
+TABLE_SIZE = Probe.ADC_LINEARITY_TABLE_SIZE
+MAX_CODE = TABLE_SIZE - 1
+
+# Command line flags.
+parser = argparse.ArgumentParser()
+parser.add_argument("--sweep", dest="sweep", default=None,
+                    help="Input sweep recording CSV file with raw,ideal lines.")
+parser.add_argument("--output", dest="output", default=None,
+                    help="Optional output CSV file with the table entries.")
+parser.add_argument("--upload", dest="upload", default=False, action="store_true",
+                    help="Upload the table to the device.")
+parser.add_argument("--clear", dest="clear", default=False, action="store_true",
+                    help="Restore the identity table on the device.")
+parser.add_argument("--device", dest="device", default=None,
+                    help="The device name or address")
+args = parser.parse_args()
+
+
+def read_sweep(file_name):
+    """ Returns the sweep points as raw, ideal numpy arrays. """
+    raw = []
+    ideal = []
+    with open(file_name, newline='') as f:
+        for row in csv.reader(f):
+            try:
+                raw_value, ideal_value = float(row[0]), float(row[1])
+            except (ValueError, IndexError):
+                continue
+            raw.append(raw_value)
+            ideal.append(ideal_value)
+    return np.array(raw), np.array(ideal)
+
+
+def build_table(raw, ideal):
+    """ Returns the table entries as a list of ints in [0, 4095]. """
+    # Average the points of each raw code and sort by raw code.
+    codes, inverse = np.unique(np.rint(raw).astype(int), return_inverse=True)
+    if len(codes) < 2:
+        sys.exit("Sweep should have at least two distinct raw codes.")
+    sums = np.bincount(inverse, weights=ideal)
+    counts = np.bincount(inverse)
+    values = sums / counts
+    # The ADC is monotonic, force it on measurement noise.
+    values = np.maximum.accumulate(values)
+    # Linear interpolation between the points. Beyond the swept range we
+    # keep the correction of the nearest point rather than extrapolating
+    # the slope.
+    all_codes = np.arange(TABLE_SIZE)
+    corrections = np.interp(all_codes, codes, values - codes)
+    table = np.clip(np.rint(all_codes + corrections), 0, MAX_CODE).astype(int)
+    print(f"Table from {len(raw)} points, {len(codes)} codes in "
+          f"[{codes[0]}, {codes[-1]}]. Max correction "
+          f"{np.max(np.abs(table - all_codes))} codes.", flush=True)
+    return table.tolist()
+
+
+def write_table(file_name, table):
+    with open(file_name, "w") as f:
+        for value in table:
+            f.write(f"{value}\n")
+
+
+async def async_main():
+    table = None
+    if args.sweep:
+        raw, ideal = read_sweep(args.sweep)
+        table = build_table(raw, ideal)
+        if args.output:
+            write_table(args.output, table)
+            print(f"Table written to {args.output}", flush=True)
+
+    if not args.upload and not args.clear:
+        return
+    if args.upload and not table:
+        sys.exit("--upload requires --sweep.")
+
+    probe = await connections.connect_to_probe(args.device)
+    assert (probe)
+    if args.clear:
+        await probe.write_command_clear_adc_linearity_table()
+        print(f"Identity table restored.", flush=True)
+    else:
+        await probe.write_command_set_adc_linearity_table(table)
+        print(f"Table uploaded. Repeat the zero calibration.", flush=True)
+    await probe.disconnect()
+
+
+asyncio.run(async_main())
@@ -305,6 +305,10 @@ def add_state(state: ProbeState):
     """ Called when a new state notification is received from the device. """
     global probe, graph1, graph2, last_state, updates_counter
 
+    # Multi motor devices notify the states of all motors. Track the first.
+    if state.motor != 0:
+        return
+
     # Compute speed based on change from previous state.
     if last_state is None:
         # print(f"No last state", flush=True)
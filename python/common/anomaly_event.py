@@ -0,0 +1,54 @@
+# Represents a notified missed step / stall anomaly event.
+
+from __future__ import annotations
+import logging
+from common.probe_info import ProbeInfo
+
+logger = logging.getLogger(__name__)
+
+
+class AnomalyEvent:
+
+    # Anomaly types. See analyzer::AnomalyType.
+    STEP_PERIOD_JUMP = 0
+    REVERSAL_BURST = 1
+    QUADRATURE_ERROR = 2
+    CURRENT_LAG = 3
+
+    TYPE_NAMES = {
+        STEP_PERIOD_JUMP: "step period jump",
+        REVERSAL_BURST: "reversal burst",
+        QUADRATURE_ERROR: "quadrature error",
+        CURRENT_LAG: "current lag",
+    }
+
+    def __init__(self, motor: int, type: int, timestamp_secs: float, detail: int,
+                 anomaly_count: int):
+        self.motor = motor
+        self.type = type
+        # Device time of the detection, in secs.
+        self.timestamp_secs = timestamp_secs
+        # Type specific value, see analyzer::AnomalyType.
+        self.detail = detail
+        # Total anomalies of the motor since the last data reset.
+        self.anomaly_count = anomaly_count
+
+    def __str__(self) -> str:
+        name = self.TYPE_NAMES.get(self.type, f"type {self.type}")
+        return (f"motor {self.motor}, {name} at {self.timestamp_secs:.3f}s, "
+                f"detail {self.detail}, total {self.anomaly_count}")
+
+    @classmethod
+    def decode(cls, data: bytearray, probe_info: ProbeInfo) -> (AnomalyEvent | None):
+        format = data[0]
+        if format != 0xa1:
+            logger.error(f"Unexpected anomaly event format {format}.")
+            return None
+
+        motor = data[1]
+        type = data[2]
+        tick_count = int.from_bytes(data[3:9], byteorder='big', signed=False)
+        detail = int.from_bytes(data[9:13], byteorder='big', signed=False)
+        anomaly_count = int.from_bytes(data[13:17], byteorder='big', signed=False)
+        return AnomalyEvent(motor, type, tick_count / probe_info.time_ticks_per_sec(), detail,
+                            anomaly_count)
@@ -21,7 +21,13 @@ class CaptureSignal:
             logger.error(f"No capture signal packets.")
             return None
 
-        divider = int.from_bytes(packets[0][4:5], byteorder='big', signed=False)
+        # Format 0x41 is of a zoom lane and has a lane byte and a wider divider.
+        if packets[0][0] == 0x41:
+            divider = int.from_bytes(packets[0][5:7], byteorder='big', signed=False)
+            header_len = 11
+        else:
+            divider = int.from_bytes(packets[0][4:5], byteorder='big', signed=False)
+            header_len = 9
         time_step_secs = divider / probe_info.time_ticks_per_sec()
 
         # Decode data points.
@@ -31,10 +37,11 @@ class CaptureSignal:
         for packet in packets:
             # NOTE: For now we ignore the packet sequence number and offset field and
             # assume that the packets match.
-            n = int.from_bytes(packet[5:7], byteorder='big', signed=False)
+            n = int.from_bytes(packet[header_len - 4:header_len - 2], byteorder='big',
+                               signed=False)
             for i in range(n):
-                # 9 is the byte Offset of the a/b pair in the packet.
-                base = 9 + (i * 4)
+                # header_len is the byte Offset of the a/b pair in the packet.
+                base = header_len + (i * 4)
                 ticks_a = int.from_bytes(packet[base:base + 2], byteorder='big', signed=True)
                 ticks_b = int.from_bytes(packet[base + 2:base + 4], byteorder='big', signed=True)
                 time_sec = len(amps_a_list) * time_step_secs
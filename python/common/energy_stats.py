@@ -0,0 +1,60 @@
+# Represents a fetched coil energy and RMS current data of a motor.
+
+from __future__ import annotations
+import logging
+from typing import List
+from common.probe_info import ProbeInfo
+
+logger = logging.getLogger(__name__)
+
+
+class EnergyStats:
+
+    def __init__(self, motor: int, secs: float, coil1_i2t: float, coil2_i2t: float,
+                 bucket_width: float, rms_currents: List[float]):
+        # Motor index.
+        self.motor = motor
+        # Time since the last data reset, in secs.
+        self.secs = secs
+        # I^2*t of each coil since the last data reset, in A^2*sec.
+        self.coil1_i2t = coil1_i2t
+        self.coil2_i2t = coil2_i2t
+        # Speed range width of the RMS current buckets, in units per sec.
+        self.bucket_width = bucket_width
+        # RMS coil current of each speed range, in amps, averaged over the
+        # two coils. Zero for speed ranges with no steps.
+        self.rms_currents = rms_currents
+
+    def __str__(self) -> str:
+        return (f"motor {self.motor}, {self.secs:.1f} secs, "
+                f"I2t {self.coil1_i2t:.2f}/{self.coil2_i2t:.2f} A2s")
+
+    @classmethod
+    def decode(cls, data: bytearray, probe_info: ProbeInfo,
+               steps_per_unit: float) -> (EnergyStats | None):
+        format = data[0]
+        if format != 0x70:
+            logger.error(f"Unexpected energy format {format}.")
+            return None
+
+        ticks_per_amp = probe_info.current_ticks_per_amp()
+        ticks_per_sec = probe_info.time_ticks_per_sec()
+        motor = data[1]
+        ticks = int.from_bytes(data[2:8], byteorder='big', signed=False)
+        sq_currents1 = int.from_bytes(data[8:16], byteorder='big', signed=False)
+        sq_currents2 = int.from_bytes(data[16:24], byteorder='big', signed=False)
+        i2t_scale = 1 / (ticks_per_amp * ticks_per_amp * ticks_per_sec)
+
+        bucket_count = data[24]
+        rms_currents = []
+        for i in range(bucket_count):
+            offset = 25 + i * 2
+            # RMS value has 4 fraction bits.
+            rms_ticks = int.from_bytes(data[offset:offset + 2], byteorder='big',
+                                       signed=False) / 16
+            rms_currents.append(rms_ticks / ticks_per_amp)
+
+        return EnergyStats(motor, ticks / ticks_per_sec, sq_currents1 * i2t_scale,
+                           sq_currents2 * i2t_scale,
+                           probe_info.histogram_bucket_steps_per_sec() / steps_per_unit,
+                           rms_currents)
@@ -0,0 +1,51 @@
+# Represents fetched velocity and acceleration of a motor.
+
+from __future__ import annotations
+import logging
+from typing import List, Tuple
+from common.probe_info import ProbeInfo
+
+logger = logging.getLogger(__name__)
+
+
+class MotionStats:
+
+    def __init__(self, motor: int, steps_per_sec: float, steps_per_sec2: float,
+                 acceleration_buckets: List[Tuple[int, float]]):
+        # Motor index.
+        self.motor = motor
+        # Velocity and acceleration estimates, in full steps. Zero if not moving.
+        self.steps_per_sec = steps_per_sec
+        self.steps_per_sec2 = steps_per_sec2
+        # Time in moves since the last data reset by absolute acceleration. A
+        # list of (min steps/sec^2, fraction of time [0, 1]) tuples. The last
+        # bucket is open ended.
+        self.acceleration_buckets = acceleration_buckets
+
+    def __str__(self) -> str:
+        return (f"motor {self.motor}, {self.steps_per_sec:.1f} steps/s, "
+                f"{self.steps_per_sec2:.0f} steps/s^2")
+
+    @classmethod
+    def decode(cls, data: bytearray, probe_info: ProbeInfo) -> (MotionStats | None):
+        format = data[0]
+        if format != 0xe0:
+            logger.error(f"Unexpected motion stats format {format}.")
+            return None
+
+        motor = data[1]
+        # Velocity and acceleration have 4 fraction bits.
+        velocity = int.from_bytes(data[2:6], byteorder='big', signed=True) / 16
+        acceleration = int.from_bytes(data[6:10], byteorder='big', signed=True) / 16
+        bucket_steps_per_sec2 = int.from_bytes(data[10:12], byteorder='big', signed=False)
+        num_buckets = data[12]
+        if len(data) != 13 + num_buckets * 2:
+            logger.error(f"Unexpected motion stats length {len(data)}.")
+            return None
+
+        acceleration_buckets = []
+        for i in range(num_buckets):
+            offset = 13 + i * 2
+            permils = int.from_bytes(data[offset:offset + 2], byteorder='big', signed=False)
+            acceleration_buckets.append((i * bucket_steps_per_sec2, permils / 1000))
+        return MotionStats(motor, velocity, acceleration, acceleration_buckets)
@@ -0,0 +1,92 @@
+# Represents a notified packet of the high rate position stream.
+
+from __future__ import annotations
+import logging
+from typing import List, Tuple
+from common.probe_info import ProbeInfo
+
+logger = logging.getLogger(__name__)
+
+# Fraction bits of the encoded positions. See kPositionFractionBits in
+# the firmware.
+POSITION_FRACTION_BITS = 8
+
+HEADER_LEN = 17
+
+
+class PositionStreamPacket:
+
+    def __init__(self, motor: int, seq_number: int, points: List[Tuple[float, float]]):
+        self.motor = motor
+        # Wraps around at 2^16. A gap indicates a lost packet.
+        self.seq_number = seq_number
+        # List of (time secs, position steps) tuples, at the stream rate.
+        self.points = points
+
+    def __str__(self) -> str:
+        if not self.points:
+            return f"motor {self.motor}, seq {self.seq_number}, no points"
+        t0, p0 = self.points[0]
+        t1, p1 = self.points[-1]
+        return (f"motor {self.motor}, seq {self.seq_number}, {len(self.points)} points, "
+                f"{t0:.4f}s..{t1:.4f}s, {p0:.2f}..{p1:.2f} steps")
+
+    @classmethod
+    def decode(cls, data: bytearray, probe_info: ProbeInfo) -> (PositionStreamPacket | None):
+        format = data[0]
+        if format != 0xf1:
+            logger.error(f"Unexpected position stream format {format}.")
+            return None
+
+        motor = data[1]
+        seq_number = int.from_bytes(data[2:4], byteorder='big', signed=False)
+        tick_count = int.from_bytes(data[4:10], byteorder='big', signed=False)
+        divider = int.from_bytes(data[10:12], byteorder='big', signed=False)
+        count = data[12]
+        position = int.from_bytes(data[13:17], byteorder='big', signed=True)
+
+        reader = _BitReader(data[HEADER_LEN:])
+        positions = [position]
+        delta = 0
+        for _ in range(1, count):
+            delta += reader.read_delta_of_delta()
+            position += delta
+            positions.append(position)
+
+        ticks_per_sec = probe_info.time_ticks_per_sec()
+        scale = 1 << POSITION_FRACTION_BITS
+        points = [((tick_count + i * divider) / ticks_per_sec, p / scale)
+                  for i, p in enumerate(positions)]
+        return PositionStreamPacket(motor, seq_number, points)
+
+
+# Reads bit fields, most significant bit first.
+class _BitReader:
+
+    def __init__(self, data: bytearray):
+        self.__value = int.from_bytes(data, byteorder='big', signed=False)
+        self.__bits_left = len(data) * 8
+
+    def read_bits(self, num_bits: int) -> int:
+        if num_bits > self.__bits_left:
+            raise ValueError("Position stream packet is truncated.")
+        self.__bits_left -= num_bits
+        return (self.__value >> self.__bits_left) & ((1 << num_bits) - 1)
+
+    def read_signed(self, num_bits: int) -> int:
+        value = self.read_bits(num_bits)
+        if value & (1 << (num_bits - 1)):
+            value -= 1 << num_bits
+        return value
+
+    # See append_delta_of_delta() in the firmware.
+    def read_delta_of_delta(self) -> int:
+        if not self.read_bits(1):
+            return 0
+        if not self.read_bits(1):
+            return self.read_signed(7)
+        if not self.read_bits(1):
+            return self.read_signed(12)
+        if not self.read_bits(1):
+            return self.read_signed(20)
+        return self.read_signed(32)
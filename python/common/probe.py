@@ -4,18 +4,30 @@
 
 from __future__ import annotations
 
+import asyncio
 import logging
-from typing import Callable, Optional
+from typing import Callable, List, Optional, Tuple
 
 from bleak import BleakClient, BleakScanner
 from bleak.backends.service import BleakGATTCharacteristic, BleakGATTService
 
 from common import ble_util
 
+from common.anomaly_event import AnomalyEvent
 from common.current_histogram import CurrentHistogram
 from common.distance_histogram import DistanceHistogram
+from common.energy_stats import EnergyStats
+from common.motion_stats import MotionStats
+from common.position_stream import PositionStreamPacket
 from common.probe_info import ProbeInfo
 from common.probe_state import ProbeState
+from common.quadrature_errors import QuadratureErrors
+from common.recording import RecordingPage, RecordingStatus, decode_page_chunk
+from common.retractions import Retractions
+from common.reversal_stats import ReversalStats
+from common.rollups import Rollup, RollupsChunk
+from common.sensor_status import SensorStatus
+from common.spectrum import Spectrum
 from common.time_histogram import TimeHistogram
 
 logger = logging.getLogger(__name__)
@@ -34,6 +46,19 @@ class Probe:
         self.__stepper_distance_histogram_chrc = None
         self.__stepper_command_chrc = None
         self.__capture_signal_chrc = None
+        self.__long_capture_chrc = None
+        self.__sensor_status_chrc = None
+        self.__energy_chrc = None
+        self.__spectrum_chrc = None
+        self.__resonance_chrc = None
+        self.__anomalies_chrc = None
+        self.__quadrature_errors_chrc = None
+        self.__retractions_chrc = None
+        self.__reversals_chrc = None
+        self.__motion_chrc = None
+        self.__position_stream_chrc = None
+        self.__rollups_chrc = None
+        self.__recording_chrc = None
 
     def __str__(self) -> str:
         return self.__client.address
@@ -210,6 +235,58 @@ class Probe:
         if not capture_signal_chrc:
             return False
 
+        # Get long capture characteristic. Optional, not available in
+        # older firmware versions and builds that disable it.
+        long_capture_chrc = stepper_service.get_characteristic("ff08")
+
+        # Get sensor status characteristic. Optional, not available in
+        # older firmware versions.
+        sensor_status_chrc = stepper_service.get_characteristic("ff09")
+
+        # Get energy characteristic. Optional, not available in older
+        # firmware versions.
+        energy_chrc = stepper_service.get_characteristic("ff0a")
+
+        # Get spectrum characteristic. Optional, not available in older
+        # firmware versions.
+        spectrum_chrc = stepper_service.get_characteristic("ff0b")
+
+        # Get resonance characteristic. Optional, not available in older
+        # firmware versions.
+        resonance_chrc = stepper_service.get_characteristic("ff0c")
+
+        # Get anomalies characteristic. Optional, not available in older
+        # firmware versions.
+        anomalies_chrc = stepper_service.get_characteristic("ff0d")
+
+        # Get quadrature errors characteristic. Optional, not available in
+        # older firmware versions.
+        quadrature_errors_chrc = stepper_service.get_characteristic("ff0e")
+
+        # Get retractions characteristic. Optional, not available in older
+        # firmware versions.
+        retractions_chrc = stepper_service.get_characteristic("ff0f")
+
+        # Get reversals characteristic. Optional, not available in older
+        # firmware versions.
+        reversals_chrc = stepper_service.get_characteristic("ff10")
+
+        # Get motion characteristic. Optional, not available in older
+        # firmware versions.
+        motion_chrc = stepper_service.get_characteristic("ff11")
+
+        # Get position stream characteristic. Optional, not available in
+        # older firmware versions.
+        position_stream_chrc = stepper_service.get_characteristic("ff12")
+
+        # Get rollups characteristic. Optional, not available in older
+        # firmware versions.
+        rollups_chrc = stepper_service.get_characteristic("ff13")
+
+        # Get recording characteristic. Optional, not available in older
+        # firmware versions.
+        recording_chrc = stepper_service.get_characteristic("ff14")
+
         # Set this object.
         self.__probe_info = ProbeInfo.decode(probe_info_bytes, model_number_bytes.decode(),
                                              manufacturer_bytes.decode())
@@ -219,6 +296,19 @@ class Probe:
         self.__stepper_distance_histogram_chrc = stepper_distance_histogram_chrc
         self.__stepper_command_chrc = stepper_command_chrc
         self.__capture_signal_chrc = capture_signal_chrc
+        self.__long_capture_chrc = long_capture_chrc
+        self.__sensor_status_chrc = sensor_status_chrc
+        self.__energy_chrc = energy_chrc
+        self.__spectrum_chrc = spectrum_chrc
+        self.__resonance_chrc = resonance_chrc
+        self.__anomalies_chrc = anomalies_chrc
+        self.__quadrature_errors_chrc = quadrature_errors_chrc
+        self.__retractions_chrc = retractions_chrc
+        self.__reversals_chrc = reversals_chrc
+        self.__motion_chrc = motion_chrc
+        self.__position_stream_chrc = position_stream_chrc
+        self.__rollups_chrc = rollups_chrc
+        self.__recording_chrc = recording_chrc
 
         logger.info(f"Connected to {self.address()}.")
         return True
@@ -258,6 +348,262 @@ class Probe:
         val_bytes = await self.__client.read_gatt_char(self.__stepper_distance_histogram_chrc)
         return DistanceHistogram.decode(val_bytes, self.__probe_info, steps_per_unit)
 
+    # Returns the noise floor, energized limits and zero offsets of the
+    # selected motor.
+    async def read_sensor_status(self) -> Optional[SensorStatus]:
+        if not self.is_connected():
+            logger.error(f"Not connected (read_sensor_status).")
+            return None
+        if not self.__sensor_status_chrc:
+            logger.error(f"Sensor status not supported by the device.")
+            return None
+        val_bytes = await self.__client.read_gatt_char(self.__sensor_status_chrc)
+        return SensorStatus.decode(val_bytes, self.__probe_info)
+
+    # Returns the quadrature error counters of the selected motor by error
+    # class, and its newest error records.
+    async def read_quadrature_errors(self) -> Optional[QuadratureErrors]:
+        if not self.is_connected():
+            logger.error(f"Not connected (read_quadrature_errors).")
+            return None
+        if not self.__quadrature_errors_chrc:
+            logger.error(f"Quadrature errors not supported by the device.")
+            return None
+        val_bytes = await self.__client.read_gatt_char(self.__quadrature_errors_chrc)
+        return QuadratureErrors.decode(val_bytes, self.__probe_info)
+
+    # Returns the retraction episodes of the selected motor since the last
+    # data reset, by retraction distance, and its latest episodes.
+    async def read_retractions(self) -> Optional[Retractions]:
+        if not self.is_connected():
+            logger.error(f"Not connected (read_retractions).")
+            return None
+        if not self.__retractions_chrc:
+            logger.error(f"Retractions not supported by the device.")
+            return None
+        val_bytes = await self.__client.read_gatt_char(self.__retractions_chrc)
+        return Retractions.decode(val_bytes, self.__probe_info)
+
+    # Returns the direction reversal counters, rate and dwell histogram of
+    # the selected motor.
+    async def read_reversal_stats(self) -> Optional[ReversalStats]:
+        if not self.is_connected():
+            logger.error(f"Not connected (read_reversal_stats).")
+            return None
+        if not self.__reversals_chrc:
+            logger.error(f"Reversal stats not supported by the device.")
+            return None
+        val_bytes = await self.__client.read_gatt_char(self.__reversals_chrc)
+        return ReversalStats.decode(val_bytes, self.__probe_info)
+
+    # Returns the velocity and acceleration estimates of the selected motor,
+    # and its time in moves by acceleration. Unlike differencing the steps
+    # of state notifications, these are updated on each step.
+    async def read_motion_stats(self) -> Optional[MotionStats]:
+        if not self.is_connected():
+            logger.error(f"Not connected (read_motion_stats).")
+            return None
+        if not self.__motion_chrc:
+            logger.error(f"Motion stats not supported by the device.")
+            return None
+        val_bytes = await self.__client.read_gatt_char(self.__motion_chrc)
+        return MotionStats.decode(val_bytes, self.__probe_info)
+
+    # Returns the completed rollups of the selected motor in the given tier,
+    # see RollupsChunk, oldest first, starting at first_period. To catch
+    # up after a reconnection, pass the period after the last one read.
+    # The device keeps the 60 latest periods of each tier.
+    async def read_rollups(self, tier: int, first_period: int = 0) -> Optional[List[Rollup]]:
+        if not self.is_connected():
+            logger.error(f"Not connected (read_rollups).")
+            return None
+        if not self.__rollups_chrc:
+            logger.error(f"Rollups not supported by the device.")
+            return None
+        cmd_bytes = bytearray([0x17, tier])
+        cmd_bytes += int(first_period).to_bytes(4, byteorder='big', signed=False)
+        await self.__client.write_gatt_char(self.__stepper_command_chrc, cmd_bytes)
+        result = []
+        while True:
+            val_bytes = await self.__client.read_gatt_char(self.__rollups_chrc)
+            chunk = RollupsChunk.decode(val_bytes, self.__probe_info)
+            if not chunk:
+                return None
+            if not chunk.rollups:
+                return result
+            result.extend(chunk.rollups)
+
+    # Returns the status of the offline recording.
+    async def read_recording_status(self) -> Optional[RecordingStatus]:
+        if not self.is_connected():
+            logger.error(f"Not connected (read_recording_status).")
+            return None
+        if not self.__recording_chrc:
+            logger.error(f"Recording not supported by the device.")
+            return None
+        val_bytes = await self.__client.read_gatt_char(self.__recording_chrc)
+        return RecordingStatus.decode(val_bytes)
+
+    # Returns the seq of the recorded page to download from to cover the
+    # given device time of a session, in millis, see RecordingRecord. The
+    # device seeks the page and starts notifying it, and the download is
+    # stopped at its first chunk. Returns None if there are no pages or
+    # on a timeout.
+    async def find_recording_page(self, session: int, millis: int,
+                                  timeout_secs: float = 3.0) -> Optional[int]:
+        status = await self.read_recording_status()
+        if not status or status.tail_seq >= status.head_seq:
+            return None
+        found = asyncio.get_running_loop().create_future()
+
+        async def callback_handler(sender, data):
+            chunk = decode_page_chunk(data)
+            if chunk and not found.done():
+                found.set_result(chunk[0])
+
+        await self.__client.start_notify(self.__recording_chrc, callback_handler)
+        try:
+            cmd_bytes = bytearray([0x1a])
+            cmd_bytes += int(session).to_bytes(2, byteorder='big', signed=False)
+            cmd_bytes += int(millis & 0xffffffff).to_bytes(4, byteorder='big', signed=False)
+            cmd_bytes += int(1).to_bytes(2, byteorder='big', signed=False)
+            await self.__client.write_gatt_char(self.__stepper_command_chrc, cmd_bytes)
+            try:
+                return await asyncio.wait_for(found, timeout_secs)
+            except asyncio.TimeoutError:
+                logger.error(f"Recording page seek timed out.")
+                return None
+        finally:
+            cmd_bytes = bytearray([0x1a, 0, 0, 0, 0, 0, 0])
+            await self.__client.write_gatt_char(self.__stepper_command_chrc, cmd_bytes)
+            await self.__client.stop_notify(self.__recording_chrc)
+
+    # Downloads up to count recorded pages starting at first_seq, by
+    # default all of them, see RecordingStatus. Pages that are torn or
+    # were overwritten meanwhile are skipped. Returns the pages in seq
+    # order. Downloads are at tens of KB/sec, so a full log takes a
+    # while.
+    async def download_recording(self, first_seq: Optional[int] = None,
+                                 count: Optional[int] = None,
+                                 idle_timeout_secs: float = 3.0) -> Optional[List[RecordingPage]]:
+        status = await self.read_recording_status()
+        if not status:
+            return None
+        start = status.tail_seq if first_seq is None else max(first_seq, status.tail_seq)
+        end = status.head_seq if count is None else min(start + count, status.head_seq)
+        if start >= end:
+            return []
+
+        # Reassembles the pages from their notified chunks.
+        page_bytes = {}
+        pending = set(range(start, end))
+        progress = asyncio.Event()
+
+        async def callback_handler(sender, data):
+            chunk = decode_page_chunk(data)
+            if not chunk:
+                return
+            seq, offset, chunk_bytes = chunk
+            if seq not in pending:
+                return
+            buffer = page_bytes.setdefault(seq, bytearray())
+            if offset > len(buffer):
+                # Missed a chunk, wait for a resend of the page.
+                buffer.clear()
+                return
+            buffer[offset:offset + len(chunk_bytes)] = chunk_bytes
+            if RecordingPage.is_complete(buffer):
+                pending.discard(seq)
+            progress.set()
+
+        await self.__client.start_notify(self.__recording_chrc, callback_handler)
+        try:
+            # Pages are sent in at most 64K chunks.
+            next_seq = start
+            while next_seq < end:
+                n = min(end - next_seq, 0xffff)
+                cmd_bytes = bytearray([0x1a])
+                cmd_bytes += int(next_seq).to_bytes(4, byteorder='big', signed=False)
+                cmd_bytes += int(n).to_bytes(2, byteorder='big', signed=False)
+                await self.__client.write_gatt_char(self.__stepper_command_chrc, cmd_bytes)
+                batch = set(range(next_seq, next_seq + n))
+                while pending & batch:
+                    progress.clear()
+                    try:
+                        await asyncio.wait_for(progress.wait(), idle_timeout_secs)
+                    except asyncio.TimeoutError:
+                        # The rest of the batch was skipped by the device.
+                        logger.warning(f"Recording download: {len(pending & batch)} pages "
+                                       f"not received.")
+                        break
+                next_seq += n
+        finally:
+            # Stop the download, if still in progress.
+            cmd_bytes = bytearray([0x1a, 0, 0, 0, 0, 0, 0])
+            await self.__client.write_gatt_char(self.__stepper_command_chrc, cmd_bytes)
+            await self.__client.stop_notify(self.__recording_chrc)
+
+        result = []
+        for seq in sorted(page_bytes):
+            if seq in pending:
+                continue
+            page = RecordingPage.decode(page_bytes[seq], self.__probe_info)
+            if page:
+                result.append(page)
+        return result
+
+    # Returns the coil energy of the selected motor since the last data
+    # reset, and its RMS coil current by speed range.
+    async def read_energy_stats(self, steps_per_unit=1.0) -> Optional[EnergyStats]:
+        if not self.is_connected():
+            logger.error(f"Not connected (read_energy_stats).")
+            return None
+        if not self.__energy_chrc:
+            logger.error(f"Energy stats not supported by the device.")
+            return None
+        val_bytes = await self.__client.read_gatt_char(self.__energy_chrc)
+        return EnergyStats.decode(val_bytes, self.__probe_info, steps_per_unit)
+
+    # Returns the coil current spectrum of the selected lane of the last
+    # capture snapshot. Call write_command_capture_signal_snapshot() first
+    # to take a new snapshot. Returns None if no snapshot is available.
+    async def read_spectrum(self) -> Optional[Spectrum]:
+        if not self.is_connected():
+            logger.error(f"Not connected (read_spectrum).")
+            return None
+        if not self.__spectrum_chrc:
+            logger.error(f"Spectrum not supported by the device.")
+            return None
+        val_bytes = await self.__client.read_gatt_char(self.__spectrum_chrc)
+        return Spectrum.decode(val_bytes, self.__probe_info)
+
+    # Returns the resonance monitoring bands of the capture motor as a
+    # list of (frequency Hz, amplitude amps) tuples, and the block
+    # sequence number. Refreshed at the state rate. Amplitude is the RMS
+    # of the amplitudes of the two coils.
+    async def read_resonance(self) -> Optional[Tuple[int, List[Tuple[int, float]]]]:
+        if not self.is_connected():
+            logger.error(f"Not connected (read_resonance).")
+            return None
+        if not self.__resonance_chrc:
+            logger.error(f"Resonance monitoring not supported by the device.")
+            return None
+        data = await self.__client.read_gatt_char(self.__resonance_chrc)
+        if data[0] != 0x90:
+            logger.error(f"Unexpected resonance format {data[0]}.")
+            return None
+        seq_number = int.from_bytes(data[2:4], byteorder='big', signed=False)
+        ticks_per_amp = self.__probe_info.current_ticks_per_amp()
+        bands = []
+        for i in range(data[4]):
+            offset = 5 + i * 4
+            frequency = int.from_bytes(data[offset:offset + 2], byteorder='big', signed=False)
+            # Amplitude has 4 fraction bits.
+            amplitude = int.from_bytes(data[offset + 2:offset + 4], byteorder='big',
+                                       signed=False) / 16
+            bands.append((frequency, amplitude / ticks_per_amp))
+        return (seq_number, bands)
+
     async def write_command_reset_data(self):
         if not self.is_connected():
             logger.error(f"Not connected (write_command_reset_data).")
@@ -271,12 +617,18 @@ class Probe:
             return
         await self.__client.write_gatt_char(self.__stepper_command_chrc, bytearray([0x02]))
 
-    async def write_command_set_capture_divider(self, divider):
+    # Capture decimation modes. See CaptureDecimation in the firmware.
+    DECIMATION_DROP = 0
+    DECIMATION_BOXCAR = 1
+    DECIMATION_CIC2 = 2
+
+    async def write_command_set_capture_divider(self, divider, decimation=DECIMATION_DROP):
         if not self.is_connected():
             logger.error(f"Not connected (write_command_set_capture_divider).")
             return
         arg = max(0, min(255, int(divider)))
-        await self.__client.write_gatt_char(self.__stepper_command_chrc, bytearray([0x03, arg]))
+        await self.__client.write_gatt_char(self.__stepper_command_chrc,
+                                            bytearray([0x03, arg, decimation]))
 
     # Changes forward/backward direction interpretation. The new direction
     # is persisted on the device.
@@ -287,6 +639,95 @@ class Probe:
         # print("Toggle direction command", flush=True)
         await self.__client.write_gatt_char(self.__stepper_command_chrc, bytearray([0x04]))
 
+    # Signal filters of the ADC readings. See analyzer::SignalFilter.
+    FILTER_BYPASS = 0
+    FILTER_LOW_PASS_LIGHT = 1
+    FILTER_LOW_PASS = 2
+    FILTER_LOW_PASS_HEAVY = 3
+    FILTER_BIQUAD = 4
+    FILTER_MEDIAN3 = 5
+
+    # Selects the signal filter of all motors. The new filter is persisted
+    # on the device.
+    async def write_command_set_signal_filter(self, signal_filter):
+        if not self.is_connected():
+            logger.error(f"Not connected (write_command_set_signal_filter).")
+            return
+        await self.__client.write_gatt_char(self.__stepper_command_chrc,
+                                            bytearray([0x0f, signal_filter]))
+
+    # Coil current metrics of the current histogram and the magnitude
+    # capture trigger. See analyzer::CurrentMetric.
+    CURRENT_METRIC_MAX_COIL = 0
+    CURRENT_METRIC_MAGNITUDE = 1
+
+    # Selects the coil current metric of all motors. The new metric is
+    # persisted on the device.
+    async def write_command_set_current_metric(self, current_metric):
+        if not self.is_connected():
+            logger.error(f"Not connected (write_command_set_current_metric).")
+            return
+        await self.__client.write_gatt_char(self.__stepper_command_chrc,
+                                            bytearray([0x14, current_metric]))
+
+    # Sets the gains of the two channels of the selected motor, e.g. 1.02 and
+    # 0.98, to balance the two sensors. Allowed range is [0.5, 2.0]. The new
+    # gains are persisted on the device.
+    async def write_command_set_gains(self, gain1, gain2):
+        if not self.is_connected():
+            logger.error(f"Not connected (write_command_set_gains).")
+            return
+        cmd = bytearray([0x12])
+        for gain in [gain1, gain2]:
+            cmd.extend(max(0, min(0xffff, round(gain * 4096))).to_bytes(2, 'big'))
+        await self.__client.write_gatt_char(self.__stepper_command_chrc, cmd)
+
+    # Sensor profiles. See acq_consts::kSensorProfiles.
+    SENSOR_PROFILE_CC6920BSO5A = 0
+    SENSOR_PROFILE_TMCS1108A4B = 1
+    SENSOR_PROFILE_BY_HARDWARE = 0xff
+
+    # Overrides the current sensor type of the hardware config. The new
+    # profile is persisted on the device. The probe info with the new ADC
+    # ticks per amp is read on the next connection.
+    async def write_command_set_sensor_profile(self, profile):
+        if not self.is_connected():
+            logger.error(f"Not connected (write_command_set_sensor_profile).")
+            return
+        await self.__client.write_gatt_char(self.__stepper_command_chrc,
+                                            bytearray([0x13, profile]))
+
+    # Number of entries in an ADC linearity table, one per 12 bits ADC code.
+    ADC_LINEARITY_TABLE_SIZE = 4096
+
+    # Entries per table upload command. Fits in the default 247 bytes MTU.
+    ADC_LINEARITY_CHUNK_SIZE = 100
+
+    # Uploads and applies an ADC linearity table. Entry i is the corrected
+    # value of ADC code i. The table is persisted on the device. Zero
+    # calibration should be repeated after changing the table.
+    async def write_command_set_adc_linearity_table(self, table):
+        if not self.is_connected():
+            logger.error(f"Not connected (write_command_set_adc_linearity_table).")
+            return
+        assert len(table) == self.ADC_LINEARITY_TABLE_SIZE
+        for offset in range(0, len(table), self.ADC_LINEARITY_CHUNK_SIZE):
+            chunk = table[offset:offset + self.ADC_LINEARITY_CHUNK_SIZE]
+            cmd = bytearray([0x10])
+            cmd.extend(offset.to_bytes(2, 'big'))
+            for value in chunk:
+                cmd.extend(int(value).to_bytes(2, 'big'))
+            await self.__client.write_gatt_char(self.__stepper_command_chrc, cmd, response=True)
+        await self.__client.write_gatt_char(self.__stepper_command_chrc, bytearray([0x11, 1]),
+                                            response=True)
+
+    # Restores the identity ADC linearity table. Persisted on the device.
+    async def write_command_clear_adc_linearity_table(self):
+        if not self.is_connected():
+            logger.error(f"Not connected (write_command_clear_adc_linearity_table).")
+            return
+        await self.__client.write_gatt_char(self.__stepper_command_chrc, bytearray([0x11, 0]))
+
     # Should be done with steppers disconnected or turned off. New zero calibration
     # is persisted on the device.
     async def write_command_zero_calibration(self):
@@ -315,12 +756,164 @@ class Probe:
         # print(f"cmd_bytes: {cmd_bytes}")
         await self.__client.write_gatt_char(self.__stepper_command_chrc, cmd_bytes, response=response)
 
+    # Capture trigger modes. See CaptureTriggerMode in the firmware.
+    TRIGGER_LEVEL = 0
+    TRIGGER_QUADRATURE_ERROR = 1
+    TRIGGER_DIRECTION_REVERSAL = 2
+    TRIGGER_ENERGIZED = 3
+    TRIGGER_NON_ENERGIZED = 4
+    TRIGGER_STEP_PERIOD = 5
+
+    # Sets the signal capture trigger. The step ticks band is used only
+    # by TRIGGER_STEP_PERIOD. Event triggers wait indefinitely for their
+    # event so the capture sequence number changes only when it happens.
+    async def write_command_set_capture_trigger(self, mode, min_step_ticks=0,
+                                                max_step_ticks=0xffffffff):
+        if not self.is_connected():
+            logger.error(f"Not connected (write_command_set_capture_trigger).")
+            return
+        cmd_bytes = bytearray([0x08, mode])
+        if mode == Probe.TRIGGER_STEP_PERIOD:
+            cmd_bytes += int(min_step_ticks).to_bytes(4, byteorder='big', signed=False)
+            cmd_bytes += int(max_step_ticks).to_bytes(4, byteorder='big', signed=False)
+        await self.__client.write_gatt_char(self.__stepper_command_chrc, cmd_bytes)
+
+    # Capture level trigger channels and slopes.
+    TRIGGER_CHANNEL_V1 = 0
+    TRIGGER_CHANNEL_V2 = 1
+    TRIGGER_CHANNEL_MAGNITUDE = 2
+    TRIGGER_SLOPE_RISING = 0
+    TRIGGER_SLOPE_FALLING = 1
+
+    # Sets the level trigger parameters and the trigger position. Level and
+    # hysteresis are in ADC ticks. Does not change the trigger mode.
+    async def write_command_set_capture_level_trigger(self, level, hysteresis, channel,
+                                                      slope, pre_trigger_percent=50):
+        if not self.is_connected():
+            logger.error(f"Not connected (write_command_set_capture_level_trigger).")
+            return
+        cmd_bytes = bytearray([0x09])
+        cmd_bytes += int(level).to_bytes(2, byteorder='big', signed=True)
+        cmd_bytes += int(hysteresis).to_bytes(2, byteorder='big', signed=False)
+        cmd_bytes += bytearray([channel, slope, pre_trigger_percent])
+        await self.__client.write_gatt_char(self.__stepper_command_chrc, cmd_bytes)
+
+    # Sets the number of signal capture zoom out lanes, 0 to 2. Each lane
+    # records at 8 times the divider of the previous one, with the same
+    # trigger.
+    async def write_command_set_capture_zoom_lanes(self, zoom_lanes):
+        if not self.is_connected():
+            logger.error(f"Not connected (write_command_set_capture_zoom_lanes).")
+            return
+        await self.__client.write_gatt_char(self.__stepper_command_chrc,
+                                            bytearray([0x0c, zoom_lanes]))
+
+    # Selects the lane of the last signal capture snapshot that the following
+    # read_next_capture_signal_packet() calls return, without taking a new
+    # snapshot. Lane 0 is the capture buffer.
+    async def write_command_select_capture_lane(self, lane):
+        if not self.is_connected():
+            logger.error(f"Not connected (write_command_select_capture_lane).")
+            return
+        await self.__client.write_gatt_char(self.__stepper_command_chrc, bytearray([0x0d, lane]))
+
     async def read_next_capture_signal_packet(self) -> Optional[bytearray]:
         if not self.is_connected():
             logger.error(f"Not connected (read_capture_signal_packet).")
             return None
         return await self.__client.read_gatt_char(self.__capture_signal_chrc)
 
+    # Long capture states. See LongCaptureState in the firmware.
+    LONG_CAPTURE_IDLE = 0
+    LONG_CAPTURE_PRE_FILL = 1
+    LONG_CAPTURE_PRE_TRIGGER = 2
+    LONG_CAPTURE_POST_TRIGGER = 3
+    LONG_CAPTURE_FROZEN = 4
+
+    # Selects the motor of multi motor devices. Applies to the state and histogram
+    # reads, the toggle direction command and the signal captures. State
+    # notifications include all motors, see ProbeState.motor.
+    async def write_command_select_motor(self, motor):
+        if not self.is_connected():
+            logger.error(f"Not connected (write_command_select_motor).")
+            return
+        await self.__client.write_gatt_char(self.__stepper_command_chrc, bytearray([0x0e, motor]))
+
+    # Clears and arms the long record capture. It freezes after the next
+    # trigger of the signal capture. Also resets the read window to the
+    # entire capture.
+    async def write_command_arm_long_capture(self, divider=1):
+        if not self.is_connected():
+            logger.error(f"Not connected (write_command_arm_long_capture).")
+            return
+        arg = max(1, min(255, int(divider)))
+        await self.__client.write_gatt_char(self.__stepper_command_chrc, bytearray([0x0a, arg]))
+
+    # Sets the range of long capture items returned by the following
+    # read_next_long_capture_packet() calls.
+    async def write_command_set_long_capture_window(self, offset, count):
+        if not self.is_connected():
+            logger.error(f"Not connected (write_command_set_long_capture_window).")
+            return
+        cmd_bytes = bytearray([0x0b])
+        cmd_bytes += int(offset).to_bytes(2, byteorder='big', signed=False)
+        cmd_bytes += int(count).to_bytes(2, byteorder='big', signed=False)
+        await self.__client.write_gatt_char(self.__stepper_command_chrc, cmd_bytes)
+
+    # Returns the next chunk of the long capture read window. Packet is
+    # format (0x50), state, seq (uint16), divider, size (uint16),
+    # trigger index (uint16), offset (uint16), count (uint16) and then
+    # count pairs of int16 values.
+    async def read_next_long_capture_packet(self) -> Optional[bytearray]:
+        if not self.is_connected():
+            logger.error(f"Not connected (read_next_long_capture_packet).")
+            return None
+        if not self.__long_capture_chrc:
+            logger.error(f"Long capture not supported by the device.")
+            return None
+        return await self.__client.read_gatt_char(self.__long_capture_chrc)
+
+    # Sets the resonance monitoring band frequencies of the capture motor,
+    # up to 4 frequencies in Hz. An empty list disables the monitoring.
+    async def write_command_set_resonance_bands(self, frequencies):
+        if not self.is_connected():
+            logger.error(f"Not connected (write_command_set_resonance_bands).")
+            return
+        cmd_bytes = bytearray([0x15])
+        for frequency in frequencies:
+            cmd_bytes += int(frequency).to_bytes(2, byteorder='big', signed=False)
+        await self.__client.write_gatt_char(self.__stepper_command_chrc, cmd_bytes)
+
+    # Sets the rate of the capture motor position stream, in samples per
+    # sec. Allowed range is [10, 2000], and 0 stops the stream. The stream
+    # is also stopped on disconnection.
+    async def write_command_set_position_stream_rate(self, rate):
+        if not self.is_connected():
+            logger.error(f"Not connected (write_command_set_position_stream_rate).")
+            return
+        cmd_bytes = bytearray([0x16])
+        cmd_bytes += int(rate).to_bytes(2, byteorder='big', signed=False)
+        await self.__client.write_gatt_char(self.__stepper_command_chrc, cmd_bytes)
+
+    # Starts a new offline recording session, with states of each motor
+    # every interval_millis, or stops the recording. Allowed interval is
+    # [20, 65535]. The recording continues after disconnection, to the
+    # end of the flash log, where it overwrites the oldest pages.
+    async def write_command_set_recording(self, enabled: bool, interval_millis: int = 1000):
+        if not self.is_connected():
+            logger.error(f"Not connected (write_command_set_recording).")
+            return
+        cmd_bytes = bytearray([0x18, 1 if enabled else 0])
+        cmd_bytes += int(interval_millis).to_bytes(2, byteorder='big', signed=False)
+        await self.__client.write_gatt_char(self.__stepper_command_chrc, cmd_bytes)
+
+    # Drops all the recorded pages.
+    async def write_command_clear_recording(self):
+        if not self.is_connected():
+            logger.error(f"Not connected (write_command_clear_recording).")
+            return
+        await self.__client.write_gatt_char(self.__stepper_command_chrc, bytearray([0x19]))
+
     async def set_state_notifications(self, handler: Callable[[ProbeState], None]):
         # Adapter handler.
         async def callback_handler(sender, data):
@@ -334,6 +927,54 @@ class Probe:
         await self.__client.start_notify(self.__stepper_state_chrc, callback_handler)
         logger.info(f"Started device state notifications.")
 
+    # Returns the total anomalies of the selected motor since the last
+    # data reset.
+    async def read_anomaly_count(self) -> Optional[int]:
+        if not self.is_connected():
+            logger.error(f"Not connected (read_anomaly_count).")
+            return None
+        if not self.__anomalies_chrc:
+            logger.error(f"Anomalies not supported by the device.")
+            return None
+        data = await self.__client.read_gatt_char(self.__anomalies_chrc)
+        if data[0] != 0xa0:
+            logger.error(f"Unexpected anomalies format {data[0]}.")
+            return None
+        return int.from_bytes(data[2:6], byteorder='big', signed=False)
+
+    async def set_anomaly_notifications(self, handler: Callable[[AnomalyEvent], None]):
+        # Adapter handler.
+        async def callback_handler(sender, data):
+            anomaly_event = AnomalyEvent.decode(data, self.__probe_info)
+            if handler and anomaly_event:
+                handler(anomaly_event)
+
+        if not self.is_connected():
+            logger.error(f"Not connected (set_anomaly_notifications).")
+            return None
+        if not self.__anomalies_chrc:
+            logger.error(f"Anomalies not supported by the device.")
+            return None
+        await self.__client.start_notify(self.__anomalies_chrc, callback_handler)
+        logger.info(f"Started anomaly notifications.")
+
+    async def set_position_stream_notifications(
+            self, handler: Callable[[PositionStreamPacket], None]):
+        # Adapter handler.
+        async def callback_handler(sender, data):
+            packet = PositionStreamPacket.decode(data, self.__probe_info)
+            if handler and packet:
+                handler(packet)
+
+        if not self.is_connected():
+            logger.error(f"Not connected (set_position_stream_notifications).")
+            return None
+        if not self.__position_stream_chrc:
+            logger.error(f"Position stream not supported by the device.")
+            return None
+        await self.__client.start_notify(self.__position_stream_chrc, callback_handler)
+        logger.info(f"Started position stream notifications.")
+
     # NOTE: This used to be problematic under Windows per 
     # https://github.com/hbldh/bleak/issues/1223 but seems 
     # to be ok as of Apr 2023.
@@ -15,7 +15,7 @@ class ProbeState:
 
     def __init__(self, timestamp_secs: float, steps: float, amps_a: float, amps_b: float,
                  ticks_a: int, ticks_b: int, quadrant: int, is_reversed_direction: bool,
-                 is_energized: bool, non_energized_count: int):
+                 is_energized: bool, non_energized_count: int, motor: int = 0):
         self.timestamp_secs = timestamp_secs
         self.steps = steps
         self.amps_a = amps_a
@@ -27,10 +27,13 @@ class ProbeState:
         self.is_reversed_direction = is_reversed_direction
         self.is_energized = is_energized
         self.non_energized_count = non_energized_count
+        # Motor index. Always 0 with single motor devices.
+        self.motor = motor
 
     @classmethod
     def decode(cls, data: bytearray, probe_info: ProbeInfo) -> (ProbeState | None):
-        if len(data) != 19:
+        # Multi motor devices append the motor index.
+        if len(data) != 19 and len(data) != 20:
             print(f"Invalid state data length {len(data)}.", flush=True)
             return None
         ticks_timestamp = int.from_bytes(data[0:6], byteorder='big', signed=False)
@@ -45,11 +48,12 @@ class ProbeState:
         amps_a = ticks_a / probe_info.current_ticks_per_amp()
         amps_b = ticks_b / probe_info.current_ticks_per_amp()
         non_energized_count = int.from_bytes(data[15:19], byteorder='big', signed=True)
+        motor = data[19] if len(data) == 20 else 0
 
         # Compute steps with fractional resolution.
         steps = ProbeState.microsteps(full_steps, quadrant, ticks_a, ticks_b, is_reversed_direction)
         return ProbeState(timestamp_secs, steps, amps_a, amps_b, ticks_a, ticks_b, quadrant,
-                          is_reversed_direction, is_energized, non_energized_count)
+                          is_reversed_direction, is_energized, non_energized_count, motor)
 
     def __str__(self):
         direction = "Fwd"
@@ -0,0 +1,101 @@
+# Represents fetched quadrature error counters and records of a motor.
+
+from __future__ import annotations
+import logging
+from typing import List
+from common.probe_info import ProbeInfo
+
+logger = logging.getLogger(__name__)
+
+
+class QuadratureErrorRecord:
+
+    def __init__(self, timestamp_secs: float, old_quadrant: int, new_quadrant: int,
+                 error_class: int, v1: float, v2: float, secs_in_step: float,
+                 steps_per_sec: float):
+        # Device time of the invalid transition, in secs.
+        self.timestamp_secs = timestamp_secs
+        self.old_quadrant = old_quadrant
+        self.new_quadrant = new_quadrant
+        # One of QuadratureErrors classes.
+        self.error_class = error_class
+        # Coil currents of the sample that entered the new quadrant, in amps.
+        self.v1 = v1
+        self.v2 = v2
+        # Time spent in the quadrant that was left, in secs.
+        self.secs_in_step = secs_in_step
+        # Step rate of the move, zero if not in a move.
+        self.steps_per_sec = steps_per_sec
+
+    def __str__(self) -> str:
+        name = QuadratureErrors.CLASS_NAMES.get(self.error_class, f"class {self.error_class}")
+        return (f"{self.timestamp_secs:.4f}s {name}: quadrant {self.old_quadrant} -> "
+                f"{self.new_quadrant}, currents {self.v1:.3f}A/{self.v2:.3f}A, "
+                f"{self.secs_in_step * 1000:.2f}ms in step, {self.steps_per_sec:.0f} steps/s")
+
+
+class QuadratureErrors:
+
+    # Error classes. See analyzer::QuadratureErrorClass.
+    LOW_CURRENT = 0
+    IN_MOVE = 1
+    AT_REST = 2
+
+    CLASS_NAMES = {
+        LOW_CURRENT: "low current",
+        IN_MOVE: "in move",
+        AT_REST: "at rest",
+    }
+
+    def __init__(self, motor: int, class_counts: List[int],
+                 records: List[QuadratureErrorRecord]):
+        # Motor index.
+        self.motor = motor
+        # Errors since the last data reset, indexed by class.
+        self.class_counts = class_counts
+        # The newest errors, oldest first.
+        self.records = records
+
+    def __str__(self) -> str:
+        counts = ", ".join(
+            f"{self.CLASS_NAMES.get(i, i)} {n}" for i, n in enumerate(self.class_counts))
+        return f"motor {self.motor}, {counts}, {len(self.records)} records"
+
+    @classmethod
+    def decode(cls, data: bytearray, probe_info: ProbeInfo) -> (QuadratureErrors | None):
+        format = data[0]
+        if format != 0xb0:
+            logger.error(f"Unexpected quadrature errors format {format}.")
+            return None
+
+        motor = data[1]
+        class_counts = []
+        i = 2
+        for _ in range(3):
+            class_counts.append(int.from_bytes(data[i:i + 4], byteorder='big', signed=False))
+            i += 4
+        num_records = data[i]
+        i += 1
+        if len(data) != i + num_records * 21:
+            logger.error(f"Unexpected quadrature errors length {len(data)}.")
+            return None
+
+        ticks_per_amp = probe_info.current_ticks_per_amp()
+        ticks_per_sec = probe_info.time_ticks_per_sec()
+        records = []
+        for _ in range(num_records):
+            tick_count = int.from_bytes(data[i:i + 6], byteorder='big', signed=False)
+            old_quadrant = data[i + 6]
+            new_quadrant = data[i + 7]
+            error_class = data[i + 8]
+            v1 = int.from_bytes(data[i + 9:i + 11], byteorder='big', signed=True)
+            v2 = int.from_bytes(data[i + 11:i + 13], byteorder='big', signed=True)
+            ticks_in_step = int.from_bytes(data[i + 13:i + 17], byteorder='big', signed=False)
+            move_step_ticks = int.from_bytes(data[i + 17:i + 21], byteorder='big', signed=False)
+            steps_per_sec = ticks_per_sec / move_step_ticks if move_step_ticks else 0
+            records.append(
+                QuadratureErrorRecord(tick_count / ticks_per_sec, old_quadrant, new_quadrant,
+                                      error_class, v1 / ticks_per_amp, v2 / ticks_per_amp,
+                                      ticks_in_step / ticks_per_sec, steps_per_sec))
+            i += 21
+        return QuadratureErrors(motor, class_counts, records)
@@ -0,0 +1,195 @@
+# Represents the status and the downloaded pages of the on device offline
+# recording. See recording/recorder.h in the firmware.
+
+from __future__ import annotations
+import binascii
+import logging
+from typing import List, Optional, Tuple
+from common.probe_info import ProbeInfo
+
+logger = logging.getLogger(__name__)
+
+# Page format. See flash_log.h in the firmware.
+PAGE_MAGIC = 0x5250
+PAGE_HEADER_LEN = 20
+
+# Format id, page seq and offset of a notified page chunk.
+CHUNK_HEADER_LEN = 6
+
+# Record types. See recorder::RecordType.
+RECORD_SESSION_START = 1
+RECORD_STATE = 2
+RECORD_ANOMALY = 3
+
+# Fields length by record type, after the 3 bytes record header.
+_RECORD_FIELDS_LEN = {RECORD_SESSION_START: 3, RECORD_STATE: 11, RECORD_ANOMALY: 5}
+
+
+class RecordingStatus:
+
+    def __init__(self, is_available: bool, is_recording: bool, session: int,
+                 state_interval_millis: int, tail_seq: int, head_seq: int, capacity_pages: int,
+                 dropped_records: int, flash_errors: int, max_erase_millis: int):
+        # False if the device has no recording partition.
+        self.is_available = is_available
+        self.is_recording = is_recording
+        # The current, or last, session.
+        self.session = session
+        self.state_interval_millis = state_interval_millis
+        # The recorded pages are [tail_seq, head_seq).
+        self.tail_seq = tail_seq
+        self.head_seq = head_seq
+        self.capacity_pages = capacity_pages
+        # Since the device initialization.
+        self.dropped_records = dropped_records
+        self.flash_errors = flash_errors
+        # The longest flash sector erase, which stalls the ADC task. Above
+        # 100ms the device drops ADC samples meanwhile.
+        self.max_erase_millis = max_erase_millis
+
+    def __str__(self) -> str:
+        return (f"available {self.is_available}, recording {self.is_recording}, "
+                f"session {self.session}, interval {self.state_interval_millis}ms, "
+                f"pages [{self.tail_seq}, {self.head_seq}) of {self.capacity_pages}, "
+                f"{self.dropped_records} dropped, {self.flash_errors} flash errors, "
+                f"max erase {self.max_erase_millis}ms")
+
+    @classmethod
+    def decode(cls, data: bytearray) -> (RecordingStatus | None):
+        format = data[0]
+        if format != 0x03:
+            logger.error(f"Unexpected recording status format {format}.")
+            return None
+        return RecordingStatus(
+            data[1] != 0, data[2] != 0,
+            int.from_bytes(data[3:5], byteorder='big', signed=False),
+            int.from_bytes(data[5:7], byteorder='big', signed=False),
+            int.from_bytes(data[7:11], byteorder='big', signed=False),
+            int.from_bytes(data[11:15], byteorder='big', signed=False),
+            int.from_bytes(data[15:19], byteorder='big', signed=False),
+            int.from_bytes(data[19:23], byteorder='big', signed=False),
+            int.from_bytes(data[23:27], byteorder='big', signed=False),
+            int.from_bytes(data[27:31], byteorder='big', signed=False))
+
+
+class RecordingRecord:
+
+    def __init__(self, type: int, motor: int, millis: int):
+        self.type = type
+        self.motor = motor
+        # Device time, in millis. Wraps around after 49 days.
+        self.millis = millis
+        # Set by type.
+        # RECORD_SESSION_START
+        self.state_interval_millis = None
+        self.num_motors = None
+        # RECORD_STATE. Current is in amps.
+        self.full_steps = None
+        self.velocity = None
+        self.max_current = None
+        self.quadrature_errors = None
+        self.is_energized = None
+        # RECORD_ANOMALY. See AnomalyEvent.
+        self.anomaly_type = None
+        self.anomaly_detail = None
+
+    def __str__(self) -> str:
+        prefix = f"{self.millis / 1000:.3f}s motor {self.motor}"
+        if self.type == RECORD_SESSION_START:
+            return (f"{prefix} session start, interval {self.state_interval_millis}ms, "
+                    f"{self.num_motors} motors")
+        if self.type == RECORD_STATE:
+            return (f"{prefix} state, {self.full_steps} steps, {self.velocity} steps/s, "
+                    f"{self.max_current:.2f}A, {self.quadrature_errors} errors, "
+                    f"energized {self.is_energized}")
+        return f"{prefix} anomaly, type {self.anomaly_type}, detail {self.anomaly_detail}"
+
+
+class RecordingPage:
+
+    def __init__(self, seq: int, first_seq: int, session: int, base_millis: int,
+                 records: List[RecordingRecord]):
+        self.seq = seq
+        # The oldest page of the log when this page was written.
+        self.first_seq = first_seq
+        self.session = session
+        self.base_millis = base_millis
+        self.records = records
+
+    def __str__(self) -> str:
+        return (f"page {self.seq}, session {self.session}, "
+                f"{self.base_millis / 1000:.3f}s, {len(self.records)} records")
+
+    # True if the reassembled page bytes include all of its data. Pages
+    # with an invalid header are sent as the header only.
+    @classmethod
+    def is_complete(cls, data: bytearray) -> bool:
+        if len(data) < PAGE_HEADER_LEN:
+            return False
+        magic = int.from_bytes(data[0:2], byteorder='big', signed=False)
+        return magic != PAGE_MAGIC or len(data) >= PAGE_HEADER_LEN + data[18]
+
+    @classmethod
+    def decode(cls, data: bytearray, probe_info: ProbeInfo) -> (RecordingPage | None):
+        if len(data) < PAGE_HEADER_LEN:
+            logger.error(f"Recording page too short ({len(data)} bytes).")
+            return None
+        magic = int.from_bytes(data[0:2], byteorder='big', signed=False)
+        seq = int.from_bytes(data[4:8], byteorder='big', signed=False)
+        data_size = data[18]
+        if magic != PAGE_MAGIC or len(data) < PAGE_HEADER_LEN + data_size:
+            logger.warning(f"Invalid recording page {seq}.")
+            return None
+        crc = int.from_bytes(data[2:4], byteorder='big', signed=False)
+        if crc != binascii.crc_hqx(bytes(data[4:PAGE_HEADER_LEN + data_size]), 0xffff):
+            logger.warning(f"Recording page {seq} failed the CRC check, likely torn.")
+            return None
+        first_seq = int.from_bytes(data[8:12], byteorder='big', signed=False)
+        session = int.from_bytes(data[12:14], byteorder='big', signed=False)
+        base_millis = int.from_bytes(data[14:18], byteorder='big', signed=False)
+        num_records = data[19]
+
+        ticks_per_amp = probe_info.current_ticks_per_amp()
+        records = []
+        offset = PAGE_HEADER_LEN
+        end = PAGE_HEADER_LEN + data_size
+        for _ in range(num_records):
+            if offset + 3 > end:
+                break
+            type = data[offset] >> 4
+            fields_len = _RECORD_FIELDS_LEN.get(type)
+            if fields_len is None or offset + 3 + fields_len > end:
+                logger.error(f"Unexpected record type {type} in page {seq}.")
+                break
+            millis = (base_millis +
+                      int.from_bytes(data[offset + 1:offset + 3], byteorder='big', signed=False))
+            record = RecordingRecord(type, data[offset] & 0x0f, millis & 0xffffffff)
+            fields = data[offset + 3:offset + 3 + fields_len]
+            if type == RECORD_SESSION_START:
+                record.state_interval_millis = int.from_bytes(fields[0:2], byteorder='big',
+                                                              signed=False)
+                record.num_motors = fields[2]
+            elif type == RECORD_STATE:
+                record.full_steps = int.from_bytes(fields[0:4], byteorder='big', signed=True)
+                record.velocity = int.from_bytes(fields[4:6], byteorder='big', signed=True)
+                record.max_current = (
+                    int.from_bytes(fields[6:8], byteorder='big', signed=False) / ticks_per_amp)
+                record.quadrature_errors = int.from_bytes(fields[8:10], byteorder='big',
+                                                          signed=False)
+                record.is_energized = (fields[10] & 0x01) != 0
+            else:
+                record.anomaly_type = fields[0]
+                record.anomaly_detail = int.from_bytes(fields[1:5], byteorder='big', signed=False)
+            records.append(record)
+            offset += 3 + fields_len
+        return RecordingPage(seq, first_seq, session, base_millis, records)
+
+
+# Parses a notified page chunk. Returns (seq, offset in page, bytes).
+def decode_page_chunk(data: bytearray) -> Optional[Tuple[int, int, bytearray]]:
+    format = data[0]
+    if format != 0x04 or len(data) < CHUNK_HEADER_LEN:
+        logger.error(f"Unexpected recording page chunk format {format}.")
+        return None
+    seq = int.from_bytes(data[1:5], byteorder='big', signed=False)
+    return (seq, data[5], data[CHUNK_HEADER_LEN:])
@@ -0,0 +1,103 @@
+# Represents fetched retraction episode analytics of a motor.
+
+from __future__ import annotations
+import logging
+from typing import List
+from common.probe_info import ProbeInfo
+
+logger = logging.getLogger(__name__)
+
+
+class RetractionBucket:
+
+    def __init__(self, min_steps: int, episodes: int, avg_steps: int,
+                 retraction_steps_per_sec: int, unretraction_steps_per_sec: int,
+                 avg_dwell_secs: float):
+        # Min retraction distance of the bucket, in full steps.
+        self.min_steps = min_steps
+        self.episodes = episodes
+        # Average retraction distance, in full steps.
+        self.avg_steps = avg_steps
+        # Retraction and unretraction speeds. Zero if unknown.
+        self.retraction_steps_per_sec = retraction_steps_per_sec
+        self.unretraction_steps_per_sec = unretraction_steps_per_sec
+        # Average time between the retraction and the unretraction.
+        self.avg_dwell_secs = avg_dwell_secs
+
+
+class RetractionEvent:
+
+    def __init__(self, timestamp_secs: float, steps: int, retraction_steps_per_sec: int,
+                 unretraction_steps_per_sec: int, dwell_secs: float):
+        # Device time of the end of the episode, in secs.
+        self.timestamp_secs = timestamp_secs
+        # Retraction distance, in full steps.
+        self.steps = steps
+        self.retraction_steps_per_sec = retraction_steps_per_sec
+        self.unretraction_steps_per_sec = unretraction_steps_per_sec
+        self.dwell_secs = dwell_secs
+
+    def __str__(self) -> str:
+        return (f"{self.timestamp_secs:.3f}s: {self.steps} steps, retraction "
+                f"{self.retraction_steps_per_sec} steps/s, dwell {self.dwell_secs:.3f}s, "
+                f"unretraction {self.unretraction_steps_per_sec} steps/s")
+
+
+class Retractions:
+
+    # Min retraction distance in full steps. See analyzer::kMinRetractionSteps.
+    MIN_STEPS = 4
+
+    def __init__(self, motor: int, buckets: List[RetractionBucket],
+                 events: List[RetractionEvent]):
+        # Motor index.
+        self.motor = motor
+        # Episodes since the last data reset, by retraction distance.
+        self.buckets = buckets
+        # The latest episodes, oldest first.
+        self.events = events
+
+    def __str__(self) -> str:
+        episodes = sum(bucket.episodes for bucket in self.buckets)
+        return f"motor {self.motor}, {episodes} retractions, {len(self.events)} events"
+
+    @classmethod
+    def decode(cls, data: bytearray, probe_info: ProbeInfo) -> (Retractions | None):
+        format = data[0]
+        if format != 0xc0:
+            logger.error(f"Unexpected retractions format {format}.")
+            return None
+
+        motor = data[1]
+        num_buckets = data[2]
+        ticks_per_sec = probe_info.time_ticks_per_sec()
+        buckets = []
+        i = 3
+        for b in range(num_buckets):
+            episodes = int.from_bytes(data[i:i + 4], byteorder='big', signed=False)
+            avg_steps = int.from_bytes(data[i + 4:i + 6], byteorder='big', signed=False)
+            retraction_speed = int.from_bytes(data[i + 6:i + 8], byteorder='big', signed=False)
+            unretraction_speed = int.from_bytes(data[i + 8:i + 10], byteorder='big', signed=False)
+            avg_dwell_ticks = int.from_bytes(data[i + 10:i + 14], byteorder='big', signed=False)
+            buckets.append(
+                RetractionBucket(cls.MIN_STEPS << b, episodes, avg_steps, retraction_speed,
+                                 unretraction_speed, avg_dwell_ticks / ticks_per_sec))
+            i += 14
+        num_events = data[i]
+        i += 1
+        if len(data) != i + num_events * 16:
+            logger.error(f"Unexpected retractions length {len(data)}.")
+            return None
+
+        events = []
+        for _ in range(num_events):
+            tick_count = int.from_bytes(data[i:i + 6], byteorder='big', signed=False)
+            steps = int.from_bytes(data[i + 6:i + 8], byteorder='big', signed=False)
+            retraction_speed = int.from_bytes(data[i + 8:i + 10], byteorder='big', signed=False)
+            unretraction_speed = int.from_bytes(data[i + 10:i + 12], byteorder='big', signed=False)
+            dwell_ticks = int.from_bytes(data[i + 12:i + 16], byteorder='big', signed=False)
+            events.append(
+                RetractionEvent(tick_count / ticks_per_sec, steps, retraction_speed,
+                                unretraction_speed, dwell_ticks / ticks_per_sec))
+            i += 16
+        return Retractions(motor, buckets, events)
@@ -0,0 +1,56 @@
+# Represents fetched direction reversal statistics of a motor.
+
+from __future__ import annotations
+import logging
+from typing import List, Tuple
+from common.probe_info import ProbeInfo
+
+logger = logging.getLogger(__name__)
+
+
+class ReversalStats:
+
+    def __init__(self, motor: int, forward_reversals: int, backward_reversals: int,
+                 last_minute_reversals: int, dwell_buckets: List[Tuple[float, int]]):
+        # Motor index.
+        self.motor = motor
+        # Reversals since the last data reset, by the direction before the reversal.
+        self.forward_reversals = forward_reversals
+        self.backward_reversals = backward_reversals
+        # Reversals in the last completed minute.
+        self.last_minute_reversals = last_minute_reversals
+        # Reversals since the last data reset by dwell, the time from the last
+        # step in one direction to the first step in the other. A list of
+        # (min dwell secs, reversals) tuples. The last bucket is open ended.
+        self.dwell_buckets = dwell_buckets
+
+    def __str__(self) -> str:
+        return (f"motor {self.motor}, reversals {self.forward_reversals} forward, "
+                f"{self.backward_reversals} backward, {self.last_minute_reversals} last minute")
+
+    @classmethod
+    def decode(cls, data: bytearray, probe_info: ProbeInfo) -> (ReversalStats | None):
+        format = data[0]
+        if format != 0xd0:
+            logger.error(f"Unexpected reversal stats format {format}.")
+            return None
+
+        motor = data[1]
+        forward_reversals = int.from_bytes(data[2:6], byteorder='big', signed=False)
+        backward_reversals = int.from_bytes(data[6:10], byteorder='big', signed=False)
+        last_minute_reversals = int.from_bytes(data[10:14], byteorder='big', signed=False)
+        bucket_ticks = int.from_bytes(data[14:16], byteorder='big', signed=False)
+        num_buckets = data[16]
+        if len(data) != 17 + num_buckets * 4:
+            logger.error(f"Unexpected reversal stats length {len(data)}.")
+            return None
+
+        ticks_per_sec = probe_info.time_ticks_per_sec()
+        dwell_buckets = []
+        for i in range(num_buckets):
+            offset = 17 + i * 4
+            reversals = int.from_bytes(data[offset:offset + 4], byteorder='big', signed=False)
+            min_ticks = (bucket_ticks << (i - 1)) if i else 0
+            dwell_buckets.append((min_ticks / ticks_per_sec, reversals))
+        return ReversalStats(motor, forward_reversals, backward_reversals, last_minute_reversals,
+                             dwell_buckets)
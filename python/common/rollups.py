@@ -0,0 +1,91 @@
+# Represents a fetched chunk of the on device per period rollups.
+
+from __future__ import annotations
+import logging
+from typing import List
+from common.probe_info import ProbeInfo
+
+logger = logging.getLogger(__name__)
+
+
+class Rollup:
+
+    def __init__(self, period: int, start_secs: float, steps: int, max_speed: int,
+                 peak_current: float, rms_current: float, quadrature_errors: int,
+                 energized_fraction: float):
+        # Index of the period since the device initialization.
+        self.period = period
+        # Device time of the period start, in secs.
+        self.start_secs = start_secs
+        # Net full steps in the period.
+        self.steps = steps
+        # Max speed, in steps/sec.
+        self.max_speed = max_speed
+        # Peak and RMS coil currents, in amps. The RMS is averaged over
+        # the two coils.
+        self.peak_current = peak_current
+        self.rms_current = rms_current
+        # Invalid quadrant transitions in the period.
+        self.quadrature_errors = quadrature_errors
+        # Fraction of the period the coils were energized, in [0, 1].
+        self.energized_fraction = energized_fraction
+
+    def __str__(self) -> str:
+        return (f"period {self.period} at {self.start_secs:.0f}s, {self.steps} steps, "
+                f"max {self.max_speed} steps/s, {self.rms_current:.2f}A RMS, "
+                f"{self.peak_current:.2f}A peak, {self.quadrature_errors} errors, "
+                f"{self.energized_fraction * 100:.1f}% energized")
+
+
+class RollupsChunk:
+
+    # Rollup tiers. See analyzer::RollupTier.
+    TIER_1_SEC = 0
+    TIER_10_SECS = 1
+    TIER_1_MIN = 2
+
+    def __init__(self, motor: int, tier: int, period_secs: int, open_period: int,
+                 rollups: List[Rollup]):
+        self.motor = motor
+        self.tier = tier
+        # The period length of the tier.
+        self.period_secs = period_secs
+        # The period in progress, not included in the rollups.
+        self.open_period = open_period
+        # Completed periods, oldest first. Empty if no newer periods are
+        # available.
+        self.rollups = rollups
+
+    def __str__(self) -> str:
+        return (f"motor {self.motor}, tier {self.tier} ({self.period_secs}s), "
+                f"open period {self.open_period}, {len(self.rollups)} rollups")
+
+    @classmethod
+    def decode(cls, data: bytearray, probe_info: ProbeInfo) -> (RollupsChunk | None):
+        format = data[0]
+        if format != 0x02:
+            logger.error(f"Unexpected rollups format {format}.")
+            return None
+
+        ticks_per_amp = probe_info.current_ticks_per_amp()
+        motor = data[1]
+        tier = data[2]
+        period_secs = int.from_bytes(data[3:5], byteorder='big', signed=False)
+        open_period = int.from_bytes(data[5:9], byteorder='big', signed=False)
+        count = data[9]
+        rollups = []
+        for i in range(count):
+            offset = 10 + i * 18
+            record = data[offset:offset + 18]
+            period = int.from_bytes(record[0:4], byteorder='big', signed=False)
+            steps = int.from_bytes(record[4:8], byteorder='big', signed=True)
+            max_speed = int.from_bytes(record[8:10], byteorder='big', signed=False)
+            peak_ticks = int.from_bytes(record[10:12], byteorder='big', signed=False)
+            # RMS value has 4 fraction bits.
+            rms_ticks = int.from_bytes(record[12:14], byteorder='big', signed=False) / 16
+            quadrature_errors = int.from_bytes(record[14:16], byteorder='big', signed=False)
+            energized_permils = int.from_bytes(record[16:18], byteorder='big', signed=False)
+            rollups.append(
+                Rollup(period, period * period_secs, steps, max_speed, peak_ticks / ticks_per_amp,
+                       rms_ticks / ticks_per_amp, quadrature_errors, energized_permils / 1000))
+        return RollupsChunk(motor, tier, period_secs, open_period, rollups)
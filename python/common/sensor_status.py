@@ -0,0 +1,52 @@
+# Represents a fetched current sensing status of a motor.
+
+from __future__ import annotations
+import logging
+from common.probe_info import ProbeInfo
+
+logger = logging.getLogger(__name__)
+
+
+class SensorStatus:
+
+    def __init__(self, motor: int, noise_floor: float, non_energized_threshold: float,
+                 energized_threshold: float, offset1: int, offset2: int):
+        # Motor index.
+        self.motor = motor
+        # Mean absolute deviation of the non energized current, in amps.
+        # Zero if not measured yet.
+        self.noise_floor = noise_floor
+        # Energized detection hysteresis limits, in amps.
+        self.non_energized_threshold = non_energized_threshold
+        self.energized_threshold = energized_threshold
+        # Zero offsets, in ADC counts.
+        self.offset1 = offset1
+        self.offset2 = offset2
+
+    def __str__(self) -> str:
+        return (f"motor {self.motor}, noise {self.noise_floor:.4f}A, "
+                f"thresholds {self.non_energized_threshold:.3f}A/"
+                f"{self.energized_threshold:.3f}A, offsets {self.offset1}/{self.offset2}")
+
+    @classmethod
+    def decode(cls, data: bytearray, probe_info: ProbeInfo) -> (SensorStatus | None):
+        format = data[0]
+        if format != 0x60:
+            logger.error(f"Unexpected sensor status format {format}.")
+            return None
+
+        if len(data) != 12:
+            logger.error(f"Unexpected sensor status length {len(data)}.")
+            return None
+
+        ticks_per_amp = probe_info.current_ticks_per_amp()
+        motor = data[1]
+        # Noise floor has 4 fraction bits.
+        noise_floor = int.from_bytes(data[2:4], byteorder='big', signed=False) / 16
+        non_energized_threshold = int.from_bytes(data[4:6], byteorder='big', signed=False)
+        energized_threshold = int.from_bytes(data[6:8], byteorder='big', signed=False)
+        offset1 = int.from_bytes(data[8:10], byteorder='big', signed=True)
+        offset2 = int.from_bytes(data[10:12], byteorder='big', signed=True)
+        return SensorStatus(motor, noise_floor / ticks_per_amp,
+                            non_energized_threshold / ticks_per_amp,
+                            energized_threshold / ticks_per_amp, offset1, offset2)
@@ -0,0 +1,58 @@
+# Represents a fetched coil current magnitude spectrum of a signal capture.
+
+from __future__ import annotations
+import logging
+from typing import List
+from common.probe_info import ProbeInfo
+
+logger = logging.getLogger(__name__)
+
+
+class Spectrum:
+
+    def __init__(self, seq_number: int, lane: int, bin_width_hz: float,
+                 amplitudes: List[float]):
+        # Sequence number of the capture snapshot.
+        self.seq_number = seq_number
+        # The capture lane, 0 for the main buffer.
+        self.lane = lane
+        # Frequency width of each bin, in Hz.
+        self.bin_width_hz = bin_width_hz
+        # Peak coil current amplitude of each bin, in amps. RMS of the
+        # amplitudes of the two coils.
+        self.amplitudes = amplitudes
+
+    # Returns the start frequency of each bin, in Hz.
+    def frequencies(self) -> List[float]:
+        return [i * self.bin_width_hz for i in range(len(self.amplitudes))]
+
+    @classmethod
+    def decode(cls, data: bytearray, probe_info: ProbeInfo) -> (Spectrum | None):
+        format = data[0]
+        if format != 0x80:
+            logger.error(f"Unexpected spectrum format {format}.")
+            return None
+
+        flags = data[1]
+        if not (flags & 0x80):
+            # No capture snapshot or too few items.
+            return None
+
+        seq_number = int.from_bytes(data[2:4], byteorder='big', signed=False)
+        lane = data[4]
+        divider = int.from_bytes(data[5:7], byteorder='big', signed=False)
+        fft_size = int.from_bytes(data[7:9], byteorder='big', signed=False)
+        fft_bins_per_bin = data[9]
+        bin_count = data[10]
+
+        ticks_per_amp = probe_info.current_ticks_per_amp()
+        amplitudes = []
+        for i in range(bin_count):
+            offset = 11 + i * 2
+            # Amplitude has 4 fraction bits.
+            ticks = int.from_bytes(data[offset:offset + 2], byteorder='big', signed=False) / 16
+            amplitudes.append(ticks / ticks_per_amp)
+
+        sample_rate = probe_info.time_ticks_per_sec() / divider
+        bin_width_hz = sample_rate * fft_bins_per_bin / fft_size
+        return Spectrum(seq_number, lane, bin_width_hz, amplitudes)